@@ -18,6 +18,11 @@
 #include "a2_files/settings.h" // Corrected path
 #include "logger.h"
 #include "lsp_watchdog.h"
+#include "lsp_transport.h"
+#include "lsp_pool.h"
+#include "frame_scheduler.h"
+#include "spell_worker.h"
+#include "term_output.h"
 
 
 #include <locale.h>
@@ -310,6 +315,15 @@ void process_editor_input(EditorState *state, wint_t ch, bool *should_exit) {
                 editor_end_completion(state);
                 return;
             default: 
+                // Typing on in the word narrows the list instead of closing it
+                if (editor_completion_continues(state, ch)) {
+                    handle_insert_mode_key(state, ch);
+                    if (!editor_update_completion(state) && state->lsp.enabled) {
+                        state->lsp.completion_pending = true;
+                        clock_gettime(CLOCK_MONOTONIC, &state->lsp.last_keystroke);
+                    }
+                    return;
+                }
                 editor_end_completion(state);
                 // Let the rest of the function process the key
                 break;
@@ -431,10 +445,9 @@ void process_editor_input(EditorState *state, wint_t ch, bool *should_exit) {
                     int win_y = event.y - beg_y;
                     int win_x = event.x - beg_x;
                     int border_offset = (ws->num_windows > 1) ? 1 : 0;
-                    int line_number_width = snprintf(NULL, 0, "%d", state->buffer.num_lines) + 1;
-                    if (line_number_width < 4) line_number_width = 4;
+                    int gutter_width = editor_gutter_width(state);
                     int click_line = state->view.top_line + (win_y - border_offset);
-                    int click_col = state->view.left_col + (win_x - border_offset - line_number_width);
+                    int click_col = state->view.left_col + (win_x - border_offset - gutter_width);
                     if (click_line >= 0 && click_line < state->buffer.num_lines && click_col >= 0) {
                         if (state->num_extra_cursors < MAX_EXTRA_CURSORS) {
                             state->extra_cursors[state->num_extra_cursors].line = click_line;
@@ -528,6 +541,7 @@ void process_editor_input(EditorState *state, wint_t ch, bool *should_exit) {
                 char *l = state->buffer.lines[state->cursor.line];
                 if (l) {
                     l[0] = '\0';
+                    editor_note_edit(state, state->cursor.line, 1, 1);
                     state->cursor.col = 0;
                     state->cursor.ideal_col = 0;
                     state->input.mode = INSERT;
@@ -632,6 +646,24 @@ check_single_command:
     }
 }    
 
+// True while a debouncer or the background grep is waiting, so the main loop keeps polling.
+static bool main_loop_timers_pending() {
+    if (workspace_manager.num_workspaces == 0 || ACTIVE_WS->num_windows == 0) return false;
+    EditorWindow *active_jw = ACTIVE_WS->windows[ACTIVE_WS->active_window_idx];
+    if (active_jw && active_jw->type == WINDOW_TYPE_EDITOR && active_jw->state) {
+        EditorState *state = active_jw->state;
+        if (state->lsp.completion_pending) return true;
+        if (lsp_has_pending_changes(state)) return true;
+        if (state->spell.hover_pending && state->spell.checker.enabled) return true;
+        if (state->image_hover.hover_pending && global_config.image_preview_enabled) return true;
+    }
+    if (spell_worker_busy()) return true;
+    pthread_mutex_lock(&global_grep_state.mutex);
+    bool grep_busy = global_grep_state.is_running || global_grep_state.results_ready;
+    pthread_mutex_unlock(&global_grep_state.mutex);
+    return grep_busy;
+}
+
 bool handle_global_shortcut(int ch, bool alt, bool ctrl, bool *should_exit) {
     EditorAction action = get_action_from_key(ch, alt, ctrl, 0);
     if (action != ACT_NONE && is_global_action(action)) {
@@ -716,6 +748,8 @@ int main(int argc, char *argv[]) {
     if (!g_safe_mode) {
         load_global_config();
         load_custom_tasks();
+        // Parse the default dictionary in the background while the first file loads
+        if (global_config.spell_checker_enabled) spell_dict_preload(global_config.default_spell_lang);
     }
     
     reset_bindings_to_default();
@@ -785,27 +819,17 @@ int main(int argc, char *argv[]) {
 
     redraw_all_windows();
     bool should_exit = false;
-    int check_counter = 0;
-    time_t last_second = time(NULL);
+    time_t last_housekeeping = time(NULL);
+    time_t last_git_gutter = last_housekeeping;
     while (!should_exit) {
-        // Force redraw if second changed (for the clock)
-        time_t current_time_now = time(NULL);
-        if (current_time_now != last_second) {
-            last_second = current_time_now;
-            if (workspace_manager.num_workspaces > 0) {
-                Workspace *ws = ACTIVE_WS;
-                for (int i = 0; i < ws->num_windows; i++) {
-                    if (ws->windows[i]->type == WINDOW_TYPE_EDITOR && ws->windows[i]->state) {
-                        ws->windows[i]->state->buffer.is_dirty = true;
-                    }
-                }
-            }
-        }
-
         if (workspace_manager.num_workspaces == 0) {
             should_exit = true;
             continue;
         }
+
+        // Post damage for the status bar clock and for focus/layout changes
+        frame_clock_tick();
+        frame_check_layout(ACTIVE_WS);
         
         fd_set readfds;
         FD_ZERO(&readfds);
@@ -820,9 +844,10 @@ int main(int argc, char *argv[]) {
                 if (jw->type == WINDOW_TYPE_TERMINAL && jw->term.pty_fd != -1) {
                     FD_SET(jw->term.pty_fd, &readfds);
                     if (jw->term.pty_fd > max_fd) max_fd = jw->term.pty_fd;
-                } else if (jw->type == WINDOW_TYPE_EDITOR && jw->state && jw->state->lsp.client && jw->state->lsp.client->stdout_fd != -1) {
-                    FD_SET(jw->state->lsp.client->stdout_fd, &readfds);
-                    if (jw->state->lsp.client->stdout_fd > max_fd) max_fd = jw->state->lsp.client->stdout_fd;
+                } else if (jw->type == WINDOW_TYPE_EDITOR && jw->state && jw->state->lsp.client && jw->state->lsp.client->transport) {
+                    int lsp_fd = lsp_transport_notify_fd(jw->state->lsp.client->transport);
+                    FD_SET(lsp_fd, &readfds);
+                    if (lsp_fd > max_fd) max_fd = lsp_fd;
                 }
             }
             // Monitoring Floating Terminal PTY even if hidden
@@ -832,20 +857,20 @@ int main(int argc, char *argv[]) {
             }
         }
 
-        // Use a timeout to make the loop non-blocking
+        // Sleep until input, pending damage is due, or a timer needs polling
         struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 50000; // 50ms
+        frame_next_timeout(&timeout, main_loop_timers_pending());
 
         int activity = select(max_fd + 1, &readfds, NULL, NULL, &timeout);
 
-        if (activity < 0 && errno != EINTR) {
-            perror("select error");
-            continue;
+        if (activity < 0) {
+            if (errno != EINTR) perror("select error");
+            FD_ZERO(&readfds); // readfds is undefined after a failed select
         }
 
         // Process keyboard input
-        if (FD_ISSET(STDIN_FILENO, &readfds)) {
+        if (activity > 0 && FD_ISSET(STDIN_FILENO, &readfds)) {
+            frame_request_present(); // Input may move the cursor even when nothing is damaged
             Workspace *ws = ACTIVE_WS;
             if (ws->floating_term && ws->floating_terminal_visible && ws->floating_term->term.pty_fd != -1) {
                 wint_t ch;
@@ -1010,6 +1035,7 @@ int main(int argc, char *argv[]) {
                     if (bytes_lidos > 0) {
                         buffer[bytes_lidos] = '\0';
                         vterm_render(jw->term.vterm, buffer, bytes_lidos);
+                        jw->term.dirty = true;
                     } else {
                         // Process finished or error. Mark terminal as "dead" but keep content.
                         close(jw->term.pty_fd);
@@ -1020,16 +1046,13 @@ int main(int argc, char *argv[]) {
                         // Append a message to the vterm buffer itself to indicate completion
                         char* end_msg = "\r\n\n[Processo finalizado. Pressione Alt+X para fechar]";
                         vterm_render(jw->term.vterm, end_msg, strlen(end_msg));
+                        jw->term.dirty = true;
                     }
                 }
                 // Process LSP output
-                else if (jw->type == WINDOW_TYPE_EDITOR && jw->state && jw->state->lsp.client && jw->state->lsp.client->stdout_fd != -1 && FD_ISSET(jw->state->lsp.client->stdout_fd, &readfds)) {
-                    char buffer[4096];
-                    ssize_t bytes_lidos = read(jw->state->lsp.client->stdout_fd, buffer, sizeof(buffer) - 1);
-                    if (bytes_lidos > 0) {
-                        buffer[bytes_lidos] = '\0';
-                        lsp_process_received_data(jw->state, buffer, bytes_lidos);
-                    }
+                else if (jw->type == WINDOW_TYPE_EDITOR && jw->state && jw->state->lsp.client && jw->state->lsp.client->transport &&
+                         FD_ISSET(lsp_transport_notify_fd(jw->state->lsp.client->transport), &readfds)) {
+                    lsp_poll_messages(jw->state);
                 }
             }
             
@@ -1040,6 +1063,7 @@ int main(int argc, char *argv[]) {
                 if (bytes_lidos > 0) {
                     buffer[bytes_lidos] = '\0';
                     vterm_render(ws->floating_term->term.vterm, buffer, bytes_lidos);
+                    ws->floating_term->term.dirty = true;
                 } else {
                     // Process finished or error. 
                     close(ws->floating_term->term.pty_fd);
@@ -1052,8 +1076,10 @@ int main(int argc, char *argv[]) {
             }
         }
         
-        // Periodically check for dead processes
-        if (check_counter++ % 10 == 0) {
+        // Periodically check for dead processes (once per second, independent of how often we wake up)
+        time_t current_time = time(NULL);
+        if (current_time != last_housekeeping) {
+             last_housekeeping = current_time;
              int status;
              while (waitpid(-1, &status, WNOHANG) > 0);
 
@@ -1062,14 +1088,16 @@ int main(int argc, char *argv[]) {
                  EditorWindow *active_jw = ACTIVE_WS->windows[ACTIVE_WS->active_window_idx];
                  if (active_jw && active_jw->type == WINDOW_TYPE_EDITOR && active_jw->state) {
                     check_external_modification(active_jw->state);
-                    editor_update_git_gutter(active_jw->state);
+                    if (current_time - last_git_gutter >= GIT_GUTTER_INTERVAL) {
+                        last_git_gutter = current_time;
+                        editor_update_git_gutter(active_jw->state);
+                    }
                     lsp_watchdog_check(active_jw->state);
                  }
              }
         }
 
         // Periodic auto-save
-        time_t current_time = time(NULL);
         for (int i = 0; i < workspace_manager.num_workspaces; i++) {
             Workspace *ws = workspace_manager.workspaces[i];
             for (int j = 0; j < ws->num_windows; j++) {
@@ -1083,6 +1111,28 @@ int main(int argc, char *argv[]) {
             }
         }
         
+        // Debouncer for LSP document changes: queued edits go out once typing pauses.
+        // Requests that timed out or that the cursor moved away from are cancelled.
+        for (int i = 0; i < workspace_manager.num_workspaces; i++) {
+            Workspace *ws = workspace_manager.workspaces[i];
+            for (int j = 0; j < ws->num_windows; j++) {
+                EditorWindow *jw = ws->windows[j];
+                if (jw->type == WINDOW_TYPE_EDITOR && jw->state) {
+                    lsp_flush_due_changes(jw->state);
+                    lsp_expire_requests(jw->state);
+                }
+            }
+        }
+        lsp_pool_reap_idle(); // language servers no window used for lsp_idle_timeout_sec
+
+        // Semantic tokens for the editors on screen
+        if (workspace_manager.num_workspaces > 0) {
+            for (int j = 0; j < ACTIVE_WS->num_windows; j++) {
+                EditorWindow *jw = ACTIVE_WS->windows[j];
+                if (jw->type == WINDOW_TYPE_EDITOR && jw->state) lsp_update_semantic_tokens(jw->state, getmaxy(jw->win));
+            }
+        }
+
         // Debouncer for LSP Autocomplete
         if (workspace_manager.num_workspaces > 0 && ACTIVE_WS->num_windows > 0) {
             EditorWindow *active_jw = ACTIVE_WS->windows[ACTIVE_WS->active_window_idx];
@@ -1097,8 +1147,11 @@ int main(int argc, char *argv[]) {
 
                     if (elapsed_ns > LSP_DEBOUNCE_NS) {
                         active_state->lsp.completion_pending = false;
-                        // Run local completion logic first to get the word to complete
-                        editor_start_completion(active_state);
+                        // Run local completion logic first to get the word to complete,
+                        // unless a list is open and already narrowed to it
+                        if (active_state->input.completion_mode != COMPLETION_TEXT) {
+                            editor_start_completion(active_state);
+                        }
                         // Only send request if there's something to complete
                         if(active_state->input.word_to_complete[0] != '\0') {
                             lsp_send_completion_request(active_state);
@@ -1108,6 +1161,9 @@ int main(int argc, char *argv[]) {
             }
         }
 
+        // Install spell worker results and keep the background scan fed
+        spell_worker_poll();
+
         // Debouncer for Spell Checker Hover
         if (workspace_manager.num_workspaces > 0 && ACTIVE_WS->num_windows > 0) {
             EditorWindow *active_jw = ACTIVE_WS->windows[ACTIVE_WS->active_window_idx];
@@ -1127,22 +1183,9 @@ int main(int argc, char *argv[]) {
                         get_word_at_cursor(active_state, word, sizeof(word));
 
                         if (strlen(word) > 0 && !spell_checker_check_word(&active_state->spell.checker, word)) {
-                            // Avoid re-generating message for the same word
+                            // Avoid re-generating message for the same word; suggestions arrive via spell_worker_poll
                             if (strcmp(active_state->spell.hover_word, word) != 0) {
-                                int n_sugg = 0;
-                                char** suggestions = spell_checker_suggest(&active_state->spell.checker, word, &n_sugg);
-                                if (n_sugg > 0) {
-                                    char popup_msg[256] = "Did you mean: ";
-                                    for (int i = 0; i < n_sugg && i < 3; i++) {
-                                        strcat(popup_msg, suggestions[i]);
-                                        if (i < n_sugg - 1 && i < 2) strcat(popup_msg, ", ");
-                                    }
-                                    if (active_state->spell.hover_message) free(active_state->spell.hover_message);
-                                    active_state->spell.hover_message = strdup(popup_msg);
-                                    strcpy(active_state->spell.hover_word, word);
-                                    active_state->buffer.is_dirty = true;
-                                    spell_checker_free_suggestions(&active_state->spell.checker, suggestions, n_sugg);
-                                }
+                                spell_worker_request_suggestions(active_state, word);
                             }
                         } else {
                             // Word is correct or empty, clear message
@@ -1152,6 +1195,7 @@ int main(int argc, char *argv[]) {
                                 active_state->buffer.is_dirty = true;
                             }
                             active_state->spell.hover_word[0] = '\0';
+                            active_state->spell.hover_request[0] = '\0';
                         }
                     }
             }
@@ -1251,7 +1295,10 @@ int main(int argc, char *argv[]) {
         } else {
             pthread_mutex_unlock(&global_grep_state.mutex);
         }
-        redraw_all_windows();
+        // Render only when something was damaged, coalesced to at most max_fps frames per second
+        if (frame_should_render()) {
+            redraw_all_windows();
+        }
     }
     
     stop_and_log_work();
@@ -1260,10 +1307,11 @@ int main(int argc, char *argv[]) {
         free_workspace(workspace_manager.workspaces[i]);
     }
     free(workspace_manager.workspaces);
+    lsp_pool_shutdown_all();
         
     pthread_mutex_destroy(&global_grep_state.mutex);
-    printf("\033_Ga=d,d=a;\033\\"); // Clear all Kitty images
-    fflush(stdout);
+    term_output_printf("\033_Ga=d,d=a;\033\\"); // Clear all Kitty images
+    term_output_flush();
     endwin(); 
     return 0;
 }
@@ -25,6 +25,11 @@ void add_suggestion(EditorState *state, const char *label, const char *detail, c
     item->insert_text = insert_text ? strdup(insert_text) : strdup(label);
 }
 
+static void free_completion_items(CompletionItem *items, int count) {
+    for (int i = 0; i < count; i++) { free(items[i].label); free(items[i].detail); free(items[i].insert_text); }
+    free(items);
+}
+
 void editor_start_completion(EditorState *state) {
     char* line = state->buffer.lines[state->cursor.line]; if (!line) return;
     int start = state->cursor.col;
@@ -34,6 +39,7 @@ void editor_start_completion(EditorState *state) {
     if (len == 0) return; 
     strncpy(state->input.word_to_complete, &line[start], len);
     state->input.word_to_complete[len] = '\0';
+    free_completion_items(state->input.completion_items, state->input.num_suggestions);
     state->input.num_suggestions = 0;
     state->input.completion_items = NULL;
     const char *delimiters = " \t\n\r`~!@#$%^&*()-=+[]{}|\\;:'\",.<>/?";
@@ -52,6 +58,159 @@ void editor_start_completion(EditorState *state) {
     }
 }
 
+// The word being completed: from completion_start_col to the cursor
+bool editor_completion_word(EditorState *state, char *word, size_t size) {
+    const char *line = state->buffer.lines[state->cursor.line];
+    int start = state->input.completion_start_col, len = state->cursor.col - start;
+    if (!line || start < 0 || len <= 0 || len >= (int)size || state->cursor.col > (int)strlen(line)) return false;
+    for (int i = start; i < state->cursor.col; i++) {
+        if (!isalnum((unsigned char)line[i]) && line[i] != '_') return false;
+    }
+    memcpy(word, line + start, len);
+    word[len] = '\0';
+    return true;
+}
+
+// Fuzzy match: the characters of word appear in candidate in order, case
+// ignored. Matches at the start, at word parts (after '_' or a lower-to-upper
+// change) and in runs score higher, as does an exact case. -1 if no match.
+static int completion_score(const char *word, const char *candidate) {
+    int score = 0, prev = -2;
+    const char *c = candidate;
+    for (const char *w = word; *w; w++) {
+        while (*c && tolower((unsigned char)*c) != tolower((unsigned char)*w)) c++;
+        if (!*c) return -1;
+        int pos = c - candidate;
+        int bonus = 1;
+        if (pos == 0) bonus += 8;
+        else if (c[-1] == '_' || (islower((unsigned char)c[-1]) && isupper((unsigned char)*c))) bonus += 6;
+        if (pos == prev + 1) bonus += 8;
+        if (*c == *w) bonus++;
+        score += bonus;
+        prev = pos;
+        c++;
+    }
+    return score * 16 - (int)strlen(candidate); // shorter candidates first among equals
+}
+
+typedef struct {
+    int index;
+    int score;
+} ScoredItem;
+
+static int compare_scored(const void *a, const void *b) {
+    const ScoredItem *x = a, *y = b;
+    if (x->score != y->score) return y->score - x->score;
+    return x->index - y->index; // keep the server's order among equals
+}
+
+// Shows the items of list that match word, best first. list may be the shown list itself.
+static void completion_show_matches(EditorState *state, const CompletionItem *list, int count, const char *word) {
+    ScoredItem *scored = count > 0 ? malloc(count * sizeof(ScoredItem)) : NULL;
+    int n = 0;
+    for (int i = 0; scored && i < count; i++) {
+        int score = completion_score(word, list[i].insert_text ? list[i].insert_text : list[i].label);
+        if (score >= 0) scored[n++] = (ScoredItem){ i, score };
+    }
+    qsort(scored, n, sizeof(ScoredItem), compare_scored);
+
+    CompletionItem *items = n > 0 ? malloc(n * sizeof(CompletionItem)) : NULL;
+    if (!items) n = 0;
+    for (int i = 0; i < n; i++) {
+        const CompletionItem *src = &list[scored[i].index];
+        items[i].label = strdup(src->label);
+        items[i].detail = strdup(src->detail ? src->detail : "");
+        items[i].insert_text = strdup(src->insert_text ? src->insert_text : src->label);
+    }
+    free(scored);
+
+    free_completion_items(state->input.completion_items, state->input.num_suggestions);
+    state->input.completion_items = items;
+    state->input.num_suggestions = n;
+    state->input.selected_suggestion = 0;
+    state->input.completion_scroll_top = 0;
+    if (n > 0) state->input.completion_mode = COMPLETION_TEXT;
+    else editor_end_completion(state);
+}
+
+static bool completion_cache_covers(EditorState *state, const char *word) {
+    CompletionCache *cache = &state->input.completion_cache;
+    return cache->valid && cache->line == state->cursor.line && cache->start_col == state->input.completion_start_col &&
+           strncmp(word, cache->prefix, strlen(cache->prefix)) == 0;
+}
+
+void editor_clear_completion_cache(CompletionCache *cache) {
+    free_completion_items(cache->items, cache->count);
+    memset(cache, 0, sizeof(*cache));
+}
+
+// Keeps the list just built from a server answer (plus the buffer's words)
+// for the prefix it was asked for, and shows it ranked for the word at the
+// cursor, which the user may have typed on since
+void editor_cache_completion(EditorState *state, const char *prefix, bool incomplete) {
+    CompletionCache *cache = &state->input.completion_cache;
+    char word[100];
+    editor_clear_completion_cache(cache);
+    if (!editor_completion_word(state, word, sizeof(word)) || strncmp(word, prefix, strlen(prefix)) != 0) return;
+
+    int count = state->input.num_suggestions;
+    cache->items = count > 0 ? malloc(count * sizeof(CompletionItem)) : NULL;
+    if (count > 0 && !cache->items) return;
+    for (int i = 0; i < count; i++) {
+        const CompletionItem *src = &state->input.completion_items[i];
+        cache->items[i].label = strdup(src->label);
+        cache->items[i].detail = strdup(src->detail);
+        cache->items[i].insert_text = strdup(src->insert_text);
+    }
+    cache->count = count;
+    cache->line = state->cursor.line;
+    cache->start_col = state->input.completion_start_col;
+    snprintf(cache->prefix, sizeof(cache->prefix), "%s", prefix);
+    cache->incomplete = incomplete;
+    cache->valid = true;
+    if (count > 0) completion_show_matches(state, cache->items, cache->count, word);
+}
+
+// Shows the cached list narrowed to the word at the cursor, if the cache has
+// it. False when the server still has to be asked.
+bool editor_complete_from_cache(EditorState *state) {
+    char word[100];
+    if (!editor_completion_word(state, word, sizeof(word)) || !completion_cache_covers(state, word)) return false;
+    CompletionCache *cache = &state->input.completion_cache;
+    completion_show_matches(state, cache->items, cache->count, word);
+    return !cache->incomplete;
+}
+
+// Called after each character typed (or erased) into the word while the list
+// is open: narrows it locally, from the cache when it covers the word. False
+// when the server has to be asked again.
+bool editor_update_completion(EditorState *state) {
+    char word[100];
+    if (!editor_completion_word(state, word, sizeof(word))) {
+        editor_end_completion(state);
+        return true;
+    }
+    bool shrank = strlen(word) < strlen(state->input.word_to_complete);
+    snprintf(state->input.word_to_complete, sizeof(state->input.word_to_complete), "%s", word);
+    if (editor_complete_from_cache(state)) return true;
+    if (completion_cache_covers(state, word)) return false; // shown, but the list was incomplete
+
+    // Nothing cached for this word start: an erased character can bring back
+    // buffer words the list no longer has
+    if (shrank) {
+        editor_start_completion(state);
+        if (state->input.num_suggestions == 0) editor_end_completion(state);
+    } else completion_show_matches(state, state->input.completion_items, state->input.num_suggestions, word);
+    return false;
+}
+
+// Typing a word character or erasing one keeps the list open
+bool editor_completion_continues(EditorState *state, wint_t ch) {
+    if (state->input.completion_mode != COMPLETION_TEXT || state->input.mode != INSERT) return false;
+    if (ch == KEY_BACKSPACE || ch == 127 || ch == 8) return state->cursor.col > state->input.completion_start_col;
+    return ch < 128 && (isalnum((int)ch) || ch == '_');
+}
+
 void editor_start_command_completion(EditorState *state) {
     if (state->input.completion_mode != COMPLETION_NONE) return;
     char* buffer = state->input.command_buffer;
@@ -124,6 +283,7 @@ void editor_apply_completion(EditorState *state) {
         state->cursor.col = state->input.completion_start_col + strlen(selected);
         state->cursor.ideal_col = state->cursor.col;
         mark_line_as_dirty(state, state->cursor.line);
+        editor_note_edit(state, state->cursor.line, 1, 1);
     } else if (state->input.completion_mode == COMPLETION_COMMAND) {
         strncpy(state->input.command_buffer, selected, sizeof(state->input.command_buffer) - 1);
         state->input.command_pos = strlen(state->input.command_buffer);
@@ -174,9 +334,15 @@ void editor_draw_completion_win(WINDOW *win, EditorState *state) {
         win_y = getbegy(win) + parent_rows - 2 - win_h; if (win_y < getbegy(win)) win_y = getbegy(win);
         win_x = getbegx(win) + 1;
     }
-    if(state->input.completion_win) delwin(state->input.completion_win); 
-    state->input.completion_win = newwin(win_h, win_w, win_y, win_x);
-    wbkgd(state->input.completion_win, COLOR_PAIR(9));
+    // Narrowing the list while typing usually keeps the popup where it is
+    WINDOW *cw = state->input.completion_win;
+    if (cw && getmaxy(cw) == win_h && getmaxx(cw) == win_w && getbegy(cw) == win_y && getbegx(cw) == win_x) {
+        werase(cw);
+    } else {
+        if (cw) delwin(cw);
+        state->input.completion_win = newwin(win_h, win_w, win_y, win_x);
+        wbkgd(state->input.completion_win, COLOR_PAIR(9));
+    }
     for (int i = 0; i < win_h; i++) {
         int idx = state->input.completion_scroll_top + i;
         if (idx < state->input.num_suggestions) {
@@ -287,7 +453,7 @@ void handle_insert_mode_key(EditorState *state, wint_t ch) {
             else {
                 bool should_indent = (state->cursor.col == 0 || isspace(state->buffer.lines[state->cursor.line][state->cursor.col - 1]));
                 if (should_indent) { push_undo(state); for (int i = 0; i < TAB_SIZE; i++) editor_insert_char(state, ' '); }
-                else { editor_start_completion(state); if (state->lsp.enabled) { state->lsp.completion_pending = true; clock_gettime(CLOCK_MONOTONIC, &state->lsp.last_keystroke); } }
+                else { editor_start_completion(state); if (state->lsp.enabled && !editor_complete_from_cache(state)) { state->lsp.completion_pending = true; clock_gettime(CLOCK_MONOTONIC, &state->lsp.last_keystroke); } }
             }
             break;
         }
@@ -6,6 +6,12 @@
 // Autocompletion Management
 void add_suggestion(EditorState *state, const char *label, const char *detail, const char *insert_text);
 void editor_start_completion(EditorState *state);
+void editor_cache_completion(EditorState *state, const char *prefix, bool incomplete);
+bool editor_completion_word(EditorState *state, char *word, size_t size);
+bool editor_complete_from_cache(EditorState *state);
+bool editor_update_completion(EditorState *state);
+bool editor_completion_continues(EditorState *state, wint_t ch);
+void editor_clear_completion_cache(CompletionCache *cache);
 void editor_start_command_completion(EditorState *state);
 void editor_start_theme_completion(EditorState *state);
 void editor_start_file_completion(EditorState *state);
@@ -1,4 +1,5 @@
 #include "base64.h"
+#include "term_output.h"
 #include <stdlib.h>
 #include <stdint.h>
 
@@ -51,8 +52,7 @@ void render_kitty_image(EditorBuffer *buf, int win_y, int win_x, int max_cols, i
     // Se precisarmos mover/redimensionar a imagem, a maneira mais segura em terminais antigos
     // é deletar a imagem inteira da memória (d=i) e re-transmitir do zero.
     if (buf->image_is_visible && (buf->image_last_cols != c || buf->image_last_rows != r || buf->image_last_y != win_y || buf->image_last_x != win_x)) {
-        printf("\033_Ga=d,d=i,i=%u;\033\\", buf->kitty_image_id);
-        fflush(stdout);
+        term_output_printf("\033_Ga=d,d=i,i=%u;\033\\", buf->kitty_image_id);
         buf->image_is_visible = false;
         buf->image_transmitted = false;
         buf->kitty_image_id = (uint32_t)(rand() % 1000000 + 1); // get a new id just in case
@@ -80,12 +80,12 @@ void render_kitty_image(EditorBuffer *buf, int win_y, int win_x, int max_cols, i
             
             if (offset == 0) {
                 // a=t: transmit only
-                printf("\033_Ga=t,f=32,s=%d,v=%d,i=%u,m=%d;", width, height, buf->kitty_image_id, m);
+                term_output_printf("\033_Ga=t,f=32,s=%d,v=%d,i=%u,m=%d;", width, height, buf->kitty_image_id, m);
             } else {
-                printf("\033_Gm=%d;", m);
+                term_output_printf("\033_Gm=%d;", m);
             }
-            fwrite(b64_data + offset, 1, size, stdout);
-            printf("\033\\");
+            term_output_write(b64_data + offset, size);
+            term_output_printf("\033\\");
             offset += size;
         }
         free(b64_data);
@@ -94,9 +94,8 @@ void render_kitty_image(EditorBuffer *buf, int win_y, int win_x, int max_cols, i
 
     if (!buf->image_is_visible) {
         // Place image
-        printf("\033[%d;%dH", win_y + 1, win_x + 1);
-        printf("\033_Ga=p,i=%u,p=1,c=%d,r=%d,z=1;\033\\", buf->kitty_image_id, c, r);
-        fflush(stdout);
+        term_output_printf("\033[%d;%dH", win_y + 1, win_x + 1);
+        term_output_printf("\033_Ga=p,i=%u,p=1,c=%d,r=%d,z=1;\033\\", buf->kitty_image_id, c, r);
         buf->image_is_visible = true;
         buf->image_last_cols = c;
         buf->image_last_rows = r;
@@ -108,8 +107,7 @@ void render_kitty_image(EditorBuffer *buf, int win_y, int win_x, int max_cols, i
 void hide_kitty_image(EditorBuffer *buf) {
     if (!buf || buf->kitty_image_id == 0) return;
     if (buf->image_is_visible) {
-        printf("\033_Ga=d,d=i,i=%u;\033\\", buf->kitty_image_id);
-        fflush(stdout);
+        term_output_printf("\033_Ga=d,d=i,i=%u;\033\\", buf->kitty_image_id);
         buf->image_is_visible = false;
         buf->image_transmitted = false;
     }
@@ -117,8 +115,7 @@ void hide_kitty_image(EditorBuffer *buf) {
 
 void delete_kitty_image(uint32_t id) {
     if (id == 0) return;
-    printf("\033_Ga=d,d=i,i=%u;\033\\", id);
-    fflush(stdout);
+    term_output_printf("\033_Ga=d,d=i,i=%u;\033\\", id);
 }
 
 void render_kitty_hover(EditorImageHover *hover, int win_y, int win_x, int max_cols, int max_rows) {
@@ -128,8 +125,7 @@ void render_kitty_hover(EditorImageHover *hover, int win_y, int win_x, int max_c
     int r = max_rows > 0 ? max_rows : 1;
 
     if (hover->image_is_visible && (hover->image_last_cols != c || hover->image_last_rows != r || hover->image_last_y != win_y || hover->image_last_x != win_x)) {
-        printf("\033_Ga=d,d=i,i=%u;\033\\", hover->kitty_image_id);
-        fflush(stdout);
+        term_output_printf("\033_Ga=d,d=i,i=%u;\033\\", hover->kitty_image_id);
         hover->image_is_visible = false;
         hover->kitty_image_id = 0; // force retransmission
     }
@@ -154,21 +150,20 @@ void render_kitty_hover(EditorImageHover *hover, int win_y, int win_x, int max_c
             if (offset + size > b64_len) size = b64_len - offset;
             int m = (offset + size < b64_len) ? 1 : 0;
             if (offset == 0) {
-                printf("\033_Ga=t,f=32,s=%d,v=%d,i=%u,m=%d;", width, height, hover->kitty_image_id, m);
+                term_output_printf("\033_Ga=t,f=32,s=%d,v=%d,i=%u,m=%d;", width, height, hover->kitty_image_id, m);
             } else {
-                printf("\033_Gm=%d;", m);
+                term_output_printf("\033_Gm=%d;", m);
             }
-            fwrite(b64_data + offset, 1, size, stdout);
-            printf("\033\\");
+            term_output_write(b64_data + offset, size);
+            term_output_printf("\033\\");
             offset += size;
         }
         free(b64_data);
     }
 
     if (!hover->image_is_visible) {
-        printf("\033[%d;%dH", win_y + 1, win_x + 1);
-        printf("\033_Ga=p,i=%u,p=1,c=%d,r=%d,z=3;\033\\", hover->kitty_image_id, c, r);
-        fflush(stdout);
+        term_output_printf("\033[%d;%dH", win_y + 1, win_x + 1);
+        term_output_printf("\033_Ga=p,i=%u,p=1,c=%d,r=%d,z=3;\033\\", hover->kitty_image_id, c, r);
         hover->image_is_visible = true;
         hover->image_last_cols = c;
         hover->image_last_rows = r;
@@ -180,8 +175,7 @@ void render_kitty_hover(EditorImageHover *hover, int win_y, int win_x, int max_c
 void hide_kitty_hover(EditorImageHover *hover) {
     if (!hover || hover->kitty_image_id == 0) return;
     if (hover->image_is_visible) {
-        printf("\033_Ga=d,d=i,i=%u;\033\\", hover->kitty_image_id);
-        fflush(stdout);
+        term_output_printf("\033_Ga=d,d=i,i=%u;\033\\", hover->kitty_image_id);
         hover->image_is_visible = false;
         hover->kitty_image_id = 0;
     }
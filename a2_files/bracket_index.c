@@ -0,0 +1,269 @@
+#include "bracket_index.h"
+#include "line_cache.h"
+#include <stdlib.h>
+#include <string.h>
+
+static bool is_opener(char c) {
+    return c == '(' || c == '[' || c == '{';
+}
+
+static char closer_for(char c) {
+    return (c == '(') ? ')' : (c == '[') ? ']' : '}';
+}
+
+static BracketToken *token_at(BracketIndex *bi, int line, int idx) {
+    return &bi->lines[line].tokens[idx];
+}
+
+static void push_token(BracketLine *bl, int col, char ch) {
+    if (bl->count == bl->cap) {
+        int new_cap = bl->cap > 0 ? bl->cap * 2 : 8;
+        BracketToken *tokens = realloc(bl->tokens, sizeof(BracketToken) * new_cap);
+        if (!tokens) return;
+        bl->tokens = tokens;
+        bl->cap = new_cap;
+    }
+    bl->tokens[bl->count++] = (BracketToken){ col, ch, -1, -1, -1, -1 };
+}
+
+static void tokenize_line(BracketLine *bl, const char *line, bool comment_in) {
+    bl->count = 0;
+    bl->comment_in = comment_in;
+    bool in_comment = comment_in, in_string = false;
+    char string_char = 0;
+    for (int j = 0; line && line[j] != '\0'; j++) {
+        char c = line[j];
+        if (in_comment) {
+            if (c == '*' && line[j + 1] == '/') { in_comment = false; j++; }
+            continue;
+        }
+        if (in_string) {
+            if (c == '\\' && line[j + 1] != '\0') { j++; continue; }
+            if (c == string_char) in_string = false;
+            continue;
+        }
+        if (c == '"' || c == '\'') { in_string = true; string_char = c; continue; }
+        if (c == '/' && line[j + 1] == '/') break;
+        if (c == '/' && line[j + 1] == '*') { in_comment = true; j++; continue; }
+        if (c == '(' || c == '[' || c == '{' || c == ')' || c == ']' || c == '}') push_token(bl, j, c);
+    }
+    bl->comment_out = in_comment;
+}
+
+// Renumbers references to lines at or after `from` (old numbering) after lines were inserted/removed.
+static void shift_line_refs(BracketIndex *bi, int from, int delta) {
+    for (int i = 0; i < bi->num_lines; i++) {
+        BracketLine *bl = &bi->lines[i];
+        if (bl->top_line >= from) bl->top_line += delta;
+        for (int k = 0; k < bl->count; k++) {
+            BracketToken *t = &bl->tokens[k];
+            if (t->match_line >= from) t->match_line += delta;
+            if (t->parent_line >= from) t->parent_line += delta;
+        }
+    }
+    if (bi->end_top_line >= from) bi->end_top_line += delta;
+}
+
+void bracket_index_note_edit(BracketIndex *bi, int line, int removed, int inserted) {
+    if (bi->reset) return;
+    if (line < 0 || removed < 0 || inserted < 0) {
+        bi->reset = true;
+        return;
+    }
+    int edit_end = line + inserted;
+    if (!bi->dirty) {
+        bi->dirty = true;
+        bi->dirty_first = line;
+        bi->dirty_end = edit_end;
+        bi->dirty_delta = inserted - removed;
+        return;
+    }
+    // Carry the range noted so far over to the numbering after this edit
+    int end = bi->dirty_end;
+    if (end >= line + removed) end += inserted - removed;
+    else if (end > line) end = edit_end;
+    if (edit_end > end) end = edit_end;
+    if (line < bi->dirty_first) bi->dirty_first = line;
+    bi->dirty_end = end;
+    bi->dirty_delta += inserted - removed;
+}
+
+void bracket_index_note_reset(BracketIndex *bi) {
+    bi->reset = true;
+}
+
+bool bracket_index_is_current(const BracketIndex *bi, int num_lines) {
+    return !bi->dirty && !bi->reset && bi->num_lines == num_lines;
+}
+
+void bracket_index_update(BracketIndex *bi, char **lines, int num_lines) {
+    int old_n = bi->num_lines;
+    if (old_n > 0 && !bi->dirty && !bi->reset && old_n == num_lines) return;
+    if (old_n == 0) {
+        bi->end_top_line = -1;
+        bi->end_top_idx = -1;
+        bi->end_depth = 0;
+    }
+
+    // 1. Find the changed region. With the edits noted, only their range is
+    // compared by line version; otherwise the common prefix and suffix of the
+    // whole buffer.
+    int prefix, old_end, new_end;
+    int delta = num_lines - old_n;
+    if (old_n > 0 && bi->dirty && !bi->reset && bi->dirty_delta == delta &&
+        bi->dirty_first >= 0 && bi->dirty_first <= bi->dirty_end && bi->dirty_end <= num_lines &&
+        bi->dirty_end - delta >= bi->dirty_first && bi->dirty_end - delta <= old_n) {
+        prefix = bi->dirty_first;
+        new_end = bi->dirty_end;
+        old_end = new_end - delta;
+        while (prefix < old_end && prefix < new_end && bi->lines[prefix].version == line_version(lines[prefix])) prefix++;
+        while (old_end > prefix && new_end > prefix &&
+               bi->lines[old_end - 1].version == line_version(lines[new_end - 1])) {
+            old_end--;
+            new_end--;
+        }
+    } else {
+        int common = old_n < num_lines ? old_n : num_lines;
+        prefix = 0;
+        while (prefix < common && bi->lines[prefix].version == line_version(lines[prefix])) prefix++;
+        int suffix = 0;
+        while (suffix < common - prefix &&
+               bi->lines[old_n - 1 - suffix].version == line_version(lines[num_lines - 1 - suffix])) suffix++;
+        old_end = old_n - suffix;
+        new_end = num_lines - suffix;
+    }
+    bi->dirty = bi->reset = false;
+    if (prefix == old_end && prefix == new_end) return;
+    int suffix = num_lines - new_end;
+
+    // Stack state at the start of the first changed line only depends on the prefix
+    int top_line, top_idx, depth;
+    if (prefix < old_n) {
+        top_line = bi->lines[prefix].top_line;
+        top_idx = bi->lines[prefix].top_idx;
+        depth = bi->lines[prefix].depth;
+    } else {
+        top_line = bi->end_top_line;
+        top_idx = bi->end_top_idx;
+        depth = bi->end_depth;
+    }
+
+    // 2. Splice: drop the old changed lines, open slots for the new ones.
+    if (num_lines > bi->cap) {
+        int new_cap = bi->cap > 0 ? bi->cap : 256;
+        while (new_cap < num_lines) new_cap *= 2;
+        BracketLine *grown = realloc(bi->lines, sizeof(BracketLine) * new_cap);
+        if (!grown) return;
+        bi->lines = grown;
+        bi->cap = new_cap;
+    }
+    for (int i = prefix; i < old_end; i++) free(bi->lines[i].tokens);
+    if (suffix > 0 && delta != 0) {
+        memmove(&bi->lines[new_end], &bi->lines[old_end], sizeof(BracketLine) * suffix);
+    }
+    if (new_end > prefix) memset(&bi->lines[prefix], 0, sizeof(BracketLine) * (new_end - prefix));
+    bi->num_lines = num_lines;
+    if (delta != 0) shift_line_refs(bi, old_end, delta);
+
+    // 3. Re-tokenize the changed lines, plus following lines whose block comment state changed.
+    bool comment = prefix > 0 ? bi->lines[prefix - 1].comment_out : false;
+    int retok_end = prefix;
+    for (int i = prefix; i < num_lines; i++) {
+        BracketLine *bl = &bi->lines[i];
+        if (i >= new_end && bl->comment_in == comment) break;
+        tokenize_line(bl, lines[i], comment);
+        bl->version = line_version(lines[i]);
+        comment = bl->comment_out;
+        retok_end = i + 1;
+    }
+
+    // 4. Re-match from the first changed line. Once past the re-tokenized lines, stop as
+    // soon as the stack equals the old checkpoint and its top lies before the change:
+    // everything after that matches exactly as before.
+    for (int i = prefix; i < num_lines; i++) {
+        BracketLine *bl = &bi->lines[i];
+        if (i >= retok_end && bl->depth == depth && bl->top_line == top_line &&
+            bl->top_idx == top_idx && top_line < prefix) {
+            return;
+        }
+        bl->top_line = top_line;
+        bl->top_idx = top_idx;
+        bl->depth = depth;
+        for (int k = 0; k < bl->count; k++) {
+            BracketToken *t = &bl->tokens[k];
+            if (is_opener(t->ch)) {
+                t->parent_line = top_line;
+                t->parent_idx = top_idx;
+                t->match_line = t->match_idx = -1;
+                top_line = i;
+                top_idx = k;
+                depth++;
+            } else if (top_line >= 0 && closer_for(token_at(bi, top_line, top_idx)->ch) == t->ch) {
+                BracketToken *open = token_at(bi, top_line, top_idx);
+                t->match_line = top_line;
+                t->match_idx = top_idx;
+                open->match_line = i;
+                open->match_idx = k;
+                top_line = open->parent_line;
+                top_idx = open->parent_idx;
+                depth--;
+            } else {
+                // Mismatched closer: reported as unmatched, the stack is left alone
+                t->match_line = t->match_idx = -1;
+            }
+        }
+    }
+
+    // Reached the end: whatever is still open is unmatched.
+    bi->end_top_line = top_line;
+    bi->end_top_idx = top_idx;
+    bi->end_depth = depth;
+    while (top_line >= 0) {
+        BracketToken *open = token_at(bi, top_line, top_idx);
+        open->match_line = open->match_idx = -1;
+        top_line = open->parent_line;
+        top_idx = open->parent_idx;
+    }
+}
+
+static int find_token(const BracketIndex *bi, int line, int col) {
+    if (line < 0 || line >= bi->num_lines) return -1;
+    const BracketLine *bl = &bi->lines[line];
+    int lo = 0, hi = bl->count - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (bl->tokens[mid].col == col) return mid;
+        if (bl->tokens[mid].col < col) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    return -1;
+}
+
+bool bracket_index_is_unmatched(const BracketIndex *bi, int line, int col) {
+    int k = find_token(bi, line, col);
+    return k >= 0 && bi->lines[line].tokens[k].match_line < 0;
+}
+
+int bracket_index_find_match(const BracketIndex *bi, int line, int col, int *match_line, int *match_col) {
+    int k = find_token(bi, line, col);
+    if (k < 0) return -1;
+    const BracketToken *t = &bi->lines[line].tokens[k];
+    if (t->match_line < 0 || t->match_line >= bi->num_lines) return 0;
+    const BracketLine *ml = &bi->lines[t->match_line];
+    if (t->match_idx < 0 || t->match_idx >= ml->count) return 0;
+    *match_line = t->match_line;
+    *match_col = ml->tokens[t->match_idx].col;
+    return 1;
+}
+
+const BracketToken *bracket_index_line_tokens(const BracketIndex *bi, int line, int *count) {
+    if (line < 0 || line >= bi->num_lines) { *count = 0; return NULL; }
+    *count = bi->lines[line].count;
+    return bi->lines[line].tokens;
+}
+
+void bracket_index_free(BracketIndex *bi) {
+    for (int i = 0; i < bi->num_lines; i++) free(bi->lines[i].tokens);
+    free(bi->lines);
+    memset(bi, 0, sizeof(*bi));
+}
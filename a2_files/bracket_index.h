@@ -0,0 +1,70 @@
+#ifndef BRACKET_INDEX_H
+#define BRACKET_INDEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Incremental bracket matching index.
+// Each line keeps its bracket tokens (strings, // and /* */ comments skipped)
+// and a checkpoint of the matcher stack at its start. The stack is persistent:
+// every opener links to the opener below it, so a checkpoint is just the top
+// token. An update re-tokenizes the changed lines and re-matches from the
+// first one until the stack converges with the old checkpoints again.
+// Edits are noted as they happen, so an update only looks at the lines they
+// touched; without notes it falls back to comparing every line.
+
+typedef struct {
+    int col;          // byte offset in the line
+    char ch;
+    int match_line;   // partner bracket, -1 when unmatched
+    int match_idx;
+    int parent_line;  // openers: enclosing opener when this one was pushed, -1 at top level
+    int parent_idx;
+} BracketToken;
+
+typedef struct {
+    uint64_t version; // line_version() of the tokenized text
+    bool comment_in;  // line starts inside a block comment
+    bool comment_out;
+    int top_line;     // matcher stack at the start of the line
+    int top_idx;
+    int depth;
+    BracketToken *tokens;
+    int count;
+    int cap;
+} BracketLine;
+
+typedef struct {
+    BracketLine *lines;
+    int num_lines;
+    int cap;
+    // Matcher stack after the last line
+    int end_top_line;
+    int end_top_idx;
+    int end_depth;
+    // Lines touched since the last update: [dirty_first, dirty_end) in the
+    // current numbering, and the net number of lines added
+    bool dirty;
+    bool reset;
+    int dirty_first;
+    int dirty_end;
+    int dirty_delta;
+} BracketIndex;
+
+// `removed` lines starting at `line` were replaced by `inserted` new ones
+// (1, 1 for an edit inside a line).
+void bracket_index_note_edit(BracketIndex *bi, int line, int removed, int inserted);
+// The whole buffer was replaced (load, undo): the next update compares every line.
+void bracket_index_note_reset(BracketIndex *bi);
+void bracket_index_update(BracketIndex *bi, char **lines, int num_lines);
+// False while edits are noted that the index has not caught up with
+bool bracket_index_is_current(const BracketIndex *bi, int num_lines);
+bool bracket_index_is_unmatched(const BracketIndex *bi, int line, int col);
+// Returns 1 and the partner position if found, 0 if the bracket is unmatched,
+// -1 if there is no indexed bracket at line/col (e.g. inside a string).
+int bracket_index_find_match(const BracketIndex *bi, int line, int col, int *match_line, int *match_col);
+// Bracket tokens of a line in column order (unmatched ones have match_line < 0)
+const BracketToken *bracket_index_line_tokens(const BracketIndex *bi, int line, int *count);
+void bracket_index_free(BracketIndex *bi);
+
+#endif // BRACKET_INDEX_H
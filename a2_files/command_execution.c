@@ -12,6 +12,7 @@
 #include "diff.h"
 #include "settings.h"
 #include "logger.h"
+#include "term_output.h"
 
 #include <sys/stat.h>
 #include <ctype.h> // For isspace
@@ -20,6 +21,7 @@
 #include <sys/wait.h> // For WIFEXITED, WEXITSTATUS
 
 void load_global_config();
+void save_global_config();
 
 // ===================================================================
 // 6. Command Execution & Processing
@@ -267,6 +269,7 @@ void process_command(EditorState *state, bool *should_exit) {
         for (int i = 0; i < state->buffer.num_lines; i++) { if(state->buffer.lines[i]) {
         free(state->buffer.lines[i]); state->buffer.lines[i] = NULL; } }
         state->buffer.num_lines = 1; state->buffer.lines[0] = calloc(1, 1); strcpy(state->buffer.filename, "[No Name]");
+        editor_note_buffer_replaced(state);
         state->cursor.line = 0; state->cursor.col = 0; state->cursor.ideal_col = 0; state->view.top_line = 0; state->view.left_col = 0;
         state->buffer.modified = false;
         if (state->buffer.shadow_copy) { free(state->buffer.shadow_copy); state->buffer.shadow_copy = NULL; }
@@ -308,6 +311,16 @@ void process_command(EditorState *state, bool *should_exit) {
                 global_config.git_gutter_enabled = false;
                 editor_update_git_gutter(state);
                 editor_set_status_msg(state, "Git gutter disabled");
+            } else if (strcmp(set_cmd, "semantic") == 0) {
+                global_config.lsp_semantic_tokens = true;
+                save_global_config();
+                mark_all_lines_dirty(state);
+                editor_set_status_msg(state, "Semantic highlighting enabled");
+            } else if (strcmp(set_cmd, "nosemantic") == 0) {
+                global_config.lsp_semantic_tokens = false;
+                save_global_config();
+                mark_all_lines_dirty(state);
+                editor_set_status_msg(state, "Semantic highlighting disabled");
             } else if (strcmp(set_cmd, "spelllang") == 0 && items == 2) {
                 if (spell_checker_load_dict(&state->spell.checker, set_val)) {
                     editor_set_status_msg(state, "Spell checker language set to: %s", set_val);
@@ -332,6 +345,33 @@ void process_command(EditorState *state, bool *should_exit) {
                 } else {
                     editor_set_status_msg(state, "Invalid bar style. Use 0 or 1.");
                 }
+            } else if (strcmp(set_cmd, "fps") == 0 && items == 2) {
+                int fps = atoi(set_val);
+                if (fps >= 1 && fps <= 240) {
+                    global_config.max_fps = fps;
+                    save_global_config();
+                    editor_set_status_msg(state, "Max frame rate set to %d fps", fps);
+                } else {
+                    editor_set_status_msg(state, "Invalid frame rate. Use 1-240.");
+                }
+            } else if (strcmp(set_cmd, "lspdelay") == 0 && items == 2) {
+                int delay = atoi(set_val);
+                if (delay >= 0 && delay <= 1000) {
+                    global_config.lsp_change_delay_ms = delay;
+                    save_global_config();
+                    editor_set_status_msg(state, "LSP changes coalesced over %d ms", delay);
+                } else {
+                    editor_set_status_msg(state, "Invalid LSP delay. Use 0-1000 ms.");
+                }
+            } else if (strcmp(set_cmd, "lspidle") == 0 && items == 2) {
+                int timeout = atoi(set_val);
+                if (timeout >= 0 && timeout <= 3600) {
+                    global_config.lsp_idle_timeout_sec = timeout;
+                    save_global_config();
+                    editor_set_status_msg(state, "Unused LSP servers stop after %d s", timeout);
+                } else {
+                    editor_set_status_msg(state, "Invalid LSP idle timeout. Use 0-3600 s.");
+                }
             } else if (strcmp(set_cmd, "themedir") == 0 && items == 2) {
                 char abs_path[PATH_MAX];
                 if (realpath(set_val, abs_path) == NULL) {
@@ -481,6 +521,22 @@ void process_command(EditorState *state, bool *should_exit) {
          else {
               editor_set_status_msg(state, "LSP not active");
           }
+    } else if (strcmp(command, "framestats") == 0) {
+        // First call starts sampling the terminal output of each frame, the second reports it
+        if (!frame_output_stats_enabled()) {
+            frame_output_stats_enable(true);
+            editor_set_status_msg(state, "Frame stats on, run :framestats again for the numbers");
+        } else {
+            const FrameOutputStats *fs = frame_output_stats();
+            frame_output_stats_enable(false);
+            if (fs->frames == 0) {
+                editor_set_status_msg(state, "Frame stats: no frames sampled (needs /proc/thread-self/io)");
+            } else {
+                editor_set_status_msg(state, "Frame stats: %ld frames | avg %.1f writes, %ld B | max %ld writes, %ld B | last %ld writes, %ld B",
+                                      fs->frames, (double)fs->writes / fs->frames, fs->bytes / fs->frames,
+                                      fs->max_writes, fs->max_bytes, fs->last_writes, fs->last_bytes);
+            }
+        }
     } else if (strcmp(command, "lsp-list") == 0) {
         display_diagnostics_list(state); 
     } else if (strcmp(command, "shortcuts-reset") == 0) {
@@ -490,6 +546,19 @@ void process_command(EditorState *state, bool *should_exit) {
         editor_set_status_msg(state, "Shortcuts saved to sc.a2");
     } else if (strcmp(command, "shortcuts-generate-default") == 0) {
         save_ds_keybindings();
+    } else if (strcmp(command, "spell-add") == 0) {
+        char word[100];
+        if (strlen(args) > 0) snprintf(word, sizeof(word), "%s", args);
+        else get_word_at_cursor(state, word, sizeof(word));
+        if (strlen(word) == 0) {
+            editor_set_status_msg(state, "Usage: :spell-add [word]");
+        } else if (!state->spell.checker.enabled) {
+            editor_set_status_msg(state, "Spell checker not active");
+        } else if (spell_personal_add_word(word)) {
+            editor_set_status_msg(state, "Added '%s' to the personal word list", word);
+        } else {
+            editor_set_status_msg(state, "Error: Could not save '%s' to the personal word list", word);
+        }
     } else if (strcmp(command, "toggle_auto_indent") == 0) {
         state->input.auto_indent = !state->input.auto_indent;
         editor_set_status_msg(state, "Auto-indent on newline: %s", state->input.auto_indent ? "ON" : "OFF");
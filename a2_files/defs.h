@@ -20,6 +20,9 @@
 #include <vterm.h>
 #include <regex.h>
 #include "spell.h"
+#include "line_cache.h"
+#include "bracket_index.h"
+#include "line_columns.h"
 
 #ifndef LSPSYMBOL_DEFINED
 #define LSPSYMBOL_DEFINED
@@ -60,6 +63,7 @@ typedef struct {
 #define TAB_SIZE 4
 #define MAX_COMMAND_HISTORY 50
 #define AUTO_SAVE_INTERVAL 1
+#define GIT_GUTTER_INTERVAL 5 // seconds between background git diff refreshes
 #define AUTO_SAVE_EXTENSION ".sv"
 #define MAX_UNDO_LEVELS 512
 
@@ -218,6 +222,30 @@ typedef struct {
 } SyntaxRule;
 #endif
 
+#ifndef SYNTAXCOMMENTS_DEFINED
+#define SYNTAXCOMMENTS_DEFINED
+#define MAX_COMMENT_TOKEN 8
+// Comment delimiters of the buffer's language ("" when it has none)
+typedef struct {
+    char line[2][MAX_COMMENT_TOKEN];  // e.g. "//", "#"
+    char block_start[MAX_COMMENT_TOKEN];
+    char block_end[MAX_COMMENT_TOKEN];
+} SyntaxComments;
+#endif
+
+#ifndef SYNTAXCACHE_DEFINED
+#define SYNTAXCACHE_DEFINED
+// Styled spans per line (see syntax_cache.h)
+typedef struct {
+    LineSpanCache spans;  // spans of drawn lines, keyed by generation and entry lexer state
+    LineSpanCache states; // lexer state after each scanned line, without spans
+    int generation;       // bumped when the syntax rules change
+    bool *entry_states;   // lexer state at the start of each line...
+    int entry_valid;      // ...known for lines [0, entry_valid)
+    int entry_cap;
+} SyntaxCache;
+#endif
+
 #ifndef BRACKETINFO_DEFINED
 #define BRACKETINFO_DEFINED
 typedef struct {
@@ -239,7 +267,7 @@ typedef struct {
 #define LSPPOSITION_DEFINED
 typedef struct {
     int line;
-    int character;
+    int character; // byte column in the buffer; the server's UTF-16 column is converted on arrival
 } LspPosition;
 #endif
 
@@ -271,6 +299,24 @@ typedef struct {
 } LspCodeAction;
 #endif
 
+#ifndef LSPPENDINGREQUEST_DEFINED
+#define LSPPENDINGREQUEST_DEFINED
+struct EditorState;
+// msg is NULL for semantic tokens, which the handler decodes from json_message itself
+typedef void (*LspResponseHandler)(struct EditorState *state, LspMessage *msg, const char *json_message);
+
+typedef struct {
+    long id;
+    int kind;                   // LspRequestKind; a new request supersedes one of the same kind
+    LspResponseHandler handler;
+    struct EditorState *owner;  // editor the answer goes to; NULL for the server's own requests
+    long long deadline_ms;      // CLOCK_MONOTONIC; 0 waits forever
+    bool at_cursor;             // answer is dropped once the cursor leaves line/col
+    int line, col;              // for completion, col is where the word starts
+    char prefix[100];           // completion: the word typed when the list was asked for
+} LspPendingRequest;
+#endif
+
 #ifndef LSPCLIENT_DEFINED
 #define LSPCLIENT_DEFINED
 typedef struct {
@@ -284,9 +330,39 @@ typedef struct {
     char *languageId;
     char *compilerFlags;
     char *compilationDatabase;
+    int sync_kind; // TextDocumentSyncKind from the initialize response
+    struct LspTransport *transport; // I/O thread that owns reads and writes on the pipes
+    // Requests waiting for a response, under ids counting up from 1
+    LspPendingRequest *pending;
+    int num_pending, pending_cap;
+    long next_request_id;
+    // One server per language, project root and compile database, shared by
+    // every editor in that project (see lsp_pool.c)
+    struct EditorState **users;
+    int num_users, users_cap;
+    bool ready;                 // initialize answered; documents can be opened
+    time_t idle_since;          // last user left; shut down after lsp_idle_timeout_sec
+    // semanticTokensProvider: color pair per legend token type (see lsp_semantic.c)
+    int *semantic_colors;
+    int num_semantic_types;
+    bool semantic_full, semantic_delta, semantic_range;
 } LspClient;
 #endif
 
+#ifndef LSPSEMANTICTOKENS_DEFINED
+#define LSPSEMANTICTOKENS_DEFINED
+typedef struct {
+    unsigned int *data;   // last full result, the base the next delta edits
+    int len, cap;
+    char *result_id;
+    LineSpanCache lines;  // decoded spans, keyed by the text of each line
+    int full_version;     // document version the last usable full/delta answer was for
+    int full_requested;   // document version of the full/delta request in flight
+    long long full_retry_ms; // CLOCK_MONOTONIC time a failed full request may be sent again
+    int range_version, range_first, range_end; // same for the last range request
+} LspSemanticTokens;
+#endif
+
 #ifndef LSPDOCUMENTSTATE_DEFINED
 #define LSPDOCUMENTSTATE_DEFINED
 typedef struct {
@@ -295,6 +371,21 @@ typedef struct {
     LspDiagnostic *diagnostics;
     int diagnostics_count;
     bool needs_update;
+    // Per-line index built when diagnostics arrive: the diagnostics touching
+    // line L are line_items[line_start[L] .. line_start[L + 1]]
+    int *line_start;
+    int *line_items;
+    int indexed_lines;
+    int error_count;
+    int warning_count;
+    // The lines as the server last received them. With incremental sync,
+    // didChange sends only the range where the buffer differs from this copy.
+    char **synced_lines;
+    int synced_count;
+    bool synced;
+    bool opened; // didOpen went out for this editor; another editor on the same file leaves it to this one
+    struct timespec last_change; // edits are queued until this is lsp_change_delay_ms old
+    LspSemanticTokens semantic;
 } LspDocumentState;
 #endif
 
@@ -337,12 +428,14 @@ typedef struct {
     bool lsp_hover;
     bool lsp_enabled;
     bool lsp_inline_diagnostics;
+    bool lsp_semantic_tokens; // color identifiers from the server's semantic tokens
     
     int tab_size;
     bool expand_tab;
     int status_bar_mode;
     char default_spell_lang[128];
     bool spell_checker_enabled;
+    bool spell_compiled_dict;
     bool show_line_numbers;
     bool relative_line_numbers;
     bool show_scrollbar;
@@ -357,6 +450,10 @@ typedef struct {
     int icon_mode;
     bool image_preview_enabled;
     char dictionary_lang[16];
+    int max_fps;
+    bool synchronized_output; // wrap each frame in DECSET 2026 begin/end markers
+    int lsp_change_delay_ms; // edits closer than this are sent as one didChange; 0 sends each edit
+    int lsp_idle_timeout_sec; // a language server no editor uses is shut down after this; 0 right away
 } A2Config;
 
 extern A2Config global_config;
@@ -371,6 +468,18 @@ typedef struct {
     char *detail;    // Extra info: "<stdio.h>" or the prototype "(const char *format. ...)"
     char *insert_text; // What will be inserted: "printf(const char format...)"
 } CompletionItem;
+
+// The last completion list the server sent, for the word starting at
+// line/start_col. While the word only grows, the list is narrowed locally
+// instead of asking again.
+typedef struct {
+    CompletionItem *items;
+    int count;
+    int line, start_col;
+    char prefix[100];  // the word when the list was requested
+    bool incomplete;   // isIncomplete, or cut at LSP_MAX_COMPLETION_ITEMS: ask again as the word grows
+    bool valid;
+} CompletionCache;
 #endif
 
 #ifndef EDITOR_NESTED_STRUCTS_DEFINED
@@ -397,6 +506,7 @@ typedef struct {
     time_t last_mod_time;
     char *shadow_copy;
     char *git_gutter;
+    int git_gutter_len;
     char git_branch[256];
     EditorSnapshot *undo_stack[MAX_UNDO_LEVELS];
     int undo_count;
@@ -405,8 +515,10 @@ typedef struct {
     time_t last_auto_save_time;
     SyntaxRule *syntax_rules;
     int num_syntax_rules;
-    BracketInfo *unmatched_brackets;
-    int num_unmatched_brackets;
+    SyntaxComments comments;
+    SyntaxCache syntax_cache;
+    LineColumnIndex columns;  // byte <-> visual column checkpoints of long lines
+    BracketIndex bracket_index;
     AssemblyMapping *mapping;
     bool is_dirty;
     bool *dirty_lines;
@@ -425,6 +537,15 @@ typedef struct {
     int mark_prev_col;
 } EditorBuffer;
 
+// What the gutter last showed on each screen row (0 = must be repainted), so a
+// frame only repaints the gutter cells whose number or sign changed
+typedef struct {
+    uint64_t *rows;
+    int num_rows;
+    int width;
+    int cursor_line; // cursor line the window was last drawn with
+} GutterCache;
+
 typedef struct {
     int top_line;
     int left_col;
@@ -433,6 +554,8 @@ typedef struct {
     bool show_scrollbar;
     int status_bar_mode;
     char status_msg[STATUS_MSG_LEN];
+    bool status_dirty; // only the status bar needs repainting (e.g. clock tick)
+    GutterCache gutter;
 } EditorView;
 
 typedef struct {
@@ -457,6 +580,7 @@ typedef struct {
     int completion_scroll_top;
     WINDOW *completion_win;
     char word_to_complete[100];
+    CompletionCache completion_cache;
     char* macro_registers[26];
     bool is_recording_macro;
     int recording_register_idx;
@@ -477,6 +601,14 @@ typedef struct {
     int history_pos;
     int start_line;
     int start_col;
+    // Highlight state: the pattern is compiled once per query change and
+    // match spans are cached per line (see search_highlight_spans)
+    char highlight_query[100];
+    bool highlight_use_regex;
+    bool highlight_has_regex;
+    regex_t highlight_regex;
+    uint64_t highlight_generation;
+    LineSpanCache highlight_cache;
 } EditorSearch;
 
 typedef struct {
@@ -513,10 +645,17 @@ typedef struct {
 
 typedef struct {
     SpellChecker checker;
+    LineSpanCache line_cache;           // misspelled words per line, keyed by checker generation and entry comment state
+    uint64_t *requested;                // per line: text + key already queued for the worker
+    int requested_cap;
+    int scan_line;                      // background scan position
+    bool scan_comment;                  // comment state entering scan_line
+    uint64_t scan_generation;
     struct timespec hover_last_move;
     bool hover_pending;
     char *hover_message;
     char hover_word[100];
+    char hover_request[100];            // word whose suggestions are being computed
 } EditorSpell;
 
 typedef struct {
@@ -821,6 +960,7 @@ typedef struct EditorWindow {
         int pty_fd;      
         pid_t pid;       
         vterm_t *vterm;  
+        bool dirty;      // vterm has output not yet drawn to the window
     } term;
 } EditorWindow;
 #endif
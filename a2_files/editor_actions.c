@@ -550,6 +550,7 @@ void handle_normal_mode_key(EditorState *state, wint_t ch) {
                     state->cursor.ideal_col = state->cursor.col;
                     state->buffer.modified = true; state->buffer.is_dirty = true;
                     mark_line_as_dirty(state, state->cursor.line);
+                    editor_note_edit(state, state->cursor.line, 1, 1);
                 }
             } else { state->input.prefix_count = 0; }
             break; }
@@ -569,6 +570,7 @@ void handle_normal_mode_key(EditorState *state, wint_t ch) {
             state->cursor.ideal_col = state->cursor.col;
             state->buffer.modified = true; state->buffer.is_dirty = true;
             mark_line_as_dirty(state, state->cursor.line);
+            editor_note_edit(state, state->cursor.line, 1, 1);
             break; }
         case 'X': { // Delete char(s) before cursor (like Ndh)
             char *line = state->buffer.lines[state->cursor.line];
@@ -583,6 +585,7 @@ void handle_normal_mode_key(EditorState *state, wint_t ch) {
             state->cursor.col = start; state->cursor.ideal_col = start;
             state->buffer.modified = true; state->buffer.is_dirty = true;
             mark_line_as_dirty(state, state->cursor.line);
+            editor_note_edit(state, state->cursor.line, 1, 1);
             break; }
         case 's': { // Substitute char(s): delete N chars, enter Insert
             char *line = state->buffer.lines[state->cursor.line];
@@ -597,6 +600,7 @@ void handle_normal_mode_key(EditorState *state, wint_t ch) {
                     memmove(line + state->cursor.col, line + end, len - end + 1);
                     state->buffer.modified = true; state->buffer.is_dirty = true;
                     mark_line_as_dirty(state, state->cursor.line);
+                    editor_note_edit(state, state->cursor.line, 1, 1);
                 }
             }
             state->input.mode = INSERT;
@@ -609,6 +613,7 @@ void handle_normal_mode_key(EditorState *state, wint_t ch) {
             state->input.prefix_count = 0;
             state->buffer.modified = true; state->buffer.is_dirty = true;
             mark_line_as_dirty(state, state->cursor.line);
+            editor_note_edit(state, state->cursor.line, 1, 1);
             state->input.mode = INSERT;
             break; }
         case 'd': state->input.mode = OPERATOR_PENDING; state->input.pending_operator = 'd'; break;
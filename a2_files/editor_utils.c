@@ -8,6 +8,7 @@
 #include "window_managment.h"
 #include "command_execution.h"
 #include "cache.h"
+#include "syntax_cache.h"
 #include "settings.h"
 #include "diff.h"
 #include "project.h"
@@ -29,7 +30,7 @@ const char *editor_commands[] = {
     "q", "q!", "w", "wq", "help", "about", "gcc", "rc", "rc!", "open", "new", "timer", "diff", "set",
     "lsp-restart", "lsp-diag", "lsp-definition", "lsp-references", "lsp-rename",
     "lsp-status", "lsp-hover", "lsp-symbols", "lsp-refresh", "lsp-check", "lsp-debug",
-    "lsp-list", "toggle_auto_indent", "llvm", "logs"
+    "lsp-list", "toggle_auto_indent", "llvm", "logs", "spell-add", "framestats"
 };
 const int num_editor_commands = sizeof(editor_commands) / sizeof(char*);
 
@@ -72,16 +73,18 @@ const int num_known_headers = 0;
 void editor_update_git_gutter(EditorState *state) {
     if (!state || strcmp(state->buffer.filename, "[No Name]") == 0) return;
     if (!global_config.git_gutter_enabled) {
-        if (state->buffer.git_gutter) { free(state->buffer.git_gutter); state->buffer.git_gutter = NULL; }
+        if (state->buffer.git_gutter) { free(state->buffer.git_gutter); state->buffer.git_gutter = NULL; state->buffer.git_gutter_len = 0; }
         return;
     }
-    if (state->buffer.git_gutter) free(state->buffer.git_gutter);
-    state->buffer.git_gutter = malloc(state->buffer.num_lines);
-    memset(state->buffer.git_gutter, ' ', state->buffer.num_lines);
+    // Build the new gutter aside so the window is only damaged when a marker actually changed.
+    int n = state->buffer.num_lines;
+    char *gutter = malloc(n > 0 ? n : 1);
+    if (!gutter) return;
+    memset(gutter, ' ', n);
     char cmd[PATH_MAX + 100];
     snprintf(cmd, sizeof(cmd), "git diff --unified=0 \"%s\" 2>/dev/null", state->buffer.filename);
     FILE *fp = popen(cmd, "r");
-    if (!fp) return;
+    if (!fp) { free(gutter); return; }
     char line[1024];
     while (fgets(line, sizeof(line), fp)) {
         if (strncmp(line, "@@", 2) == 0) {
@@ -93,22 +96,28 @@ void editor_update_git_gutter(EditorState *state) {
             if (sscanf(plus, "+%d,%d", &new_start, &new_count) != 2) sscanf(plus, "+%d", &new_start);
             if (new_count == 0) {
                 int idx = new_start;
-                if (idx >= 0 && idx < state->buffer.num_lines) state->buffer.git_gutter[idx] = '-';
+                if (idx >= 0 && idx < n) gutter[idx] = '-';
             } else if (old_count == 0) {
                 for (int i = 0; i < new_count; i++) {
                     int idx = new_start + i - 1;
-                    if (idx >= 0 && idx < state->buffer.num_lines) state->buffer.git_gutter[idx] = '+';
+                    if (idx >= 0 && idx < n) gutter[idx] = '+';
                 }
             } else {
                 for (int i = 0; i < new_count; i++) {
                     int idx = new_start + i - 1;
-                    if (idx >= 0 && idx < state->buffer.num_lines) state->buffer.git_gutter[idx] = '~';
+                    if (idx >= 0 && idx < n) gutter[idx] = '~';
                 }
             }
         }
     }
     pclose(fp);
-    state->buffer.is_dirty = true;
+
+    bool changed = !state->buffer.git_gutter || state->buffer.git_gutter_len != n ||
+                   memcmp(state->buffer.git_gutter, gutter, n) != 0;
+    free(state->buffer.git_gutter);
+    state->buffer.git_gutter = gutter;
+    state->buffer.git_gutter_len = n;
+    if (changed) state->buffer.is_dirty = true;
 }
 
 void editor_set_status_msg(EditorState *state, const char *format, ...) {
@@ -120,63 +129,14 @@ void editor_set_status_msg(EditorState *state, const char *format, ...) {
     state->buffer.is_dirty = true;
 }
 
+// Brings the bracket index up to date. Only the lines noted by editor_note_edit()
+// are re-tokenized, and re-matching stops once nesting converges with the old state.
 void editor_find_unmatched_brackets(EditorState *state) {
-    if (state->buffer.unmatched_brackets) free(state->buffer.unmatched_brackets);
-    state->buffer.unmatched_brackets = NULL;
-    state->buffer.num_unmatched_brackets = 0;
-    typedef struct { int line; int col; char type; } BracketStackItem;
-    BracketStackItem *stack = NULL;
-    int stack_top = 0, stack_capacity = 0;
-    for (int i = 0; i < state->buffer.num_lines; i++) {
-        char *line = state->buffer.lines[i];
-        if (!line) continue;
-        bool in_string = false; char string_char = 0;
-        for (int j = 0; line[j] != '\0'; j++) {
-            if (in_string) {
-                if (line[j] == '\\') { j++; continue; }
-                if (line[j] == string_char) in_string = false;
-                continue;
-            }
-            if (line[j] == '"' || line[j] == '\'') { in_string = true; string_char = line[j]; continue; }
-            if (line[j] == '/' && line[j+1] != '\0' && line[j+1] == '/') break;
-            char c = line[j];
-            if (c == '(' || c == '[' || c == '{') {
-                if (stack_top >= stack_capacity) {
-                    stack_capacity = (stack_capacity == 0) ? 8 : stack_capacity * 2;
-                    stack = realloc(stack, stack_capacity * sizeof(BracketStackItem));
-                }
-                stack[stack_top++] = (BracketStackItem){ .line = i, .col = j, .type = c };
-            } else if (c == ')' || c == ']' || c == '}') {
-                if (stack_top > 0) {
-                    char open_bracket = stack[stack_top - 1].type;
-                    if ((c == ')' && open_bracket == '(') || (c == ']' && open_bracket == '[') || (c == '}' && open_bracket == '{')) stack_top--;
-                    else {
-                        state->buffer.num_unmatched_brackets++;
-                        state->buffer.unmatched_brackets = realloc(state->buffer.unmatched_brackets, state->buffer.num_unmatched_brackets * sizeof(BracketInfo));
-                        state->buffer.unmatched_brackets[state->buffer.num_unmatched_brackets - 1] = (BracketInfo){ .line = i, .col = j, .type = c };
-                    }
-                } else {
-                    state->buffer.num_unmatched_brackets++;
-                    state->buffer.unmatched_brackets = realloc(state->buffer.unmatched_brackets, state->buffer.num_unmatched_brackets * sizeof(BracketInfo));
-                    state->buffer.unmatched_brackets[state->buffer.num_unmatched_brackets - 1] = (BracketInfo){ .line = i, .col = j, .type = c };
-                }
-            }
-        }
-    }
-    if (stack_top > 0) {
-        int old_num = state->buffer.num_unmatched_brackets;
-        state->buffer.num_unmatched_brackets += stack_top;
-        state->buffer.unmatched_brackets = realloc(state->buffer.unmatched_brackets, state->buffer.num_unmatched_brackets * sizeof(BracketInfo));
-        for (int k = 0; k < stack_top; k++) state->buffer.unmatched_brackets[old_num + k] = (BracketInfo){ .line = stack[k].line, .col = stack[k].col, .type = stack[k].type };
-    }
-    if (stack) free(stack);
+    bracket_index_update(&state->buffer.bracket_index, state->buffer.lines, state->buffer.num_lines);
 }
 
 bool is_unmatched_bracket(EditorState *state, int line, int col) {
-    for (int i = 0; i < state->buffer.num_unmatched_brackets; i++) {
-        if (state->buffer.unmatched_brackets[i].line == line && state->buffer.unmatched_brackets[i].col == col) return true;
-    }
-    return false;
+    return bracket_index_is_unmatched(&state->buffer.bracket_index, line, col);
 }
 
 void editor_ensure_dirty_lines_capacity(EditorState *state, int required_capacity) {
@@ -196,9 +156,21 @@ void mark_line_as_dirty(EditorState *state, int line_num) {
     if (line_num >= 0 && line_num < state->buffer.num_lines) state->buffer.dirty_lines[line_num] = true;
 }
 
+// Edits are recorded for the indexes that update incrementally
+void editor_note_edit(EditorState *state, int line, int removed, int inserted) {
+    bracket_index_note_edit(&state->buffer.bracket_index, line, removed, inserted);
+    syntax_cache_note_edit(state, line);
+}
+
+void editor_note_buffer_replaced(EditorState *state) {
+    bracket_index_note_reset(&state->buffer.bracket_index);
+    syntax_cache_note_edit(state, -1);
+}
+
 void mark_all_lines_dirty(EditorState *state) {
     editor_ensure_dirty_lines_capacity(state, state->buffer.num_lines);
     for (int i = 0; i < state->buffer.num_lines; i++) state->buffer.dirty_lines[i] = true;
+    state->view.gutter.num_rows = 0; // the gutter is repainted along with the text
     state->buffer.is_dirty = true;
 }
 
@@ -319,6 +291,22 @@ void editor_jump_to_matching_bracket(EditorState *state) {
     char *line = state->buffer.lines[state->cursor.line];
     if (state->cursor.col >= (int)strlen(line)) return;
 
+    // The index is kept current by the redraw; right after an edit it may lag behind
+    int match_line, match_col;
+    int found = -1;
+    if (bracket_index_is_current(&state->buffer.bracket_index, state->buffer.num_lines)) {
+        found = bracket_index_find_match(&state->buffer.bracket_index, state->cursor.line, state->cursor.col, &match_line, &match_col);
+    }
+    if (found == 1) {
+        state->cursor.line = match_line;
+        state->cursor.col = match_col;
+        state->cursor.ideal_col = match_col;
+        return;
+    } else if (found == 0) {
+        return;
+    }
+    // Not an indexed bracket (inside a string or comment): scan for it by hand
+
     char open_char = 0, close_char = 0;
     int direction = 0;
     char current_char = line[state->cursor.col];
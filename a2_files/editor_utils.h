@@ -12,6 +12,8 @@ void editor_update_git_gutter(EditorState *state);
 void editor_ensure_dirty_lines_capacity(EditorState *state, int required_capacity);
 void mark_line_as_dirty(EditorState *state, int line_num);
 void mark_all_lines_dirty(EditorState *state);
+void editor_note_edit(EditorState *state, int line, int removed, int inserted);
+void editor_note_buffer_replaced(EditorState *state);
 
 char* trim_whitespace(char *str);
 
@@ -11,6 +11,7 @@
 #include "settings.h"
 #include "base64.h"
 #include "logger.h"
+#include "syntax_cache.h"
 
 
 #include <limits.h> // For PATH_MAX
@@ -309,6 +310,7 @@ void load_file_core(EditorState *state, const char *filename) {
     state->view.left_col = 0;
     for (int i = 0; i < state->buffer.num_lines; i++) { if(state->buffer.lines[i]) free(state->buffer.lines[i]); state->buffer.lines[i] = NULL; }
     state->buffer.num_lines = 0;
+    editor_note_buffer_replaced(state);
     strncpy(state->buffer.filename, filename, sizeof(state->buffer.filename) - 1);
     state->buffer.filename[sizeof(state->buffer.filename) - 1] = '\0';
 
@@ -335,6 +337,7 @@ void load_file_core(EditorState *state, const char *filename) {
 
     for (int i = 0; i < state->buffer.num_lines; i++) { if(state->buffer.lines[i]) free(state->buffer.lines[i]); state->buffer.lines[i] = NULL; }
     state->buffer.num_lines = 0;
+    editor_note_buffer_replaced(state);
     strncpy(state->buffer.filename, absolute_path, sizeof(state->buffer.filename) - 1);
     state->buffer.filename[sizeof(state->buffer.filename) - 1] = '\0';
     
@@ -709,6 +712,16 @@ void editor_reload_file(EditorState *state) {
 }
 
 void load_syntax_file(EditorState *state, const char *filename) {
+    syntax_cache_invalidate(state);
+
+    // C-style comments unless the syntax file names its own
+    SyntaxComments *comments = &state->buffer.comments;
+    memset(comments, 0, sizeof(*comments));
+    strcpy(comments->line[0], "//");
+    strcpy(comments->block_start, "/*");
+    strcpy(comments->block_end, "*/");
+    bool custom_comments = false;
+
     // Clear existing syntax rules before loading new ones
     if (state->buffer.syntax_rules) {
         for (int i = 0; i < state->buffer.num_syntax_rules; i++) {
@@ -768,6 +781,25 @@ void load_syntax_file(EditorState *state, const char *filename) {
 
         if (strlen(type_str) == 0 || strlen(word_str) == 0) continue;
 
+        // LINE_COMMENT:# (up to two) and BLOCK_COMMENT:/* */
+        if (strcmp(type_str, "LINE_COMMENT") == 0 || strcmp(type_str, "BLOCK_COMMENT") == 0) {
+            if (!custom_comments) {
+                memset(comments, 0, sizeof(*comments));
+                custom_comments = true;
+            }
+            if (type_str[0] == 'L') {
+                int slot = comments->line[0][0] ? 1 : 0;
+                snprintf(comments->line[slot], MAX_COMMENT_TOKEN, "%s", word_str);
+            } else {
+                char start[MAX_COMMENT_TOKEN], end[MAX_COMMENT_TOKEN];
+                if (sscanf(word_str, "%7s %7s", start, end) == 2) {
+                    strcpy(comments->block_start, start);
+                    strcpy(comments->block_end, end);
+                }
+            }
+            continue;
+        }
+
         state->buffer.num_syntax_rules++;
         state->buffer.syntax_rules = realloc(state->buffer.syntax_rules, sizeof(SyntaxRule) * state->buffer.num_syntax_rules);
         
@@ -937,6 +969,7 @@ void handle_file_recovery(EditorState *state, const char *original_filename, con
                 editor_set_status_msg(state, "");
                 state->buffer.num_lines = 1;
                 state->buffer.lines[0] = calloc(1, 1);
+                editor_note_buffer_replaced(state);
                 strcpy(state->buffer.filename, "[No Name]");
                 return;
         }
@@ -0,0 +1,147 @@
+#include "frame_scheduler.h"
+#include <time.h>
+
+#define FRAME_POLL_MS 50 // Debouncers and async results are polled at this rate
+
+static struct timespec last_frame;
+static bool present_pending = false;
+static time_t last_clock_second = 0;
+
+static Workspace *last_ws = NULL;
+static int last_num_windows = -1;
+static int last_active_idx = -1;
+static bool last_floating_visible = false;
+static int last_lines = -1, last_cols = -1;
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static long frame_interval_ms(void) {
+    int fps = global_config.max_fps > 0 ? global_config.max_fps : 60;
+    return 1000 / fps;
+}
+
+void frame_damage_window(EditorWindow *jw) {
+    if (!jw) return;
+    switch (jw->type) {
+        case WINDOW_TYPE_EDITOR:
+            if (jw->state) jw->state->buffer.is_dirty = true;
+            break;
+        case WINDOW_TYPE_EXPLORER:
+            if (jw->explorer_state) jw->explorer_state->is_dirty = true;
+            break;
+        case WINDOW_TYPE_HELP:
+            if (jw->help_state) jw->help_state->is_dirty = true;
+            break;
+        case WINDOW_TYPE_SETTINGS_PANEL:
+            if (jw->settings_state) jw->settings_state->is_dirty = true;
+            break;
+        case WINDOW_TYPE_TERMINAL:
+            jw->term.dirty = true;
+            break;
+    }
+}
+
+void frame_damage_workspace(Workspace *ws) {
+    if (!ws) return;
+    for (int i = 0; i < ws->num_windows; i++) {
+        frame_damage_window(ws->windows[i]);
+    }
+    if (ws->floating_term) ws->floating_term->term.dirty = true;
+}
+
+void frame_damage_status(EditorState *state) {
+    if (state) state->view.status_dirty = true;
+}
+
+void frame_request_present(void) {
+    present_pending = true;
+}
+
+bool frame_window_has_damage(EditorWindow *jw) {
+    if (!jw) return false;
+    switch (jw->type) {
+        case WINDOW_TYPE_EDITOR:
+            return jw->state && (jw->state->buffer.is_dirty || jw->state->view.status_dirty);
+        case WINDOW_TYPE_EXPLORER:
+            return jw->explorer_state && jw->explorer_state->is_dirty;
+        case WINDOW_TYPE_HELP:
+            return jw->help_state && jw->help_state->is_dirty;
+        case WINDOW_TYPE_SETTINGS_PANEL:
+            return jw->settings_state && jw->settings_state->is_dirty;
+        case WINDOW_TYPE_TERMINAL:
+            return jw->term.dirty;
+    }
+    return false;
+}
+
+bool frame_has_damage(void) {
+    if (workspace_manager.num_workspaces == 0) return false;
+    Workspace *ws = ACTIVE_WS;
+    for (int i = 0; i < ws->num_windows; i++) {
+        if (frame_window_has_damage(ws->windows[i])) return true;
+    }
+    if (ws->floating_term && ws->floating_terminal_visible && ws->floating_term->term.dirty) return true;
+    return false;
+}
+
+void frame_clock_tick(void) {
+    time_t now = time(NULL);
+    if (now == last_clock_second) return;
+    last_clock_second = now;
+    if (workspace_manager.num_workspaces == 0) return;
+
+    // Only the style 1 status bar shows a clock; nothing else depends on wall time.
+    Workspace *ws = ACTIVE_WS;
+    for (int i = 0; i < ws->num_windows; i++) {
+        EditorWindow *jw = ws->windows[i];
+        if (jw->type == WINDOW_TYPE_EDITOR && jw->state && jw->state->view.status_bar_mode == 1) {
+            frame_damage_status(jw->state);
+        }
+    }
+}
+
+void frame_check_layout(Workspace *ws) {
+    if (!ws) return;
+    if (ws != last_ws || ws->num_windows != last_num_windows || ws->active_window_idx != last_active_idx ||
+        ws->floating_terminal_visible != last_floating_visible || LINES != last_lines || COLS != last_cols) {
+        frame_damage_workspace(ws);
+        last_ws = ws;
+        last_num_windows = ws->num_windows;
+        last_active_idx = ws->active_window_idx;
+        last_floating_visible = ws->floating_terminal_visible;
+        last_lines = LINES;
+        last_cols = COLS;
+    }
+}
+
+bool frame_should_render(void) {
+    if (!present_pending && !frame_has_damage()) return false;
+    long long last = (long long)last_frame.tv_sec * 1000LL + last_frame.tv_nsec / 1000000;
+    return now_ms() - last >= frame_interval_ms();
+}
+
+void frame_rendered(void) {
+    clock_gettime(CLOCK_MONOTONIC, &last_frame);
+    present_pending = false;
+}
+
+void frame_next_timeout(struct timeval *tv, bool timers_pending) {
+    long wait_ms;
+    if (present_pending || frame_has_damage()) {
+        long long last = (long long)last_frame.tv_sec * 1000LL + last_frame.tv_nsec / 1000000;
+        wait_ms = (long)(last + frame_interval_ms() - now_ms());
+        if (wait_ms < 0) wait_ms = 0;
+    } else {
+        // Idle: wake up on the next second boundary for the clock and housekeeping.
+        struct timespec rt;
+        clock_gettime(CLOCK_REALTIME, &rt);
+        wait_ms = 1000 - rt.tv_nsec / 1000000;
+    }
+    if (timers_pending && wait_ms > FRAME_POLL_MS) wait_ms = FRAME_POLL_MS;
+    tv->tv_sec = wait_ms / 1000;
+    tv->tv_usec = (wait_ms % 1000) * 1000;
+}
@@ -0,0 +1,33 @@
+#ifndef FRAME_SCHEDULER_H
+#define FRAME_SCHEDULER_H
+
+#include "defs.h"
+#include <sys/time.h>
+
+// Damage is posted to the windows that changed (the existing is_dirty flags,
+// term.dirty and view.status_dirty). The main loop only renders when some
+// window in the active workspace is damaged, at most global_config.max_fps
+// times per second.
+
+void frame_damage_window(EditorWindow *jw);
+void frame_damage_workspace(Workspace *ws);
+void frame_damage_status(EditorState *state);
+void frame_request_present(void);
+
+bool frame_window_has_damage(EditorWindow *jw);
+bool frame_has_damage(void);
+
+// Posts status bar damage to clock-showing editors when the second changes.
+void frame_clock_tick(void);
+
+// Focus, split count or workspace changes repaint every border of the workspace.
+void frame_check_layout(Workspace *ws);
+
+bool frame_should_render(void);
+void frame_rendered(void);
+
+// select() timeout: the rest of the frame interval when damage is pending,
+// a short poll while timers are pending, otherwise sleep until the next second.
+void frame_next_timeout(struct timeval *tv, bool timers_pending);
+
+#endif // FRAME_SCHEDULER_H
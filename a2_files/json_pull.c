@@ -0,0 +1,244 @@
+#include "json_pull.h"
+#include <stdlib.h>
+#include <string.h>
+
+void json_pull_init(JsonPull *jp, const char *json, size_t len) {
+    jp->p = json;
+    jp->end = json + len;
+    jp->error = json == NULL;
+}
+
+static void skip_ws(JsonPull *jp) {
+    while (jp->p < jp->end && (*jp->p == ' ' || *jp->p == '\t' || *jp->p == '\n' || *jp->p == '\r')) jp->p++;
+}
+
+static bool fail(JsonPull *jp) {
+    jp->error = true;
+    return false;
+}
+
+JsonPullType json_pull_peek(JsonPull *jp) {
+    skip_ws(jp);
+    if (jp->error || jp->p >= jp->end) return JSON_PULL_ERROR;
+    switch (*jp->p) {
+        case '{': return JSON_PULL_OBJECT;
+        case '[': return JSON_PULL_ARRAY;
+        case '"': return JSON_PULL_STRING;
+        case 't': return JSON_PULL_TRUE;
+        case 'f': return JSON_PULL_FALSE;
+        case 'n': return JSON_PULL_NULL;
+        default:
+            if (*jp->p == '-' || (*jp->p >= '0' && *jp->p <= '9')) return JSON_PULL_NUMBER;
+            return JSON_PULL_ERROR;
+    }
+}
+
+// Moves past the closing quote of the string starting at p
+static bool skip_string(JsonPull *jp) {
+    const char *p = jp->p + 1;
+    while (p < jp->end) {
+        const char *q = memchr(p, '"', jp->end - p);
+        if (!q) break;
+        // The quote is escaped if an odd number of backslashes precede it
+        const char *b = q;
+        while (b > p && b[-1] == '\\') b--;
+        p = q + 1;
+        if ((q - b) % 2 == 0) {
+            jp->p = p;
+            return true;
+        }
+    }
+    return fail(jp);
+}
+
+// Moves past the bracket closing the current container, depth levels up
+static void skip_to_close(JsonPull *jp, int depth) {
+    while (jp->p < jp->end) {
+        char c = *jp->p;
+        if (c == '"') {
+            if (!skip_string(jp)) return;
+            continue;
+        }
+        jp->p++;
+        if (c == '{' || c == '[') depth++;
+        else if ((c == '}' || c == ']') && --depth == 0) return;
+    }
+    fail(jp);
+}
+
+void json_pull_skip(JsonPull *jp) {
+    switch (json_pull_peek(jp)) {
+        case JSON_PULL_ERROR:
+            fail(jp);
+            break;
+        case JSON_PULL_STRING:
+            skip_string(jp);
+            break;
+        case JSON_PULL_OBJECT:
+        case JSON_PULL_ARRAY:
+            skip_to_close(jp, 0);
+            break;
+        default: // number or literal
+            while (jp->p < jp->end && !strchr(",]} \t\r\n", *jp->p)) jp->p++;
+            break;
+    }
+}
+
+void json_pull_leave(JsonPull *jp) {
+    if (!jp->error) skip_to_close(jp, 1);
+}
+
+bool json_pull_enter_object(JsonPull *jp) {
+    if (json_pull_peek(jp) != JSON_PULL_OBJECT) return false;
+    jp->p++;
+    return true;
+}
+
+bool json_pull_enter_array(JsonPull *jp) {
+    if (json_pull_peek(jp) != JSON_PULL_ARRAY) return false;
+    jp->p++;
+    return true;
+}
+
+// Consumes the separator before the next member or element; false at the closing bracket
+static bool next_entry(JsonPull *jp, char close) {
+    skip_ws(jp);
+    if (jp->error || jp->p >= jp->end) return fail(jp);
+    if (*jp->p == close) {
+        jp->p++;
+        return false;
+    }
+    if (*jp->p == ',') {
+        jp->p++;
+        skip_ws(jp);
+    }
+    return true;
+}
+
+bool json_pull_next_key(JsonPull *jp, char *key, size_t key_size) {
+    if (!next_entry(jp, '}')) return false;
+    if (jp->p >= jp->end || *jp->p != '"') return fail(jp);
+    const char *start = jp->p + 1;
+    if (!skip_string(jp)) return false;
+    // Keys we look for have no escapes; they are copied as written
+    size_t len = jp->p - 1 - start;
+    if (key_size > 0) {
+        if (len >= key_size) len = key_size - 1;
+        memcpy(key, start, len);
+        key[len] = '\0';
+    }
+    skip_ws(jp);
+    if (jp->p >= jp->end || *jp->p != ':') return fail(jp);
+    jp->p++;
+    return true;
+}
+
+bool json_pull_find_key(JsonPull *jp, const char *key) {
+    char name[64];
+    while (json_pull_next_key(jp, name, sizeof(name))) {
+        if (strcmp(name, key) == 0) return true;
+        json_pull_skip(jp);
+    }
+    return false;
+}
+
+bool json_pull_next_item(JsonPull *jp) {
+    return next_entry(jp, ']');
+}
+
+static int hex_value(const char *p) {
+    int value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') value |= c - '0';
+        else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+        else return -1;
+    }
+    return value;
+}
+
+static char *put_utf8(char *out, unsigned cp) {
+    if (cp < 0x80) {
+        *out++ = cp;
+    } else if (cp < 0x800) {
+        *out++ = 0xC0 | (cp >> 6);
+        *out++ = 0x80 | (cp & 0x3F);
+    } else if (cp < 0x10000) {
+        *out++ = 0xE0 | (cp >> 12);
+        *out++ = 0x80 | ((cp >> 6) & 0x3F);
+        *out++ = 0x80 | (cp & 0x3F);
+    } else {
+        *out++ = 0xF0 | (cp >> 18);
+        *out++ = 0x80 | ((cp >> 12) & 0x3F);
+        *out++ = 0x80 | ((cp >> 6) & 0x3F);
+        *out++ = 0x80 | (cp & 0x3F);
+    }
+    return out;
+}
+
+char *json_pull_string(JsonPull *jp) {
+    if (json_pull_peek(jp) != JSON_PULL_STRING) {
+        json_pull_skip(jp);
+        return NULL;
+    }
+    const char *start = jp->p + 1;
+    if (!skip_string(jp)) return NULL;
+    const char *end = jp->p - 1;
+
+    // Unescaping never makes the text longer
+    char *value = malloc(end - start + 1);
+    if (!value) return NULL;
+    char *out = value;
+    for (const char *p = start; p < end; p++) {
+        if (*p != '\\' || p + 1 >= end) {
+            *out++ = *p;
+            continue;
+        }
+        p++;
+        switch (*p) {
+            case 'n': *out++ = '\n'; break;
+            case 't': *out++ = '\t'; break;
+            case 'r': *out++ = '\r'; break;
+            case 'b': *out++ = '\b'; break;
+            case 'f': *out++ = '\f'; break;
+            case 'u': {
+                int cp = end - p > 4 ? hex_value(p + 1) : -1;
+                if (cp < 0) {
+                    *out++ = '?';
+                    break;
+                }
+                p += 4;
+                // A surrogate pair encodes one code point above U+FFFF
+                if (cp >= 0xD800 && cp < 0xDC00 && end - p > 6 && p[1] == '\\' && p[2] == 'u') {
+                    int low = hex_value(p + 3);
+                    if (low >= 0xDC00 && low < 0xE000) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        p += 6;
+                    }
+                }
+                out = put_utf8(out, cp);
+                break;
+            }
+            default: *out++ = *p; break; // \" \\ \/
+        }
+    }
+    *out = '\0';
+    return value;
+}
+
+bool json_pull_int(JsonPull *jp, long long *out) {
+    if (json_pull_peek(jp) != JSON_PULL_NUMBER) {
+        json_pull_skip(jp);
+        return false;
+    }
+    char digits[32];
+    size_t len = 0;
+    const char *p = jp->p;
+    while (p < jp->end && len < sizeof(digits) - 1 && !strchr(",]} \t\r\n", *p)) digits[len++] = *p++;
+    digits[len] = '\0';
+    json_pull_skip(jp);
+    *out = strtoll(digits, NULL, 10);
+    return true;
+}
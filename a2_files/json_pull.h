@@ -0,0 +1,56 @@
+#ifndef JSON_PULL_H
+#define JSON_PULL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Pull-style reader over JSON text, for large server messages where only a few
+// fields matter. Nothing is built: the caller walks objects and arrays in
+// order, reads the values it wants and skips the rest, and can stop at any
+// point (e.g. after the first N completion items) without scanning further.
+//
+// Every value must be consumed (read, entered or skipped) before asking for
+// the next key or item. Malformed input sets error and every call then fails.
+
+typedef enum {
+    JSON_PULL_ERROR,
+    JSON_PULL_OBJECT,
+    JSON_PULL_ARRAY,
+    JSON_PULL_STRING,
+    JSON_PULL_NUMBER,
+    JSON_PULL_TRUE,
+    JSON_PULL_FALSE,
+    JSON_PULL_NULL
+} JsonPullType;
+
+typedef struct {
+    const char *p, *end;
+    bool error;
+} JsonPull;
+
+void json_pull_init(JsonPull *jp, const char *json, size_t len);
+
+// Type of the next value, without consuming it
+JsonPullType json_pull_peek(JsonPull *jp);
+
+// Steps inside an object or array; false (and nothing consumed) for any other value
+bool json_pull_enter_object(JsonPull *jp);
+bool json_pull_enter_array(JsonPull *jp);
+
+// Next member of the current object, its key copied into key (truncated to
+// fit). False at the end of the object, which is then consumed.
+bool json_pull_next_key(JsonPull *jp, char *key, size_t key_size);
+// Skips members up to the one named key; false if the object has none
+bool json_pull_find_key(JsonPull *jp, const char *key);
+// Next element of the current array; false at its end, which is then consumed
+bool json_pull_next_item(JsonPull *jp);
+// Skips the rest of the current object or array, including its closing bracket
+void json_pull_leave(JsonPull *jp);
+
+void json_pull_skip(JsonPull *jp);
+// The string value unescaped (caller frees), NULL if the value isn't a string (it is skipped)
+char *json_pull_string(JsonPull *jp);
+// Integer value; false if the value isn't a number (it is skipped)
+bool json_pull_int(JsonPull *jp, long long *out);
+
+#endif // JSON_PULL_H
@@ -0,0 +1,107 @@
+#include "line_cache.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define LINE_HASH_MUL 0x9E3779B97F4A7C15ULL
+
+static inline uint64_t mix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t line_version(const char *line) {
+    if (!line) return 0;
+    size_t len = strlen(line);
+    uint64_t h = len * LINE_HASH_MUL;
+    const char *p = line;
+
+    // Eight bytes at a time; memcpy keeps it safe on unaligned pointers
+    while (len >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        h = (h ^ mix64(w)) * LINE_HASH_MUL;
+        p += 8;
+        len -= 8;
+    }
+    if (len > 0) {
+        uint64_t w = 0;
+        memcpy(&w, p, len);
+        h = (h ^ mix64(w)) * LINE_HASH_MUL;
+    }
+    // Never 0, so a zeroed slot can't match an empty line by accident
+    return mix64(h) | 1;
+}
+
+static bool line_cache_reserve(LineSpanCache *cache, int line_idx) {
+    if (line_idx < cache->num_slots) return true;
+    int new_size = cache->num_slots > 0 ? cache->num_slots : 64;
+    while (new_size <= line_idx) new_size *= 2;
+    LineSpanSlot *slots = realloc(cache->slots, sizeof(LineSpanSlot) * new_size);
+    if (!slots) return false;
+    memset(slots + cache->num_slots, 0, sizeof(LineSpanSlot) * (new_size - cache->num_slots));
+    cache->slots = slots;
+    cache->num_slots = new_size;
+    return true;
+}
+
+LineSpanSlot *line_cache_lookup(LineSpanCache *cache, int line_idx, const char *line, uint64_t aux) {
+    if (!cache || line_idx < 0 || line_idx >= cache->num_slots) return NULL;
+    LineSpanSlot *slot = &cache->slots[line_idx];
+    if (!slot->valid || slot->aux != aux) return NULL;
+    if (slot->version != line_version(line)) return NULL;
+    return slot;
+}
+
+LineSpanSlot *line_cache_begin(LineSpanCache *cache, int line_idx, const char *line, uint64_t aux) {
+    return line_cache_begin_version(cache, line_idx, line_version(line), aux);
+}
+
+LineSpanSlot *line_cache_begin_version(LineSpanCache *cache, int line_idx, uint64_t version, uint64_t aux) {
+    if (!cache || line_idx < 0 || !line_cache_reserve(cache, line_idx)) return NULL;
+    LineSpanSlot *slot = &cache->slots[line_idx];
+    slot->version = version;
+    slot->aux = aux;
+    slot->count = 0;
+    slot->end_state = 0;
+    slot->valid = true;
+    return slot;
+}
+
+void line_cache_push(LineSpanSlot *slot, int start, int end, int style) {
+    if (!slot) return;
+    if (slot->count == slot->cap) {
+        int new_cap = slot->cap > 0 ? slot->cap * 2 : 4;
+        LineSpan *spans = realloc(slot->spans, sizeof(LineSpan) * new_cap);
+        if (!spans) return;
+        slot->spans = spans;
+        slot->cap = new_cap;
+    }
+    slot->spans[slot->count++] = (LineSpan){ start, end, style };
+}
+
+int line_cache_find_span(const LineSpanSlot *slot, int pos) {
+    if (!slot) return -1;
+    int lo = 0, hi = slot->count - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (pos < slot->spans[mid].start) hi = mid - 1;
+        else if (pos >= slot->spans[mid].end) lo = mid + 1;
+        else return mid;
+    }
+    return -1;
+}
+
+void line_cache_invalidate(LineSpanCache *cache) {
+    if (!cache) return;
+    for (int i = 0; i < cache->num_slots; i++) cache->slots[i].valid = false;
+}
+
+void line_cache_free(LineSpanCache *cache) {
+    if (!cache) return;
+    for (int i = 0; i < cache->num_slots; i++) free(cache->slots[i].spans);
+    free(cache->slots);
+    cache->slots = NULL;
+    cache->num_slots = 0;
+}
@@ -0,0 +1,51 @@
+#ifndef LINE_CACHE_H
+#define LINE_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Per-line cache of byte spans (search matches, misspellings, styles...).
+// Buffer lines are edited in place from many places, so a slot is keyed by a
+// hash of the line's content (its "version") instead of an edit counter: a
+// slot whose line changed simply misses and gets recomputed.
+
+typedef struct {
+    int start;  // byte offset, inclusive
+    int end;    // byte offset, exclusive
+    int style;  // meaning depends on the cache owner (color pair, flags...)
+} LineSpan;
+
+typedef struct {
+    uint64_t version; // line_version() of the text the spans were computed from
+    uint64_t aux;     // owner-defined key (query generation, dictionary...)
+    bool valid;
+    int end_state;    // owner-defined state after the line (lexer state...)
+    LineSpan *spans;
+    int count;
+    int cap;
+} LineSpanSlot;
+
+typedef struct {
+    LineSpanSlot *slots;
+    int num_slots;
+} LineSpanCache;
+
+// Fast content hash of a line, used as its version
+uint64_t line_version(const char *line);
+
+// Returns the slot if it was computed from this exact text and aux, NULL otherwise
+LineSpanSlot *line_cache_lookup(LineSpanCache *cache, int line_idx, const char *line, uint64_t aux);
+
+// Clears the slot for line_idx and keys it to the given text, ready for line_cache_push
+LineSpanSlot *line_cache_begin(LineSpanCache *cache, int line_idx, const char *line, uint64_t aux);
+// Same, for spans computed elsewhere from a copy whose version is already known
+LineSpanSlot *line_cache_begin_version(LineSpanCache *cache, int line_idx, uint64_t version, uint64_t aux);
+
+void line_cache_push(LineSpanSlot *slot, int start, int end, int style);
+
+// Index of the span containing byte pos (spans sorted and disjoint), -1 if none
+int line_cache_find_span(const LineSpanSlot *slot, int pos);
+void line_cache_invalidate(LineSpanCache *cache);
+void line_cache_free(LineSpanCache *cache);
+
+#endif // LINE_CACHE_H
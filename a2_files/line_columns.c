@@ -0,0 +1,109 @@
+#include "line_columns.h"
+#include "line_cache.h"
+#include "defs.h"
+#include "utf8.h"
+#include <stdlib.h>
+#include <string.h>
+
+static inline int column_step(const char *line, int i, int *col) {
+    return utf8_column_step(line, i, col, TAB_SIZE);
+}
+
+int visual_col_advance(const char *line, int from_byte, int from_col, int to_byte) {
+    return utf8_columns_advance(line, from_byte, from_col, to_byte, TAB_SIZE);
+}
+
+// Checkpoints of a long line, rebuilt when its text changed; NULL for short lines
+static LineColumns *line_columns_get(LineColumnIndex *ci, int line_idx, const char *line, int len) {
+    if (!ci || line_idx < 0 || len < COLUMN_CHECKPOINT_STRIDE) return NULL;
+    if (line_idx >= ci->num_lines) {
+        int new_size = ci->num_lines > 0 ? ci->num_lines : 64;
+        while (new_size <= line_idx) new_size *= 2;
+        LineColumns *lines = realloc(ci->lines, sizeof(LineColumns) * new_size);
+        if (!lines) return NULL;
+        memset(lines + ci->num_lines, 0, sizeof(LineColumns) * (new_size - ci->num_lines));
+        ci->lines = lines;
+        ci->num_lines = new_size;
+    }
+
+    LineColumns *lc = &ci->lines[line_idx];
+    uint64_t version = line_version(line);
+    if (lc->version == version && lc->count > 0) return lc;
+
+    lc->version = version;
+    lc->count = 0;
+    int col = 0, next = 0;
+    for (int i = 0; i < len; ) {
+        if (i >= next) {
+            if (lc->count == lc->cap) {
+                int new_cap = lc->cap > 0 ? lc->cap * 2 : len / COLUMN_CHECKPOINT_STRIDE + 1;
+                ColumnCheckpoint *points = realloc(lc->points, sizeof(ColumnCheckpoint) * new_cap);
+                if (!points) { lc->version = 0; return NULL; }
+                lc->points = points;
+                lc->cap = new_cap;
+            }
+            lc->points[lc->count++] = (ColumnCheckpoint){ i, col };
+            next = i + COLUMN_CHECKPOINT_STRIDE;
+        }
+        size_t run = utf8_ascii_run(line + i, (next < len ? next : len) - i);
+        if (run > 0) {
+            i += run;
+            col += run;
+            continue;
+        }
+        i += column_step(line, i, &col);
+    }
+    return lc;
+}
+
+int line_visual_col(LineColumnIndex *ci, int line_idx, const char *line, int byte_col) {
+    if (!line) return 0;
+    int len = strlen(line);
+    if (byte_col > len) byte_col = len;
+    LineColumns *lc = line_columns_get(ci, line_idx, line, len);
+    if (!lc) return visual_col_advance(line, 0, 0, byte_col);
+
+    // Last checkpoint at or before byte_col
+    int lo = 0, hi = lc->count - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (lc->points[mid].byte <= byte_col) lo = mid;
+        else hi = mid - 1;
+    }
+    return visual_col_advance(line, lc->points[lo].byte, lc->points[lo].col, byte_col);
+}
+
+int line_byte_at_col(LineColumnIndex *ci, int line_idx, const char *line, int col, int *col_at) {
+    int i = 0, c = 0;
+    if (line) {
+        int len = strlen(line);
+        LineColumns *lc = line_columns_get(ci, line_idx, line, len);
+        if (lc) {
+            // Last checkpoint at or before col
+            int lo = 0, hi = lc->count - 1;
+            while (lo < hi) {
+                int mid = (lo + hi + 1) / 2;
+                if (lc->points[mid].col <= col) lo = mid;
+                else hi = mid - 1;
+            }
+            i = lc->points[lo].byte;
+            c = lc->points[lo].col;
+        }
+        while (c < col && i < len) {
+            size_t run = utf8_ascii_run(line + i, min(col - c, len - i));
+            i += run;
+            c += run;
+            if (c < col && i < len) i += column_step(line, i, &c);
+        }
+    }
+    if (col_at) *col_at = c;
+    return i;
+}
+
+void line_columns_free(LineColumnIndex *ci) {
+    if (!ci) return;
+    for (int i = 0; i < ci->num_lines; i++) free(ci->lines[i].points);
+    free(ci->lines);
+    ci->lines = NULL;
+    ci->num_lines = 0;
+}
@@ -0,0 +1,45 @@
+#ifndef LINE_COLUMNS_H
+#define LINE_COLUMNS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Byte offset <-> visual column mapping for long lines.
+// Lines longer than COLUMN_CHECKPOINT_STRIDE get a checkpoint (byte offset and
+// the visual column it starts at) every STRIDE bytes, built once per version
+// of the line. A lookup starts from the nearest checkpoint, so it costs at
+// most one stride plus the distance to the target instead of the whole prefix.
+// Shorter lines are measured directly.
+
+#define COLUMN_CHECKPOINT_STRIDE 1024
+
+typedef struct {
+    int byte;
+    int col;
+} ColumnCheckpoint;
+
+typedef struct {
+    uint64_t version; // line_version() of the measured text, 0 when unused
+    ColumnCheckpoint *points;
+    int count;
+    int cap;
+} LineColumns;
+
+typedef struct {
+    LineColumns *lines;
+    int num_lines;
+} LineColumnIndex;
+
+// Visual column reached after measuring line[from_byte, to_byte) starting at from_col
+int visual_col_advance(const char *line, int from_byte, int from_col, int to_byte);
+
+// Visual column of byte_col in the line
+int line_visual_col(LineColumnIndex *ci, int line_idx, const char *line, int byte_col);
+
+// First character boundary at or past visual column col (the line length if the line is shorter).
+// col_at, if not NULL, receives the column that boundary starts at.
+int line_byte_at_col(LineColumnIndex *ci, int line_idx, const char *line, int col, int *col_at);
+
+void line_columns_free(LineColumnIndex *ci);
+
+#endif // LINE_COLUMNS_H
@@ -6,6 +6,10 @@
 #include "project.h"
 #include "logger.h"
 #include "lsp_watchdog.h"
+#include "lsp_transport.h"
+#include "lsp_pool.h"
+#include "lsp_semantic.h"
+#include "json_pull.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -27,16 +31,40 @@
 // Forward declaration to resolve implicit declaration warning
 void get_word_at_cursor(EditorState *state, char *buffer, size_t buffer_size);
 
-// Function to convert byte column to character column, considering UTF-8
-int get_character_col_from_byte(const char *line, int byte_col) {
-    if (!line) return 0;
-    int char_col = 0;
+static const char *buffer_line(EditorState *state, int i) {
+    const char *line = state->buffer.lines[i];
+    return line ? line : "";
+}
+
+// Line i of the buffer, or "" for a line the buffer does not have
+static const char *lsp_line_at(EditorState *state, int i) {
+    return i >= 0 && i < state->buffer.num_lines ? buffer_line(state, i) : "";
+}
+
+// LSP positions count UTF-16 code units
+static int lsp_utf16_col(const char *line, int byte_col) {
+    int col = 0;
     for (int i = 0; i < byte_col && line[i] != '\0'; i++) {
-        if ((line[i] & 0xC0) != 0x80) {
-            char_col++;
-        }
+        unsigned char c = line[i];
+        if ((c & 0xC0) != 0x80) col += c >= 0xF0 ? 2 : 1;
+    }
+    return col;
+}
+
+// Byte column of a UTF-16 column from the server, on a character boundary;
+// past the end of the line gives its length
+static int lsp_byte_col(const char *line, int utf16_col) {
+    int byte = 0, col = 0;
+    while (line[byte] != '\0' && col < utf16_col) {
+        col += (unsigned char)line[byte] >= 0xF0 ? 2 : 1; // beyond the BMP: a surrogate pair
+        byte++;
+        while ((line[byte] & 0xC0) == 0x80) byte++;
     }
-    return char_col;
+    return byte;
+}
+
+static int lsp_cursor_utf16(EditorState *state) {
+    return lsp_utf16_col(lsp_line_at(state, state->cursor.line), state->cursor.col);
 }
 
 #ifndef max
@@ -172,35 +200,221 @@ char* lsp_serialize_message(LspMessage *msg) {
     return json_str;
 }
 
-// Parses LSP diagnostics
-void lsp_parse_diagnostics(EditorState *state, const char *json_response) {
-    lsp_log("=== START DIAGNOSTICS PARSING ===\n");
-    lsp_log("JSON received: %s\n", json_response);
-    
-    LspMessage *msg = lsp_parse_message(json_response);
-    if (!msg) {
-        lsp_log("Failed to parse JSON message\n");
-        return;
+typedef enum {
+    LSP_REQ_INITIALIZE,
+    LSP_REQ_SHUTDOWN,
+    LSP_REQ_DEFINITION,
+    LSP_REQ_COMPLETION,
+    LSP_REQ_SYMBOLS,
+    LSP_REQ_CODE_ACTION,
+    LSP_REQ_SEMANTIC_FULL,  // full or full/delta
+    LSP_REQ_SEMANTIC_RANGE
+} LspRequestKind;
+
+#define LSP_REQUEST_TIMEOUT_MS 10000
+#define LSP_COMPLETION_TIMEOUT_MS 5000
+#define LSP_SEMANTIC_RETRY_MS 1000
+
+static long long lsp_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static void lsp_on_initialize(LspClient *client, LspMessage *msg);
+static void lsp_on_definition(EditorState *state, LspMessage *msg, const char *json_message);
+static void lsp_on_document_symbols(EditorState *state, LspMessage *msg, const char *json_message);
+static void lsp_on_code_actions(EditorState *state, LspMessage *msg, const char *json_message);
+static void lsp_on_semantic_tokens(EditorState *state, LspMessage *msg, const char *json_message);
+static void lsp_on_semantic_range(EditorState *state, LspMessage *msg, const char *json_message);
+static void lsp_send_writer(EditorState *state, LspWriter *w, const char *what);
+static bool lsp_take_document(EditorState *state);
+static void lsp_snapshot_free(LspDocumentState *doc);
+
+// Tells the server to stop working on pending[index] and forgets it
+static void lsp_cancel_request(LspClient *client, int index) {
+    char cancel_buf[128];
+    snprintf(cancel_buf, sizeof(cancel_buf),
+             "{\"jsonrpc\":\"2.0\",\"method\":\"$/cancelRequest\",\"params\":{\"id\":%ld}}", client->pending[index].id);
+    lsp_transport_send(client->transport, cancel_buf, strlen(cancel_buf));
+    client->pending[index] = client->pending[--client->num_pending];
+}
+
+// Sends a request under a fresh id and remembers how to handle its response.
+// A request of the same kind from the same editor still in flight is cancelled
+// first. owner is NULL for the server's own requests (initialize, shutdown).
+// Takes params.
+static void lsp_send_request(LspClient *client, EditorState *owner, int kind, const char *method, json_t *params,
+                             LspResponseHandler handler, int timeout_ms, bool at_cursor) {
+    for (int i = client->num_pending - 1; i >= 0; i--) {
+        if (client->pending[i].kind == kind && client->pending[i].owner == owner) lsp_cancel_request(client, i);
+    }
+
+    if (client->num_pending == client->pending_cap) {
+        int new_cap = client->pending_cap > 0 ? client->pending_cap * 2 : 8;
+        LspPendingRequest *pending = realloc(client->pending, sizeof(LspPendingRequest) * new_cap);
+        if (!pending) {
+            json_decref(params);
+            return;
+        }
+        client->pending = pending;
+        client->pending_cap = new_cap;
+    }
+    long id = ++client->next_request_id;
+    client->pending[client->num_pending++] = (LspPendingRequest){
+        .id = id,
+        .kind = kind,
+        .handler = handler,
+        .owner = owner,
+        .deadline_ms = timeout_ms > 0 ? lsp_now_ms() + timeout_ms : 0,
+        .at_cursor = at_cursor && owner,
+        .line = owner ? owner->cursor.line : 0,
+        .col = owner ? owner->cursor.col : 0,
+    };
+    // A completion list stays good while the user types on into its word
+    LspPendingRequest *req = &client->pending[client->num_pending - 1];
+    if (kind == LSP_REQ_COMPLETION && owner) {
+        req->col = owner->input.completion_start_col;
+        if (!editor_completion_word(owner, req->prefix, sizeof(req->prefix))) req->prefix[0] = '\0';
+    }
+
+    char id_buf[32];
+    snprintf(id_buf, sizeof(id_buf), "%ld", id);
+    LspMessage *msg = lsp_create_message();
+    msg->id = strdup(id_buf);
+    msg->method = strdup(method);
+    msg->params = params;
+    char *json_str = lsp_serialize_message(msg);
+    if (json_str) {
+        lsp_log("Sending request: %s\n", json_str);
+        lsp_transport_send(client->transport, json_str, strlen(json_str));
+        free(json_str);
     }
-    
-    if (!msg->params) {
-        lsp_log("No params in message\n");
-        lsp_free_message(msg);
-        return;
+    lsp_free_message(msg);
+}
+
+// Whether the answer is tied to a cursor position the user already left. A
+// completion list only needs the cursor still in the word it was asked for,
+// with that word typed on, not erased.
+static bool lsp_request_stale(const LspPendingRequest *req, EditorState *owner) {
+    if (!req->at_cursor) return false;
+    if (req->line != owner->cursor.line) return true;
+    if (req->kind != LSP_REQ_COMPLETION) return req->col != owner->cursor.col;
+    char word[100];
+    return req->col != owner->input.completion_start_col || !editor_completion_word(owner, word, sizeof(word)) ||
+           strncmp(word, req->prefix, strlen(req->prefix)) != 0;
+}
+
+// Cancels requests past their deadline and those whose answer is tied to a
+// cursor position the user already left. Called from the main loop.
+void lsp_expire_requests(EditorState *state) {
+    if (!lsp_is_available(state) || state->lsp.client->num_pending == 0) return;
+    LspClient *client = state->lsp.client;
+    long long now = lsp_now_ms();
+    for (int i = client->num_pending - 1; i >= 0; i--) {
+        LspPendingRequest *req = &client->pending[i];
+        if (req->owner != state) continue;
+        if (req->deadline_ms > 0 && now >= req->deadline_ms) {
+            lsp_log("Request %ld timed out\n", req->id);
+            if (req->kind == LSP_REQ_DEFINITION || req->kind == LSP_REQ_CODE_ACTION) {
+                editor_set_status_msg(state, "LSP request timed out");
+            }
+            lsp_cancel_request(client, i);
+        } else if (lsp_request_stale(req, state)) {
+            lsp_cancel_request(client, i);
+        }
     }
-    
-    // Detailed log of parameters
-    char *params_str = json_dumps(msg->params, JSON_INDENT(2));
-    lsp_log("Params: %s\n", params_str);
-    free(params_str);
-    lsp_log("Parsing diagnostics: %s\n", json_response);
-    lsp_log("Debug: Received diagnostic message\n");
-    lsp_log("Drawing %d diagnostics\n", state->lsp.document->diagnostics_count);
-    if (!msg || !msg->params) {
-        lsp_free_message(msg);
+}
+
+// Finds and removes the request a response answers; false for unknown,
+// cancelled or stale ids
+static bool lsp_take_request(LspClient *client, const char *id, LspPendingRequest *out) {
+    char *end;
+    long num = strtol(id, &end, 10);
+    if (*end != '\0') return false;
+    for (int i = 0; i < client->num_pending; i++) {
+        if (client->pending[i].id != num) continue;
+        *out = client->pending[i];
+        client->pending[i] = client->pending[--client->num_pending];
+        return !lsp_request_stale(out, out->owner);
+    }
+    return false;
+}
+
+// Cancels what an editor leaving the server still waits for
+static void lsp_drop_requests(LspClient *client, EditorState *owner) {
+    for (int i = client->num_pending - 1; i >= 0; i--) {
+        if (client->pending[i].owner == owner) lsp_cancel_request(client, i);
+    }
+}
+
+// Reads {"line":..,"character":..}
+static void lsp_pull_position(JsonPull *jp, LspPosition *pos) {
+    if (!json_pull_enter_object(jp)) {
+        json_pull_skip(jp);
         return;
     }
-    lsp_log("Debug: Received diagnostic message\n");
+    char key[32];
+    long long value;
+    while (json_pull_next_key(jp, key, sizeof(key))) {
+        if (strcmp(key, "line") == 0) {
+            if (json_pull_int(jp, &value)) pos->line = value;
+        } else if (strcmp(key, "character") == 0) {
+            if (json_pull_int(jp, &value)) pos->character = value;
+        } else {
+            json_pull_skip(jp);
+        }
+    }
+}
+
+static void lsp_pull_diagnostic(JsonPull *jp, LspDiagnostic *diag) {
+    // Initialize with defaults
+    memset(diag, 0, sizeof(*diag));
+    diag->severity = LSP_SEVERITY_ERROR;
+    
+    char key[32];
+    long long value;
+    if (json_pull_enter_object(jp)) {
+        while (json_pull_next_key(jp, key, sizeof(key))) {
+            if (strcmp(key, "range") == 0 && json_pull_enter_object(jp)) {
+                while (json_pull_next_key(jp, key, sizeof(key))) {
+                    if (strcmp(key, "start") == 0) lsp_pull_position(jp, &diag->range.start);
+                    else if (strcmp(key, "end") == 0) lsp_pull_position(jp, &diag->range.end);
+                    else json_pull_skip(jp);
+                }
+            } else if (strcmp(key, "severity") == 0) {
+                if (json_pull_int(jp, &value)) diag->severity = value;
+            } else if (strcmp(key, "message") == 0 && !diag->message) {
+                diag->message = json_pull_string(jp);
+            } else if (strcmp(key, "code") == 0 && !diag->code) {
+                JsonPullType type = json_pull_peek(jp);
+                if (type == JSON_PULL_STRING) {
+                    diag->code = json_pull_string(jp);
+                } else if (type == JSON_PULL_NUMBER && json_pull_int(jp, &value)) {
+                    char code_buf[32];
+                    snprintf(code_buf, sizeof(code_buf), "%lld", value);
+                    diag->code = strdup(code_buf);
+                } else {
+                    json_pull_skip(jp);
+                }
+            } else {
+                json_pull_skip(jp);
+            }
+        }
+    } else {
+        json_pull_skip(jp);
+    }
+    if (!diag->message) diag->message = strdup("Unknown error");
+    if (!diag->code) diag->code = strdup("unknown");
+}
+
+// Parses LSP diagnostics straight from the message text; only the fields the
+// editor shows are read
+void lsp_parse_diagnostics(EditorState *state, const char *json_response) {
+    if (!state->lsp.document) return;
+    size_t json_len = strlen(json_response);
+    lsp_log("Parsing diagnostics (%zu bytes)\n", json_len);
+    
     // Clean up existing diagnostics
     lsp_cleanup_diagnostics(state);
         
@@ -212,84 +426,44 @@ void lsp_parse_diagnostics(EditorState *state, const char *json_response) {
     }
     
     // Get diagnostics array from params
-    json_t *diagnostics = json_object_get(msg->params, "diagnostics");
-    if (!diagnostics || !json_is_array(diagnostics)) {
-        lsp_free_message(msg);
+    JsonPull jp;
+    json_pull_init(&jp, json_response, json_len);
+    if (!json_pull_enter_object(&jp) || !json_pull_find_key(&jp, "params") ||
+        !json_pull_enter_object(&jp) || !json_pull_find_key(&jp, "diagnostics") ||
+        !json_pull_enter_array(&jp)) {
         return;
     }
     
-    size_t num_diagnostics = json_array_size(diagnostics);
-    if (num_diagnostics > 0) {
-        state->lsp.document->diagnostics = malloc(num_diagnostics * sizeof(LspDiagnostic));
-        state->lsp.document->diagnostics_count = num_diagnostics;
-        
-        for (size_t i = 0; i < num_diagnostics; i++) {
-            json_t *diag_obj = json_array_get(diagnostics, i);
-            LspDiagnostic *diag = &state->lsp.document->diagnostics[i];
-            
-            // Initialize with defaults
-            diag->range.start.line = 0;
-            diag->range.start.character = 0;
-            diag->range.end.line = 0;
-            diag->range.end.character = 0;
-            diag->severity = LSP_SEVERITY_ERROR;
-            diag->message = NULL;
-            diag->code = NULL;
-            
-            // Parse range
-            json_t *range = json_object_get(diag_obj, "range");
-            if (range) {
-                json_t *start = json_object_get(range, "start");
-                if (start) {
-                    json_t *line = json_object_get(start, "line");
-                    json_t *character = json_object_get(start, "character");
-                    if (json_is_integer(line)) diag->range.start.line = json_integer_value(line);
-                    if (json_is_integer(character)) diag->range.start.character = json_integer_value(character);
-                }
-                
-                json_t *end = json_object_get(range, "end");
-                if (end) {
-                    json_t *line = json_object_get(end, "line");
-                    json_t *character = json_object_get(end, "character");
-                    if (json_is_integer(line)) diag->range.end.line = json_integer_value(line);
-                    if (json_is_integer(character)) diag->range.end.character = json_integer_value(character);
-                }
-            }
-            
-            // Parse severity
-            json_t *severity = json_object_get(diag_obj, "severity");
-            if (json_is_integer(severity)) {
-                diag->severity = json_integer_value(severity);
-            }
-            
-            // Parse message
-            json_t *message = json_object_get(diag_obj, "message");
-            if (json_is_string(message)) {
-                diag->message = strdup(json_string_value(message));
-            } else {
-                diag->message = strdup("Unknown error");
-            }
-            
-            // Parse code
-            json_t *code = json_object_get(diag_obj, "code");
-            if (code) {
-                if (json_is_string(code)) {
-                    diag->code = strdup(json_string_value(code));
-                } else if (json_is_integer(code)) {
-                    char code_buf[32];
-                    snprintf(code_buf, sizeof(code_buf), "%lld", (long long)json_integer_value(code));
-                    diag->code = strdup(code_buf);
-                } else {
-                    diag->code = strdup("unknown");
-                }
-            }
-            else {
-                diag->code = strdup("unknown");
-            }
+    LspDiagnostic *diagnostics = NULL;
+    int count = 0, cap = 0;
+    while (json_pull_next_item(&jp)) {
+        if (count == cap) {
+            int new_cap = cap > 0 ? cap * 2 : 16;
+            LspDiagnostic *grown = realloc(diagnostics, new_cap * sizeof(LspDiagnostic));
+            if (!grown) break;
+            diagnostics = grown;
+            cap = new_cap;
         }
+        lsp_pull_diagnostic(&jp, &diagnostics[count++]);
+        if (jp.error) break;
     }
+    if (jp.error) lsp_log("Malformed diagnostics, kept the first %d\n", count);
     
-    lsp_free_message(msg);
+    // Ranges arrive in UTF-16 units; the editor keeps byte columns
+    for (int i = 0; i < count; i++) {
+        LspRange *range = &diagnostics[i].range;
+        range->start.character = lsp_byte_col(lsp_line_at(state, range->start.line), range->start.character);
+        range->end.character = lsp_byte_col(lsp_line_at(state, range->end.line), range->end.character);
+    }
+    
+    if (count > 0) {
+        state->lsp.document->diagnostics = diagnostics;
+        state->lsp.document->diagnostics_count = count;
+    } else {
+        free(diagnostics);
+    }
+    
+    lsp_build_diagnostic_index(state->lsp.document);
     lsp_log("Debug: %d diagnostics processed\n", state->lsp.document->diagnostics_count);
 
     if (state->buffer.dirty_lines) {
@@ -301,8 +475,8 @@ void lsp_parse_diagnostics(EditorState *state, const char *json_response) {
 
 void process_lsp_status(EditorState *state) {
     if (state->lsp.enabled && state->lsp.client) {
-        editor_set_status_msg(state, "LSP active for %s (PID: %d)", 
-                state->lsp.client->languageId, state->lsp.client->server_pid);
+        editor_set_status_msg(state, "LSP active for %s (PID: %d, shared by %d windows)", 
+                state->lsp.client->languageId, state->lsp.client->server_pid, state->lsp.client->num_users);
     } else {
         editor_set_status_msg(state, "LSP not active");
     }
@@ -361,36 +535,132 @@ void process_lsp_symbols(EditorState *state) {
 
 
 void lsp_did_change(EditorState *state) {
-    if (!lsp_is_available(state)) return;
+    if (!lsp_is_available(state) || !state->lsp.document) return;
 
     // Immediately clears old diagnostics so the UI is updated.
     // The new diagnostics will come from the LSP server.
     lsp_cleanup_diagnostics(state);
+    // Not open on the server yet (didOpen sends the text), or open for another
+    // window on the same file: the edit hands the server's copy over to this one
+    if (!state->lsp.document->opened) {
+        lsp_take_document(state);
+        return;
+    }
     
     state->lsp.document->needs_update = true;
     state->lsp.document->version++;
+    clock_gettime(CLOCK_MONOTONIC, &state->lsp.document->last_change);
     
-    // Sends the change notification immediately to get quick feedback.
-    lsp_send_did_change(state);
+    // Edits within lsp_change_delay_ms of each other go out as one didChange
+    // (see lsp_flush_due_changes); with no delay every edit is sent right away.
+    if (global_config.lsp_change_delay_ms <= 0) lsp_send_did_change(state);
+}
+
+// Sends the queued edits, if any. Requests that read the document call this
+// first so the server answers for the text on screen.
+void lsp_flush_changes(EditorState *state) {
+    if (!lsp_is_available(state) || !state->lsp.document) return;
+    if (!state->lsp.document->opened) lsp_take_document(state);
+    else if (state->lsp.document->needs_update) lsp_send_did_change(state);
+}
+
+bool lsp_has_pending_changes(EditorState *state) {
+    return lsp_is_available(state) && state->lsp.document && state->lsp.document->needs_update;
+}
+
+// Called from the main loop: sends the queued edits once typing paused for the delay
+void lsp_flush_due_changes(EditorState *state) {
+    if (!lsp_has_pending_changes(state)) return;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long elapsed_ms = (now.tv_sec - state->lsp.document->last_change.tv_sec) * 1000LL;
+    elapsed_ms += (now.tv_nsec - state->lsp.document->last_change.tv_nsec) / 1000000;
+    if (elapsed_ms >= global_config.lsp_change_delay_ms) lsp_send_did_change(state);
 }
 
 
 void lsp_did_save(EditorState *state) {
     if (!lsp_is_available(state)) return;
+    lsp_flush_changes(state);
     
     char *uri = lsp_get_uri_from_path(state->buffer.filename);
     if (!uri) return;
     
-    char *save_msg = "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didSave\",\"params\":{\"textDocument\":{\"uri\":\"%s\"}}}";
-    char save_buf[1024];
-    snprintf(save_buf, sizeof(save_buf), save_msg, uri);
-    
-    write(state->lsp.client->stdin_fd, save_buf, strlen(save_buf));
+    LspWriter w = {0};
+    lsp_writer_str(&w, "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didSave\",\"params\":{\"textDocument\":{\"uri\":\"");
+    lsp_writer_escaped(&w, uri, strlen(uri));
+    lsp_writer_str(&w, "\"}}}");
+    lsp_send_writer(state, &w, "didSave");
     
     free(uri); // Free the memory allocated for the URI
 }
 
 
+// Another editor on this server with the same file open, or NULL. The server
+// holds one document per URI, kept in sync by the editor that last edited it.
+static EditorState *lsp_document_holder(LspClient *client, EditorState *state) {
+    if (!state->lsp.document || !state->lsp.document->uri) return NULL;
+    for (int i = 0; i < client->num_users; i++) {
+        EditorState *user = client->users[i];
+        if (user != state && user->lsp.document && user->lsp.document->opened && user->lsp.document->uri &&
+            strcmp(user->lsp.document->uri, state->lsp.document->uri) == 0) {
+            return user;
+        }
+    }
+    return NULL;
+}
+
+// Closes the editor's document on the server. Another editor on the same file
+// opens it again with its own text.
+static void lsp_did_close(EditorState *state) {
+    LspClient *client = state->lsp.client;
+    if (!lsp_is_available(state) || !state->lsp.document || !state->lsp.document->opened) return;
+    state->lsp.document->opened = false;
+
+    char *close_msg = "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didClose\",\"params\":{\"textDocument\":{\"uri\":\"%s\"}}}";
+    size_t close_size = snprintf(NULL, 0, close_msg, state->lsp.document->uri) + 1;
+    char *close_buf = malloc(close_size);
+    if (close_buf) {
+        snprintf(close_buf, close_size, close_msg, state->lsp.document->uri);
+        lsp_send_message(state, close_buf);
+        free(close_buf);
+    }
+
+    for (int i = 0; i < client->num_users; i++) {
+        EditorState *user = client->users[i];
+        if (user != state && user->lsp.document && user->lsp.document->uri &&
+            strcmp(user->lsp.document->uri, state->lsp.document->uri) == 0) {
+            lsp_did_open(user);
+            break;
+        }
+    }
+}
+
+// Makes the server's copy of the file follow this editor when another window
+// on the same file holds it: the whole text goes out as a didChange with a
+// version above the holder's. False when the file is not open on the server.
+static bool lsp_take_document(EditorState *state) {
+    LspDocumentState *doc = state->lsp.document;
+    if (!doc || doc->opened) return doc != NULL;
+    EditorState *holder = lsp_document_holder(state->lsp.client, state);
+    if (!holder) return false;
+
+    LspDocumentState *held = holder->lsp.document;
+    held->opened = false;
+    held->needs_update = false;
+    lsp_snapshot_free(held);
+    // The server reports on this editor's text from now on
+    lsp_cleanup_diagnostics(holder);
+
+    if (doc->version <= held->version) doc->version = held->version + 1;
+    doc->opened = true;
+    lsp_snapshot_free(doc);
+    lsp_send_did_change(state);
+    return true;
+}
+
+// Detaches the editor from its language server. The server itself lives on
+// while other editors use it, and for lsp_idle_timeout_sec after the last one.
 void lsp_shutdown(EditorState *state) {
     if (!state || !state->lsp.client) return;
 
@@ -402,122 +672,269 @@ void lsp_shutdown(EditorState *state) {
         return;
     }
 
-    if (state->lsp.client->stdin_fd != -1) {
-        char *shutdown_msg = "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"shutdown\",\"params\":{}}";
-        write(state->lsp.client->stdin_fd, shutdown_msg, strlen(shutdown_msg));
+    LspClient *client = state->lsp.client;
+    if (client->ready) lsp_did_close(state);
+    lsp_drop_requests(client, state);
+    state->lsp.client = NULL;
+    state->lsp.enabled = false;
+    lsp_pool_detach(client, state);
+
+    lsp_free_document_state(state);
+}
+
+// Stops the server process and frees the client
+void lsp_client_destroy(LspClient *client) {
+    if (!client) return;
+
+    if (client->transport) {
+        lsp_send_request(client, NULL, LSP_REQ_SHUTDOWN, "shutdown", NULL, NULL, 0, false);
         char *exit_msg = "{\"jsonrpc\":\"2.0\",\"method\":\"exit\",\"params\":{}}";
-        write(state->lsp.client->stdin_fd, exit_msg, strlen(exit_msg));
+        lsp_transport_send(client->transport, exit_msg, strlen(exit_msg));
+        lsp_transport_stop(client->transport);
+        client->transport = NULL;
     }
 
-    if (state->lsp.client->stdin_fd != -1) {
-        close(state->lsp.client->stdin_fd);
-        state->lsp.client->stdin_fd = -1;
-    }
-    if (state->lsp.client->stdout_fd != -1) {
-        close(state->lsp.client->stdout_fd);
-        state->lsp.client->stdout_fd = -1;
-    }
-    if (state->lsp.client->stderr_fd != -1) {
-        close(state->lsp.client->stderr_fd);
-        state->lsp.client->stderr_fd = -1;
-    }
+    if (client->stdin_fd != -1) close(client->stdin_fd);
+    if (client->stdout_fd != -1) close(client->stdout_fd);
+    if (client->stderr_fd != -1) close(client->stderr_fd);
 
-    if (state->lsp.client->server_pid != -1) {
+    if (client->server_pid != -1) {
         // Use WNOHANG to prevent blocking if the server is slow to exit.
         // The main loop's waitpid will clean up the zombie process later.
-        waitpid(state->lsp.client->server_pid, NULL, WNOHANG);
-        state->lsp.client->server_pid = -1;
-    }
+        waitpid(client->server_pid, NULL, WNOHANG);
+    }
+
+    free(client->languageId);
+    free(client->rootUri);
+    free(client->workspaceFolders);
+    free(client->compilerFlags);
+    free(client->compilationDatabase);
+    free(client->pending);
+    free(client->users);
+    free(client->semantic_colors);
+    free(client);
+}
+
+#define LSP_SYNC_INCREMENTAL 2
 
-    if (state->lsp.client->languageId) {
-        free(state->lsp.client->languageId);
-        state->lsp.client->languageId = NULL;
+// The whole buffer as the server sees it, one '\n' after every line, escaped
+// straight into the message
+static void lsp_write_document_text(LspWriter *w, EditorState *state) {
+    size_t total_length = 0;
+    for (int i = 0; i < state->buffer.num_lines; i++) {
+        total_length += strlen(buffer_line(state, i)) + 2;
     }
-    if (state->lsp.client->rootUri) {
-        free(state->lsp.client->rootUri);
-        state->lsp.client->rootUri = NULL;
+    lsp_writer_reserve(w, total_length + 64);
+
+    for (int i = 0; i < state->buffer.num_lines; i++) {
+        const char *line = buffer_line(state, i);
+        lsp_writer_escaped(w, line, strlen(line));
+        lsp_writer_raw(w, "\\n", 2);
     }
-    if (state->lsp.client->workspaceFolders) {
-        free(state->lsp.client->workspaceFolders);
-        state->lsp.client->workspaceFolders = NULL;
+}
+
+// Queues a message built in place; the writer's buffer goes to the I/O thread as is
+static void lsp_send_writer(EditorState *state, LspWriter *w, const char *what) {
+    if (!w->failed) lsp_log("Sending %s (%zu bytes)\n", what, w->len);
+    lsp_transport_send_writer(state->lsp.client->transport, w);
+}
+
+static void lsp_snapshot_free(LspDocumentState *doc) {
+    for (int i = 0; i < doc->synced_count; i++) free(doc->synced_lines[i]);
+    free(doc->synced_lines);
+    doc->synced_lines = NULL;
+    doc->synced_count = 0;
+    doc->synced = false;
+}
+
+// Remembers the buffer as just sent in full; only kept for incremental servers
+static void lsp_snapshot_reset(EditorState *state) {
+    LspDocumentState *doc = state->lsp.document;
+    if (!doc) return;
+    lsp_snapshot_free(doc);
+    if (state->lsp.client->sync_kind != LSP_SYNC_INCREMENTAL) return;
+
+    doc->synced_lines = malloc(sizeof(char*) * (state->buffer.num_lines + 1));
+    if (!doc->synced_lines) return;
+    for (int i = 0; i < state->buffer.num_lines; i++) {
+        doc->synced_lines[i] = strdup(buffer_line(state, i));
+        if (!doc->synced_lines[i]) {
+            doc->synced_count = i;
+            lsp_snapshot_free(doc);
+            return;
+        }
     }
-    if (state->lsp.client->compilerFlags) {
-        free(state->lsp.client->compilerFlags);
-        state->lsp.client->compilerFlags = NULL;
+    doc->synced_count = state->buffer.num_lines;
+    doc->synced = true;
+}
+
+// Diffs the buffer against the synced copy and returns the contentChanges entry
+// replacing just the differing range, updating the copy to match. Returns NULL
+// when nothing changed or on allocation failure; the caller then sends the full text.
+static char *lsp_build_range_change(EditorState *state) {
+    LspDocumentState *doc = state->lsp.document;
+    char **old_lines = doc->synced_lines;
+    int old_count = doc->synced_count;
+    int new_count = state->buffer.num_lines;
+
+    // Lines [top, old_end) of the copy became lines [top, new_end) of the buffer
+    int top = 0;
+    while (top < old_count && top < new_count && strcmp(old_lines[top], buffer_line(state, top)) == 0) top++;
+    if (top == old_count && top == new_count) return NULL;
+    int old_end = old_count, new_end = new_count;
+    while (old_end > top && new_end > top && strcmp(old_lines[old_end - 1], buffer_line(state, new_end - 1)) == 0) {
+        old_end--;
+        new_end--;
+    }
+
+    int start_line = top, start_byte = 0, end_line = old_end, end_byte = 0;
+    int first_skip = 0, last_keep = -1; // bytes cut from new_lines[top] and kept of new_lines[new_end - 1]
+    if (old_end > top && new_end > top) {
+        // Both sides have changed lines: trim the common prefix of the first line
+        // and the common suffix of the last, on character boundaries
+        const char *old_first = old_lines[top], *new_first = buffer_line(state, top);
+        const char *old_last = old_lines[old_end - 1], *new_last = buffer_line(state, new_end - 1);
+        int old_last_len = strlen(old_last), new_last_len = strlen(new_last);
+
+        int prefix = 0;
+        while (old_first[prefix] && old_first[prefix] == new_first[prefix]) prefix++;
+        while (prefix > 0 && (new_first[prefix] & 0xC0) == 0x80) prefix--;
+
+        int max_suffix = min(old_last_len - (old_end - 1 == top ? prefix : 0),
+                             new_last_len - (new_end - 1 == top ? prefix : 0));
+        int suffix = 0;
+        while (suffix < max_suffix && old_last[old_last_len - 1 - suffix] == new_last[new_last_len - 1 - suffix]) suffix++;
+        while (suffix > 0 && (new_last[new_last_len - suffix] & 0xC0) == 0x80) suffix--;
+
+        start_byte = prefix;
+        end_line = old_end - 1;
+        end_byte = old_last_len - suffix;
+        first_skip = prefix;
+        last_keep = new_last_len - suffix;
+    }
+
+    size_t text_len = 0;
+    for (int i = top; i < new_end; i++) text_len += strlen(buffer_line(state, i)) + 1;
+    char *text = malloc(text_len + 1);
+    if (!text) return NULL;
+    size_t pos = 0;
+    for (int i = top; i < new_end; i++) {
+        const char *line = buffer_line(state, i);
+        int from = i == top ? first_skip : 0;
+        int to = (i == new_end - 1 && last_keep >= 0) ? last_keep : (int)strlen(line);
+        memcpy(text + pos, line + from, to - from);
+        pos += to - from;
+        if (i < new_end - 1 || last_keep < 0) text[pos++] = '\n';
+    }
+    text[pos] = '\0';
+
+    char *escaped = json_escape_string(text);
+    free(text);
+    if (!escaped) return NULL;
+
+    int start_char = start_line < old_count ? lsp_utf16_col(old_lines[start_line], start_byte) : 0;
+    int end_char = end_line < old_count ? lsp_utf16_col(old_lines[end_line], end_byte) : 0;
+    const char *change_format = "{\"range\":{\"start\":{\"line\":%d,\"character\":%d},\"end\":{\"line\":%d,\"character\":%d}},\"text\":\"%s\"}";
+    size_t needed_size = snprintf(NULL, 0, change_format, start_line, start_char, end_line, end_char, escaped) + 1;
+    char *change = malloc(needed_size);
+    if (change) snprintf(change, needed_size, change_format, start_line, start_char, end_line, end_char, escaped);
+    free(escaped);
+    if (!change) return NULL;
+
+    // Bring the copy in line with the buffer
+    int removed = old_end - top, added = new_end - top;
+    char **added_lines = malloc(sizeof(char*) * (added > 0 ? added : 1));
+    char **lines = added > removed ? realloc(old_lines, sizeof(char*) * (old_count - removed + added)) : old_lines;
+    if (!added_lines || !lines) {
+        free(added_lines);
+        if (lines) doc->synced_lines = lines;
+        lsp_snapshot_free(doc);
+        free(change);
+        return NULL;
     }
-    if (state->lsp.client->compilationDatabase) {
-        free(state->lsp.client->compilationDatabase);
-        state->lsp.client->compilationDatabase = NULL;
+    for (int i = 0; i < added; i++) {
+        added_lines[i] = strdup(buffer_line(state, top + i));
+        if (!added_lines[i]) {
+            while (i-- > 0) free(added_lines[i]);
+            free(added_lines);
+            doc->synced_lines = lines;
+            lsp_snapshot_free(doc);
+            free(change);
+            return NULL;
+        }
     }
+    for (int i = top; i < old_end; i++) free(lines[i]);
+    memmove(&lines[top + added], &lines[old_end], sizeof(char*) * (old_count - old_end));
+    memcpy(&lines[top], added_lines, sizeof(char*) * added);
+    free(added_lines);
+    doc->synced_lines = lines;
+    doc->synced_count = old_count - removed + added;
+    return change;
+}
 
-    free(state->lsp.client);
-    state->lsp.client = NULL;
-    state->lsp.enabled = false;
+// textDocumentSync is either the kind itself or an options object with "change"
+static int lsp_read_sync_kind(json_t *result) {
+    json_t *sync = json_object_get(json_object_get(result, "capabilities"), "textDocumentSync");
+    if (json_is_object(sync)) sync = json_object_get(sync, "change");
+    return json_is_integer(sync) ? (int)json_integer_value(sync) : 0;
+}
 
-    lsp_free_document_state(state);
+// semanticTokensProvider: which requests the server answers, and a color for each token type in its legend
+static void lsp_read_semantic_legend(LspClient *client, json_t *result) {
+    json_t *provider = json_object_get(json_object_get(result, "capabilities"), "semanticTokensProvider");
+    json_t *types = json_object_get(json_object_get(provider, "legend"), "tokenTypes");
+    if (!json_is_array(types) || json_array_size(types) == 0) return;
+    
+    int *colors = malloc(sizeof(int) * json_array_size(types));
+    if (!colors) return;
+    for (size_t i = 0; i < json_array_size(types); i++) {
+        colors[i] = lsp_semantic_color(json_string_value(json_array_get(types, i)));
+    }
+    free(client->semantic_colors);
+    client->semantic_colors = colors;
+    client->num_semantic_types = json_array_size(types);
+    
+    json_t *full = json_object_get(provider, "full");
+    json_t *range = json_object_get(provider, "range");
+    client->semantic_full = json_is_true(full) || json_is_object(full);
+    client->semantic_delta = json_is_true(json_object_get(full, "delta"));
+    client->semantic_range = json_is_true(range) || json_is_object(range);
 }
 
 void lsp_did_open(EditorState *state) {
     if (!lsp_is_available(state)) return;
+    if (!state->lsp.document) lsp_init_document_state(state);
+    if (lsp_document_holder(state->lsp.client, state)) return; // that editor keeps the server's copy
     
     lsp_log("Sending didOpen for: %s\n", state->buffer.filename);
     
-    // Build the file content
-    size_t total_length = 0;
-    for (int i = 0; i < state->buffer.num_lines; i++) {
-        if (state->buffer.lines[i]) {
-            total_length += strlen(state->buffer.lines[i]) + 1; // +1 for newline
-        }
-    }
-    
-    char *content = malloc(total_length + 1);
-    if (!content) return;
-    
-    content[0] = '\0';
-    for (int i = 0; i < state->buffer.num_lines; i++) {
-        if (state->buffer.lines[i]) {
-            strcat(content, state->buffer.lines[i]);
-            strcat(content, "\n");
-        }
-    }
-    
-    // Escape content for JSON
-    char *escaped_content = json_escape_string(content);
-    free(content);
-    
-    if (!escaped_content) {
-        lsp_log("Failed to escape content for didOpen\n");
-        return;
-    }
-    
-    // Create didOpen message
-    char *uri = lsp_get_uri_from_path(state->buffer.filename);
-    char *open_msg_format = "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didOpen\",\"params\":{\"textDocument\":{\"uri\":\"%s\",\"languageId\":\"%s\",\"version\":1,\"text\":\"%s\"}}}";
-    
-    size_t needed_size = snprintf(NULL, 0, open_msg_format, uri, state->lsp.client->languageId, escaped_content) + 1;
-    char *open_buf = malloc(needed_size);
-    if (!open_buf) {
+    LspWriter w = {0};
+    lsp_writer_str(&w, "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didOpen\",\"params\":{\"textDocument\":{\"uri\":\"");
+    lsp_writer_escaped(&w, state->lsp.document->uri, strlen(state->lsp.document->uri));
+    lsp_writer_str(&w, "\",\"languageId\":\"");
+    lsp_writer_str(&w, state->lsp.client->languageId);
+    // A window reopening the file another one closed has counted its own edits;
+    // the didChange versions that follow go on from here
+    if (state->lsp.document->version < 1) state->lsp.document->version = 1;
+    char version_buf[48];
+    snprintf(version_buf, sizeof(version_buf), "\",\"version\":%d,\"text\":\"", state->lsp.document->version);
+    lsp_writer_str(&w, version_buf);
+    lsp_write_document_text(&w, state);
+    lsp_writer_str(&w, "\"}}}");
+    if (w.failed) {
         lsp_log("Failed to allocate buffer for didOpen\n");
-        free(uri);
-        free(escaped_content);
+        lsp_writer_free(&w);
         return;
     }
-    snprintf(open_buf, needed_size, open_msg_format, uri, state->lsp.client->languageId, escaped_content);
-    
-    lsp_log("didOpen message: %s\n", open_buf);
-    
-    // Send the message
-    lsp_send_message(state, open_buf);
+    lsp_send_writer(state, &w, "didOpen");
     
-    free(open_buf);
-    free(uri);
-    free(escaped_content);
-    
-    // Initialize the document state if it doesn't exist
-    if (!state->lsp.document) {
-        lsp_init_document_state(state);
-    }
+    state->lsp.document->opened = true;
     state->lsp.document->needs_update = false;
+    lsp_snapshot_reset(state);
+    // Ask again: after a restart the server has none of the earlier results
+    state->lsp.document->semantic.full_version = 0;
+    state->lsp.document->semantic.full_retry_ms = 0;
+    state->lsp.document->semantic.range_version = 0;
 }
 
 char* json_escape_string(const char *str) {
@@ -535,7 +952,7 @@ char* json_escape_string(const char *str) {
                 escaped_len += 2; // \ + special character
                 break;
             default:
-                if (str[i] < 0x20 || str[i] > 0x7E) {
+                if ((unsigned char)str[i] < 0x20) {
                     escaped_len += 6; // \uXXXX
                 } else {
                     escaped_len += 1;
@@ -574,8 +991,9 @@ char* json_escape_string(const char *str) {
                 escaped[j++] = '\\'; escaped[j++] = 't'; 
                 break;
             default:
-                if (str[i] < 0x20 || str[i] > 0x7E) {
-                    // Non-ASCII character: use Unicode escape
+                if ((unsigned char)str[i] < 0x20) {
+                    // Other control characters: use Unicode escape. UTF-8 is
+                    // passed through as is, JSON text is UTF-8.
                     snprintf(escaped + j, 7, "\\u%04x", (unsigned char)str[i]);
                     j += 6;
                 } else {
@@ -605,19 +1023,85 @@ void lsp_force_diagnostics(EditorState *state) {
     lsp_log("Forcing diagnostics update via didChange\n");
 }
 
+// Buckets diagnostics by line (counting sort, CSR layout) so rendering and
+// hover only look at the diagnostics of the lines they touch.
+void lsp_build_diagnostic_index(LspDocumentState *doc) {
+    free(doc->line_start);
+    free(doc->line_items);
+    doc->line_start = NULL;
+    doc->line_items = NULL;
+    doc->indexed_lines = 0;
+    doc->error_count = 0;
+    doc->warning_count = 0;
+    if (doc->diagnostics_count == 0) return;
+
+    int max_line = -1;
+    for (int i = 0; i < doc->diagnostics_count; i++) {
+        LspDiagnostic *diag = &doc->diagnostics[i];
+        if (diag->severity == LSP_SEVERITY_ERROR) doc->error_count++;
+        else if (diag->severity == LSP_SEVERITY_WARNING) doc->warning_count++;
+        if (diag->range.end.line < diag->range.start.line) diag->range.end.line = diag->range.start.line;
+        if (diag->range.start.line < 0) continue;
+        if (diag->range.end.line > max_line) max_line = diag->range.end.line;
+    }
+    if (max_line < 0) return;
+    if (max_line >= MAX_LINES) max_line = MAX_LINES - 1;
+
+    int lines = max_line + 1;
+    doc->line_start = calloc(lines + 1, sizeof(int));
+    if (!doc->line_start) return;
+    for (int i = 0; i < doc->diagnostics_count; i++) {
+        LspDiagnostic *diag = &doc->diagnostics[i];
+        if (diag->range.start.line < 0 || diag->range.start.line >= lines) continue;
+        int last = diag->range.end.line < lines ? diag->range.end.line : lines - 1;
+        for (int l = diag->range.start.line; l <= last; l++) doc->line_start[l + 1]++;
+    }
+    for (int l = 0; l < lines; l++) doc->line_start[l + 1] += doc->line_start[l];
+
+    doc->line_items = malloc(sizeof(int) * (doc->line_start[lines] > 0 ? doc->line_start[lines] : 1));
+    int *fill = malloc(sizeof(int) * lines);
+    if (!doc->line_items || !fill) {
+        free(fill);
+        free(doc->line_items);
+        free(doc->line_start);
+        doc->line_items = NULL;
+        doc->line_start = NULL;
+        return;
+    }
+    memcpy(fill, doc->line_start, sizeof(int) * lines);
+    // Ascending diagnostic order within each line, same as the old linear scans
+    for (int i = 0; i < doc->diagnostics_count; i++) {
+        LspDiagnostic *diag = &doc->diagnostics[i];
+        if (diag->range.start.line < 0 || diag->range.start.line >= lines) continue;
+        int last = diag->range.end.line < lines ? diag->range.end.line : lines - 1;
+        for (int l = diag->range.start.line; l <= last; l++) doc->line_items[fill[l]++] = i;
+    }
+    free(fill);
+    doc->indexed_lines = lines;
+}
+
+int lsp_diagnostics_on_line(EditorState *state, int line, const int **items) {
+    LspDocumentState *doc = state->lsp.document;
+    *items = NULL;
+    if (!doc || !doc->line_start || line < 0 || line >= doc->indexed_lines) return 0;
+    *items = doc->line_items + doc->line_start[line];
+    return doc->line_start[line + 1] - doc->line_start[line];
+}
+
 LspDiagnostic* get_diagnostic_under_cursor(EditorState *state) {
     if (!state->lsp.document || state->lsp.document->diagnostics_count == 0) {
         return NULL;
     }
 
-    // Converts the cursor column from bytes to characters before comparing
-    int cursor_char_col = get_character_col_from_byte(state->buffer.lines[state->cursor.line], state->cursor.col);
+    const int *items;
+    int count = lsp_diagnostics_on_line(state, state->cursor.line, &items);
+    if (count == 0) return NULL;
 
-    for (int i = 0; i < state->lsp.document->diagnostics_count; i++) {
-        LspDiagnostic *diag = &state->lsp.document->diagnostics[i];
+    for (int i = 0; i < count; i++) {
+        LspDiagnostic *diag = &state->lsp.document->diagnostics[items[i]];
         if (state->cursor.line == diag->range.start.line && 
-            cursor_char_col >= diag->range.start.character && 
-            cursor_char_col <= diag->range.end.character) {
+            state->cursor.col >= diag->range.start.character && 
+            state->cursor.col <= diag->range.end.character) {
             return diag;
         }
     }
@@ -659,10 +1143,7 @@ void process_lsp_definition(EditorState *state) {
         editor_set_status_msg(state, "LSP not available");
         return;
     }
-
-    LspMessage *msg = lsp_create_message();
-    msg->id = strdup("2"); // ID para a resposta de "definição"
-    msg->method = strdup("textDocument/definition");
+    lsp_flush_changes(state);
 
     json_t *params = json_object();
     json_t *textDocument = json_object();
@@ -671,16 +1152,11 @@ void process_lsp_definition(EditorState *state) {
 
     json_t *position = json_object();
     json_object_set_new(position, "line", json_integer(state->cursor.line));
-    json_object_set_new(position, "character", json_integer(state->cursor.col));
+    json_object_set_new(position, "character", json_integer(lsp_cursor_utf16(state)));
     json_object_set_new(params, "position", position);
     
-    msg->params = params;
-
-    char *json_str = lsp_serialize_message(msg);
-    lsp_send_message(state, json_str);
-
-    free(json_str);
-    lsp_free_message(msg);
+    lsp_send_request(state->lsp.client, state, LSP_REQ_DEFINITION, "textDocument/definition", params,
+                     lsp_on_definition, LSP_REQUEST_TIMEOUT_MS, true);
     editor_set_status_msg(state, "Sent 'go to definition' request...");
 }
 
@@ -736,6 +1212,7 @@ void process_lsp_rename(EditorState *state, const char *new_name) {
                     
                     free(state->buffer.lines[i]);
                     state->buffer.lines[i] = strdup(new_line);
+                    editor_note_edit(state, i, 1, 1);
                     count++;
                 }
                 pos += strlen(current_word);
@@ -793,39 +1270,22 @@ void lsp_initialize(EditorState *state) {
     state->lsp.init_time = time(NULL);
     state->lsp.init_retries = 0;
 
-    state->lsp.client = malloc(sizeof(LspClient));
-    if (!state->lsp.client) {
-        editor_set_status_msg(state, "Allocation error for LSP");
-        return;
-    }
-    memset(state->lsp.client, 0, sizeof(LspClient)); // Initialize with zeros
-
     bool lsp_will_be_enabled = false;
+    const char *languageId = "plaintext";
     const char *ext = strrchr(state->buffer.filename, '.');
 
     // Determine languageId and if LSP will be used
     if (ext) {
         if (strcmp(ext, ".c") == 0 || strcmp(ext, ".h") == 0) {
-            state->lsp.client->languageId = strdup("c");
+            languageId = "c";
             lsp_will_be_enabled = true;
         } else if (strcmp(ext, ".cpp") == 0 || strcmp(ext, ".hpp") == 0 || strcmp(ext, ".cxx") == 0 || strcmp(ext, ".hxx") == 0) {
-            state->lsp.client->languageId = strdup("cpp");
+            languageId = "cpp";
             lsp_will_be_enabled = true;
         } else if (strcmp(ext, ".py") == 0) {
-            state->lsp.client->languageId = strdup("python");
+            languageId = "python";
             lsp_will_be_enabled = true;
-        } else {
-            state->lsp.client->languageId = strdup("plaintext");
         }
-    } else {
-        state->lsp.client->languageId = strdup("plaintext");
-    }
-
-    if (!state->lsp.client->languageId) {
-        editor_set_status_msg(state, "Allocation error for languageId");
-        free(state->lsp.client);
-        state->lsp.client = NULL;
-        return;
     }
 
     // Spell Check Policy
@@ -839,20 +1299,64 @@ void lsp_initialize(EditorState *state) {
 
     // Now, proceed with LSP initialization if needed
     if (!lsp_will_be_enabled || !global_config.lsp_enabled) {
-        free(state->lsp.client->languageId);
-        free(state->lsp.client);
-        state->lsp.client = NULL;
         state->lsp.enabled = false;
         return;
     }
+
+    // The server is picked by project: without a marker the working directory
+    // is the root, and clangd reads compile_commands.json from there
+    bool is_clang = strcmp(languageId, "c") == 0 || strcmp(languageId, "cpp") == 0;
+    char *root = find_project_root(state->buffer.filename);
+    char cwd[PATH_MAX];
+    if (!root && getcwd(cwd, sizeof(cwd)) != NULL) root = strdup(cwd);
+    char *rootUri = root ? lsp_get_uri_from_path(root) : NULL;
+    char *compilationDatabase = is_clang && root ? strdup(root) : NULL;
+    free(root);
+
+    LspClient *shared = lsp_pool_find(languageId, rootUri, compilationDatabase);
+    if (shared) {
+        free(rootUri);
+        free(compilationDatabase);
+        if (!lsp_pool_attach(shared, state)) {
+            editor_set_status_msg(state, "Allocation error for LSP");
+            return;
+        }
+        state->lsp.client = shared;
+        state->lsp.enabled = true;
+        lsp_init_document_state(state);
+        // Before the initialize answer, the document is opened along with the others
+        if (shared->ready) lsp_did_open(state);
+        editor_set_status_msg(state, "LSP attached to %s server (PID: %d)", languageId, shared->server_pid);
+        return;
+    }
+
+    state->lsp.client = malloc(sizeof(LspClient));
+    if (!state->lsp.client) {
+        editor_set_status_msg(state, "Allocation error for LSP");
+        free(rootUri);
+        free(compilationDatabase);
+        return;
+    }
+    memset(state->lsp.client, 0, sizeof(LspClient)); // Initialize with zeros
+    state->lsp.client->languageId = strdup(languageId);
+    state->lsp.client->rootUri = rootUri;
+    state->lsp.client->compilationDatabase = compilationDatabase;
+
+    if (!state->lsp.client->languageId) {
+        editor_set_status_msg(state, "Allocation error for languageId");
+        lsp_client_destroy(state->lsp.client);
+        state->lsp.client = NULL;
+        return;
+    }
+    state->lsp.client->server_pid = -1;
+    state->lsp.client->stdin_fd = state->lsp.client->stdout_fd = state->lsp.client->stderr_fd = -1;
     
     // Start the LSP server (clangd for C/C++)
     int stdin_pipe[2], stdout_pipe[2], stderr_pipe[2];
     
     if (pipe(stdin_pipe) != 0 || pipe(stdout_pipe) != 0 || pipe(stderr_pipe) != 0) {
         editor_set_status_msg(state, "Error creating pipes for LSP");
-        free(state->lsp.client->languageId);
-        free(state->lsp.client);
+        lsp_client_destroy(state->lsp.client);
         state->lsp.client = NULL;
         return;
     }
@@ -897,15 +1401,27 @@ void lsp_initialize(EditorState *state) {
         state->lsp.client->stdout_fd = stdout_pipe[0];
         state->lsp.client->stderr_fd = stderr_pipe[0];
         
-        fcntl(state->lsp.client->stdout_fd, F_SETFL, O_NONBLOCK);
-        fcntl(state->lsp.client->stderr_fd, F_SETFL, O_NONBLOCK);
+        state->lsp.client->transport = lsp_transport_start(state->lsp.client->stdin_fd,
+                state->lsp.client->stdout_fd, state->lsp.client->stderr_fd);
+        if (!state->lsp.client->transport) {
+            editor_set_status_msg(state, "Error starting LSP I/O thread");
+            lsp_shutdown(state);
+            return;
+        }
+        
+        state->lsp.client->initialized = true;
+        if (!lsp_pool_attach(state->lsp.client, state)) {
+            editor_set_status_msg(state, "Allocation error for LSP");
+            lsp_shutdown(state);
+            return;
+        }
+        lsp_pool_add(state->lsp.client);
         
         lsp_init_document_state(state);
         lsp_send_initialize(state);
         
         editor_set_status_msg(state, "LSP initialized for %s", state->lsp.client->languageId);
         state->lsp.enabled = true;
-        state->lsp.client->initialized = true;
     } else {
         editor_set_status_msg(state, "Error starting LSP: %s", strerror(errno));
         
@@ -917,8 +1433,7 @@ void lsp_initialize(EditorState *state) {
         close(stderr_pipe[0]);
         close(stderr_pipe[1]);
         
-        free(state->lsp.client->languageId);
-        free(state->lsp.client);
+        lsp_client_destroy(state->lsp.client);
         state->lsp.client = NULL;
     }
 }
@@ -976,12 +1491,13 @@ void lsp_init_document_state(EditorState *state) {
             free(state->lsp.document->uri);
             state->lsp.document->uri = NULL;
         }
+        lsp_snapshot_free(state->lsp.document);
+        lsp_semantic_free(&state->lsp.document->semantic);
     }
     
     state->lsp.document->uri = lsp_get_uri_from_path(state->buffer.filename);
     state->lsp.document->version = 1;
-    state->lsp.document->diagnostics = NULL;
-    state->lsp.document->diagnostics_count = 0;
+    lsp_cleanup_diagnostics(state);
     state->lsp.document->needs_update = false;
 }
 
@@ -994,6 +1510,8 @@ void lsp_free_document_state(EditorState *state) {
     }
     
     lsp_cleanup_diagnostics(state);
+    lsp_snapshot_free(state->lsp.document);
+    lsp_semantic_free(&state->lsp.document->semantic);
     
     free(state->lsp.document);
     state->lsp.document = NULL;
@@ -1011,51 +1529,85 @@ void lsp_cleanup_diagnostics(EditorState *state) {
     free(state->lsp.document->diagnostics);
     state->lsp.document->diagnostics = NULL;
     state->lsp.document->diagnostics_count = 0;
+    lsp_build_diagnostic_index(state->lsp.document);
 }
 
 // Parses completion suggestions from LSP
-void lsp_parse_completion(EditorState *state, const char *json_response) {
-    LspMessage *msg = lsp_parse_message(json_response);
-    if (!msg || !msg->result) {
-        lsp_free_message(msg);
-        return;
-    }
-    
-    json_t *items = NULL;
-    if (json_is_array(msg->result)) {
-        items = msg->result;
-    } else if (json_is_object(msg->result)) {
-        items = json_object_get(msg->result, "items");
-    }
+// Reads label, detail and insertText of one CompletionItem; false if it has no label
+static bool lsp_pull_completion_item(JsonPull *jp, char **label, char **detail, char **insert_text) {
+    *label = *detail = *insert_text = NULL;
+    if (!json_pull_enter_object(jp)) {
+        json_pull_skip(jp);
+        return false;
+    }
+    char key[32];
+    while (json_pull_next_key(jp, key, sizeof(key))) {
+        char **field = strcmp(key, "label") == 0 ? label :
+                       strcmp(key, "detail") == 0 ? detail :
+                       strcmp(key, "insertText") == 0 ? insert_text : NULL;
+        if (field && !*field) *field = json_pull_string(jp);
+        else json_pull_skip(jp);
+    }
+    return *label != NULL;
+}
 
-    // FIX: Check if items exist and the array is not empty before proceeding
-    if (!items || !json_is_array(items) || json_array_size(items) == 0) {
-        lsp_free_message(msg);
-        return; // No items, so do nothing and don't enter completion mode
-    }
-    
-    // Only now, when we know we have suggestions, do we enter completion mode.
-    if (state->input.completion_mode == COMPLETION_NONE) {
-        state->input.completion_mode = COMPLETION_TEXT;
-        state->input.selected_suggestion = 0;
-        state->input.completion_scroll_top = 0;
+// Servers can answer with thousands of items; the menu shows the first ones
+// and decoding stops there, without reading the rest of the message
+#define LSP_MAX_COMPLETION_ITEMS 200
+
+// Adds the items of a completion array; true if it was cut at LSP_MAX_COMPLETION_ITEMS
+static bool lsp_pull_completion_items(EditorState *state, JsonPull *jp, int *num_items) {
+    while (json_pull_next_item(jp)) {
+        if (*num_items == LSP_MAX_COMPLETION_ITEMS) {
+            json_pull_leave(jp);
+            return true;
+        }
+        // Only now, when we know we have suggestions, do we enter completion mode.
+        if ((*num_items)++ == 0 && state->input.completion_mode == COMPLETION_NONE) {
+            state->input.completion_mode = COMPLETION_TEXT;
+            state->input.selected_suggestion = 0;
+            state->input.completion_scroll_top = 0;
+        }
+        char *label, *detail, *insert_text;
+        if (lsp_pull_completion_item(jp, &label, &detail, &insert_text)) {
+            add_suggestion(state, label, detail, insert_text);
+        }
+        free(label);
+        free(detail);
+        free(insert_text);
     }
-    
-    size_t num_items = json_array_size(items);
-    for (size_t i = 0; i < num_items; i++) {
-        json_t *item = json_array_get(items, i);
-        json_t *label = json_object_get(item, "label");
-        json_t *detail = json_object_get(item, "detail");
-        json_t *insert_text = json_object_get(item, "insertText");
-        
-        if (json_is_string(label)) {
-            const char *label_str = json_string_value(label);
-            const char *detail_str = json_is_string(detail) ? json_string_value(detail) : NULL;
-            const char *insert_str = json_is_string(insert_text) ? json_string_value(insert_text) : NULL;
-            
-            add_suggestion(state, label_str, detail_str, insert_str);
+    return false;
+}
+
+void lsp_parse_completion(EditorState *state, const char *json_response, const char *prefix) {
+    JsonPull jp;
+    json_pull_init(&jp, json_response, strlen(json_response));
+    if (!json_pull_enter_object(&jp) || !json_pull_find_key(&jp, "result")) return;
+    
+    // The result is either the item array or a CompletionList holding it.
+    // A bare array is complete; a truncated list never is.
+    int num_items = 0;
+    bool incomplete = false, truncated = false;
+    if (json_pull_enter_object(&jp)) {
+        char key[32];
+        while (json_pull_next_key(&jp, key, sizeof(key))) {
+            if (strcmp(key, "isIncomplete") == 0) {
+                incomplete = json_pull_peek(&jp) == JSON_PULL_TRUE;
+                json_pull_skip(&jp);
+            } else if (strcmp(key, "items") == 0 && json_pull_enter_array(&jp)) {
+                truncated = lsp_pull_completion_items(state, &jp, &num_items);
+            } else {
+                json_pull_skip(&jp);
+            }
         }
+    } else if (json_pull_enter_array(&jp)) {
+        truncated = lsp_pull_completion_items(state, &jp, &num_items);
     }
+    if (jp.error) truncated = true; // keep what was read, but ask again on the next key
+    lsp_log("Completion: %d items decoded%s\n", num_items, incomplete || truncated ? " (incomplete)" : "");
+    
+    // Typing on from here is filtered locally until the server has to be asked again
+    editor_cache_completion(state, prefix, incomplete || truncated);
     
     if (state->input.num_suggestions > 0 && !state->input.completion_win) {
         // Create completion window if it doesn't exist
@@ -1075,8 +1627,6 @@ void lsp_parse_completion(EditorState *state, const char *json_response) {
         state->input.completion_win = newwin(win_height, win_width, start_y, start_x);
         keypad(state->input.completion_win, TRUE);
     }
-    
-    lsp_free_message(msg);
 }
 
 void lsp_send_initialize(EditorState *state) {
@@ -1107,6 +1657,28 @@ void lsp_send_initialize(EditorState *state) {
     json_object_set_new(textDocument, "implementation", json_object());
     json_object_set_new(textDocument, "documentSymbol", json_object());
 
+    /* Semantic tokens: full results with deltas after edits, and ranges for the lines in view */
+    json_t *semanticTokens = json_object();
+    json_t *semanticRequests = json_object();
+    json_t *semanticFull = json_object();
+    json_t *tokenTypes = json_array();
+    const char *token_types[] = { "namespace", "type", "class", "enum", "interface", "struct", "typeParameter",
+                                  "parameter", "variable", "property", "enumMember", "function", "method",
+                                  "macro", "keyword", "modifier", "comment", "string", "number", "operator" };
+    for (size_t i = 0; i < sizeof(token_types) / sizeof(token_types[0]); i++) {
+        json_array_append_new(tokenTypes, json_string(token_types[i]));
+    }
+    json_t *formats = json_array();
+    json_array_append_new(formats, json_string("relative"));
+    json_object_set_new(semanticFull, "delta", json_true());
+    json_object_set_new(semanticRequests, "full", semanticFull);
+    json_object_set_new(semanticRequests, "range", json_true());
+    json_object_set_new(semanticTokens, "requests", semanticRequests);
+    json_object_set_new(semanticTokens, "tokenTypes", tokenTypes);
+    json_object_set_new(semanticTokens, "tokenModifiers", json_array());
+    json_object_set_new(semanticTokens, "formats", formats);
+    json_object_set_new(textDocument, "semanticTokens", semanticTokens);
+
     /* Declare code action capability so the server returns full CodeAction objects
      * (with edit/command fields) instead of the legacy Command-only format. */
     json_t *codeAction            = json_object();
@@ -1129,35 +1701,13 @@ void lsp_send_initialize(EditorState *state) {
     json_object_set_new(params, "processId", json_integer(getpid()));
     json_object_set_new(params, "capabilities", capabilities);
 
-    char* project_root = find_project_root(state->buffer.filename);
-    char root_path_buffer[PATH_MAX]; // Buffer para o fallback
-    char* root_path_for_lsp = NULL;
-
-    if (project_root) {
-        root_path_for_lsp = project_root;
-    } else {
-        // Fallback: se não encontrar, usa o diretório de trabalho atual
-        if (getcwd(root_path_buffer, sizeof(root_path_buffer)) != NULL) {
-            root_path_for_lsp = root_path_buffer;
-        }
-    }
-
-    if (root_path_for_lsp) {
-        char *uri = lsp_get_uri_from_path(root_path_for_lsp);
-        if (uri) {
-            json_object_set_new(params, "rootUri", json_string(uri));
-            free(uri);
-        }
-    } else {
-       json_object_set_new(params, "rootUri", json_string("file:///tmp"));
-    }
+    LspClient *client = state->lsp.client;
+    json_object_set_new(params, "rootUri", json_string(client->rootUri ? client->rootUri : "file:///tmp"));
 
     json_t *initOptions = json_object();
-    if (strcmp(state->lsp.client->languageId, "c") == 0 || strcmp(state->lsp.client->languageId, "cpp") == 0) {
-        if (root_path_for_lsp) {
-            json_object_set_new(initOptions, "compilationDatabasePath", json_string(root_path_for_lsp));
-        }
-    } else if (strcmp(state->lsp.client->languageId, "python") == 0) {
+    if (client->compilationDatabase) {
+        json_object_set_new(initOptions, "compilationDatabasePath", json_string(client->compilationDatabase));
+    } else if (strcmp(client->languageId, "python") == 0) {
         json_t *pylsp_plugins = json_object();
         json_t *ruff_plugin = json_object();
         json_object_set_new(ruff_plugin, "enabled", json_true());
@@ -1177,103 +1727,53 @@ void lsp_send_initialize(EditorState *state) {
         json_decref(initOptions);
     }
             
-    LspMessage *msg = lsp_create_message();
-    msg->id = strdup("1");
-    msg->method = strdup("initialize");
-    msg->params = params;
-    char *json_str = lsp_serialize_message(msg);
-    
-    A2_LOG(LOG_DEBUG, TAG_LSP, "Sending initialization message:\n%s", json_str);
-    
-    // Add Content-Length header as per LSP protocol
-    char header[100];
-    size_t content_length = strlen(json_str);
-    snprintf(header, sizeof(header), "Content-Length: %zu\r\n\r\n", content_length);
-    
-    // Send header followed by JSON content
-    write(state->lsp.client->stdin_fd, header, strlen(header));
-    ssize_t bytes_written = write(state->lsp.client->stdin_fd, json_str, content_length);
-    
-    A2_LOG(LOG_DEBUG, TAG_LSP, "Bytes written: %zd (header: %zu, content: %zu)", 
-            bytes_written, strlen(header), content_length);
-
-    if (project_root) {
-        free(project_root);
-    }
-    
-    // lsp_send_message(state, json_str); // This call is redundant and was removed.
-    free(json_str);
-    lsp_free_message(msg);
+    A2_LOG(LOG_DEBUG, TAG_LSP, "Sending initialization message");
+    lsp_send_request(client, NULL, LSP_REQ_INITIALIZE, "initialize", params, NULL, 0, false);
 }
 
 
 void lsp_send_message(EditorState *state, const char *json_message) {
     if (!lsp_is_available(state) || !json_message) return;
     
-    char header[100];
-    size_t content_length = strlen(json_message);
-    snprintf(header, sizeof(header), "Content-Length: %zu\r\n\r\n", content_length);
-    
-    lsp_log("Sending header: %s", header);
     lsp_log("Sending message: %s\n", json_message);
     
-    write(state->lsp.client->stdin_fd, header, strlen(header));
-    write(state->lsp.client->stdin_fd, json_message, content_length);
+    // Framed and written by the I/O thread; never blocks on a server that stopped reading
+    lsp_transport_send(state->lsp.client->transport, json_message, strlen(json_message));
 }
 
 void lsp_send_did_change(EditorState *state) {
-    if (!lsp_is_available(state)) return;
-    
-    // Build the file content in a simpler way
-    size_t total_length = 0;
-    for (int i = 0; i < state->buffer.num_lines; i++) {
-        if (state->buffer.lines[i]) {
-            total_length += strlen(state->buffer.lines[i]) + 1; // +1 for newline
-        }
-    }
-    
-    char *content = malloc(total_length + 1);
-    if (!content) return;
-    
-    content[0] = '\0';
-    for (int i = 0; i < state->buffer.num_lines; i++) {
-        if (state->buffer.lines[i]) {
-            strcat(content, state->buffer.lines[i]);
-            strcat(content, "\n");
-        }
-    }
-    
-    // Escape content for JSON
-    char *escaped_content = json_escape_string(content);
-    free(content);
-    
-    if (!escaped_content) {
-        lsp_log("Failed to escape content\n");
-        return;
+    if (!lsp_is_available(state) || !state->lsp.document) return;
+    
+    // Incremental servers get only the changed range; full sync (or a copy that
+    // is missing or unchanged) sends the whole document
+    char *change = NULL;
+    if (state->lsp.client->sync_kind == LSP_SYNC_INCREMENTAL && state->lsp.document->synced) {
+        change = lsp_build_range_change(state);
+    }
+    
+    LspWriter w = {0};
+    char version_buf[64];
+    snprintf(version_buf, sizeof(version_buf), "\",\"version\":%d},\"contentChanges\":[", state->lsp.document->version);
+    lsp_writer_str(&w, "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didChange\",\"params\":{\"textDocument\":{\"uri\":\"");
+    lsp_writer_escaped(&w, state->lsp.document->uri, strlen(state->lsp.document->uri));
+    lsp_writer_str(&w, version_buf);
+    if (change) {
+        lsp_writer_str(&w, change);
+        free(change);
+    } else {
+        lsp_writer_str(&w, "{\"text\":\"");
+        lsp_write_document_text(&w, state);
+        lsp_writer_str(&w, "\"}");
+        if (!w.failed) lsp_snapshot_reset(state);
     }
-    
-    // Create didChange message
-    char *uri = lsp_get_uri_from_path(state->buffer.filename);
-    char *change_msg_format = "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didChange\",\"params\":{\"textDocument\":{\"uri\":\"%s\",\"version\":%d},\"contentChanges\":[{\"text\":\"%s\"}]}}";
-    
-    size_t needed_size = snprintf(NULL, 0, change_msg_format, uri, state->lsp.document->version, escaped_content) + 1;
-    char *change_buf = malloc(needed_size);
-    if (!change_buf) {
+    lsp_writer_str(&w, "]}}");
+    if (w.failed) {
         lsp_log("Failed to allocate buffer for didChange\n");
-        free(uri);
-        free(escaped_content);
+        lsp_snapshot_free(state->lsp.document); // resync with the full text next time
+        lsp_writer_free(&w);
         return;
     }
-    snprintf(change_buf, needed_size, change_msg_format, uri, 
-             state->lsp.document->version, escaped_content);
-    
-    lsp_log("Sending didChange: %s\n", change_buf);
-    
-    lsp_send_message(state, change_buf);
-    
-    free(change_buf);
-    free(uri);
-    free(escaped_content);
+    lsp_send_writer(state, &w, "didChange");
     state->lsp.document->version++;
     state->lsp.document->needs_update = false;
 }
@@ -1301,18 +1801,6 @@ bool lsp_is_ready(EditorState *state) {
 void lsp_process_messages(EditorState *state) {
     if (!lsp_is_available(state)) return;
     
-    fd_set readfds;
-    struct timeval tv = {0, 10000}; // 10ms timeout
-    
-    FD_ZERO(&readfds);
-    FD_SET(state->lsp.client->stdout_fd, &readfds);
-    
-    int retval = select(state->lsp.client->stdout_fd + 1, &readfds, NULL, NULL, &tv);
-    if (retval <= 0) return;
-    
-    char buffer[4096];
-    ssize_t bytes_read = read(state->lsp.client->stdout_fd, buffer, sizeof(buffer) - 1);
-    
     time_t now = time(NULL);
     if (state->lsp.client && !state->lsp.client->initialized && 
         now - state->lsp.init_time > 5) {
@@ -1327,123 +1815,170 @@ void lsp_process_messages(EditorState *state) {
         }
     }
     
-    if (bytes_read > 0) {
-        buffer[bytes_read] = '\0';
-        lsp_log("Raw data received: %s\n", buffer);
-        lsp_process_received_data(state, buffer, bytes_read);
+    lsp_poll_messages(state);
+}
+
+// Opens the documents of every editor that attached while the server started
+static void lsp_on_initialize(LspClient *client, LspMessage *msg) {
+    if (!msg->result) return;
+    lsp_log("Initialize response received\n");
+    client->sync_kind = lsp_read_sync_kind(msg->result);
+    lsp_read_semantic_legend(client, msg->result);
+    client->ready = true;
+    for (int i = 0; i < client->num_users; i++) {
+        lsp_did_open(client->users[i]);
     }
 }
 
-void lsp_process_received_data(EditorState *state, const char *buffer, size_t buffer_len) {
-    static char *message_buffer = NULL;
-    static size_t message_pos = 0;
-    static size_t buffer_capacity = 0;
+static void lsp_on_definition(EditorState *state, LspMessage *msg, const char *json_message) {
+    (void)json_message;
+    if (!msg->result) return;
+    lsp_log("Definition response received\n");
+    lsp_handle_definition_response(state, msg->result);
+}
 
-    // Ensure the buffer has capacity for the new data
-    if (message_pos + buffer_len + 1 > buffer_capacity) {
-        size_t new_capacity = buffer_capacity == 0 ? 32768 : buffer_capacity;
-        while (new_capacity < message_pos + buffer_len + 1) {
-            new_capacity *= 2;
-        }
-        char *new_buffer = realloc(message_buffer, new_capacity);
-        if (!new_buffer) {
-            lsp_log("Failed to reallocate LSP message buffer\n");
-            free(message_buffer);
-            message_buffer = NULL;
-            message_pos = 0;
-            buffer_capacity = 0;
-            return;
+static void lsp_on_document_symbols(EditorState *state, LspMessage *msg, const char *json_message) {
+    (void)json_message;
+    if (!msg->result) return;
+    lsp_log("Document symbols received\n");
+    json_t *symbols_array = msg->result;
+    if (json_is_array(symbols_array)) {
+        state->lsp.num_symbols = json_array_size(symbols_array);
+        state->lsp.symbols = malloc(sizeof(LspSymbol) * state->lsp.num_symbols);
+        for (int i = 0; i < state->lsp.num_symbols; i++) {
+            json_t *symbol_obj = json_array_get(symbols_array, i);
+            const char *name = json_string_value(json_object_get(symbol_obj, "name"));
+            int kind = json_integer_value(json_object_get(symbol_obj, "kind"));
+            json_t *location = json_object_get(symbol_obj, "location");
+            if (!location) location = symbol_obj; // Alguns LSPs aninham de forma diferente
+            json_t *range = json_object_get(location, "range");
+            json_t *start = json_object_get(range, "start");
+            int line = json_integer_value(json_object_get(start, "line"));
+
+            state->lsp.symbols[i].name = strdup(name ? name : "unknown");
+            state->lsp.symbols[i].kind = kind;
+            state->lsp.symbols[i].line = line;
         }
-        message_buffer = new_buffer;
-        buffer_capacity = new_capacity;
     }
-    
-    // Add new data to the buffer
-    memcpy(message_buffer + message_pos, buffer, buffer_len);
-    message_pos += buffer_len;
-    message_buffer[message_pos] = '\0';
-    
-    // Process complete messages
-    char *ptr = message_buffer;
-    while (ptr < message_buffer + message_pos) {
-        char *content_length_start = strstr(ptr, "Content-Length:");
-        if (!content_length_start) break;
-        
-        char *header_end = strstr(content_length_start, "\r\n\r\n");
-        if (!header_end) break;
-        
-        long content_length = strtol(content_length_start + 15, NULL, 10);
-        if (content_length <= 0) {
-             ptr = header_end + 4;
-             continue;
-        }
-        char *json_start = header_end + 4;
-        
-        if ((size_t)(message_buffer + message_pos - json_start) < (size_t)content_length) break;
-        
-        // Allocate memory for the JSON message
-        char *json_message = malloc(content_length + 1);
-        if (!json_message) {
-            lsp_log("Failed to allocate buffer for JSON message\n");
-            ptr = json_start + content_length; // Skip this message
-            continue;
+}
+
+static void lsp_on_code_actions(EditorState *state, LspMessage *msg, const char *json_message) {
+    (void)json_message;
+    /* Code action response — result may be null/empty if no actions are available */
+    lsp_log("Code action response received\n");
+    lsp_handle_code_action_response(state, msg->result);
+}
+
+// msg is NULL: a full result for a large file is a long array of numbers, read in one pass
+static void lsp_on_semantic_tokens(EditorState *state, LspMessage *msg, const char *json_message) {
+    (void)msg;
+    LspDocumentState *doc = state->lsp.document;
+    if (!doc) return;
+    if (!lsp_semantic_read_full(&doc->semantic, json_message)) {
+        // full_version stays behind, so the whole document is asked for again
+        lsp_log("Semantic tokens: no usable result\n");
+        doc->semantic.full_retry_ms = lsp_now_ms() + LSP_SEMANTIC_RETRY_MS;
+        return;
+    }
+    doc->semantic.full_version = doc->semantic.full_requested;
+    // After an edit the lines no longer match; the delta for it is on its way
+    if (doc->version == doc->semantic.full_version) {
+        lsp_semantic_apply(state, doc->semantic.data, doc->semantic.len, 0, state->buffer.num_lines);
+    }
+}
+
+static void lsp_on_semantic_range(EditorState *state, LspMessage *msg, const char *json_message) {
+    (void)msg;
+    LspDocumentState *doc = state->lsp.document;
+    if (!doc || doc->version != doc->semantic.range_version) return;
+    lsp_semantic_read_range(state, json_message, doc->semantic.range_first, doc->semantic.range_end);
+}
+
+// What routing a message needs, read without decoding the rest of it
+typedef struct {
+    char method[128];
+    char id[32];
+    char *uri; // params.uri, for diagnostics
+} LspEnvelope;
+
+static void lsp_read_envelope(const char *json_message, size_t len, LspEnvelope *env) {
+    memset(env, 0, sizeof(*env));
+    JsonPull jp;
+    json_pull_init(&jp, json_message, len);
+    if (!json_pull_enter_object(&jp)) return;
+    char key[32];
+    long long id;
+    while (json_pull_next_key(&jp, key, sizeof(key))) {
+        if (strcmp(key, "method") == 0 && json_pull_peek(&jp) == JSON_PULL_STRING) {
+            char *method = json_pull_string(&jp);
+            if (method) snprintf(env->method, sizeof(env->method), "%s", method);
+            free(method);
+        } else if (strcmp(key, "id") == 0 && json_pull_peek(&jp) == JSON_PULL_STRING) {
+            char *id_str = json_pull_string(&jp);
+            if (id_str) snprintf(env->id, sizeof(env->id), "%s", id_str);
+            free(id_str);
+        } else if (strcmp(key, "id") == 0 && json_pull_peek(&jp) == JSON_PULL_NUMBER) {
+            if (json_pull_int(&jp, &id)) snprintf(env->id, sizeof(env->id), "%lld", id);
+        } else if (strcmp(key, "params") == 0 && !env->uri && json_pull_enter_object(&jp)) {
+            if (json_pull_find_key(&jp, "uri")) {
+                env->uri = json_pull_string(&jp);
+                json_pull_leave(&jp);
+            }
+        } else {
+            json_pull_skip(&jp);
         }
-        memcpy(json_message, json_start, content_length);
-        json_message[content_length] = '\0';
-        
-        lsp_log("Processing JSON message: %s\n", json_message);
-        
-        LspMessage *msg = lsp_parse_message(json_message);
-        if (msg) {
-            if (msg->method && strstr(msg->method, "textDocument/publishDiagnostics")) {
-                lsp_parse_diagnostics(state, json_message);
-            } else if (msg->id && strcmp(msg->id, "1") == 0 && msg->result) {
-                lsp_log("Initialize response received\n");
-                lsp_did_open(state);
-            } else if (msg->id && strcmp(msg->id, "3") == 0 && msg->result) { // Resposta do autocompletar
-                lsp_log("Completion response received\n");
-                lsp_parse_completion(state, json_message);
-            } else if (msg->id && strcmp(msg->id, "2") == 0 && msg->result) { // Resposta do "ir para definição"
-                lsp_log("Definition response received\n");
-                lsp_handle_definition_response(state, msg->result);
-            } else if (msg->id && strcmp(msg->id, "4") == 0 && msg->result) { // Resposta do "documentSymbol"
-                lsp_log("Document symbols received\n");
-                json_t *symbols_array = msg->result;
-                if (json_is_array(symbols_array)) {
-                    state->lsp.num_symbols = json_array_size(symbols_array);
-                    state->lsp.symbols = malloc(sizeof(LspSymbol) * state->lsp.num_symbols);
-                    for (int i = 0; i < state->lsp.num_symbols; i++) {
-                        json_t *symbol_obj = json_array_get(symbols_array, i);
-                        const char *name = json_string_value(json_object_get(symbol_obj, "name"));
-                        int kind = json_integer_value(json_object_get(symbol_obj, "kind"));
-                        json_t *location = json_object_get(symbol_obj, "location");
-                        if (!location) location = symbol_obj; // Alguns LSPs aninham de forma diferente
-                        json_t *range = json_object_get(location, "range");
-                        json_t *start = json_object_get(range, "start");
-                        int line = json_integer_value(json_object_get(start, "line"));
-
-                        state->lsp.symbols[i].name = strdup(name ? name : "unknown");
-                        state->lsp.symbols[i].kind = kind;
-                        state->lsp.symbols[i].line = line;
-                    }
+    }
+}
+
+// Acts on one message from the server: diagnostics go to the editor holding
+// the file they are for, responses to the editor that sent the request
+static void lsp_handle_message(LspClient *client, const char *json_message) {
+    size_t len = strlen(json_message);
+    lsp_log("Processing message (%zu bytes): %.200s\n", len, json_message);
+    
+    LspEnvelope env;
+    lsp_read_envelope(json_message, len, &env);
+    if (env.method[0]) {
+        if (strcmp(env.method, "textDocument/publishDiagnostics") == 0) {
+            for (int i = 0; env.uri && i < client->num_users; i++) {
+                EditorState *user = client->users[i];
+                // Only the editor holding the file sent the text they describe
+                if (user->lsp.document && user->lsp.document->opened && user->lsp.document->uri &&
+                    strcmp(user->lsp.document->uri, env.uri) == 0) {
+                    lsp_parse_diagnostics(user, json_message);
                 }
-            } else if (msg->id && strcmp(msg->id, "5") == 0) {
-                /* Code action response — result may be null/empty if no actions are available */
-                lsp_log("Code action response received\n");
-                lsp_handle_code_action_response(state, msg->result);
             }
+        }
+    } else if (env.id[0]) {
+        LspPendingRequest req;
+        if (!lsp_take_request(client, env.id, &req) || (req.kind != LSP_REQ_INITIALIZE && !req.owner)) {
+            lsp_log("Dropping response %s: cancelled, stale or unknown\n", env.id);
+        } else if (req.kind == LSP_REQ_COMPLETION) {
+            // Completion lists can be megabytes, so the text is decoded selectively,
+            // and cached for the word the request was sent with
+            lsp_parse_completion(req.owner, json_message, req.prefix);
+        } else if (req.kind == LSP_REQ_SEMANTIC_FULL || req.kind == LSP_REQ_SEMANTIC_RANGE) {
+            req.handler(req.owner, NULL, json_message);
+        } else {
+            // The other answers are small; they get the whole tree
+            LspMessage *msg = lsp_parse_message(json_message);
+            if (msg && req.kind == LSP_REQ_INITIALIZE) lsp_on_initialize(client, msg);
+            else if (msg) req.handler(req.owner, msg, json_message);
             lsp_free_message(msg);
         }
-        
-        free(json_message); // Free the message memory
-        
-        ptr = json_start + content_length;
     }
-    
-    if (ptr > message_buffer) {
-        size_t remaining = message_pos - (ptr - message_buffer);
-        memmove(message_buffer, ptr, remaining);
-        message_pos = remaining;
+    free(env.uri);
+}
+
+// Handles the messages the I/O thread received since the last call, for every
+// editor sharing the server
+void lsp_poll_messages(EditorState *state) {
+    LspClient *client = state->lsp.client;
+    if (!client || (uintptr_t)client < 0x1000 || !client->transport) return;
+    char *json_message;
+    while ((json_message = lsp_transport_next(client->transport))) {
+        lsp_handle_message(client, json_message);
+        free(json_message);
     }
 }
 
@@ -1521,10 +2056,7 @@ void lsp_draw_diagnostics(WINDOW *win, EditorState *state) {
 
 void lsp_send_completion_request(EditorState *state) {
     if (!lsp_is_available(state)) return;
-
-    LspMessage *msg = lsp_create_message();
-    msg->id = strdup("3"); // ID para respostas de autocompletar
-    msg->method = strdup("textDocument/completion");
+    lsp_flush_changes(state);
 
     json_t *params = json_object();
     
@@ -1534,39 +2066,82 @@ void lsp_send_completion_request(EditorState *state) {
 
     json_t *position = json_object();
     json_object_set_new(position, "line", json_integer(state->cursor.line));
-    json_object_set_new(position, "character", json_integer(state->cursor.col));
+    json_object_set_new(position, "character", json_integer(lsp_cursor_utf16(state)));
     json_object_set_new(params, "position", position);
     
-    msg->params = params;
-
-    char *json_str = lsp_serialize_message(msg);
-    lsp_send_message(state, json_str);
-
-    free(json_str);
-    lsp_free_message(msg);
+    lsp_send_request(state->lsp.client, state, LSP_REQ_COMPLETION, "textDocument/completion", params,
+                     NULL, LSP_COMPLETION_TIMEOUT_MS, true);
 }
 
-void lsp_check_and_process_messages(EditorState *state) {
-    if (!lsp_is_available(state)) return;
+static bool lsp_request_in_flight(LspClient *client, EditorState *owner, int kind) {
+    for (int i = 0; i < client->num_pending; i++) {
+        if (client->pending[i].kind == kind && client->pending[i].owner == owner) return true;
+    }
+    return false;
+}
 
-    fd_set readfds;
-    FD_ZERO(&readfds);
-    FD_SET(state->lsp.client->stdout_fd, &readfds);
+// Called from the main loop for the editors on screen. The whole document is
+// asked for once per edit (as a delta of the last result when the server keeps
+// them); the lines in view are asked for on their own while that answer is
+// still on its way, or after every scroll and edit from servers that only do ranges.
+void lsp_update_semantic_tokens(EditorState *state, int rows) {
+    if (!global_config.lsp_semantic_tokens || !lsp_is_available(state) || !state->lsp.document) return;
+    LspClient *client = state->lsp.client;
+    LspDocumentState *doc = state->lsp.document;
+    LspSemanticTokens *tokens = &doc->semantic;
+    if (!client->ready || !client->semantic_colors || !doc->opened || doc->needs_update) return;
+
+    bool full_in_flight = lsp_request_in_flight(client, state, LSP_REQ_SEMANTIC_FULL);
+    // Only an answer sets full_version: a request that timed out or failed is sent again
+    if (client->semantic_full && tokens->full_version != doc->version && !full_in_flight &&
+        lsp_now_ms() >= tokens->full_retry_ms) {
+        json_t *params = json_object();
+        json_t *textDocument = json_object();
+        json_object_set_new(textDocument, "uri", json_string(doc->uri));
+        json_object_set_new(params, "textDocument", textDocument);
+        const char *method = "textDocument/semanticTokens/full";
+        if (client->semantic_delta && tokens->result_id) {
+            method = "textDocument/semanticTokens/full/delta";
+            json_object_set_new(params, "previousResultId", json_string(tokens->result_id));
+        }
+        lsp_send_request(client, state, LSP_REQ_SEMANTIC_FULL, method, params, lsp_on_semantic_tokens,
+                         LSP_REQUEST_TIMEOUT_MS, false);
+        tokens->full_requested = doc->version;
+        full_in_flight = true;
+    }
+    if (!client->semantic_range) return;
 
-    struct timeval timeout;
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 0; // Timeout zero para não bloquear
+    // With word wrap top_line counts screen rows; the lines around the cursor are the ones in view
+    int first = state->view.word_wrap ? max(0, state->cursor.line - rows) : state->view.top_line;
+    int end = min((state->view.word_wrap ? state->cursor.line : first) + rows, state->buffer.num_lines);
+    bool moved = first != tokens->range_first || end != tokens->range_end;
+    bool wanted = client->semantic_full ? moved && full_in_flight : moved || tokens->range_version != doc->version;
+    if (!wanted || first >= end || lsp_semantic_lines_current(state, first, end)) return;
 
-    int activity = select(state->lsp.client->stdout_fd + 1, &readfds, NULL, NULL, &timeout);
+    json_t *params = json_object();
+    json_t *textDocument = json_object();
+    json_object_set_new(textDocument, "uri", json_string(doc->uri));
+    json_object_set_new(params, "textDocument", textDocument);
+    json_t *range = json_object();
+    json_t *start = json_object();
+    json_object_set_new(start, "line", json_integer(first));
+    json_object_set_new(start, "character", json_integer(0));
+    json_t *stop = json_object();
+    json_object_set_new(stop, "line", json_integer(end));
+    json_object_set_new(stop, "character", json_integer(0));
+    json_object_set_new(range, "start", start);
+    json_object_set_new(range, "end", stop);
+    json_object_set_new(params, "range", range);
+    lsp_send_request(client, state, LSP_REQ_SEMANTIC_RANGE, "textDocument/semanticTokens/range", params,
+                     lsp_on_semantic_range, LSP_REQUEST_TIMEOUT_MS, false);
+    tokens->range_first = first;
+    tokens->range_end = end;
+    tokens->range_version = doc->version;
+}
 
-    if (activity > 0 && FD_ISSET(state->lsp.client->stdout_fd, &readfds)) {
-        char buffer[4096];
-        ssize_t bytes_lidos = read(state->lsp.client->stdout_fd, buffer, sizeof(buffer) - 1);
-        if (bytes_lidos > 0) {
-            buffer[bytes_lidos] = '\0';
-            lsp_process_received_data(state, buffer, bytes_lidos);
-        }
-    }
+void lsp_check_and_process_messages(EditorState *state) {
+    if (!lsp_is_available(state)) return;
+    lsp_poll_messages(state);
 }
 
 
@@ -1596,7 +2171,7 @@ void lsp_handle_definition_response(EditorState *state, json_t *result) {
         if (jw->type == WINDOW_TYPE_EDITOR && strcmp(jw->state->buffer.filename, path) == 0) {
             ACTIVE_WS->active_window_idx = i;
             jw->state->cursor.line = line;
-            jw->state->cursor.col = character;
+            jw->state->cursor.col = lsp_byte_col(lsp_line_at(jw->state, line), character);
             editor_set_status_msg(jw->state, "Jumped to definition.");
             return;
         }
@@ -1605,12 +2180,13 @@ void lsp_handle_definition_response(EditorState *state, json_t *result) {
     // Se não, abre no editor atual
     load_file(state, path);
     state->cursor.line = line;
-    state->cursor.col = character;
+    state->cursor.col = lsp_byte_col(lsp_line_at(state, line), character);
     editor_set_status_msg(state, "Jumped to definition.");
 }
 
 void lsp_request_document_symbols(EditorState *state) {
     if (!lsp_is_available(state)) return;
+    lsp_flush_changes(state);
 
     // Limpa o cache de símbolos antigo
     if (state->lsp.symbols) {
@@ -1622,22 +2198,13 @@ void lsp_request_document_symbols(EditorState *state) {
         state->lsp.num_symbols = 0;
     }
 
-    LspMessage *msg = lsp_create_message();
-    msg->id = strdup("4"); // Um novo ID para esta requisição
-    msg->method = strdup("textDocument/documentSymbol");
-
     json_t *params = json_object();
     json_t *textDocument = json_object();
     json_object_set_new(textDocument, "uri", json_string(state->lsp.document->uri));
     json_object_set_new(params, "textDocument", textDocument);
     
-    msg->params = params;
-
-    char *json_str = lsp_serialize_message(msg);
-    lsp_send_message(state, json_str);
-
-    free(json_str);
-    lsp_free_message(msg);
+    lsp_send_request(state->lsp.client, state, LSP_REQ_SYMBOLS, "textDocument/documentSymbol", params,
+                     lsp_on_document_symbols, LSP_REQUEST_TIMEOUT_MS, false);
 }
 
 /* =========================================================
@@ -1663,14 +2230,11 @@ void lsp_request_code_actions(EditorState *state) {
         editor_set_status_msg(state, "LSP not available");
         return;
     }
+    lsp_flush_changes(state);
 
     /* Free any previously cached actions */
     lsp_free_code_actions(state);
 
-    LspMessage *msg = lsp_create_message();
-    msg->id     = strdup("5");
-    msg->method = strdup("textDocument/codeAction");
-
     json_t *params      = json_object();
     json_t *textDoc     = json_object();
     json_t *range       = json_object();
@@ -1684,9 +2248,9 @@ void lsp_request_code_actions(EditorState *state) {
 
     /* range = current cursor position (point, not a selection) */
     json_object_set_new(rangeStart, "line",      json_integer(state->cursor.line));
-    json_object_set_new(rangeStart, "character", json_integer(state->cursor.col));
+    json_object_set_new(rangeStart, "character", json_integer(lsp_cursor_utf16(state)));
     json_object_set_new(rangeEnd,   "line",      json_integer(state->cursor.line));
-    json_object_set_new(rangeEnd,   "character", json_integer(state->cursor.col));
+    json_object_set_new(rangeEnd,   "character", json_integer(lsp_cursor_utf16(state)));
     json_object_set_new(range, "start", rangeStart);
     json_object_set_new(range, "end",   rangeEnd);
     json_object_set_new(params, "range", range);
@@ -1700,9 +2264,11 @@ void lsp_request_code_actions(EditorState *state) {
         json_t *drs = json_object();
         json_t *dre = json_object();
         json_object_set_new(drs, "line",      json_integer(diag->range.start.line));
-        json_object_set_new(drs, "character", json_integer(diag->range.start.character));
+        json_object_set_new(drs, "character",
+                            json_integer(lsp_utf16_col(lsp_line_at(state, diag->range.start.line), diag->range.start.character)));
         json_object_set_new(dre, "line",      json_integer(diag->range.end.line));
-        json_object_set_new(dre, "character", json_integer(diag->range.end.character));
+        json_object_set_new(dre, "character",
+                            json_integer(lsp_utf16_col(lsp_line_at(state, diag->range.end.line), diag->range.end.character)));
         json_object_set_new(dr, "start", drs);
         json_object_set_new(dr, "end",   dre);
         json_object_set_new(d, "range",    dr);
@@ -1715,12 +2281,8 @@ void lsp_request_code_actions(EditorState *state) {
     json_object_set_new(context, "triggerKind", json_integer(1)); /* 1 = Invoked */
     json_object_set_new(params, "context", context);
 
-    msg->params = params;
-
-    char *json_str = lsp_serialize_message(msg);
-    lsp_send_message(state, json_str);
-    free(json_str);
-    lsp_free_message(msg);
+    lsp_send_request(state->lsp.client, state, LSP_REQ_CODE_ACTION, "textDocument/codeAction", params,
+                     lsp_on_code_actions, LSP_REQUEST_TIMEOUT_MS, true);
 
     editor_set_status_msg(state, "Requesting code actions...");
 }
@@ -1836,6 +2398,9 @@ void lsp_apply_code_action(EditorState *state, int index) {
 
         if (sl < 0 || sl >= state->buffer.num_lines) continue;
         if (el < 0 || el >= state->buffer.num_lines) continue;
+        // Spliced at the bytes the UTF-16 columns point to, never inside a character
+        sc = lsp_byte_col(buffer_line(state, sl), sc);
+        ec = lsp_byte_col(buffer_line(state, el), ec);
 
         if (sl == el) {
             /* Single-line edit: replace [sc, ec) with nt */
@@ -1852,6 +2417,7 @@ void lsp_apply_code_action(EditorState *state, int index) {
             strcat(new_line, line + ec);
             free(state->buffer.lines[sl]);
             state->buffer.lines[sl] = new_line;
+            editor_note_edit(state, sl, 1, 1);
         } else {
             /* Multi-line edit: merge prefix + nt + suffix, remove intermediate lines */
             char *sl_str = state->buffer.lines[sl];
@@ -1877,6 +2443,7 @@ void lsp_apply_code_action(EditorState *state, int index) {
                     &state->buffer.lines[el + 1],
                     sizeof(char *) * (size_t)remaining);
             state->buffer.num_lines -= to_remove;
+            editor_note_edit(state, sl, to_remove + 1, 1);
         }
     }
 
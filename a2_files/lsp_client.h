@@ -10,8 +10,13 @@ LspMessage* lsp_parse_message(const char *json_str);
 char* lsp_serialize_message(LspMessage *msg);
 void lsp_parse_diagnostics(EditorState *state, const char *json_response);
 void lsp_did_change(EditorState *state);
+void lsp_flush_changes(EditorState *state);
+bool lsp_has_pending_changes(EditorState *state);
+void lsp_flush_due_changes(EditorState *state);
+void lsp_expire_requests(EditorState *state);
 void lsp_did_save(EditorState *state);
 void lsp_shutdown(EditorState *state);
+void lsp_client_destroy(LspClient *client);
 void lsp_did_open(EditorState *state);
 char* json_escape_string(const char *str);
 void lsp_request_diagnostics(EditorState *state);
@@ -23,17 +28,20 @@ char* lsp_get_uri_from_path(const char *path);
 void lsp_init_document_state(EditorState *state);
 void lsp_free_document_state(EditorState *state);
 void lsp_cleanup_diagnostics(EditorState *state);
-void lsp_parse_completion(EditorState *state, const char *json_response);
+void lsp_build_diagnostic_index(LspDocumentState *doc);
+int lsp_diagnostics_on_line(EditorState *state, int line, const int **items);
+void lsp_parse_completion(EditorState *state, const char *json_response, const char *prefix);
 void lsp_send_initialize(EditorState *state);
 void lsp_send_message(EditorState *state, const char *json_message);
 void lsp_send_did_change(EditorState *state);
 bool lsp_process_alive(EditorState *state);
 bool lsp_is_ready(EditorState *state);
 void lsp_process_messages(EditorState *state);
-void lsp_process_received_data(EditorState *state, const char *buffer, size_t buffer_len);
+void lsp_poll_messages(EditorState *state);
 void lsp_log(const char *format, ...);
 void lsp_draw_diagnostics(WINDOW *win, EditorState *state);
 void lsp_send_completion_request(EditorState *state);
+void lsp_update_semantic_tokens(EditorState *state, int rows);
 void lsp_handle_definition_response(EditorState *state, json_t *result);
 void lsp_request_document_symbols(EditorState *state);
 void lsp_check_and_process_messages(EditorState *state);
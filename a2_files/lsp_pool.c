@@ -0,0 +1,108 @@
+#include "lsp_pool.h"
+#include "lsp_client.h"
+#include "lsp_transport.h"
+#include "logger.h"
+#include <sys/types.h>
+#include <sys/wait.h>
+
+static LspClient **servers;
+static int num_servers, servers_cap;
+
+static bool same_key(const char *a, const char *b) {
+    if (!a || !b) return a == b;
+    return strcmp(a, b) == 0;
+}
+
+static bool server_alive(const LspClient *client) {
+    return client->transport && client->server_pid > 0 && waitpid(client->server_pid, NULL, WNOHANG) == 0;
+}
+
+static void release_server(int index) {
+    LspClient *client = servers[index];
+    servers[index] = servers[--num_servers];
+    A2_LOG(LOG_INFO, TAG_LSP, "Shutting down %s server (PID %d)", client->languageId, client->server_pid);
+    lsp_client_destroy(client);
+}
+
+LspClient *lsp_pool_find(const char *languageId, const char *rootUri, const char *compilationDatabase) {
+    for (int i = 0; i < num_servers; i++) {
+        LspClient *client = servers[i];
+        if (!same_key(client->languageId, languageId) || !same_key(client->rootUri, rootUri) ||
+            !same_key(client->compilationDatabase, compilationDatabase)) {
+            continue;
+        }
+        if (server_alive(client)) return client;
+    }
+    return NULL;
+}
+
+void lsp_pool_add(LspClient *client) {
+    if (num_servers == servers_cap) {
+        int new_cap = servers_cap > 0 ? servers_cap * 2 : 4;
+        LspClient **grown = realloc(servers, sizeof(LspClient *) * new_cap);
+        if (!grown) return; // still works, just never shared
+        servers = grown;
+        servers_cap = new_cap;
+    }
+    servers[num_servers++] = client;
+}
+
+bool lsp_pool_attach(LspClient *client, EditorState *state) {
+    for (int i = 0; i < client->num_users; i++) {
+        if (client->users[i] == state) return true;
+    }
+    if (client->num_users == client->users_cap) {
+        int new_cap = client->users_cap > 0 ? client->users_cap * 2 : 4;
+        EditorState **grown = realloc(client->users, sizeof(EditorState *) * new_cap);
+        if (!grown) return false;
+        client->users = grown;
+        client->users_cap = new_cap;
+    }
+    client->users[client->num_users++] = state;
+    client->idle_since = 0;
+    return true;
+}
+
+void lsp_pool_detach(LspClient *client, EditorState *state) {
+    for (int i = 0; i < client->num_users; i++) {
+        if (client->users[i] == state) {
+            client->users[i] = client->users[--client->num_users];
+            break;
+        }
+    }
+    if (client->num_users > 0) return;
+
+    int index = -1;
+    for (int i = 0; i < num_servers; i++) {
+        if (servers[i] == client) index = i;
+    }
+    if (index < 0) {
+        lsp_client_destroy(client); // never made it into the pool
+    } else if (global_config.lsp_idle_timeout_sec <= 0 || !server_alive(client)) {
+        release_server(index);
+    } else {
+        client->idle_since = time(NULL);
+    }
+}
+
+void lsp_pool_reap_idle(void) {
+    if (num_servers == 0) return;
+    time_t now = time(NULL);
+    for (int i = num_servers - 1; i >= 0; i--) {
+        LspClient *client = servers[i];
+        if (client->num_users > 0) continue;
+        // Nobody polls an idle server; whatever it still sends is dropped here
+        char *message;
+        while (client->transport && (message = lsp_transport_next(client->transport))) free(message);
+        if (now - client->idle_since >= global_config.lsp_idle_timeout_sec || !server_alive(client)) {
+            release_server(i);
+        }
+    }
+}
+
+void lsp_pool_shutdown_all(void) {
+    while (num_servers > 0) release_server(num_servers - 1);
+    free(servers);
+    servers = NULL;
+    servers_cap = 0;
+}
@@ -0,0 +1,31 @@
+#ifndef LSP_POOL_H
+#define LSP_POOL_H
+
+#include "defs.h"
+
+// Running language servers, shared between editors.
+// A server is keyed by language, project root and compile database; every
+// editor with a file in that project attaches to it instead of forking its own
+// clangd or pylsp, and the server keeps one open document per file. When the
+// last editor detaches the server stays up for lsp_idle_timeout_sec, so
+// reopening a file in the project doesn't pay for startup and indexing again.
+
+// A live server for the key, or NULL. Dead servers are never handed out.
+LspClient *lsp_pool_find(const char *languageId, const char *rootUri, const char *compilationDatabase);
+
+// Takes ownership of a freshly started server
+void lsp_pool_add(LspClient *client);
+
+bool lsp_pool_attach(LspClient *client, EditorState *state);
+
+// The server shuts down once idle for the timeout (right away with a timeout
+// of 0, or if it already died). The client must not be used after this.
+void lsp_pool_detach(LspClient *client, EditorState *state);
+
+// Called from the main loop: shuts down servers idle for longer than the timeout
+void lsp_pool_reap_idle(void);
+
+// At exit
+void lsp_pool_shutdown_all(void);
+
+#endif // LSP_POOL_H
@@ -0,0 +1,255 @@
+#include "lsp_semantic.h"
+#include "json_pull.h"
+#include "themes.h"
+#include <string.h>
+
+int lsp_semantic_color(const char *token_type) {
+    static const struct {
+        const char *type;
+        int color;
+    } colors[] = {
+        { "namespace", PAIR_TYPE }, { "type", PAIR_TYPE }, { "class", PAIR_TYPE }, { "enum", PAIR_TYPE },
+        { "interface", PAIR_TYPE }, { "struct", PAIR_TYPE }, { "typeParameter", PAIR_TYPE }, { "concept", PAIR_TYPE },
+        { "function", PAIR_STD_FUNCTION }, { "method", PAIR_STD_FUNCTION },
+        { "macro", PAIR_KEYWORD }, { "keyword", PAIR_KEYWORD }, { "modifier", PAIR_KEYWORD },
+        { "comment", PAIR_COMMENT },
+        // Names the keyword tables may have colored by mistake
+        { "variable", 0 }, { "parameter", 0 }, { "property", 0 }, { "enumMember", 0 },
+    };
+    if (!token_type) return -1;
+    for (size_t i = 0; i < sizeof(colors) / sizeof(colors[0]); i++) {
+        if (strcmp(colors[i].type, token_type) == 0) return colors[i].color;
+    }
+    return -1;
+}
+
+// Appends the numbers of a JSON array to *data
+static bool pull_numbers(JsonPull *jp, unsigned int **data, int *len, int *cap) {
+    if (!json_pull_enter_array(jp)) {
+        json_pull_skip(jp);
+        return false;
+    }
+    long long value;
+    while (json_pull_next_item(jp)) {
+        if (!json_pull_int(jp, &value) || value < 0) return false;
+        if (*len == *cap) {
+            int new_cap = *cap > 0 ? *cap * 2 : 1024;
+            unsigned int *grown = realloc(*data, sizeof(unsigned int) * new_cap);
+            if (!grown) return false;
+            *data = grown;
+            *cap = new_cap;
+        }
+        (*data)[(*len)++] = (unsigned int)value;
+    }
+    return !jp->error;
+}
+
+typedef struct {
+    long long start, delete_count;
+    unsigned int *data;
+    int len, cap;
+} TokenEdit;
+
+static bool pull_edit(JsonPull *jp, TokenEdit *edit) {
+    memset(edit, 0, sizeof(*edit));
+    if (!json_pull_enter_object(jp)) return false;
+    bool ok = true;
+    char key[32];
+    while (json_pull_next_key(jp, key, sizeof(key))) {
+        if (strcmp(key, "start") == 0) ok = json_pull_int(jp, &edit->start) && ok;
+        else if (strcmp(key, "deleteCount") == 0) ok = json_pull_int(jp, &edit->delete_count) && ok;
+        else if (strcmp(key, "data") == 0) ok = pull_numbers(jp, &edit->data, &edit->len, &edit->cap) && ok;
+        else json_pull_skip(jp);
+        if (jp->error) return false;
+    }
+    return ok;
+}
+
+static int compare_edits(const void *a, const void *b) {
+    const TokenEdit *x = a, *y = b;
+    return (x->start < y->start) - (x->start > y->start);
+}
+
+// Edits address the previous array; applied from the last one back, the
+// offsets of the others stay valid
+static bool apply_edits(LspSemanticTokens *tokens, TokenEdit *edits, int num_edits) {
+    qsort(edits, num_edits, sizeof(TokenEdit), compare_edits);
+    for (int i = 0; i < num_edits; i++) {
+        TokenEdit *edit = &edits[i];
+        if (edit->start < 0 || edit->delete_count < 0 || edit->start + edit->delete_count > tokens->len) return false;
+        int new_len = tokens->len - (int)edit->delete_count + edit->len;
+        if (new_len > tokens->cap) {
+            unsigned int *grown = realloc(tokens->data, sizeof(unsigned int) * new_len);
+            if (!grown) return false;
+            tokens->data = grown;
+            tokens->cap = new_len;
+        }
+        unsigned int *at = tokens->data + edit->start;
+        memmove(at + edit->len, at + edit->delete_count, sizeof(unsigned int) * (tokens->len - edit->start - edit->delete_count));
+        if (edit->len > 0) memcpy(at, edit->data, sizeof(unsigned int) * edit->len);
+        tokens->len = new_len;
+    }
+    return true;
+}
+
+bool lsp_semantic_read_full(LspSemanticTokens *tokens, const char *json_response) {
+    JsonPull jp;
+    json_pull_init(&jp, json_response, strlen(json_response));
+    char *result_id = NULL;
+    unsigned int *data = NULL;
+    int len = 0, cap = 0;
+    TokenEdit *edits = NULL;
+    int num_edits = 0, edits_cap = 0;
+    bool ok = false, is_delta = false;
+
+    // An error or a null result leaves nothing to build on
+    if (json_pull_enter_object(&jp) && json_pull_find_key(&jp, "result") && json_pull_enter_object(&jp)) {
+        ok = true;
+        char key[32];
+        while (ok && json_pull_next_key(&jp, key, sizeof(key))) {
+            if (strcmp(key, "resultId") == 0) {
+                free(result_id);
+                result_id = json_pull_string(&jp);
+            } else if (strcmp(key, "data") == 0) {
+                ok = pull_numbers(&jp, &data, &len, &cap);
+            } else if (strcmp(key, "edits") == 0 && json_pull_enter_array(&jp)) {
+                is_delta = true;
+                while (ok && json_pull_next_item(&jp)) {
+                    if (num_edits == edits_cap) {
+                        int new_cap = edits_cap > 0 ? edits_cap * 2 : 4;
+                        TokenEdit *grown = realloc(edits, sizeof(TokenEdit) * new_cap);
+                        if (!grown) {
+                            ok = false;
+                            break;
+                        }
+                        edits = grown;
+                        edits_cap = new_cap;
+                    }
+                    ok = pull_edit(&jp, &edits[num_edits++]);
+                }
+            } else {
+                json_pull_skip(&jp);
+            }
+        }
+        ok = ok && !jp.error;
+    }
+
+    if (ok && is_delta) {
+        ok = apply_edits(tokens, edits, num_edits);
+    } else if (ok) {
+        free(tokens->data);
+        tokens->data = data;
+        tokens->len = len;
+        tokens->cap = cap;
+        data = NULL;
+    }
+    for (int i = 0; i < num_edits; i++) free(edits[i].data);
+    free(edits);
+    free(data);
+
+    // A failed delta leaves data in an unknown state: the next request is a full one
+    free(tokens->result_id);
+    tokens->result_id = ok ? result_id : NULL;
+    if (!ok) {
+        free(result_id);
+        tokens->len = 0;
+    }
+    return ok;
+}
+
+bool lsp_semantic_read_range(EditorState *state, const char *json_response, int first, int end) {
+    JsonPull jp;
+    json_pull_init(&jp, json_response, strlen(json_response));
+    if (!json_pull_enter_object(&jp) || !json_pull_find_key(&jp, "result") ||
+        !json_pull_enter_object(&jp) || !json_pull_find_key(&jp, "data")) {
+        return false;
+    }
+    unsigned int *data = NULL;
+    int len = 0, cap = 0;
+    bool ok = pull_numbers(&jp, &data, &len, &cap);
+    if (ok) lsp_semantic_apply(state, data, len, first, end);
+    free(data);
+    return ok;
+}
+
+// Byte offset of UTF-16 column unit, walking on from where the previous token
+// of the line stopped (tokens come sorted)
+static int utf16_to_byte(const char *text, int text_len, int *byte, int *at, int unit) {
+    while (*byte < text_len && *at < unit) {
+        unsigned char c = text[*byte];
+        int n = c < 0xC0 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+        *at += n == 4 ? 2 : 1; // characters beyond the BMP take a surrogate pair
+        *byte += n;
+    }
+    return *byte < text_len ? *byte : text_len;
+}
+
+void lsp_semantic_apply(EditorState *state, const unsigned int *data, int len, int first, int end) {
+    if (!state->lsp.document || !state->lsp.client) return;
+    LineSpanCache *cache = &state->lsp.document->semantic.lines;
+    const LspClient *client = state->lsp.client;
+    if (end > state->buffer.num_lines) end = state->buffer.num_lines;
+    if (first < 0) first = 0;
+
+    // Every line in the range gets a slot, so lines without tokens count as decoded
+    int next_line = first;
+    LineSpanSlot *slot = NULL;
+    const char *text = NULL;
+    int text_len = 0, byte = 0, at = 0;
+
+    unsigned int line = 0, col = 0;
+    for (int i = 0; i + 5 <= len; i += 5) {
+        if (data[i] > 0) {
+            line += data[i];
+            col = data[i + 1];
+        } else {
+            col += data[i + 1];
+        }
+        if (line >= (unsigned int)end) break;
+        if (line < (unsigned int)first) continue;
+        while (next_line <= (int)line) {
+            text = state->buffer.lines[next_line] ? state->buffer.lines[next_line] : "";
+            slot = line_cache_begin(cache, next_line, text, 0);
+            text_len = strlen(text);
+            byte = at = 0;
+            next_line++;
+        }
+
+        unsigned int type = data[i + 3];
+        int color = type < (unsigned int)client->num_semantic_types ? client->semantic_colors[type] : -1;
+        if (!slot || color < 0) continue;
+        int start = utf16_to_byte(text, text_len, &byte, &at, (int)col);
+        int stop = utf16_to_byte(text, text_len, &byte, &at, (int)(col + data[i + 2]));
+        // Spans stay sorted and disjoint, as the renderer expects
+        if (slot->count > 0 && start < slot->spans[slot->count - 1].end) continue;
+        if (start < stop) line_cache_push(slot, start, stop, color);
+    }
+    for (; next_line < end; next_line++) {
+        line_cache_begin(cache, next_line, state->buffer.lines[next_line] ? state->buffer.lines[next_line] : "", 0);
+    }
+
+    if (state->buffer.dirty_lines) {
+        for (int i = first; i < end && i < state->buffer.dirty_lines_cap; i++) state->buffer.dirty_lines[i] = true;
+    }
+}
+
+bool lsp_semantic_lines_current(EditorState *state, int first, int end) {
+    if (!state->lsp.document) return false;
+    LineSpanCache *cache = &state->lsp.document->semantic.lines;
+    for (int i = first; i < end && i < state->buffer.num_lines; i++) {
+        if (!line_cache_lookup(cache, i, state->buffer.lines[i] ? state->buffer.lines[i] : "", 0)) return false;
+    }
+    return true;
+}
+
+const LineSpanSlot *lsp_semantic_line_spans(EditorState *state, int line_idx, const char *line) {
+    if (!global_config.lsp_semantic_tokens || !state->lsp.enabled || !state->lsp.document || !line) return NULL;
+    return line_cache_lookup(&state->lsp.document->semantic.lines, line_idx, line, 0);
+}
+
+void lsp_semantic_free(LspSemanticTokens *tokens) {
+    free(tokens->data);
+    free(tokens->result_id);
+    line_cache_free(&tokens->lines);
+    memset(tokens, 0, sizeof(*tokens));
+}
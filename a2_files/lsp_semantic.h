@@ -0,0 +1,34 @@
+#ifndef LSP_SEMANTIC_H
+#define LSP_SEMANTIC_H
+
+#include "defs.h"
+
+// Semantic tokens: the server's classification of identifiers (type, macro,
+// member, parameter...), drawn over the lexer's colors. The last full result
+// is kept as the server sent it, so a later full/delta answer only carries the
+// edits to it; the decoded spans live per line in a LineSpanCache keyed by the
+// line's text, so an edited line falls back to the lexer until the next answer.
+// Range answers (the lines in view) fill the same cache.
+
+// Color pair for a legend token type; 0 draws it as plain text, -1 leaves it to the lexer
+int lsp_semantic_color(const char *token_type);
+
+// Reads a semanticTokens/full or full/delta response into tokens->data.
+// False if it can't be used; the next request is then a full one.
+bool lsp_semantic_read_full(LspSemanticTokens *tokens, const char *json_response);
+
+// Reads a semanticTokens/range response and decodes it into lines [first, end)
+bool lsp_semantic_read_range(EditorState *state, const char *json_response, int first, int end);
+
+// Decodes a token array into spans for lines [first, end), marking them for redraw
+void lsp_semantic_apply(EditorState *state, const unsigned int *data, int len, int first, int end);
+
+// True if every line in [first, end) has spans for its current text
+bool lsp_semantic_lines_current(EditorState *state, int first, int end);
+
+// Spans for the line as it is now, or NULL (not decoded yet, edited since, or turned off)
+const LineSpanSlot *lsp_semantic_line_spans(EditorState *state, int line_idx, const char *line);
+
+void lsp_semantic_free(LspSemanticTokens *tokens);
+
+#endif // LSP_SEMANTIC_H
@@ -0,0 +1,466 @@
+#include "lsp_transport.h"
+#include "logger.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#define LSP_READ_CHUNK 65536
+#define LSP_DIRECT_READ 4096    // body bytes still missing before they are read straight into the body
+#define LSP_STOP_FLUSH_MS 200   // how long lsp_transport_stop() waits for queued messages
+#define LSP_STDERR_LINE 512
+
+typedef struct LspPacket {
+    char header[40];            // Content-Length, outgoing only; written together with data
+    size_t header_len;
+    char *data;
+    size_t len;
+    size_t sent;                // of header_len + len
+    struct LspPacket *next;
+} LspPacket;
+
+typedef struct {
+    LspPacket *head, *tail;
+} LspPacketList;
+
+struct LspTransport {
+    int in_fd, out_fd, err_fd;  // server's stdin, stdout and stderr
+    int wake[2];                // main thread -> I/O thread: new outgoing message or stop
+    int notify[2];              // I/O thread -> main loop: received messages are waiting
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    LspPacketList outbox;       // to the server
+    LspPacketList inbox;        // from the server
+    bool stopping;
+
+    // I/O thread only. stdout is framed incrementally: header lines are parsed
+    // out of rx as they complete, and each body gets a buffer of its own, filled
+    // from rx or by reading straight into it, that is handed over as is.
+    char rx[LSP_READ_CHUNK];
+    size_t rx_start, rx_len;    // unparsed bytes are rx[rx_start .. rx_len)
+    long content_length;        // from the headers read so far, -1 if none yet
+    char *body;                 // message being received
+    size_t body_len, body_got;
+    size_t skip;                // body bytes to drop after a failed allocation
+    char err_line[LSP_STDERR_LINE];
+    size_t err_len;
+};
+
+static void list_push(LspPacketList *list, LspPacket *p) {
+    p->next = NULL;
+    if (list->tail) list->tail->next = p;
+    else list->head = p;
+    list->tail = p;
+}
+
+static LspPacket *list_pop(LspPacketList *list) {
+    LspPacket *p = list->head;
+    if (!p) return NULL;
+    list->head = p->next;
+    if (!list->head) list->tail = NULL;
+    return p;
+}
+
+static void list_free(LspPacketList *list) {
+    LspPacket *p;
+    while ((p = list_pop(list))) {
+        free(p->data);
+        free(p);
+    }
+}
+
+static void drain_fd(int fd) {
+    char buf[256];
+    while (read(fd, buf, sizeof(buf)) > 0);
+}
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static void deliver(LspTransport *t, char *json, size_t len) {
+    LspPacket *p = malloc(sizeof(LspPacket));
+    if (!p) { free(json); return; }
+    p->header_len = 0;
+    p->data = json;
+    p->len = len;
+    p->sent = 0;
+    pthread_mutex_lock(&t->mutex);
+    bool was_empty = t->inbox.head == NULL;
+    list_push(&t->inbox, p);
+    if (was_empty) write(t->notify[1], "", 1);
+    pthread_mutex_unlock(&t->mutex);
+}
+
+static void finish_body(LspTransport *t) {
+    t->body[t->body_len] = '\0';
+    deliver(t, t->body, t->body_len);
+    t->body = NULL;
+}
+
+// Consumes the buffered bytes: header lines until the blank line that ends
+// them, then the body they announced
+static void parse_buffered(LspTransport *t) {
+    while (t->rx_start < t->rx_len) {
+        char *data = t->rx + t->rx_start;
+        size_t avail = t->rx_len - t->rx_start;
+
+        if (t->body || t->skip > 0) {
+            size_t want = t->body ? t->body_len - t->body_got : t->skip;
+            size_t take = avail < want ? avail : want;
+            if (t->body) {
+                memcpy(t->body + t->body_got, data, take);
+                t->body_got += take;
+                if (t->body_got == t->body_len) finish_body(t);
+            } else {
+                t->skip -= take;
+            }
+            t->rx_start += take;
+            continue;
+        }
+
+        char *eol = memchr(data, '\n', avail);
+        if (!eol) break;
+        t->rx_start += eol - data + 1;
+        size_t line_len = eol - data;
+        if (line_len > 0 && data[line_len - 1] == '\r') line_len--;
+
+        if (line_len > 0) {
+            if (line_len > 15 && strncasecmp(data, "Content-Length:", 15) == 0) {
+                t->content_length = strtol(data + 15, NULL, 10);
+            }
+            continue;
+        }
+        // Blank line: the body follows
+        if (t->content_length > 0) {
+            t->body = malloc(t->content_length + 1);
+            if (t->body) {
+                t->body_len = t->content_length;
+                t->body_got = 0;
+            } else {
+                A2_LOG(LOG_ERROR, TAG_LSP, "Dropped a %ld byte message from the server", t->content_length);
+                t->skip = t->content_length;
+            }
+        }
+        t->content_length = -1;
+    }
+}
+
+// Reads what the server wrote to stdout; false once the pipe is closed
+static bool read_stdout(LspTransport *t) {
+    for (;;) {
+        parse_buffered(t);
+
+        ssize_t n;
+        if (t->body && t->body_len - t->body_got >= LSP_DIRECT_READ) {
+            // Large bodies skip rx and go straight into the buffer handed to the main loop
+            n = read(t->out_fd, t->body + t->body_got, t->body_len - t->body_got);
+            if (n > 0) {
+                t->body_got += n;
+                if (t->body_got == t->body_len) finish_body(t);
+                continue;
+            }
+        } else {
+            // Keep the unparsed tail (a partial header line at most) at the front
+            if (t->rx_start > 0) {
+                memmove(t->rx, t->rx + t->rx_start, t->rx_len - t->rx_start);
+                t->rx_len -= t->rx_start;
+                t->rx_start = 0;
+            }
+            if (t->rx_len == sizeof(t->rx)) {
+                A2_LOG(LOG_ERROR, TAG_LSP, "Header line from the server too long, discarding it");
+                t->rx_len = 0;
+            }
+            n = read(t->out_fd, t->rx + t->rx_len, sizeof(t->rx) - t->rx_len);
+            if (n > 0) {
+                t->rx_len += n;
+                continue;
+            }
+        }
+        if (n < 0 && errno == EINTR) continue;
+        return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+}
+
+// Logs the server's stderr line by line; false once the pipe is closed
+static bool read_stderr(LspTransport *t) {
+    char buf[4096];
+    for (;;) {
+        ssize_t n = read(t->err_fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        for (ssize_t i = 0; i < n; i++) {
+            bool eol = buf[i] == '\n';
+            if (!eol) t->err_line[t->err_len++] = buf[i];
+            if (eol || t->err_len == LSP_STDERR_LINE - 1) {
+                t->err_line[t->err_len] = '\0';
+                if (t->err_len > 0) A2_LOG(LOG_DEBUG, TAG_LSP, "server: %s", t->err_line);
+                t->err_len = 0;
+            }
+        }
+    }
+}
+
+// Writes queued messages until the pipe is full; false if the server closed its stdin
+static bool write_stdin(LspTransport *t) {
+    for (;;) {
+        pthread_mutex_lock(&t->mutex);
+        LspPacket *p = t->outbox.head;
+        pthread_mutex_unlock(&t->mutex);
+        if (!p) return true;
+
+        // Only this thread removes packets, so p stays valid without the lock.
+        // Header and body go out in one writev, straight from their own buffers.
+        size_t total = p->header_len + p->len;
+        while (p->sent < total) {
+            struct iovec iov[2];
+            int iovcnt = 0;
+            if (p->sent < p->header_len) {
+                iov[iovcnt++] = (struct iovec){ p->header + p->sent, p->header_len - p->sent };
+                iov[iovcnt++] = (struct iovec){ p->data, p->len };
+            } else {
+                size_t off = p->sent - p->header_len;
+                iov[iovcnt++] = (struct iovec){ p->data + off, p->len - off };
+            }
+            ssize_t n = writev(t->in_fd, iov, iovcnt);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            p->sent += n;
+        }
+
+        pthread_mutex_lock(&t->mutex);
+        list_pop(&t->outbox);
+        pthread_mutex_unlock(&t->mutex);
+        free(p->data);
+        free(p);
+    }
+}
+
+static void *transport_main(void *arg) {
+    LspTransport *t = arg;
+
+    // A server that exits makes writes fail with EPIPE instead of killing the editor
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    bool in_open = true, out_open = true, err_open = true;
+    long long stop_deadline = 0;
+    for (;;) {
+        pthread_mutex_lock(&t->mutex);
+        bool pending = t->outbox.head != NULL;
+        bool stopping = t->stopping;
+        pthread_mutex_unlock(&t->mutex);
+
+        if (stopping) {
+            if (!pending || !in_open) break;
+            if (stop_deadline == 0) stop_deadline = now_ms() + LSP_STOP_FLUSH_MS;
+            else if (now_ms() >= stop_deadline) break;
+        }
+
+        struct pollfd fds[4];
+        int nfds = 0, out_idx = -1, err_idx = -1, in_idx = -1;
+        fds[nfds++] = (struct pollfd){ t->wake[0], POLLIN, 0 };
+        if (out_open) { out_idx = nfds; fds[nfds++] = (struct pollfd){ t->out_fd, POLLIN, 0 }; }
+        if (err_open) { err_idx = nfds; fds[nfds++] = (struct pollfd){ t->err_fd, POLLIN, 0 }; }
+        if (pending && in_open) { in_idx = nfds; fds[nfds++] = (struct pollfd){ t->in_fd, POLLOUT, 0 }; }
+
+        if (poll(fds, nfds, stopping ? 10 : -1) < 0) {
+            if (errno == EINTR) continue;
+            A2_LOG(LOG_ERROR, TAG_LSP, "LSP transport poll failed: %s", strerror(errno));
+            break;
+        }
+
+        if (fds[0].revents) drain_fd(t->wake[0]);
+        if (out_idx >= 0 && fds[out_idx].revents && !read_stdout(t)) out_open = false;
+        if (err_idx >= 0 && fds[err_idx].revents && !read_stderr(t)) err_open = false;
+        if (in_idx >= 0 && fds[in_idx].revents && !write_stdin(t)) {
+            A2_LOG(LOG_WARN, TAG_LSP, "LSP server closed its input, dropping queued messages");
+            in_open = false;
+            pthread_mutex_lock(&t->mutex);
+            list_free(&t->outbox);
+            pthread_mutex_unlock(&t->mutex);
+        }
+    }
+    return NULL;
+}
+
+static bool make_pipe(int fds[2]) {
+    if (pipe(fds) != 0) return false;
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+}
+
+LspTransport *lsp_transport_start(int stdin_fd, int stdout_fd, int stderr_fd) {
+    LspTransport *t = calloc(1, sizeof(LspTransport));
+    if (!t) return NULL;
+    t->in_fd = stdin_fd;
+    t->out_fd = stdout_fd;
+    t->err_fd = stderr_fd;
+    t->content_length = -1;
+    fcntl(stdin_fd, F_SETFL, O_NONBLOCK);
+    fcntl(stdout_fd, F_SETFL, O_NONBLOCK);
+    fcntl(stderr_fd, F_SETFL, O_NONBLOCK);
+
+    if (!make_pipe(t->wake)) {
+        free(t);
+        return NULL;
+    }
+    if (!make_pipe(t->notify)) {
+        close(t->wake[0]);
+        close(t->wake[1]);
+        free(t);
+        return NULL;
+    }
+    pthread_mutex_init(&t->mutex, NULL);
+    if (pthread_create(&t->thread, NULL, transport_main, t) != 0) {
+        pthread_mutex_destroy(&t->mutex);
+        close(t->wake[0]);
+        close(t->wake[1]);
+        close(t->notify[0]);
+        close(t->notify[1]);
+        free(t);
+        return NULL;
+    }
+    return t;
+}
+
+// Queues a body the transport now owns
+static void queue_body(LspTransport *t, char *data, size_t len) {
+    LspPacket *p = malloc(sizeof(LspPacket));
+    if (!p) { free(data); return; }
+    p->header_len = snprintf(p->header, sizeof(p->header), "Content-Length: %zu\r\n\r\n", len);
+    p->data = data;
+    p->len = len;
+    p->sent = 0;
+
+    pthread_mutex_lock(&t->mutex);
+    list_push(&t->outbox, p);
+    pthread_mutex_unlock(&t->mutex);
+    write(t->wake[1], "", 1);
+}
+
+void lsp_transport_send(LspTransport *t, const char *json, size_t len) {
+    if (!t || !json) return;
+    char *data = malloc(len);
+    if (!data) return;
+    memcpy(data, json, len);
+    queue_body(t, data, len);
+}
+
+void lsp_writer_reserve(LspWriter *w, size_t extra) {
+    if (w->failed || w->len + extra <= w->cap) return;
+    size_t new_cap = w->cap > 0 ? w->cap : 256;
+    while (new_cap < w->len + extra) new_cap *= 2;
+    char *data = realloc(w->data, new_cap);
+    if (!data) {
+        w->failed = true;
+        return;
+    }
+    w->data = data;
+    w->cap = new_cap;
+}
+
+void lsp_writer_raw(LspWriter *w, const char *data, size_t len) {
+    if (len == 0) return;
+    lsp_writer_reserve(w, len);
+    if (w->failed) return;
+    memcpy(w->data + w->len, data, len);
+    w->len += len;
+}
+
+void lsp_writer_str(LspWriter *w, const char *str) {
+    lsp_writer_raw(w, str, strlen(str));
+}
+
+void lsp_writer_escaped(LspWriter *w, const char *data, size_t len) {
+    size_t run = 0; // start of the bytes that need no escaping
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = data[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        lsp_writer_raw(w, data + run, i - run);
+        run = i + 1;
+        char esc[8];
+        switch (c) {
+            case '"':  lsp_writer_raw(w, "\\\"", 2); break;
+            case '\\': lsp_writer_raw(w, "\\\\", 2); break;
+            case '\b': lsp_writer_raw(w, "\\b", 2); break;
+            case '\f': lsp_writer_raw(w, "\\f", 2); break;
+            case '\n': lsp_writer_raw(w, "\\n", 2); break;
+            case '\r': lsp_writer_raw(w, "\\r", 2); break;
+            case '\t': lsp_writer_raw(w, "\\t", 2); break;
+            default:
+                // UTF-8 is passed through as is, JSON text is UTF-8
+                snprintf(esc, sizeof(esc), "\\u%04x", c);
+                lsp_writer_raw(w, esc, 6);
+                break;
+        }
+    }
+    lsp_writer_raw(w, data + run, len - run);
+}
+
+void lsp_writer_free(LspWriter *w) {
+    free(w->data);
+    *w = (LspWriter){0};
+}
+
+void lsp_transport_send_writer(LspTransport *t, LspWriter *w) {
+    if (!t || w->failed || !w->data) {
+        if (w->failed) A2_LOG(LOG_ERROR, TAG_LSP, "Out of memory building an LSP message, dropped");
+        lsp_writer_free(w);
+        return;
+    }
+    queue_body(t, w->data, w->len);
+    *w = (LspWriter){0};
+}
+
+char *lsp_transport_next(LspTransport *t) {
+    if (!t) return NULL;
+    pthread_mutex_lock(&t->mutex);
+    LspPacket *p = list_pop(&t->inbox);
+    if (!t->inbox.head) drain_fd(t->notify[0]);
+    pthread_mutex_unlock(&t->mutex);
+    if (!p) return NULL;
+    char *json = p->data;
+    free(p);
+    return json;
+}
+
+int lsp_transport_notify_fd(const LspTransport *t) {
+    return t ? t->notify[0] : -1;
+}
+
+void lsp_transport_stop(LspTransport *t) {
+    if (!t) return;
+    pthread_mutex_lock(&t->mutex);
+    t->stopping = true;
+    pthread_mutex_unlock(&t->mutex);
+    write(t->wake[1], "", 1);
+    pthread_join(t->thread, NULL);
+
+    list_free(&t->outbox);
+    list_free(&t->inbox);
+    pthread_mutex_destroy(&t->mutex);
+    close(t->wake[0]);
+    close(t->wake[1]);
+    close(t->notify[0]);
+    close(t->notify[1]);
+    free(t->body);
+    free(t);
+}
@@ -0,0 +1,50 @@
+#ifndef LSP_TRANSPORT_H
+#define LSP_TRANSPORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Pipe I/O with a language server, on a thread of its own.
+// Outgoing messages are framed and queued; the thread writes them as fast as
+// the server's stdin accepts them, so a server that stops reading never blocks
+// the editor. The server's stdout is split into JSON messages that the main
+// loop picks up with lsp_transport_next(), and stderr is drained into the log
+// so a chatty server can't stall on a full pipe.
+
+typedef struct LspTransport LspTransport;
+
+// The pipe ends stay owned by the caller and are closed after lsp_transport_stop()
+LspTransport *lsp_transport_start(int stdin_fd, int stdout_fd, int stderr_fd);
+
+// Queues one message; the Content-Length header is added here
+void lsp_transport_send(LspTransport *t, const char *json, size_t len);
+
+// A message body written in place. Document text is escaped straight from the
+// buffer lines into it, and lsp_transport_send_writer() queues the buffer itself,
+// so sending a file makes no full-size copies on the way to the pipe.
+typedef struct {
+    char *data;
+    size_t len, cap;
+    bool failed; // an allocation failed; the message is dropped
+} LspWriter;
+
+void lsp_writer_reserve(LspWriter *w, size_t extra);
+void lsp_writer_raw(LspWriter *w, const char *data, size_t len);
+void lsp_writer_str(LspWriter *w, const char *str);
+// Contents of a JSON string: quotes, backslashes and control bytes are escaped
+void lsp_writer_escaped(LspWriter *w, const char *data, size_t len);
+void lsp_writer_free(LspWriter *w);
+
+// Queues the body without copying it; the writer is left empty
+void lsp_transport_send_writer(LspTransport *t, LspWriter *w);
+
+// Next message body received from the server (caller frees), NULL if none is waiting
+char *lsp_transport_next(LspTransport *t);
+
+// Readable while received messages are waiting, for the main loop's select()
+int lsp_transport_notify_fd(const LspTransport *t);
+
+// Gives queued messages a moment to go out, then stops the thread
+void lsp_transport_stop(LspTransport *t);
+
+#endif // LSP_TRANSPORT_H
@@ -1,4 +1,5 @@
 #include "screen_ui.h"
+#include "search_local.h"
 #include "themes.h"
 #include "defs.h"
 #include "others.h"
@@ -6,6 +7,11 @@
 #include "window_managment.h"
 #include "cache.h"
 #include "spell.h"
+#include "spell_worker.h"
+#include "syntax_cache.h"
+#include "scroll_region.h"
+#include "lsp_semantic.h"
+#include "utf8.h"
 #include <ctype.h>
 #include <unistd.h>
 #include <wctype.h>
@@ -237,16 +243,11 @@ void draw_diagnostic_popup(WINDOW *main_win, EditorState *state, const char *mes
     
     int border_offset = ACTIVE_WS->num_windows > 1 ? 1 : 0;
     
-    int line_number_width = 0;
-    if (state->view.show_line_numbers) {
-        int max_lines = state->buffer.num_lines > 0 ? state->buffer.num_lines : 1;
-        line_number_width = snprintf(NULL, 0, "%d", max_lines) + 1;
-        if (line_number_width < 4) line_number_width = 4;
-    }
+    int gutter_width = editor_gutter_width(state);
 
     if (!state->lsp.is_popup_movable && !state->lsp.is_popup_pinned) {
         cursor_y = (visual_y - state->view.top_line) + border_offset;
-        cursor_x = (visual_x - state->view.left_col) + border_offset + line_number_width;
+        cursor_x = (visual_x - state->view.left_col) + border_offset + gutter_width;
 
         win_y = getbegy(main_win) + cursor_y + 1;
         win_x = getbegx(main_win) + cursor_x;
@@ -355,10 +356,360 @@ void draw_code_action_popup(WINDOW *win, EditorState *state) {
     delwin(popup);
 }
 
+// --- Overlay compositor ---
+// Everything drawn over the syntax colors of a line (selection, bracket errors,
+// misspellings, search hits, diagnostics, extra cursors) is a sorted list of
+// disjoint byte spans. A line is drawn in one sweep over the syntax spans and
+// all layers together, so the cost grows with the number of spans, not cells.
+// Layers are in precedence order: a later layer wins where they overlap.
+enum {
+    OVERLAY_SEMANTIC,   // server's token colors over the lexer's; style 0 is plain text
+    OVERLAY_SELECTION,  // recolors the text
+    OVERLAY_BRACKET,    // recolors the text, unless selected
+    OVERLAY_SPELL,      // underline, unless selected
+    OVERLAY_SEARCH,
+    OVERLAY_DIAGNOSTIC, // span style is the color pair
+    OVERLAY_CURSOR,
+    OVERLAY_COUNT
+};
+
+typedef struct {
+    const LineSpan *spans;
+    int count;
+    int next; // first span that doesn't end before the sweep position
+} OverlayLayer;
+
+typedef struct {
+    OverlayLayer layers[OVERLAY_COUNT];
+    bool cursor_at_eol; // an extra cursor sits past the last byte
+} LineOverlays;
+
+// Scratch spans for the layers that aren't cached elsewhere, reused for every line
+static LineSpanSlot overlay_scratch[OVERLAY_COUNT];
+
+// Extra cursors sorted by position once per redraw
+static struct { int line, col; } sorted_cursors[MAX_EXTRA_CURSORS];
+static int num_sorted_cursors;
+
+static void sort_extra_cursors(EditorState *state) {
+    num_sorted_cursors = 0;
+    for (int c = 0; c < state->num_extra_cursors && c < MAX_EXTRA_CURSORS; c++) {
+        int line = state->extra_cursors[c].line, col = state->extra_cursors[c].col;
+        int k = num_sorted_cursors++;
+        while (k > 0 && (sorted_cursors[k - 1].line > line || (sorted_cursors[k - 1].line == line && sorted_cursors[k - 1].col > col))) {
+            sorted_cursors[k] = sorted_cursors[k - 1];
+            k--;
+        }
+        sorted_cursors[k].line = line;
+        sorted_cursors[k].col = col;
+    }
+}
+
+// Byte range [start, end) of the visual selection on a line, same rules as is_selected
+static bool selection_span_on_line(EditorState *state, int line_idx, int line_len, int *start, int *end) {
+    if (state->cursor.visual_selection_mode == VISUAL_MODE_NONE) return false;
+
+    int start_line, start_col, end_line, end_col;
+    if (state->cursor.selection_start_line < state->cursor.line ||
+        (state->cursor.selection_start_line == state->cursor.line && state->cursor.selection_start_col <= state->cursor.col)) {
+        start_line = state->cursor.selection_start_line;
+        start_col = state->cursor.selection_start_col;
+        end_line = state->cursor.line;
+        end_col = state->cursor.col;
+    } else {
+        start_line = state->cursor.line;
+        start_col = state->cursor.col;
+        end_line = state->cursor.selection_start_line;
+        end_col = state->cursor.selection_start_col;
+    }
+    if (line_idx < start_line || line_idx > end_line) return false;
+
+    *start = 0;
+    *end = line_len;
+    if (state->cursor.visual_selection_mode == VISUAL_MODE_BLOCK) {
+        *start = min(start_col, end_col);
+        *end = max(start_col, end_col) + 1;
+    } else if (state->cursor.visual_selection_mode != VISUAL_MODE_LINE) {
+        if (line_idx == start_line) *start = start_col;
+        if (line_idx == end_line) *end = end_col;
+    }
+    *start = max(*start, 0);
+    *end = min(*end, line_len);
+    return *start < *end;
+}
+
+static void set_layer(LineOverlays *ov, int layer, const LineSpanSlot *slot) {
+    ov->layers[layer].spans = slot ? slot->spans : NULL;
+    ov->layers[layer].count = slot ? slot->count : 0;
+    ov->layers[layer].next = 0;
+}
+
+// Layers for the bytes [from, to) of a line
+static void build_line_overlays(EditorState *state, int line_idx, const char *line, int line_len, int from, int to, bool in_comment, LineOverlays *ov) {
+    for (int l = 0; l < OVERLAY_COUNT; l++) overlay_scratch[l].count = 0;
+    ov->cursor_at_eol = false;
+
+    set_layer(ov, OVERLAY_SEMANTIC, lsp_semantic_line_spans(state, line_idx, line));
+
+    int sel_start, sel_end;
+    if (selection_span_on_line(state, line_idx, line_len, &sel_start, &sel_end)) {
+        line_cache_push(&overlay_scratch[OVERLAY_SELECTION], sel_start, sel_end, 0);
+    }
+    set_layer(ov, OVERLAY_SELECTION, &overlay_scratch[OVERLAY_SELECTION]);
+
+    int num_brackets;
+    const BracketToken *brackets = bracket_index_line_tokens(&state->buffer.bracket_index, line_idx, &num_brackets);
+    int lo = 0, hi = num_brackets;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (brackets[mid].col < from) lo = mid + 1;
+        else hi = mid;
+    }
+    for (int b = lo; b < num_brackets && brackets[b].col < to; b++) {
+        if (brackets[b].match_line < 0 && brackets[b].col < line_len) {
+            line_cache_push(&overlay_scratch[OVERLAY_BRACKET], brackets[b].col, brackets[b].col + 1, 0);
+        }
+    }
+    set_layer(ov, OVERLAY_BRACKET, &overlay_scratch[OVERLAY_BRACKET]);
+
+    // Search matches and misspellings for this line, cached until the line, the query or the dictionary changes
+    set_layer(ov, OVERLAY_SPELL, spell_line_spans(state, line_idx, line, in_comment));
+    set_layer(ov, OVERLAY_SEARCH, search_highlight_spans(state, line_idx));
+
+    if (global_config.lsp_diagnostics && global_config.lsp_highlight && state->lsp.enabled && state->lsp.document) {
+        LineSpanSlot *diags = &overlay_scratch[OVERLAY_DIAGNOSTIC];
+        const int *line_diags;
+        int line_diag_count = lsp_diagnostics_on_line(state, line_idx, &line_diags);
+        for (int d = 0; d < line_diag_count; d++) {
+            LspDiagnostic *diag = &state->lsp.document->diagnostics[line_diags[d]];
+            if (diag->range.start.line > line_idx || diag->range.end.line < line_idx) continue;
+            int start = (diag->range.start.line == line_idx) ? diag->range.start.character : 0;
+            int end = (diag->range.end.line == line_idx) ? diag->range.end.character : line_len;
+            start = max(start, 0);
+            end = min(end, line_len);
+            if (start >= end) continue;
+            int color = (diag->severity == LSP_SEVERITY_ERROR) ? 11 : 3;
+            // Keep the spans sorted and disjoint: insert by start, trimming overlaps
+            int k = diags->count;
+            line_cache_push(diags, start, end, color);
+            if (k == diags->count) continue;
+            while (k > 0 && diags->spans[k - 1].start > start) {
+                diags->spans[k] = diags->spans[k - 1];
+                k--;
+            }
+            diags->spans[k] = (LineSpan){ start, end, color };
+        }
+        int kept = 0;
+        for (int d = 0; d < diags->count; d++) {
+            LineSpan span = diags->spans[d];
+            if (kept > 0) span.start = max(span.start, diags->spans[kept - 1].end);
+            if (span.start < span.end) diags->spans[kept++] = span;
+        }
+        diags->count = kept;
+    }
+    set_layer(ov, OVERLAY_DIAGNOSTIC, &overlay_scratch[OVERLAY_DIAGNOSTIC]);
+
+    lo = 0;
+    hi = num_sorted_cursors;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (sorted_cursors[mid].line < line_idx) lo = mid + 1;
+        else hi = mid;
+    }
+    LineSpanSlot *cursors = &overlay_scratch[OVERLAY_CURSOR];
+    for (int c = lo; c < num_sorted_cursors && sorted_cursors[c].line == line_idx; c++) {
+        int col = sorted_cursors[c].col;
+        if (col < 0) continue;
+        if (col >= line_len) { ov->cursor_at_eol = true; break; }
+        if (cursors->count > 0 && cursors->spans[cursors->count - 1].end > col) continue;
+        int end = col + 1;
+        while (end < line_len && ((unsigned char)line[end] & 0xC0) == 0x80) end++;
+        line_cache_push(cursors, col, end, 0);
+    }
+    set_layer(ov, OVERLAY_CURSOR, cursors);
+}
+
+// Draws bytes [from, to) of a line at the cursor position, stopping at column max_x.
+// The window's current attributes (line highlight, conflict block) are the base.
+static void draw_line_range(WINDOW *win, const char *line, int line_len, const LineSpanSlot *syntax, LineOverlays *ov, int from, int to, int max_x) {
+    attr_t base_attr;
+    short base_pair;
+    wattr_get(win, &base_attr, &base_pair, NULL);
+    base_attr &= ~A_COLOR;
+
+    int k = line_cache_find_span(syntax, from);
+    if (k < 0 && syntax) {
+        k = 0;
+        while (k < syntax->count && syntax->spans[k].end <= from) k++;
+    }
+
+    // Skip the spans that end before the range without walking them
+    for (int l = 0; l < OVERLAY_COUNT; l++) {
+        OverlayLayer *layer = &ov->layers[l];
+        int lo = layer->next, hi = layer->count;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (layer->spans[mid].end <= from) lo = mid + 1;
+            else hi = mid;
+        }
+        layer->next = lo;
+    }
+
+    int pos = from;
+    while (pos < to) {
+        int x = getcurx(win);
+        if (x >= max_x) break;
+
+        int stop = to, color = base_pair;
+        if (syntax && k < syntax->count && syntax->spans[k].start <= pos) {
+            stop = min(syntax->spans[k].end, to);
+            if (SYNTAX_SPAN_COLOR(syntax->spans[k].style)) color = SYNTAX_SPAN_COLOR(syntax->spans[k].style);
+        } else if (syntax && k < syntax->count) {
+            stop = min(syntax->spans[k].start, to);
+        }
+
+        // The span of each layer covering pos, if any; the piece ends at the nearest boundary
+        const LineSpan *active[OVERLAY_COUNT];
+        for (int l = 0; l < OVERLAY_COUNT; l++) {
+            OverlayLayer *layer = &ov->layers[l];
+            while (layer->next < layer->count && layer->spans[layer->next].end <= pos) layer->next++;
+            active[l] = NULL;
+            if (layer->next >= layer->count) continue;
+            const LineSpan *span = &layer->spans[layer->next];
+            if (span->start <= pos) {
+                active[l] = span;
+                stop = min(stop, span->end);
+            } else {
+                stop = min(stop, span->start);
+            }
+        }
+
+        attr_t attr = base_attr;
+        if (active[OVERLAY_SEMANTIC]) color = active[OVERLAY_SEMANTIC]->style ? active[OVERLAY_SEMANTIC]->style : base_pair;
+        bool selected = active[OVERLAY_SELECTION] != NULL;
+        if (selected) color = PAIR_SELECTION;
+        else if (active[OVERLAY_BRACKET]) color = 11;
+        if (active[OVERLAY_SPELL] && !selected) { attr = A_UNDERLINE; color = PAIR_SPELL_ERROR; }
+        if (active[OVERLAY_SEARCH]) { attr = A_REVERSE; color = PAIR_WARNING; }
+        if (active[OVERLAY_DIAGNOSTIC]) { attr = A_UNDERLINE; color = active[OVERLAY_DIAGNOSTIC]->style; }
+        if (active[OVERLAY_CURSOR]) { attr = A_REVERSE; color = 0; }
+
+        // Bytes are at least as many as columns; only cut on a character boundary
+        int bytes = stop - pos;
+        if (bytes > max_x - x) {
+            bytes = max_x - x;
+            while (bytes > 0 && ((unsigned char)line[pos + bytes] & 0xC0) == 0x80) bytes--;
+            if (bytes == 0) break;
+        }
+        wattr_set(win, attr, color, NULL);
+        waddnstr(win, &line[pos], bytes);
+        pos += bytes;
+        if (pos < stop) break;
+        if (syntax && k < syntax->count && syntax->spans[k].end <= pos) k++;
+    }
+
+    if (ov->cursor_at_eol && to >= line_len && pos >= line_len && getcurx(win) < max_x) {
+        wattr_set(win, A_REVERSE, 0, NULL);
+        waddch(win, ' ');
+    }
+    wattr_set(win, base_attr, base_pair, NULL);
+}
+
+// The gutter is a sign column (git changes, diagnostics) followed by the line numbers
+static int gutter_sign_width(void) {
+    return (global_config.git_gutter_enabled || global_config.lsp_diagnostics) ? 1 : 0;
+}
+
+int editor_gutter_width(EditorState *state) {
+    int width = gutter_sign_width();
+    if (state->view.show_line_numbers) {
+        int max_lines = state->buffer.num_lines > 0 ? state->buffer.num_lines : 1;
+        int number_width = snprintf(NULL, 0, "%d", max_lines) + 1;
+        width += number_width < 4 ? 4 : number_width;
+    }
+    return width;
+}
+
+// Sign shown next to a line: diagnostics starting on it win over its git change
+static char gutter_sign(EditorState *state, int line_idx, int *pair) {
+    if (global_config.lsp_diagnostics && state->lsp.enabled && state->lsp.document) {
+        const int *line_diags;
+        int line_diag_count = lsp_diagnostics_on_line(state, line_idx, &line_diags);
+        int severity = 0;
+        for (int d = 0; d < line_diag_count; d++) {
+            LspDiagnostic *diag = &state->lsp.document->diagnostics[line_diags[d]];
+            if (diag->range.start.line != line_idx) continue;
+            if (severity == 0 || diag->severity < severity) severity = diag->severity;
+        }
+        if (severity == LSP_SEVERITY_ERROR) { *pair = PAIR_ERROR; return 'E'; }
+        if (severity == LSP_SEVERITY_WARNING) { *pair = PAIR_WARNING; return 'W'; }
+        if (severity != 0) { *pair = PAIR_COMMENT; return 'i'; }
+    }
+    if (state->buffer.git_gutter && line_idx < state->buffer.git_gutter_len) {
+        char mark = state->buffer.git_gutter[line_idx];
+        if (mark == '+') { *pair = PAIR_DIFF_ADD; return mark; }
+        if (mark == '~') { *pair = PAIR_WARNING; return mark; }
+        if (mark == '-') { *pair = PAIR_ERROR; return mark; }
+    }
+    *pair = 0;
+    return ' ';
+}
+
+// Line number gutter of one screen row; relative numbers count from the cursor line
+static void draw_line_number(WINDOW *win, EditorState *state, int y, int x, int line_idx, int width) {
+    wattron(win, COLOR_PAIR(8) | A_DIM);
+    int display_num = global_config.relative_line_numbers ? (line_idx == state->cursor.line ? line_idx + 1 : abs(line_idx - state->cursor.line)) : line_idx + 1;
+    if (global_config.relative_line_numbers && line_idx == state->cursor.line) { wattroff(win, A_DIM); wattron(win, A_BOLD); }
+    mvwprintw(win, y, x, "%*d ", width - 1, display_num);
+    wattroff(win, A_BOLD); wattroff(win, COLOR_PAIR(8) | A_DIM);
+}
+
+// Repaints the gutter of screen row `row` (line_idx -1 for a blank one) if what it
+// shows changed since the last frame; text redraws never touch these cells
+static void update_gutter_row(WINDOW *win, EditorState *state, int row, int y, int x, int line_idx) {
+    GutterCache *gutter = &state->view.gutter;
+    if (row < 0 || row >= gutter->num_rows || gutter->width == 0) return;
+
+    int pair = 0;
+    char sign = ' ';
+    uint64_t key = 1;
+    if (line_idx >= 0) {
+        int display_num = 0;
+        if (state->view.show_line_numbers) {
+            display_num = global_config.relative_line_numbers && line_idx != state->cursor.line ? abs(line_idx - state->cursor.line) : line_idx + 1;
+        }
+        bool bold = global_config.relative_line_numbers && line_idx == state->cursor.line;
+        if (gutter_sign_width()) sign = gutter_sign(state, line_idx, &pair);
+        key = ((uint64_t)(display_num + 1) << 32) | ((uint64_t)bold << 31) | ((uint64_t)(pair & 0x7FFF) << 16) |
+              ((uint64_t)(unsigned char)sign << 8) | 1;
+    }
+    if (gutter->rows[row] == key) return;
+    gutter->rows[row] = key;
+
+    // The line's attributes (selection of an asm range, conflict blocks) stay out of the gutter
+    attr_t attrs;
+    short color;
+    wattr_get(win, &attrs, &color, NULL);
+    wattr_set(win, A_NORMAL, 0, NULL);
+    int sign_width = gutter_sign_width();
+    if (sign_width) {
+        if (pair) wattron(win, COLOR_PAIR(pair) | A_BOLD);
+        mvwaddch(win, y, x, sign);
+        if (pair) wattroff(win, COLOR_PAIR(pair) | A_BOLD);
+    }
+    int number_width = gutter->width - sign_width;
+    if (number_width > 0) {
+        if (line_idx >= 0) draw_line_number(win, state, y, x + sign_width, line_idx, number_width);
+        else mvwprintw(win, y, x + sign_width, "%*s", number_width, "");
+    }
+    wattr_set(win, attrs, color, NULL);
+}
+
 void editor_redraw(WINDOW *win, EditorState *state) {
     wbkgd(win, COLOR_PAIR(PAIR_DEFAULT));
 
-    if (state->buffer.modified) {
+    // Cheap once built: only the edited lines are looked at
+    if (state->buffer.modified || state->buffer.bracket_index.num_lines > 0) {
         editor_find_unmatched_brackets(state);
     }
 
@@ -366,25 +717,64 @@ void editor_redraw(WINDOW *win, EditorState *state) {
     getmaxyx(win, rows, cols);
     int border_offset = ACTIVE_WS->num_windows > 1 ? 1 : 0;
     
-    int line_number_width = 0;
-    if (state->view.show_line_numbers) {
-        int max_lines = state->buffer.num_lines > 0 ? state->buffer.num_lines : 1;
-        line_number_width = snprintf(NULL, 0, "%d", max_lines) + 1;
-        if (line_number_width < 4) line_number_width = 4;
-    }
+    int gutter_width = editor_gutter_width(state);
 
     // Store old viewport to detect scrolling
     int old_top_line = state->view.top_line;
     int old_left_col = state->view.left_col;
     adjust_viewport(win, state);
-    bool scrolled = (state->view.top_line != old_top_line) || (state->view.left_col != old_left_col);
-    if (state->buffer.mapping || find_assembly_state_for_source(state->buffer.filename)) scrolled = true;
-
-    if (scrolled) {
-        werase(win); // If scrolled, a full erase is the simplest, most reliable way
+    int content_height = rows - (border_offset + 1); 
+    int scroll_delta = state->view.top_line - old_top_line;
+    bool scrolled = scroll_delta != 0 || (state->view.left_col != old_left_col);
+    bool linked_view = state->buffer.mapping || find_assembly_state_for_source(state->buffer.filename);
+    GutterCache *gutter = &state->view.gutter;
+    // A wider or narrower gutter moves all the text
+    if (gutter->width != gutter_width) scrolled = true;
+
+    // A vertical scroll without wrapping keeps the rows still on screen: they are shifted
+    // and only the exposed rows are rendered (see scroll_region.h)
+    ScrollPlan plan = scroll_plan(scroll_delta, content_height, scrolled && !linked_view && !state->view.word_wrap &&
+                                  state->view.left_col == old_left_col && gutter->width == gutter_width);
+    int exposed_from = plan.exposed_from, exposed_to = plan.exposed_to;
+    if (plan.shift) {
+        scroll_text_rows(win, border_offset, content_height, scroll_delta);
+        scrolled = false;
+    } else if (scrolled || linked_view) {
+        scrolled = true;
+        werase(win); // Horizontal scrolls and jumps repaint everything
         mark_all_lines_dirty(state); // Mark everything to be redrawn
     }
 
+    if (gutter->num_rows != content_height) {
+        uint64_t *cells = realloc(gutter->rows, sizeof(uint64_t) * (content_height > 0 ? content_height : 1));
+        if (cells) {
+            gutter->rows = cells;
+            gutter->num_rows = content_height > 0 ? content_height : 0;
+        } else {
+            gutter->num_rows = 0;
+        }
+        if (gutter->num_rows) memset(gutter->rows, 0, sizeof(uint64_t) * gutter->num_rows);
+    } else if (exposed_to > exposed_from) {
+        // The gutter cells moved along with the rows
+        if (scroll_delta > 0) memmove(gutter->rows, gutter->rows + scroll_delta, sizeof(uint64_t) * (content_height - scroll_delta));
+        else memmove(gutter->rows - scroll_delta, gutter->rows, sizeof(uint64_t) * (content_height + scroll_delta));
+        memset(gutter->rows + exposed_from, 0, sizeof(uint64_t) * (exposed_to - exposed_from));
+    }
+    gutter->width = gutter_width;
+
+    // Cursor movement re-renders the text of the lines it left and entered (and the
+    // selection in between); every other row at most gets its gutter repainted
+    if (gutter->cursor_line != state->cursor.line) {
+        int from = min(gutter->cursor_line, state->cursor.line);
+        int to = max(gutter->cursor_line, state->cursor.line);
+        if (state->input.mode == VISUAL) {
+            for (int l = max(from, state->view.top_line); l <= to && l < state->view.top_line + content_height; l++) mark_line_as_dirty(state, l);
+        }
+        mark_line_as_dirty(state, from);
+        mark_line_as_dirty(state, to);
+        gutter->cursor_line = state->cursor.line;
+    }
+
     if (border_offset) {
         if (ACTIVE_WS->windows[ACTIVE_WS->active_window_idx]->state == state) {
             wattron(win, COLOR_PAIR(PAIR_BORDER_ACTIVE) | A_BOLD);
@@ -397,55 +787,10 @@ void editor_redraw(WINDOW *win, EditorState *state) {
         }
     }
 
-    const char *delimiters = " \t\n\r,;()[]{}<>=+-*/%&|!^.";
-    int content_height = rows - (border_offset + 1); 
     int screen_y = 0;
     int current_conflict_block = 0; // 0: none, 1: MINE, 2: THEIRS
-    bool in_multiline_comment = false;
-
-    // Scan from the beginning of the file to determine current multiline comment state
-    // We must scan file lines, not visual lines.
-    for (int i = 0; i < state->buffer.num_lines; i++) {
-        // If we are NOT in wrap mode, we only need to scan up to top_line.
-        // If we ARE in wrap mode, we'd ideally know which file line corresponds to top_line,
-        // but for now, scanning all lines until the current visible one is safer.
-        // This scan is simplified: we stop when we reach the first visible file line.
-        
-        // Find which file line corresponds to the first visible visual line
-        int current_visual_line = 0;
-        int first_visible_file_line = 0;
-        if (state->view.word_wrap) {
-            for (int f = 0; f < state->buffer.num_lines; f++) {
-                int f_len = strlen(state->buffer.lines[f]);
-                int wraps = 0;
-                if (f_len > 0) {
-                    int content_w = cols - 2*border_offset - line_number_width;
-                    if (content_w <= 0) content_w = 1;
-                    // Approximate wrap count
-                    wraps = (f_len + content_w - 1) / content_w;
-                } else {
-                    wraps = 1;
-                }
-                if (current_visual_line + wraps > state->view.top_line) {
-                    first_visible_file_line = f;
-                    break;
-                }
-                current_visual_line += wraps;
-            }
-        } else {
-            first_visible_file_line = state->view.top_line;
-        }
-
-        for (int i = 0; i < first_visible_file_line && i < state->buffer.num_lines; i++) {
-            char *l = state->buffer.lines[i];
-            if (!l) continue;
-            for (int p = 0; l[p]; p++) {
-                if (!in_multiline_comment && l[p] == '/' && l[p+1] == '*') { in_multiline_comment = true; p++; }
-                else if (in_multiline_comment && l[p] == '*' && l[p+1] == '/') { in_multiline_comment = false; p++; }
-            }
-        }
-        break; // Exit the outer helper loop
-    }
+    bool in_multiline_comment = false; // lexer state at the start of the current line
+    sort_extra_cursors(state);
 
     if (state->view.word_wrap) {
         state->view.left_col = 0;
@@ -455,12 +800,6 @@ void editor_redraw(WINDOW *win, EditorState *state) {
             if (!line) continue;
             
             bool highlight_this_line = false;
-            bool is_line_comment = false; 
-            bool is_directive = false;
-
-            int first_non_space = 0;
-            while (line[first_non_space] && isspace(line[first_non_space])) first_non_space++;
-            if (line[first_non_space] == '#') is_directive = true;
 
             // --- CONFLICT HIGHLIGHTING (WORD WRAP) ---
             if (strncmp(line, "<<<<<<<", 7) == 0) current_conflict_block = 1;
@@ -493,204 +832,40 @@ void editor_redraw(WINDOW *win, EditorState *state) {
             int line_len = strlen(line);
             int line_offset = 0;
             
-            // Per-file-line search regex compilation for efficiency
-            bool is_searching = (state->input.command_buffer[0] == '/');
-            const char *query = is_searching ? state->input.command_buffer + 1 : state->search.last_term;
-            regex_t regex;
-            bool has_regex = false;
-            if (query && query[0] != '\0') {
-                if (is_searching || state->search.is_regex) {
-                    if (regcomp(&regex, query, REG_EXTENDED | REG_NEWLINE) == 0) has_regex = true;
-                }
-            }
+            // Syntax spans and overlays, built once the first segment of the line is visible
+            const LineSpanSlot *syntax_spans = NULL;
+            LineOverlays overlays;
+            bool overlays_built = false;
 
             while(line_offset < line_len || line_len == 0) {
-                int content_width = cols - 2*border_offset - line_number_width;
+                int content_width = cols - 2*border_offset - gutter_width;
                 if (content_width <= 0) content_width = 1;
-                int current_bytes = 0;
-                int current_width = 0;
-                int last_space_bytes = -1;
-
-                while (line[line_offset + current_bytes] != '\0') {
-                    wchar_t wc;
-                    int bytes_consumed = mbtowc(&wc, &line[line_offset + current_bytes], MB_CUR_MAX);
-                    if (bytes_consumed <= 0) { bytes_consumed = 1; wc = ' '; } 
-                    int char_width = wcwidth(wc);
-                    if (char_width < 0) char_width = 1;
-                    if (current_width + char_width > content_width) break;
-                    current_width += char_width;
-                    if (iswspace(wc)) last_space_bytes = current_bytes + bytes_consumed;
-                    current_bytes += bytes_consumed;
-                }
-
-                int break_pos;
-                if (line[line_offset + current_bytes] != '\0' && last_space_bytes != -1) break_pos = last_space_bytes;
-                else break_pos = current_bytes;
-                
-                // Safety: prevent infinite loops
-                if (break_pos == 0 && line[line_offset] != '\0') break_pos = 1;
+                int break_pos = utf8_wrap_break(line + line_offset, line_len - line_offset, content_width);
 
                 if (visual_line_idx >= state->view.top_line && screen_y < content_height) {
-                    wmove(win, screen_y + border_offset, border_offset + line_number_width);
+                    wmove(win, screen_y + border_offset, border_offset + gutter_width);
                     
-                    if (state->view.show_line_numbers && line_offset == 0) {
-                        wattron(win, COLOR_PAIR(8) | A_DIM);
-                        int display_num = global_config.relative_line_numbers ? (file_line_idx == state->cursor.line ? file_line_idx + 1 : abs(file_line_idx - state->cursor.line)) : file_line_idx + 1;
-                        if (global_config.relative_line_numbers && file_line_idx == state->cursor.line) { wattroff(win, A_DIM); wattron(win, A_BOLD); }
-                        mvwprintw(win, screen_y + border_offset, border_offset, "%*d ", line_number_width - 1, display_num);
-                        wattroff(win, A_BOLD); wattroff(win, COLOR_PAIR(8) | A_DIM);
-                        wmove(win, screen_y + border_offset, border_offset + line_number_width);
-                    }
+                    update_gutter_row(win, state, screen_y, screen_y + border_offset, border_offset, line_offset == 0 ? file_line_idx : -1);
+                    wmove(win, screen_y + border_offset, border_offset + gutter_width);
 
-                    int current_pos_in_segment = 0;
-                    while(current_pos_in_segment < break_pos) {
-                        int token_start_in_line = line_offset + current_pos_in_segment;
-                        if (getcurx(win) >= cols - 1 - border_offset) break;
-
-                        // 1. Handle Comments (Single and Multi)
-                        if (is_line_comment || in_multiline_comment || is_directive || (line[token_start_in_line] == '/' && (line[token_start_in_line+1] == '/' || line[token_start_in_line+1] == '*'))) {
-                            if (!is_line_comment && !in_multiline_comment && !is_directive) {
-                                if (line[token_start_in_line+1] == '/') is_line_comment = true;
-                                else in_multiline_comment = true;
-                            }
-                            
-                            wattron(win, COLOR_PAIR(PAIR_COMMENT));
-                            int segment_remaining = break_pos - current_pos_in_segment;
-                            int visual_remaining = (cols - 1 - border_offset) - getcurx(win);
-
-                            if (in_multiline_comment) {
-                                char *end_ptr = strstr(&line[token_start_in_line], "*/");
-                                if (end_ptr && (end_ptr - &line[token_start_in_line]) < segment_remaining) {
-                                    int bytes_to_end = (end_ptr - &line[token_start_in_line]) + 2;
-                                    int bytes_to_print = bytes_to_end > visual_remaining ? visual_remaining : bytes_to_end;
-                                    waddnstr(win, &line[token_start_in_line], bytes_to_print);
-                                    in_multiline_comment = false;
-                                    current_pos_in_segment += bytes_to_end;
-                                    wattroff(win, COLOR_PAIR(PAIR_COMMENT));
-                                    continue;
-                                }
-                            }
-                            
-                            int bytes_to_print = segment_remaining > visual_remaining ? visual_remaining : segment_remaining;
-                            waddnstr(win, &line[token_start_in_line], bytes_to_print);
-                            current_pos_in_segment += segment_remaining;
-                            wattroff(win, COLOR_PAIR(PAIR_COMMENT));
-                            continue;
-                        }
-
-                        // 2. Normal Highlighting
-                        int token_start_in_segment = current_pos_in_segment;
-                        if (strchr(delimiters, line[token_start_in_line])) {
-                            current_pos_in_segment++;
-                        } else {
-                            while(current_pos_in_segment < break_pos && !strchr(delimiters, line[line_offset + current_pos_in_segment])) {
-                                if (line[line_offset + current_pos_in_segment] == '/' && (line[line_offset + current_pos_in_segment + 1] == '/' || line[line_offset + current_pos_in_segment + 1] == '*')) break;
-                                current_pos_in_segment++;
-                            }
-                        }
-                        
-                        int token_len = current_pos_in_segment - token_start_in_segment;
-                        if (token_len > 0) {
-                            char *token_ptr = &line[token_start_in_line];
-                            int color_pair = 0;
-                            if (is_selected(state, file_line_idx, token_start_in_line)) color_pair = PAIR_SELECTION;
-                            else if (token_len == 1 && is_unmatched_bracket(state, file_line_idx, token_start_in_line)) color_pair = 11;
-                            else if (line[token_start_in_line] == '#') { 
-                                color_pair = PAIR_COMMENT; 
-                                // Directive highlight should ideally not skip the whole segment to allow wrap awareness
-                            }
-                            else {
-                                bool is_misspelled = false;
-                                if (state->spell.checker.enabled && !isdigit(token_ptr[0]) && !strchr(delimiters, *token_ptr)) {
-                                    char *word_to_check = strndup(token_ptr, token_len);
-                                    if (word_to_check) {
-                                        if (!spell_checker_check_word(&state->spell.checker, word_to_check)) {
-                                            is_misspelled = true;
-                                        }
-                                        free(word_to_check);
-                                    }
-                                }
-                                if (is_misspelled) {
-                                    color_pair = PAIR_SPELL_ERROR;
-                                } else {
-                                    for (int j = 0; j < state->buffer.num_syntax_rules; j++) {
-                                        if (strlen(state->buffer.syntax_rules[j].word) == (size_t)token_len && strncmp(token_ptr, state->buffer.syntax_rules[j].word, token_len) == 0) {
-                                            switch(state->buffer.syntax_rules[j].type) { case SYNTAX_KEYWORD: color_pair = PAIR_KEYWORD; break; case SYNTAX_TYPE: color_pair = PAIR_TYPE; break; case SYNTAX_STD_FUNCTION: color_pair = PAIR_STD_FUNCTION; break; }
-                                            break;
-                                        }
-                                    }
-                                }
-                            }
-                            if (color_pair) wattron(win, COLOR_PAIR(color_pair));
-                            if (color_pair == PAIR_SPELL_ERROR) wattron(win, A_UNDERLINE);
-                            wprintw(win, "%.*s", token_len, token_ptr);
-                            if (color_pair == PAIR_SPELL_ERROR) wattroff(win, A_UNDERLINE);
-                            if (color_pair) wattroff(win, COLOR_PAIR(color_pair));
-                        }
+                    if (!overlays_built) {
+                        syntax_spans = syntax_line_spans(state, file_line_idx, in_multiline_comment);
+                        build_line_overlays(state, file_line_idx, line, line_len, 0, line_len, in_multiline_comment, &overlays);
+                        overlays_built = true;
                     }
+                    draw_line_range(win, line, line_len, syntax_spans, &overlays, line_offset, line_offset + break_pos, cols - 1 - border_offset);
                     int y, x; getyx(win, y, x); int end_col = cols - border_offset;
                     for (int i = x; i < end_col; i++) mvwaddch(win, y, i, ' ');
 
-                    // --- REAL-TIME SEARCH HIGHLIGHT (WORD WRAP) ---
-                    if (query && query[0] != '\0') {
-                        int search_offset = line_offset;
-                        while (search_offset < line_offset + break_pos) {
-                            int match_start = -1, match_len = 0;
-                            if (has_regex) {
-                                regmatch_t pmatch[1];
-                                if (regexec(&regex, line + search_offset, 1, pmatch, 0) == 0) {
-                                    match_start = search_offset + pmatch[0].rm_so;
-                                    match_len = pmatch[0].rm_eo - pmatch[0].rm_so;
-                                    if (match_len == 0) match_len = 1;
-                                } else break;
-                            } else {
-                                char *match = strstr(line + search_offset, query);
-                                if (match) {
-                                    match_start = match - line;
-                                    match_len = strlen(query);
-                                } else break;
-                            }
-
-                            if (match_start != -1 && match_start < line_offset + break_pos) {
-                                int s_start = max(match_start, line_offset);
-                                int s_end = min(match_start + match_len, line_offset + break_pos);
-                                if (s_start < s_end) {
-                                    int sx = border_offset + line_number_width + get_visual_col(line + line_offset, s_start - line_offset);
-                                    int ex = border_offset + line_number_width + get_visual_col(line + line_offset, s_end - line_offset);
-                                    int mx = cols - border_offset;
-                                    if (sx < mx) mvwchgat(win, screen_y + border_offset, sx, min(ex, mx) - sx, A_REVERSE, PAIR_WARNING, NULL);
-                                }
-                                search_offset = match_start + match_len;
-                            } else break;
-                        }
-                    }
-                    
-                    // --- LSP DIAGNOSTICS HIGHLIGHT (WORD WRAP) ---
+                    // --- LSP INLINE DIAGNOSTICS (WORD WRAP) ---
                     if (global_config.lsp_diagnostics && global_config.lsp_highlight && state->lsp.enabled && state->lsp.document) {
-                        for (int d = 0; d < state->lsp.document->diagnostics_count; d++) {
-                            LspDiagnostic *diag = &state->lsp.document->diagnostics[d];
-                            if (diag->range.start.line <= file_line_idx && diag->range.end.line >= file_line_idx) {
-                                int diag_start_col = (diag->range.start.line == file_line_idx) ? diag->range.start.character : 0;
-                                int diag_end_col = (diag->range.end.line == file_line_idx) ? diag->range.end.character : line_len;
-                                
-                                int s_start = max(diag_start_col, line_offset);
-                                int s_end = min(diag_end_col, line_offset + break_pos);
-                                
-                                if (s_start < s_end) {
-                                    int sx = border_offset + line_number_width + get_visual_col(line + line_offset, s_start - line_offset);
-                                    int ex = border_offset + line_number_width + get_visual_col(line + line_offset, s_end - line_offset);
-                                    int mx = cols - border_offset;
-                                    
-                                    if (sx < mx) {
-                                        int lsp_color_pair = (diag->severity == LSP_SEVERITY_ERROR) ? 11 : 3;
-                                        mvwchgat(win, screen_y + border_offset, sx, min(ex, mx) - sx, A_UNDERLINE, lsp_color_pair, NULL);
-                                    }
-                                }
-                            }
-                            
+                        const int *line_diags;
+                        int line_diag_count = lsp_diagnostics_on_line(state, file_line_idx, &line_diags);
+                        for (int d = 0; d < line_diag_count; d++) {
+                            LspDiagnostic *diag = &state->lsp.document->diagnostics[line_diags[d]];
                             // Inline diagnostic for word wrap
                             if (global_config.lsp_inline_diagnostics && diag->range.end.line == file_line_idx && line_offset + break_pos >= line_len) {
-                                int base_x = border_offset + line_number_width;
+                                int base_x = border_offset + gutter_width;
                                 int visual_line_len = get_visual_col(line + line_offset, break_pos);
                                 int end_x = base_x + visual_line_len + 4; // padding
                                 if (end_x < cols - border_offset - 2) {
@@ -727,37 +902,27 @@ void editor_redraw(WINDOW *win, EditorState *state) {
                     if (strncmp(line, ">>>>>>>", 7) == 0) current_conflict_block = 0;
 
                     screen_y++;
-                } else {
-                    // Even if not visible, we must maintain multiline comment state
-                    for (int p = 0; p < break_pos; p++) {
-                        if (!in_multiline_comment && line[line_offset + p] == '/' && line[line_offset + p + 1] == '*') { in_multiline_comment = true; p++; }
-                        else if (in_multiline_comment && line[line_offset + p] == '*' && line[line_offset + p + 1] == '/') { in_multiline_comment = false; p++; }
-                    }
                 }
                 visual_line_idx++;
                 line_offset += break_pos;
                 if (line_len == 0) break;
             }
-            if (has_regex) regfree(&regex);
+            in_multiline_comment = syntax_spans ? syntax_spans->end_state : syntax_line_ends_in_comment(state, file_line_idx, in_multiline_comment);
             if (highlight_this_line) wattroff(win, A_REVERSE);
         }
     } else { // NO WORD WRAP
+        in_multiline_comment = syntax_comment_state_at(state, state->view.top_line);
         for (int i = 0; i < content_height; i++) {
             int line_idx = state->view.top_line + i;
-            if (line_idx >= state->buffer.num_lines) { if (scrolled) { wmove(win, i + border_offset, border_offset + line_number_width); wclrtoeol(win); } continue; }
-
-            if (scrolled || (line_idx < state->buffer.dirty_lines_cap && state->buffer.dirty_lines[line_idx])) {
-                wmove(win, i + border_offset, border_offset + line_number_width); wclrtoeol(win);
-                wmove(win, i + border_offset, border_offset);
+            bool exposed = scroll_row_exposed(&plan, i);
+            update_gutter_row(win, state, i, i + border_offset, border_offset, line_idx < state->buffer.num_lines ? line_idx : -1);
+            if (line_idx >= state->buffer.num_lines) { if (scrolled || exposed) { wmove(win, i + border_offset, border_offset + gutter_width); wclrtoeol(win); } continue; }
+
+            // A line whose spans no longer match (e.g. a comment opened above it) is redrawn too
+            if (scrolled || exposed || (line_idx < state->buffer.dirty_lines_cap && state->buffer.dirty_lines[line_idx]) ||
+                !syntax_line_current(state, line_idx, in_multiline_comment)) {
+                wmove(win, i + border_offset, border_offset + gutter_width); wclrtoeol(win);
                 char *line = state->buffer.lines[line_idx];
-                if (state->view.show_line_numbers) {
-                    wattron(win, COLOR_PAIR(8) | A_DIM);
-                    int display_num = global_config.relative_line_numbers ? (line_idx == state->cursor.line ? line_idx + 1 : abs(line_idx - state->cursor.line)) : line_idx + 1;
-                    if (global_config.relative_line_numbers && line_idx == state->cursor.line) { wattroff(win, A_DIM); wattron(win, A_BOLD); }
-                    mvwprintw(win, i + border_offset, border_offset, "%*d ", line_number_width - 1, display_num);
-                    wattroff(win, A_BOLD); wattroff(win, COLOR_PAIR(8) | A_DIM);
-                }
-                wmove(win, i + border_offset, border_offset + line_number_width);
 
                 bool highlight_this_line = false;
                 if (state->buffer.mapping) {
@@ -781,173 +946,35 @@ void editor_redraw(WINDOW *win, EditorState *state) {
                 
                 if (highlight_this_line) wattron(win, A_REVERSE);
 
-                int current_col_val = 0, line_len = strlen(line);
-                bool is_line_comment = false;
-                bool is_directive = false;
-
-                int first_non_space = 0;
-                while (line[first_non_space] && isspace(line[first_non_space])) first_non_space++;
-                if (line[first_non_space] == '#') is_directive = true;
-
-                // Per-file-line search regex compilation
-                bool is_searching = (state->input.command_buffer[0] == '/');
-                const char *query = is_searching ? state->input.command_buffer + 1 : state->search.last_term;
-                regex_t regex;
-                bool has_regex = false;
-                if (query && query[0] != '\0') {
-                    if (is_searching || state->search.is_regex) {
-                        if (regcomp(&regex, query, REG_EXTENDED | REG_NEWLINE) == 0) has_regex = true;
-                    }
+                int line_len = strlen(line);
+
+                // left_col is a visual column: find the bytes on screen from the line's checkpoints
+                int content_width = cols - 2 * border_offset - gutter_width;
+                int start_col;
+                int start_byte = line_byte_at_col(&state->buffer.columns, line_idx, line, state->view.left_col, &start_col);
+                int end_byte = line_byte_at_col(&state->buffer.columns, line_idx, line, state->view.left_col + content_width, NULL);
+                const LineSpanSlot *syntax_spans = syntax_line_spans(state, line_idx, in_multiline_comment);
+                if (start_byte < line_len) {
+                    // A tab or wide character cut by the left edge leaves blank cells
+                    for (int c = state->view.left_col; c < start_col; c++) waddch(win, ' ');
+                    LineOverlays overlays;
+                    build_line_overlays(state, line_idx, line, line_len, start_byte, end_byte, in_multiline_comment, &overlays);
+                    draw_line_range(win, line, line_len, syntax_spans, &overlays, start_byte, end_byte, cols - 1 - border_offset);
                 }
-
-                while(current_col_val < line_len) {
-                    if (current_col_val < state->view.left_col) {
-                        // Maintenance of multiline comment state even when skipped by horizontal scroll
-                        if (!is_line_comment && !in_multiline_comment && line[current_col_val] == '/' && line[current_col_val+1] == '/') is_line_comment = true;
-                        if (!is_line_comment && !in_multiline_comment && line[current_col_val] == '/' && line[current_col_val+1] == '*') { in_multiline_comment = true; current_col_val++; }
-                        else if (in_multiline_comment && line[current_col_val] == '*' && line[current_col_val+1] == '/') { in_multiline_comment = false; current_col_val++; }
-                        current_col_val++; 
-                        continue; 
-                    }
-                    if (getcurx(win) >= cols - 1 - border_offset) break;
-                    
-                    // Comment Logic (Non-word-wrap)
-                    if (!in_multiline_comment && line[current_col_val] == '/' && line[current_col_val+1] == '/') is_line_comment = true;
-                    if (!is_line_comment && !in_multiline_comment && line[current_col_val] == '/' && line[current_col_val+1] == '*') in_multiline_comment = true;
-
-                    if (is_line_comment || in_multiline_comment || is_directive) {
-                        wattron(win, COLOR_PAIR(PAIR_COMMENT));
-                        int line_remaining = line_len - current_col_val;
-                        int visual_remaining = (cols - 1 - border_offset) - getcurx(win);
-
-                        if (in_multiline_comment) {
-                            char *end_ptr = strstr(&line[current_col_val], "*/");
-                            if (end_ptr) {
-                                int bytes_to_end = (end_ptr - &line[current_col_val]) + 2;
-                                int bytes_to_print = bytes_to_end > visual_remaining ? visual_remaining : bytes_to_end;
-                                waddnstr(win, &line[current_col_val], bytes_to_print);
-                                in_multiline_comment = false;
-                                current_col_val += bytes_to_end;
-                                wattroff(win, COLOR_PAIR(PAIR_COMMENT));
-                                continue;
-                            }
-                        }
-                        
-                        int bytes_to_print = line_remaining > visual_remaining ? visual_remaining : line_remaining;
-                        waddnstr(win, &line[current_col_val], bytes_to_print);
-                        current_col_val += line_remaining;
-                        wattroff(win, COLOR_PAIR(PAIR_COMMENT));
-                        continue;
-                    }
-
-                    int token_start = current_col_val, token_len;
-                    char current_char = line[token_start];
-                    if (strchr(delimiters, current_char)) token_len = 1;
-                    else { 
-                        int end = token_start; 
-                        while(end < line_len && !strchr(delimiters, line[end]) && !(line[end] == '/' && (line[end+1] == '/' || line[end+1] == '*'))) end++; 
-                        token_len = end - token_start; 
-                    }
-                    
-                    int color_pair = 0;
-                    if (is_selected(state, line_idx, token_start)) color_pair = PAIR_SELECTION;
-                    else if (token_len == 1 && is_unmatched_bracket(state, line_idx, token_start)) color_pair = 11;
-                    else if (current_char == '#') { 
-                        color_pair = PAIR_COMMENT; 
-                    }
-                    else {
-                        bool is_misspelled = false;
-                        if (state->spell.checker.enabled && !isdigit(current_char) && !strchr(delimiters, current_char)) {
-                            char *word_to_check = strndup(&line[token_start], token_len);
-                            if (word_to_check) {
-                                if (!spell_checker_check_word(&state->spell.checker, word_to_check)) {
-                                    is_misspelled = true;
-                                }
-                                free(word_to_check);
-                            }
-                        }
-                        if (is_misspelled) {
-                            color_pair = PAIR_SPELL_ERROR;
-                        } else {
-                            for (int j = 0; j < state->buffer.num_syntax_rules; j++) {
-                                if (strlen(state->buffer.syntax_rules[j].word) == (size_t)token_len && strncmp(&line[token_start], state->buffer.syntax_rules[j].word, token_len) == 0) {
-                                    switch(state->buffer.syntax_rules[j].type) { case SYNTAX_KEYWORD: color_pair = PAIR_KEYWORD; break; case SYNTAX_TYPE: color_pair = PAIR_TYPE; break; case SYNTAX_STD_FUNCTION: color_pair = PAIR_STD_FUNCTION; break; }
-                                    break;
-                                }
-                            }
-                        }
-                    }
-                    if (color_pair) wattron(win, COLOR_PAIR(color_pair));
-                    if (color_pair == PAIR_SPELL_ERROR) wattron(win, A_UNDERLINE);
-                    wprintw(win, "%.*s", token_len, &line[token_start]);
-                    if (color_pair == PAIR_SPELL_ERROR) wattroff(win, A_UNDERLINE);
-                    if (color_pair) wattroff(win, COLOR_PAIR(color_pair));
-                    current_col_val += token_len;
-                }
-
-                // --- REAL-TIME SEARCH HIGHLIGHT (NO WRAP) ---
-                if (query && query[0] != '\0') {
-                    int search_offset = state->view.left_col;
-                    while (search_offset < line_len) {
-                        int match_start = -1, match_len = 0;
-                        if (has_regex) {
-                            regmatch_t pmatch[1];
-                            if (regexec(&regex, line + search_offset, 1, pmatch, 0) == 0) {
-                                match_start = search_offset + pmatch[0].rm_so;
-                                match_len = pmatch[0].rm_eo - pmatch[0].rm_so;
-                                if (match_len == 0) match_len = 1;
-                            } else break;
-                        } else {
-                            char *match = strstr(line + search_offset, query);
-                            if (match) {
-                                match_start = match - line;
-                                match_len = strlen(query);
-                            } else break;
-                        }
-
-                        if (match_start != -1) {
-                            int s_start = max(match_start, state->view.left_col);
-                            int s_end = match_start + match_len;
-                            if (s_start < s_end) {
-                                int sx = border_offset + line_number_width + get_visual_col(line + state->view.left_col, s_start - state->view.left_col);
-                                int ex = border_offset + line_number_width + get_visual_col(line + state->view.left_col, s_end - state->view.left_col);
-                                int mx = cols - border_offset;
-                                if (sx < mx) mvwchgat(win, i + border_offset, sx, min(ex, mx) - sx, A_REVERSE, PAIR_WARNING, NULL);
-                            }
-                            search_offset = match_start + match_len;
-                        } else break;
-                    }
-                }
-                
-                if (has_regex) regfree(&regex);
+                in_multiline_comment = syntax_spans ? syntax_spans->end_state : syntax_line_ends_in_comment(state, line_idx, in_multiline_comment);
                 if (highlight_this_line) wattroff(win, A_REVERSE);
                 
+                // --- LSP INLINE DIAGNOSTICS (NO WRAP) ---
                 if (global_config.lsp_diagnostics && global_config.lsp_highlight && state->lsp.enabled && state->lsp.document) {
-                    for (int d = 0; d < state->lsp.document->diagnostics_count; d++) {
-                        LspDiagnostic *diag = &state->lsp.document->diagnostics[d];
+                    const int *line_diags;
+                    int line_diag_count = lsp_diagnostics_on_line(state, line_idx, &line_diags);
+                    for (int d = 0; d < line_diag_count; d++) {
+                        LspDiagnostic *diag = &state->lsp.document->diagnostics[line_diags[d]];
                         if (diag->range.start.line <= line_idx && diag->range.end.line >= line_idx) {
-                            int diag_start_col = (diag->range.start.line == line_idx) ? diag->range.start.character : 0;
-                            int diag_end_col = (diag->range.end.line == line_idx) ? diag->range.end.character : line_len;
-                            
-                            int s_start = max(diag_start_col, state->view.left_col);
-                            int s_end = min(diag_end_col, line_len);
-                            if (s_start < s_end) {
-                                int sx = border_offset + line_number_width + get_visual_col(line + state->view.left_col, s_start - state->view.left_col);
-                                int ex = border_offset + line_number_width + get_visual_col(line + state->view.left_col, s_end - state->view.left_col);
-                                int mx = cols - border_offset;
-                                if (sx < mx) {
-                                    int color = (diag->severity == LSP_SEVERITY_ERROR) ? 11 : 3;
-                                    mvwchgat(win, i + border_offset, sx, min(ex, mx) - sx, A_UNDERLINE, color, NULL);
-                                }
-                            }
-
                             if (global_config.lsp_inline_diagnostics && diag->range.end.line == line_idx) {
-                                int base_x = border_offset + line_number_width;
-                                int remaining_len = line_len - state->view.left_col;
-                                int visual_line_len = 0;
-                                if (remaining_len > 0) {
-                                    visual_line_len = get_visual_col(line + state->view.left_col, remaining_len);
-                                }
+                                int base_x = border_offset + gutter_width;
+                                int visual_line_len = line_visual_col(&state->buffer.columns, line_idx, line, line_len) - state->view.left_col;
+                                if (visual_line_len < 0) visual_line_len = 0;
                                 int end_x = base_x + visual_line_len + 4; // padding
                                 if (end_x < cols - border_offset - 2) {
                                     int max_len = (cols - border_offset) - end_x;
@@ -980,25 +1007,9 @@ void editor_redraw(WINDOW *win, EditorState *state) {
                     }
                 }
                 
-                for (int c = 0; c < state->num_extra_cursors; c++) {
-                    if (state->extra_cursors[c].line == line_idx) {
-                        int cx = state->extra_cursors[c].col - state->view.left_col + border_offset + line_number_width;
-                        if (cx >= border_offset + line_number_width && cx < cols) {
-                            mvwchgat(win, i + border_offset, cx, 1, A_REVERSE, 0, NULL);
-                        }
-                    }
-                }
-                
-                state->buffer.dirty_lines[line_idx] = false;
+                if (line_idx < state->buffer.dirty_lines_cap) state->buffer.dirty_lines[line_idx] = false;
             } else {
-                // If line not dirty, we still need to maintain in_multiline_comment state
-                char *l = state->buffer.lines[line_idx];
-                if (l) {
-                    for (int p = 0; l[p]; p++) {
-                        if (!in_multiline_comment && l[p] == '/' && l[p+1] == '*') { in_multiline_comment = true; p++; }
-                        else if (in_multiline_comment && l[p] == '*' && l[p+1] == '/') { in_multiline_comment = false; p++; }
-                    }
-                }
+                in_multiline_comment = syntax_line_ends_in_comment(state, line_idx, in_multiline_comment);
             }
         }
     }
@@ -1040,6 +1051,14 @@ void editor_redraw(WINDOW *win, EditorState *state) {
         }
     }
 
+    editor_draw_status_bar(win, state);
+}
+
+// Repaints only the status line, so a clock tick doesn't cost a full editor redraw.
+void editor_draw_status_bar(WINDOW *win, EditorState *state) {
+    int rows, cols;
+    getmaxyx(win, rows, cols);
+
     int color_pair = 8; // Cor padrão
     if (state->cursor.is_moving) {
         color_pair = 2;
@@ -1066,7 +1085,7 @@ void editor_redraw(WINDOW *win, EditorState *state) {
             default: strcpy(mode_str, "--          --"); break;
         }
         
-        int visual_col = get_visual_col(state->buffer.lines[state->cursor.line], state->cursor.col);
+        int visual_col = line_visual_col(&state->buffer.columns, state->cursor.line, state->buffer.lines[state->cursor.line], state->cursor.col);
 
         if (state->view.status_bar_mode == 1) { // New robust style
             char left_bar[256], right_bar[256], display_filename[64], error_count_str[64] = "";
@@ -1083,11 +1102,7 @@ void editor_redraw(WINDOW *win, EditorState *state) {
             display_filename[sizeof(display_filename) - 1] = '\0';
 
             if (global_config.show_error_count && state->lsp.document && state->lsp.document->diagnostics_count > 0) {
-                int errors = 0, warnings = 0;
-                for (int i = 0; i < state->lsp.document->diagnostics_count; i++) {
-                    if (state->lsp.document->diagnostics[i].severity == LSP_SEVERITY_ERROR) errors++;
-                    else if (state->lsp.document->diagnostics[i].severity == LSP_SEVERITY_WARNING) warnings++;
-                }
+                int errors = state->lsp.document->error_count, warnings = state->lsp.document->warning_count;
                 if (errors > 0 || warnings > 0) snprintf(error_count_str, sizeof(error_count_str), "☒ %d ⚠ %d | ", errors, warnings);
             }
 
@@ -1129,15 +1144,10 @@ void adjust_viewport(WINDOW *win, EditorState *state) {
     
     int border_offset = ACTIVE_WS->num_windows > 1 ? 1 : 0;
     
-    int line_number_width = 0;
-    if (state->view.show_line_numbers) {
-        int max_lines = state->buffer.num_lines > 0 ? state->buffer.num_lines : 1;
-        line_number_width = snprintf(NULL, 0, "%d", max_lines) + 1;
-        if (line_number_width < 4) line_number_width = 4;
-    }
+    int gutter_width = editor_gutter_width(state);
     
     int content_height = rows - border_offset - 1;
-    int content_width = cols - 2 * border_offset - line_number_width;
+    int content_width = cols - 2 * border_offset - gutter_width;
 
     int visual_y, visual_x;
     get_visual_pos(win, state, &visual_y, &visual_x);
@@ -1172,14 +1182,9 @@ void get_visual_pos(WINDOW *win, EditorState *state, int *visual_y, int *visual_
 
     int border_offset = ACTIVE_WS->num_windows > 1 ? 1 : 0;
     
-    int line_number_width = 0;
-    if (state->view.show_line_numbers) {
-        int max_lines = state->buffer.num_lines > 0 ? state->buffer.num_lines : 1;
-        line_number_width = snprintf(NULL, 0, "%d", max_lines) + 1;
-        if (line_number_width < 4) line_number_width = 4;
-    }
+    int gutter_width = editor_gutter_width(state);
     
-    int content_width = cols - (2 * border_offset) - line_number_width;
+    int content_width = cols - (2 * border_offset) - gutter_width;
     if (content_width <= 0) content_width = 1;
 
     int y = 0;
@@ -1198,71 +1203,16 @@ void get_visual_pos(WINDOW *win, EditorState *state, int *visual_y, int *visual_
             int line_offset = 0;
             while (line_offset < line_len) {
                 y++;
-                int current_bytes = 0;
-                int current_width = 0;
-                int last_space_bytes = -1;
-
-                while (line[line_offset + current_bytes] != '\0') {
-                    wchar_t wc;
-                    int bytes_consumed = mbtowc(&wc, &line[line_offset + current_bytes], MB_CUR_MAX);
-                    if (bytes_consumed <= 0) { bytes_consumed = 1; wc = ' '; }
-                    
-                    int char_width = wcwidth(wc);
-                    if (char_width < 0) char_width = 1;
-                    if (current_width + char_width > content_width) break;
-
-                    current_width += char_width;
-                    if (iswspace(wc)) {
-                        last_space_bytes = current_bytes + bytes_consumed;
-                    }
-                    current_bytes += bytes_consumed;
-                }
-
-                int break_pos;
-                if (line[line_offset + current_bytes] != '\0' && last_space_bytes != -1) {
-                    break_pos = last_space_bytes;
-                } else {
-                    break_pos = current_bytes;
-                }
-                if (break_pos == 0 && (size_t)(line_offset + current_bytes) < strlen(line)) {
-                    break_pos = current_bytes;
-                }
+                int break_pos = utf8_wrap_break(line + line_offset, line_len - line_offset, content_width);
                 line_offset += break_pos;
             }
         }
 
         char *current_line_str = state->buffer.lines[state->cursor.line];
+        int current_line_len = strlen(current_line_str);
         int line_offset = 0;
         while (line_offset < state->cursor.col) {
-            int current_bytes = 0;
-            int current_width = 0;
-            int last_space_bytes = -1;
-
-            while (current_line_str[line_offset + current_bytes] != '\0') {
-                wchar_t wc;
-                int bytes_consumed = mbtowc(&wc, &current_line_str[line_offset + current_bytes], MB_CUR_MAX);
-                if (bytes_consumed <= 0) { bytes_consumed = 1; wc = ' '; }
-                
-                int char_width = wcwidth(wc);
-                if (char_width < 0) char_width = 1;
-                if (current_width + char_width > content_width) break;
-
-                current_width += char_width;
-                if (iswspace(wc)) {
-                    last_space_bytes = current_bytes + bytes_consumed;
-                }
-                current_bytes += bytes_consumed;
-            }
-            
-            int break_pos;
-            if (current_line_str[line_offset + current_bytes] != '\0' && last_space_bytes != -1) {
-                break_pos = last_space_bytes;
-            } else {
-                break_pos = current_bytes;
-            }
-            if (break_pos == 0 && (size_t)(line_offset + current_bytes) < strlen(current_line_str)) {
-                break_pos = current_bytes;
-            }
+            int break_pos = utf8_wrap_break(current_line_str + line_offset, current_line_len - line_offset, content_width);
 
             if (line_offset + break_pos < state->cursor.col) {
                 y++;
@@ -1275,7 +1225,7 @@ void get_visual_pos(WINDOW *win, EditorState *state, int *visual_y, int *visual_
 
     } else { 
         y = state->cursor.line;
-        x = get_visual_col(state->buffer.lines[state->cursor.line], state->cursor.col);
+        x = line_visual_col(&state->buffer.columns, state->cursor.line, state->buffer.lines[state->cursor.line], state->cursor.col);
     }
 
     *visual_y = y;
@@ -1283,29 +1233,7 @@ void get_visual_pos(WINDOW *win, EditorState *state, int *visual_y, int *visual_
 }
 
 int get_visual_col(const char *line, int byte_col) {
-    if (!line) return 0;
-    int visual_col = 0;
-    int i = 0;
-    while (i < byte_col) {
-        if (line[i] == '\t') {
-            visual_col += TAB_SIZE - (visual_col % TAB_SIZE);
-            i++;
-        } else {
-            wchar_t wc;
-            int bytes_consumed = mbtowc(&wc, &line[i], MB_CUR_MAX);
-            
-            if (bytes_consumed <= 0) {
-                visual_col++;
-                i++;
-            } else {
-                int char_width = wcwidth(wc);
-                
-                visual_col += (char_width > 0) ? char_width : 1;
-                i += bytes_consumed;
-            }
-       }
-   }
-   return visual_col;
+    return visual_col_advance(line, 0, 0, byte_col);
 }
 
 bool is_selected(EditorState *state, int line_idx, int col_idx) {
@@ -1685,10 +1613,10 @@ void help_viewer_redraw(EditorWindow *jw) {
             int block_y = draw_y;
             char *p = line;
             while (*p) {
-                wchar_t wc;
-                int bytes = mbtowc(&wc, p, MB_CUR_MAX);
-                if (bytes <= 0) { p++; continue; }
-                int w = wcwidth(wc);
+                uint32_t cp;
+                int bytes = utf8_decode(p, &cp);
+                if (cp == UTF8_INVALID && bytes == 1) { p++; continue; }
+                int w = utf8_char_width(cp);
                 if (w < 0) w = 1;
                 if (block_x + w > cols - 2) {
                     block_y++;
@@ -1722,10 +1650,11 @@ void help_viewer_redraw(EditorWindow *jw) {
                     char *link_ptr = ptr + 1;
                     wattron(jw->win, A_UNDERLINE | COLOR_PAIR(PAIR_TYPE));
                     while (link_ptr < end_text) {
-                        wchar_t wc;
-                        int b = mbtowc(&wc, link_ptr, MB_CUR_MAX);
-                        if (b <= 0) { link_ptr++; continue; }
-                        int w = wcwidth(wc);
+                        uint32_t cp;
+                        int b = utf8_decode(link_ptr, &cp);
+                        if (cp == UTF8_INVALID && b == 1) { link_ptr++; continue; }
+                        wchar_t wc = (wchar_t)cp;
+                        int w = utf8_char_width(cp);
                         if (w < 0) w = 1;
                         
                         if (curr_x + w > cols - 2) { draw_y++; curr_x = 2; if (draw_y > max_draw_y) break; }
@@ -1751,10 +1680,11 @@ void help_viewer_redraw(EditorWindow *jw) {
                     char *bold_ptr = ptr + 1;
                     wattron(jw->win, A_BOLD);
                     while (bold_ptr < end_bold) {
-                        wchar_t wc;
-                        int b = mbtowc(&wc, bold_ptr, MB_CUR_MAX);
-                        if (b <= 0) { bold_ptr++; continue; }
-                        int w = wcwidth(wc);
+                        uint32_t cp;
+                        int b = utf8_decode(bold_ptr, &cp);
+                        if (cp == UTF8_INVALID && b == 1) { bold_ptr++; continue; }
+                        wchar_t wc = (wchar_t)cp;
+                        int w = utf8_char_width(cp);
                         if (w < 0) w = 1;
 
                         if (curr_x + w > cols - 2) { draw_y++; curr_x = 2; if (draw_y > max_draw_y) break; }
@@ -1774,10 +1704,11 @@ void help_viewer_redraw(EditorWindow *jw) {
             }
 
             // 3. Normal Character
-            wchar_t wc;
-            int b = mbtowc(&wc, ptr, MB_CUR_MAX);
-            if (b <= 0) { ptr++; continue; }
-            int w = wcwidth(wc);
+            uint32_t cp;
+            int b = utf8_decode(ptr, &cp);
+            if (cp == UTF8_INVALID && b == 1) { ptr++; continue; }
+            wchar_t wc = (wchar_t)cp;
+            int w = utf8_char_width(cp);
             if (w < 0) w = 1;
 
             if (curr_x + w > cols - 2) { draw_y++; curr_x = 2; if (draw_y > max_draw_y) break; }
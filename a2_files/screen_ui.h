@@ -7,9 +7,11 @@
 void draw_diagnostic_popup(WINDOW *main_win, EditorState *state, const char *message);
 void draw_code_action_popup(WINDOW *win, EditorState *state);
 void editor_redraw(WINDOW *win, EditorState *state);
+void editor_draw_status_bar(WINDOW *win, EditorState *state);
 void adjust_viewport(WINDOW *win, EditorState *state);
 void get_visual_pos(WINDOW *win, EditorState *state, int *visual_y, int *visual_x);
 int get_visual_col(const char *line, int byte_col);
+int editor_gutter_width(EditorState *state); // columns left of the text: signs and line numbers
 void display_output_screen(const char *title, const char *filename);
 void display_diagnostics_list(EditorState *state);
 FileViewer* create_file_viewer(const char* filename);
@@ -0,0 +1,28 @@
+#include "scroll_region.h"
+#include <stdlib.h>
+
+ScrollPlan scroll_plan(int delta, int content_height, bool can_shift) {
+    ScrollPlan plan = { false, 0, 0 };
+    if (!can_shift || delta == 0 || abs(delta) >= content_height) return plan;
+    plan.shift = true;
+    plan.exposed_from = delta > 0 ? content_height - delta : 0;
+    plan.exposed_to = delta > 0 ? content_height : -delta;
+    return plan;
+}
+
+bool scroll_row_exposed(const ScrollPlan *plan, int row) {
+    return row >= plan->exposed_from && row < plan->exposed_to;
+}
+
+void scroll_window_setup(WINDOW *win) {
+    scrollok(win, FALSE);
+    idlok(win, TRUE);
+}
+
+void scroll_text_rows(WINDOW *win, int first, int count, int delta) {
+    scrollok(win, TRUE);
+    wsetscrreg(win, first, first + count - 1);
+    wscrl(win, delta);
+    wsetscrreg(win, 0, getmaxy(win) - 1);
+    scrollok(win, FALSE);
+}
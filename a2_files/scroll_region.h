@@ -0,0 +1,33 @@
+#ifndef SCROLL_REGION_H
+#define SCROLL_REGION_H
+
+#include <ncurses.h>
+#include <stdbool.h>
+
+// Vertical scrolling of the text rows of a window.
+// When nothing but the top line moved, the rows still on screen are shifted
+// (ncurses sends that to the terminal as a scroll of the region) and only the
+// rows the shift exposes are rendered again; otherwise everything is repainted.
+// Shared by editor_redraw() and bench/scroll_bench.c.
+
+typedef struct {
+    bool shift;       // shift the region instead of repainting it
+    int exposed_from; // rows [exposed_from, exposed_to) must be rendered after the shift
+    int exposed_to;
+} ScrollPlan;
+
+// delta: lines the top moved by (negative: up); can_shift: the rows kept on
+// screen are still valid (no horizontal scroll, wrapping or gutter change)
+ScrollPlan scroll_plan(int delta, int content_height, bool can_shift);
+
+bool scroll_row_exposed(const ScrollPlan *plan, int row);
+
+// Sets up a new editor window for scrolling: no automatic scroll at the bottom
+// right corner, and idlok() so ncurses can send shifted rows as terminal scrolls
+void scroll_window_setup(WINDOW *win);
+
+// Shifts rows [first, first + count) of win up by delta (down if negative) and blanks
+// the rows it exposes. The window must be set up by scroll_window_setup().
+void scroll_text_rows(WINDOW *win, int first, int count, int delta);
+
+#endif // SCROLL_REGION_H
@@ -116,6 +116,78 @@ void editor_find_previous(EditorState *state) {
     editor_set_status_msg(state, "No other occurrence of: %s", state->search.last_term);
 }
 
+// Recompiles the highlight pattern only when the query (or regex mode) changed.
+// Returns false when there is nothing to highlight.
+static bool search_highlight_prepare(EditorState *state) {
+    bool is_searching = (state->input.command_buffer[0] == '/');
+    const char *query = is_searching ? state->input.command_buffer + 1 : state->search.last_term;
+    bool use_regex = is_searching || state->search.is_regex;
+    if (!query || query[0] == '\0') return false;
+
+    if (strcmp(query, state->search.highlight_query) != 0 || use_regex != state->search.highlight_use_regex) {
+        if (state->search.highlight_has_regex) {
+            regfree(&state->search.highlight_regex);
+            state->search.highlight_has_regex = false;
+        }
+        strncpy(state->search.highlight_query, query, sizeof(state->search.highlight_query) - 1);
+        state->search.highlight_query[sizeof(state->search.highlight_query) - 1] = '\0';
+        state->search.highlight_use_regex = use_regex;
+        if (use_regex && regcomp(&state->search.highlight_regex, query, REG_EXTENDED | REG_NEWLINE) == 0) {
+            state->search.highlight_has_regex = true;
+        }
+        // Bumping the generation makes every cached line miss without touching the slots
+        state->search.highlight_generation++;
+    }
+    return true;
+}
+
+const LineSpanSlot *search_highlight_spans(EditorState *state, int line_idx) {
+    if (line_idx < 0 || line_idx >= state->buffer.num_lines) return NULL;
+    if (!search_highlight_prepare(state)) return NULL;
+    const char *line = state->buffer.lines[line_idx];
+    if (!line) return NULL;
+
+    LineSpanCache *cache = &state->search.highlight_cache;
+    uint64_t gen = state->search.highlight_generation;
+    LineSpanSlot *slot = line_cache_lookup(cache, line_idx, line, gen);
+    if (slot) return slot;
+
+    slot = line_cache_begin(cache, line_idx, line, gen);
+    if (!slot) return NULL;
+
+    const char *query = state->search.highlight_query;
+    int line_len = strlen(line);
+    int query_len = strlen(query);
+    int search_offset = 0;
+    while (search_offset < line_len) {
+        int match_start, match_len;
+        if (state->search.highlight_has_regex) {
+            regmatch_t pmatch[1];
+            if (regexec(&state->search.highlight_regex, line + search_offset, 1, pmatch, 0) != 0) break;
+            match_start = search_offset + pmatch[0].rm_so;
+            match_len = pmatch[0].rm_eo - pmatch[0].rm_so;
+            if (match_len == 0) match_len = 1;
+        } else {
+            const char *match = strstr(line + search_offset, query);
+            if (!match) break;
+            match_start = match - line;
+            match_len = query_len;
+        }
+        line_cache_push(slot, match_start, match_start + match_len, 0);
+        search_offset = match_start + match_len;
+    }
+    return slot;
+}
+
+void search_highlight_free(EditorState *state) {
+    if (state->search.highlight_has_regex) {
+        regfree(&state->search.highlight_regex);
+        state->search.highlight_has_regex = false;
+    }
+    state->search.highlight_query[0] = '\0';
+    line_cache_free(&state->search.highlight_cache);
+}
+
 static char* replace_in_line_helper(char* line, const char* find, const char* replace, bool replace_all, int start_col, int* replacements_made) {
     char *pos = strstr(line + start_col, find);
     if (!pos) return line;
@@ -148,7 +220,10 @@ void editor_do_replace(EditorState *state, const char *find, const char *replace
     int replacements = 0;
     if (flags && flags[0] == 'l' && isdigit(flags[1])) {
         int line_num = atoi(flags + 1) - 1;
-        if (line_num >= 0 && line_num < state->buffer.num_lines) state->buffer.lines[line_num] = replace_in_line_helper(state->buffer.lines[line_num], find, replace, true, 0, &replacements);
+        if (line_num >= 0 && line_num < state->buffer.num_lines) {
+            state->buffer.lines[line_num] = replace_in_line_helper(state->buffer.lines[line_num], find, replace, true, 0, &replacements);
+            editor_note_edit(state, line_num, 1, 1);
+        }
     } else if (flags && isdigit(flags[0])) {
         int count = atoi(flags);
         for (int i = state->cursor.line; i < state->buffer.num_lines && count > 0; i++) {
@@ -160,6 +235,7 @@ void editor_do_replace(EditorState *state, const char *find, const char *replace
                 int offset = occurrence - line;
                 state->buffer.lines[i] = replace_in_line_helper(line, find, replace, false, offset, &replacements);
                 count--; line = state->buffer.lines[i];
+                editor_note_edit(state, i, 1, 1);
                 search_from = line + offset + strlen(replace);
                 occurrence = strstr(search_from, find);
             }
@@ -169,6 +245,7 @@ void editor_do_replace(EditorState *state, const char *find, const char *replace
             int start_col = (i == state->cursor.line) ? state->cursor.col : 0;
             if (strstr(state->buffer.lines[i] + start_col, find)) {
                 state->buffer.lines[i] = replace_in_line_helper(state->buffer.lines[i], find, replace, false, start_col, &replacements);
+                editor_note_edit(state, i, 1, 1);
                 break; 
             }
         }
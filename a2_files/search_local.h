@@ -10,4 +10,8 @@ void add_to_search_history(EditorState *state, const char *term);
 void editor_do_replace(EditorState *state, const char *find, const char *replace, const char *flags);
 void editor_do_regex_replace(EditorState *state, const char *find, const char *replace, const char *flags);
 
+// Cached search-highlight matches for one line (byte spans), NULL if no query is active
+const LineSpanSlot *search_highlight_spans(EditorState *state, int line_idx);
+void search_highlight_free(EditorState *state);
+
 #endif // SEARCH_LOCAL_H
@@ -27,6 +27,7 @@ A2Config global_config = {
     .lsp_diagnostics = true,
     .lsp_inline_diagnostics = false,
     .lsp_highlight = true,
+    .lsp_semantic_tokens = true,
     .lsp_completion = true,
     .lsp_hover = true,
     .tab_size = 4,
@@ -34,6 +35,7 @@ A2Config global_config = {
     .status_bar_mode = 1,
     .default_spell_lang = "",
     .spell_checker_enabled = true,
+    .spell_compiled_dict = true,
     .show_line_numbers = false,
     .show_error_count = true,
     .abbreviate_filename = true,
@@ -43,7 +45,11 @@ A2Config global_config = {
     .log_level_filter = LOG_DEBUG,
     .icon_mode = 1,
     .image_preview_enabled = true,
-    .dictionary_lang = "auto"
+    .dictionary_lang = "auto",
+    .max_fps = 60,
+    .synchronized_output = true,
+    .lsp_change_delay_ms = 100,
+    .lsp_idle_timeout_sec = 60
 };
 
 typedef struct {
@@ -63,7 +69,9 @@ BoolSetting editor_bool_settings[] = {
     {"Abbreviate Filename", &global_config.abbreviate_filename},
     {"Smart Merge Save", &global_config.smart_save_enabled},
     {"Image Previews", &global_config.image_preview_enabled},
-    {"Git Diff Gutter", &global_config.git_gutter_enabled}
+    {"Git Diff Gutter", &global_config.git_gutter_enabled},
+    {"Compiled Spell Dict", &global_config.spell_compiled_dict},
+    {"Synchronized Output", &global_config.synchronized_output}
     };
 
 const int num_bool_settings = sizeof(editor_bool_settings) / sizeof(BoolSetting);
@@ -76,7 +84,10 @@ typedef struct {
 IntSetting editor_int_settings[] = {
     {"Tab Size", &global_config.tab_size},
     {"Status Bar Style", &global_config.status_bar_mode},
-    {"Icon Mode (0-2)", &global_config.icon_mode}
+    {"Icon Mode (0-2)", &global_config.icon_mode},
+    {"Max FPS", &global_config.max_fps},
+    {"LSP Change Delay (ms)", &global_config.lsp_change_delay_ms},
+    {"LSP Idle Timeout (s)", &global_config.lsp_idle_timeout_sec}
 };
 
 const int num_int_settings = sizeof(editor_int_settings) / sizeof(IntSetting);
@@ -353,6 +364,7 @@ void save_global_config() {
         fprintf(f, "expand_tab=%d\n", global_config.expand_tab);
         fprintf(f, "status_bar_mode=%d\n", global_config.status_bar_mode);
         fprintf(f, "spell_checker_enabled=%d\n", global_config.spell_checker_enabled);
+        fprintf(f, "spell_compiled_dict=%d\n", global_config.spell_compiled_dict);
         fprintf(f, "show_line_numbers=%d\n", global_config.show_line_numbers);
         fprintf(f, "show_scrollbar=%d\n", global_config.show_scrollbar);
         fprintf(f, "relative_line_numbers=%d\n", global_config.relative_line_numbers);
@@ -360,6 +372,7 @@ void save_global_config() {
         fprintf(f, "lsp_diagnostics=%d\n", global_config.lsp_diagnostics);
         fprintf(f, "lsp_inline_diagnostics=%d\n", global_config.lsp_inline_diagnostics);
         fprintf(f, "lsp_highlight=%d\n", global_config.lsp_highlight);
+        fprintf(f, "lsp_semantic_tokens=%d\n", global_config.lsp_semantic_tokens);
         fprintf(f, "lsp_completion=%d\n", global_config.lsp_completion);
         fprintf(f, "lsp_hover=%d\n", global_config.lsp_hover);
         fprintf(f, "show_error_count=%d\n", global_config.show_error_count);
@@ -371,6 +384,10 @@ void save_global_config() {
         fprintf(f, "icon_mode=%d\n", global_config.icon_mode);
         fprintf(f, "image_preview_enabled=%d\n", global_config.image_preview_enabled);
         fprintf(f, "dictionary_lang=%s\n", global_config.dictionary_lang);
+        fprintf(f, "max_fps=%d\n", global_config.max_fps);
+        fprintf(f, "synchronized_output=%d\n", global_config.synchronized_output);
+        fprintf(f, "lsp_change_delay_ms=%d\n", global_config.lsp_change_delay_ms);
+        fprintf(f, "lsp_idle_timeout_sec=%d\n", global_config.lsp_idle_timeout_sec);
         fclose(f);
     }
 }
@@ -395,6 +412,7 @@ void load_global_config() {
         else if (sscanf(line, "expand_tab=%d", &val) == 1) global_config.expand_tab = val;
         else if (sscanf(line, "status_bar_mode=%d", &val) == 1) global_config.status_bar_mode = val;
         else if (sscanf(line, "spell_checker_enabled=%d", &val) == 1) global_config.spell_checker_enabled = val;
+        else if (sscanf(line, "spell_compiled_dict=%d", &val) == 1) global_config.spell_compiled_dict = val;
         else if (sscanf(line, "show_line_numbers=%d", &val) == 1) global_config.show_line_numbers = val;
         else if (sscanf(line, "show_scrollbar=%d", &val) == 1) global_config.show_scrollbar = val;
         else if (sscanf(line, "relative_line_numbers=%d", &val) == 1) global_config.relative_line_numbers = val;
@@ -402,6 +420,7 @@ void load_global_config() {
         else if (sscanf(line, "lsp_diagnostics=%d", &val) == 1) global_config.lsp_diagnostics = val;
         else if (sscanf(line, "lsp_inline_diagnostics=%d", &val) == 1) global_config.lsp_inline_diagnostics = val;
         else if (sscanf(line, "lsp_highlight=%d", &val) == 1) global_config.lsp_highlight = val;
+        else if (sscanf(line, "lsp_semantic_tokens=%d", &val) == 1) global_config.lsp_semantic_tokens = val;
         else if (sscanf(line, "lsp_completion=%d", &val) == 1) global_config.lsp_completion = val;
         else if (sscanf(line, "lsp_hover=%d", &val) == 1) global_config.lsp_hover = val;
         else if (sscanf(line, "show_error_count=%d", &val) == 1) global_config.show_error_count = val;
@@ -412,6 +431,10 @@ void load_global_config() {
         else if (sscanf(line, "log_level_filter=%d", &val) == 1) global_config.log_level_filter = val;
         else if (sscanf(line, "icon_mode=%d", &val) == 1) global_config.icon_mode = val;
         else if (sscanf(line, "image_preview_enabled=%d", &val) == 1) global_config.image_preview_enabled = val;
+        else if (sscanf(line, "max_fps=%d", &val) == 1) global_config.max_fps = val;
+        else if (sscanf(line, "synchronized_output=%d", &val) == 1) global_config.synchronized_output = val;
+        else if (sscanf(line, "lsp_change_delay_ms=%d", &val) == 1) global_config.lsp_change_delay_ms = val;
+        else if (sscanf(line, "lsp_idle_timeout_sec=%d", &val) == 1) global_config.lsp_idle_timeout_sec = val;
         else if (sscanf(line, "default_spell_lang=%127[^\n]", str_val) == 1) {
             strncpy(global_config.default_spell_lang, str_val, sizeof(global_config.default_spell_lang) - 1);
             global_config.default_spell_lang[sizeof(global_config.default_spell_lang) - 1] = '\0';
@@ -720,10 +743,11 @@ void draw_lsp_settings(EditorWindow *jw) {
         "Auto-completion",
         "Show Hover Info",
         "Inline Diagnostics",
+        "Semantic Highlight",
         "RESTART LSP SERVER" 
     };
     
-    for (int i = 0; i < 7; i++) {
+    for (int i = 0; i < 8; i++) {
         if (i == state->current_selection) wattron(jw->win, COLOR_PAIR(PAIR_SELECTION));
         
         bool status = false;
@@ -733,8 +757,9 @@ void draw_lsp_settings(EditorWindow *jw) {
         else if (i == 3) status = global_config.lsp_completion;
         else if (i == 4) status = global_config.lsp_hover;
         else if (i == 5) status = global_config.lsp_inline_diagnostics;
+        else if (i == 6) status = global_config.lsp_semantic_tokens;
         
-        if (i == 6) {
+        if (i == 7) {
             mvwprintw(jw->win, 4 + i, 4, "  !!! %s !!! ", lsp_opts[i]);
         } else {
             mvwprintw(jw->win, 4 + i, 4, "  %-20s : ", lsp_opts[i]);
@@ -1102,7 +1127,14 @@ void settings_panel_process_input(EditorWindow *jw, wint_t ch, bool *should_exit
                             global_config.status_bar_mode = (global_config.status_bar_mode == 1) ? 0 : 1;
                         } else if (strcmp(editor_int_settings[int_idx].name, "Icon Mode (0-2)") == 0) {
                             global_config.icon_mode = (global_config.icon_mode == 1) ? 2 : (global_config.icon_mode == 2) ? 0 : 1;
-
+                        } else if (strcmp(editor_int_settings[int_idx].name, "Max FPS") == 0) {
+                            global_config.max_fps = (global_config.max_fps >= 120) ? 30 : global_config.max_fps * 2;
+
+                        } else if (strcmp(editor_int_settings[int_idx].name, "LSP Change Delay (ms)") == 0) {
+                            global_config.lsp_change_delay_ms = (global_config.lsp_change_delay_ms >= 150) ? 0 : global_config.lsp_change_delay_ms + 50;
+                        } else if (strcmp(editor_int_settings[int_idx].name, "LSP Idle Timeout (s)") == 0) {
+                            global_config.lsp_idle_timeout_sec = (global_config.lsp_idle_timeout_sec >= 300) ? 0 :
+                                (global_config.lsp_idle_timeout_sec >= 60) ? 300 : global_config.lsp_idle_timeout_sec + 30;
                         }
                     }
                     save_global_config(); // Salva no disco
@@ -1233,7 +1265,7 @@ void settings_panel_process_input(EditorWindow *jw, wint_t ch, bool *should_exit
                     break;
                 case KEY_CTRL_RIGHT_BRACKET: state->is_dirty = true; next_window(); break;
                 case 'j': case KEY_DOWN:
-                    if (state->current_selection < 6) state->current_selection++;
+                    if (state->current_selection < 7) state->current_selection++;
                     break;
                 case 'k': case KEY_UP:
                     if (state->current_selection > 0) state->current_selection--;
@@ -1256,6 +1288,8 @@ void settings_panel_process_input(EditorWindow *jw, wint_t ch, bool *should_exit
                     } else if (state->current_selection == 5) {
                         global_config.lsp_inline_diagnostics = !global_config.lsp_inline_diagnostics;
                     } else if (state->current_selection == 6) {
+                        global_config.lsp_semantic_tokens = !global_config.lsp_semantic_tokens;
+                    } else if (state->current_selection == 7) {
                         EditorState *editor_state = get_any_editor_state();
                         if (editor_state) process_lsp_restart(editor_state);
                     }
@@ -4,6 +4,36 @@
 #include <string.h>
 #include <stdlib.h> // for the free function
 #include <unistd.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "spell_worker.h"
+#include "spell_compiled.h"
+#include "cache.h"
+
+struct SpellDict {
+    char lang[32];
+    char aff_path[1024];
+    char dic_path[1024];
+    Hunhandle *handle;        // NULL while loading or if loading failed
+    SpellCompiled *compiled;  // fast positive lookups, NULL if disabled or unavailable
+    bool loading;
+    bool pinned;              // preloaded, kept even with no users
+    int refcount;
+    // Read by the renderer without the lock, which the worker may hold for a
+    // whole Hunspell_suggest call
+    atomic_bool ready;        // handle is set
+    atomic_bool failed;       // Hunspell could not load the files
+    _Atomic uint64_t generation;
+    SpellCacheEntry *cache;   // direct mapped word -> result
+    pthread_mutex_t lock;     // guards handle and cache
+    SpellDict *next;
+};
+
+// Registry of loaded dictionaries; also guards refcounts, loading flags and next_generation
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static SpellDict *dicts = NULL;
+static uint64_t next_generation = 1;
 
 void spell_log(const char *message) {
     A2_LOG(LOG_DEBUG, TAG_SPELL, "%s", message);
@@ -19,16 +49,157 @@ const char *dict_paths[] = {
 
 void spell_checker_init(SpellChecker *sc) {
     if (!sc) return;
-    sc->hunspell_handle = NULL;
+    sc->dict = NULL;
     sc->current_lang[0] = '\0';
     sc->enabled = false;
 }
 
+static void personal_words_path(char *out, size_t size) {
+    const char *home_dir = getenv("HOME");
+    snprintf(out, size, "%s/.config/a2/spell_words.txt", home_dir ? home_dir : ".");
+}
+
+// Feed the personal word list into a freshly created dictionary
+static void load_personal_words(Hunhandle *handle) {
+    char path[1024];
+    personal_words_path(path, sizeof(path));
+    FILE *f = fopen(path, "r");
+    if (!f) return;
+    char word[256];
+    while (fgets(word, sizeof(word), f)) {
+        word[strcspn(word, "\r\n")] = '\0';
+        if (word[0] != '\0') Hunspell_add(handle, word);
+    }
+    fclose(f);
+}
+
+static bool find_dict_files(const char *lang, char *aff_path, char *dic_path, size_t size) {
+    // try to find the user paths firts
+    const char *home_dir = getenv("HOME");
+    if (home_dir) {
+        snprintf(aff_path, size, "%s/.config/a2/hunspell/%s.aff", home_dir, lang);
+        snprintf(dic_path, size, "%s/.config/a2/hunspell/%s.dic", home_dir, lang);
+        if (access(aff_path, R_OK) == 0 && access(dic_path, R_OK) == 0) return true;
+    }
+
+    // if not found, we try the system paths
+    for (int i = 0; dict_paths[i] != NULL; i++) {
+        snprintf(aff_path, size, "%s%s.aff", dict_paths[i], lang);
+        snprintf(dic_path, size, "%s%s.dic", dict_paths[i], lang);
+        if (access(dic_path, R_OK) == 0) return true;
+    }
+    return false;
+}
+
+static void registry_remove(SpellDict *d) {
+    for (SpellDict **link = &dicts; *link; link = &(*link)->next) {
+        if (*link == d) { *link = d->next; return; }
+    }
+}
+
+static void dict_free(SpellDict *d) {
+    if (d->handle) Hunspell_destroy(d->handle);
+    spell_compiled_close(d->compiled);
+    pthread_mutex_destroy(&d->lock);
+    free(d->cache);
+    free(d);
+}
+
+static void *dict_load_thread(void *arg) {
+    SpellDict *d = arg;
+
+    // Most words on screen are plain stems: answer those from the compiled set
+    SpellCompiled *compiled = NULL;
+    if (global_config.spell_compiled_dict) {
+        char cache_name[64], personal_path[1024];
+        snprintf(cache_name, sizeof(cache_name), "spell_%s.a2sd", d->lang);
+        char *cache_path = get_cache_filename(cache_name);
+        personal_words_path(personal_path, sizeof(personal_path));
+        if (cache_path) compiled = spell_compiled_open(d->aff_path, d->dic_path, personal_path, cache_path);
+        free(cache_path);
+    }
+
+    Hunhandle *handle = Hunspell_create(d->aff_path, d->dic_path);
+    if (handle) load_personal_words(handle);
+    else A2_LOG(LOG_ERROR, TAG_SPELL, "Could not load dictionary %s", d->dic_path);
+
+    pthread_mutex_lock(&registry_lock);
+    pthread_mutex_lock(&d->lock);
+    d->handle = handle;
+    d->compiled = compiled;
+    pthread_mutex_unlock(&d->lock);
+    atomic_store(&d->generation, next_generation++);
+    atomic_store(&d->failed, handle == NULL);
+    atomic_store(&d->ready, handle != NULL);
+    d->loading = false;
+    bool orphan = d->refcount == 0 && !d->pinned;
+    if (orphan) registry_remove(d);
+    pthread_mutex_unlock(&registry_lock);
+
+    if (orphan) dict_free(d);
+    return NULL;
+}
+
+// Returns the shared dictionary for lang with a new reference, starting its load if needed
+static SpellDict *dict_acquire(const char *lang, bool pin) {
+    pthread_mutex_lock(&registry_lock);
+    // A dictionary that failed to load is retried (the files may have been fixed)
+    SpellDict *d = dicts;
+    while (d && (strcmp(d->lang, lang) != 0 || atomic_load(&d->failed))) d = d->next;
+    if (d) {
+        if (!pin) d->refcount++;
+        if (pin) d->pinned = true;
+        pthread_mutex_unlock(&registry_lock);
+        return d;
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    d = calloc(1, sizeof(SpellDict));
+    if (!d) return NULL;
+    if (!find_dict_files(lang, d->aff_path, d->dic_path, sizeof(d->aff_path))) {
+        free(d);
+        return NULL;
+    }
+    snprintf(d->lang, sizeof(d->lang), "%s", lang);
+    d->cache = calloc(SPELL_CACHE_SIZE, sizeof(SpellCacheEntry));
+    pthread_mutex_init(&d->lock, NULL);
+    atomic_init(&d->ready, false);
+    atomic_init(&d->failed, false);
+    atomic_init(&d->generation, 0);
+    d->loading = true;
+    d->pinned = pin;
+    d->refcount = pin ? 0 : 1;
+
+    pthread_mutex_lock(&registry_lock);
+    atomic_store(&d->generation, next_generation++);
+    d->next = dicts;
+    dicts = d;
+    pthread_mutex_unlock(&registry_lock);
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, dict_load_thread, d) == 0) {
+        pthread_detach(thread);
+    } else {
+        dict_load_thread(d); // no thread available: load inline
+    }
+    return d;
+}
+
+static void dict_release(SpellDict *d) {
+    pthread_mutex_lock(&registry_lock);
+    d->refcount--;
+    bool unused = d->refcount == 0 && !d->loading && !d->pinned;
+    if (unused) registry_remove(d);
+    pthread_mutex_unlock(&registry_lock);
+    if (unused) dict_free(d);
+}
+
 void spell_checker_destroy(SpellChecker *sc) {
     if (!sc) return;
-    if (sc->hunspell_handle) {
-        Hunspell_destroy(sc->hunspell_handle);
-        sc->hunspell_handle = NULL;
+    spell_worker_cancel(sc); // the worker must not be using this dictionary
+    if (sc->dict) {
+        dict_release(sc->dict);
+        sc->dict = NULL;
     }
 }
 
@@ -39,63 +210,50 @@ void spell_checker_unload_dict(SpellChecker *sc) {
     sc->enabled = false;
 }
 
-
 bool spell_checker_load_dict(SpellChecker *sc, const char *lang) {
     if (!sc || !lang) return false;
-    
-    if (sc->hunspell_handle) {
-        spell_checker_unload_dict(sc);
-    }
-    
-    char aff_path[1024];
-    char dic_path[1024];
-    bool found = false;
-    
-    // try to find the user paths firts
-    const char *home_dir = getenv("HOME");
-    if (home_dir) {
-        char user_path[1024];
-        snprintf(user_path, sizeof(user_path), "%s./config/a2/hunspell/", home_dir);
-        snprintf(aff_path, sizeof(aff_path), "%s%s.aff", user_path, lang);
-        snprintf(dic_path, sizeof(dic_path), "%s%s.dic", user_path, lang);
-        
-        FILE *dic_file = fopen(aff_path, "r");
-        if (dic_file) {
-            fclose(dic_file);
-            FILE *aff_file = fopen(aff_path, "r");
-            if (aff_file) {
-                fclose(aff_file);
-                found = true;
-            }
-        }
-    }
-    
-    // if not found, we try the system paths
-    
-    if (!found) {
-        for (int i = 0; dict_paths[i] != NULL; i++) {
-            snprintf(aff_path, sizeof(aff_path), "%s%s.aff", dict_paths[i], lang);
-            snprintf(dic_path, sizeof(dic_path), "%s%s.dic", dict_paths[i], lang);
-            
-            FILE *dic_file = fopen(dic_path, "r");
-            if (dic_file) {
-                fclose(dic_file);
-                found = true;
-                break;
-            }
-        }
-    }
-    
-    if (!found) {
-        return false;
-    }
-    sc->hunspell_handle = Hunspell_create(aff_path, dic_path);
-    if (sc->hunspell_handle) {
-        strncpy(sc->current_lang, lang, sizeof(sc->current_lang) - 1);
+
+    if (sc->dict && strcmp(sc->current_lang, lang) == 0) {
         sc->enabled = true;
         return true;
     }
-    return false;
+
+    SpellDict *d = dict_acquire(lang, false);
+    if (!d) return false;
+
+    if (sc->dict) spell_checker_unload_dict(sc);
+    sc->dict = d;
+    snprintf(sc->current_lang, sizeof(sc->current_lang), "%s", lang);
+    sc->enabled = true;
+    return true;
+}
+
+void spell_dict_preload(const char *lang) {
+    if (!lang || lang[0] == '\0') return;
+    dict_acquire(lang, true);
+}
+
+bool spell_checker_ready(SpellChecker *sc) {
+    return sc && sc->enabled && sc->dict && atomic_load(&sc->dict->ready);
+}
+
+bool spell_checker_failed(SpellChecker *sc) {
+    return sc && sc->enabled && sc->dict && atomic_load(&sc->dict->failed);
+}
+
+uint64_t spell_checker_generation(SpellChecker *sc) {
+    if (!sc || !sc->dict) return 0;
+    return atomic_load(&sc->dict->generation);
+}
+
+bool spell_dicts_loading(void) {
+    pthread_mutex_lock(&registry_lock);
+    bool loading = false;
+    for (SpellDict *d = dicts; d; d = d->next) {
+        if (d->loading) { loading = true; break; }
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return loading;
 }
 
 /*
@@ -144,33 +302,98 @@ bool spell_checker_load_dict(SpellChecker *sc, const char *lang) {
 
 
 bool spell_checker_check_word(SpellChecker *sc, const char *word) {
-    if (!sc || !sc->enabled || !sc->hunspell_handle || !word || word[0] == '\0') {
+    if (!sc || !sc->enabled || !sc->dict || !word || word[0] == '\0') {
         return true;
     }
-    
-    int result = Hunspell_spell(sc->hunspell_handle, word);
-    
-    return result != 0;
+
+    SpellDict *d = sc->dict;
+    pthread_mutex_lock(&d->lock);
+    if (!d->handle) { // still loading
+        pthread_mutex_unlock(&d->lock);
+        return true;
+    }
+    size_t len = strlen(word);
+    if (d->compiled && spell_compiled_contains(d->compiled, word, len)) {
+        pthread_mutex_unlock(&d->lock);
+        return true;
+    }
+    if (len >= SPELL_CACHE_WORD_MAX || !d->cache) {
+        bool correct = Hunspell_spell(d->handle, word) != 0;
+        pthread_mutex_unlock(&d->lock);
+        return correct;
+    }
+
+    // FNV-1a; a colliding word just replaces the entry
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) hash = (hash ^ (unsigned char)word[i]) * 16777619u;
+
+    SpellCacheEntry *entry = &d->cache[hash & (SPELL_CACHE_SIZE - 1)];
+    if (entry->valid && entry->hash == hash && strcmp(entry->word, word) == 0) {
+        bool correct = entry->correct;
+        pthread_mutex_unlock(&d->lock);
+        return correct;
+    }
+
+    bool correct = Hunspell_spell(d->handle, word) != 0;
+    entry->hash = hash;
+    entry->valid = true;
+    entry->correct = correct;
+    memcpy(entry->word, word, len + 1);
+    pthread_mutex_unlock(&d->lock);
+    return correct;
+}
+
+bool spell_personal_add_word(const char *word) {
+    if (!word || word[0] == '\0') return false;
+    char path[1024];
+    personal_words_path(path, sizeof(path));
+    char dir[1024];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (slash) { *slash = '\0'; mkdir(dir, 0755); }
+
+    FILE *f = fopen(path, "a");
+    if (!f) return false;
+    fprintf(f, "%s\n", word);
+    fclose(f);
+
+    // Dictionaries still loading read the file themselves
+    pthread_mutex_lock(&registry_lock);
+    for (SpellDict *d = dicts; d; d = d->next) {
+        pthread_mutex_lock(&d->lock);
+        if (d->handle) {
+            Hunspell_add(d->handle, word);
+            if (d->cache) memset(d->cache, 0, sizeof(SpellCacheEntry) * SPELL_CACHE_SIZE);
+            atomic_store(&d->generation, next_generation++);
+        }
+        pthread_mutex_unlock(&d->lock);
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return true;
 }
 
 char **spell_checker_suggest(SpellChecker *sc, const char *word, int *n_suggestions) {
-    if (!sc || !sc->enabled || !sc->hunspell_handle) {
-        *n_suggestions = 0;
+    *n_suggestions = 0;
+    if (!sc || !sc->enabled || !sc->dict) {
         return NULL;
     }
-    
+
     char **suggestions = NULL;
-    *n_suggestions = Hunspell_suggest(sc->hunspell_handle, &suggestions, word);
-    
-    return suggestions;    
+    pthread_mutex_lock(&sc->dict->lock);
+    if (sc->dict->handle) *n_suggestions = Hunspell_suggest(sc->dict->handle, &suggestions, word);
+    pthread_mutex_unlock(&sc->dict->lock);
+
+    return suggestions;
 }
 
 
 void spell_checker_free_suggestions(SpellChecker *sc, char **suggestions, int n_suggestions) {
-    if (!sc || !sc->hunspell_handle || !suggestions) {
+    if (!sc || !sc->dict || !suggestions) {
         return;
     }
-    Hunspell_free_list(sc->hunspell_handle, &suggestions, n_suggestions);
+    pthread_mutex_lock(&sc->dict->lock);
+    if (sc->dict->handle) Hunspell_free_list(sc->dict->handle, &suggestions, n_suggestions);
+    pthread_mutex_unlock(&sc->dict->lock);
 }
 
 bool spell_checker_is_downloaded(const char *lang) {
@@ -8,11 +8,27 @@
 #endif
 
 #include <stdbool.h>
+#include <stdint.h>
+
+#define SPELL_CACHE_SIZE 4096    // word cache entries, power of two
+#define SPELL_CACHE_WORD_MAX 32  // longer words skip the cache
+#define SPELL_DELIMITERS " \t\n\r,;()[]{}<>=+-*/%&|!^."
 
 void spell_log(const char *message);
 
 typedef struct {
-    Hunhandle *hunspell_handle;
+    uint32_t hash;
+    bool valid;
+    bool correct;
+    char word[SPELL_CACHE_WORD_MAX];
+} SpellCacheEntry;
+
+// A loaded dictionary, shared by every checker using the same language.
+// Defined in spell.c; loaded on a background thread and refcounted.
+typedef struct SpellDict SpellDict;
+
+typedef struct {
+    SpellDict *dict;
     char current_lang[32];
     bool enabled;
 } SpellChecker;
@@ -20,9 +36,24 @@ typedef struct {
 // initialize the spell checke, but don't load any dictionary yet
 void spell_checker_init(SpellChecker *sc);
 
-// load a dict
+// load a dict; returns once the files are found, Hunspell itself loads in the background
 bool spell_checker_load_dict(SpellChecker *sc, const char *lang);
 
+// start loading a dictionary before any window needs it, and keep it loaded
+void spell_dict_preload(const char *lang);
+
+// true once the dictionary finished loading; until then every word is accepted
+bool spell_checker_ready(SpellChecker *sc);
+
+// true if the dictionary files were found but Hunspell could not load them
+bool spell_checker_failed(SpellChecker *sc);
+
+// changes whenever results may change (dictionary loaded or swapped, personal words)
+uint64_t spell_checker_generation(SpellChecker *sc);
+
+// true while any dictionary is still being loaded
+bool spell_dicts_loading(void);
+
 // unload the current dict and deactivate verification
 void spell_checker_unload_dict(SpellChecker *sc);
 
@@ -38,6 +69,9 @@ void spell_checker_destroy(SpellChecker *sc);
 // free the memory used by the suggestion list
 void spell_checker_free_suggestions(SpellChecker *sc, char ** suggestions, int n_suggestions);
 
+// add a word to the personal word list and to every loaded dictionary
+bool spell_personal_add_word(const char *word);
+
 // verify if a dictionary was already downloaded
 bool spell_checker_is_downloaded(const char *lang);
 
@@ -0,0 +1,448 @@
+#include "spell_compiled.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SPELL_COMPILED_MAGIC "A2SD"
+#define SPELL_COMPILED_FORMAT 1
+#define SPELL_COMPILED_WORD_MAX 256
+
+typedef struct {
+    char magic[4];
+    uint32_t format;
+    // Sources the set was built from; any change triggers a rebuild
+    uint64_t dic_mtime, dic_size;
+    uint64_t aff_mtime, aff_size;
+    uint64_t personal_mtime, personal_size;
+    uint32_t num_slots;   // power of two
+    uint32_t num_words;
+    uint64_t pool_size;
+} SpellCompiledHeader;
+
+typedef struct {
+    uint32_t hash;
+    uint32_t offset;      // pool offset + 1, 0 for an empty slot
+} SpellCompiledSlot;
+
+struct SpellCompiled {
+    void *map;
+    size_t map_size;
+    const SpellCompiledHeader *header;
+    const SpellCompiledSlot *slots;
+    const char *pool;
+};
+
+typedef enum {
+    AFF_FLAG_CHAR,
+    AFF_FLAG_LONG,
+    AFF_FLAG_NUM,
+    AFF_FLAG_UTF8
+} AffFlagType;
+
+typedef struct {
+    AffFlagType flag_type;
+    bool utf8;
+    bool has_ignore;
+    char excluded_raw[4][64];     // NEEDAFFIX, ONLYINCOMPOUND, KEEPCASE, FORBIDDENWORD (last)
+    uint32_t excluded[4];
+    bool has_excluded[4];
+    char **aliases;               // AF flag vectors, referenced by number from the .dic
+    int num_aliases;
+} AffInfo;
+
+enum { EXCL_NEEDAFFIX, EXCL_ONLYINCOMPOUND, EXCL_KEEPCASE, EXCL_FORBIDDEN };
+
+// Build-time table: word state per unique word
+typedef struct {
+    uint32_t hash;
+    uint32_t offset;
+    bool forbidden;
+} BuildSlot;
+
+typedef struct {
+    BuildSlot *slots;
+    uint32_t num_slots;
+    uint32_t num_words;
+    char *pool;
+    size_t pool_size, pool_cap;
+} BuildSet;
+
+static uint32_t word_hash(const char *word, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) hash = (hash ^ (unsigned char)word[i]) * 16777619u;
+    return hash;
+}
+
+static void source_stamp(const char *path, uint64_t *mtime, uint64_t *size) {
+    struct stat st;
+    if (path && stat(path, &st) == 0) {
+        *mtime = (uint64_t)st.st_mtime;
+        *size = (uint64_t)st.st_size;
+    } else {
+        *mtime = 0;
+        *size = 0;
+    }
+}
+
+// ---------- .aff parsing ----------
+
+static int decode_flags(const AffInfo *aff, const char *s, size_t n, uint32_t *out, int max) {
+    int count = 0;
+    size_t i = 0;
+    while (i < n && count < max) {
+        switch (aff->flag_type) {
+            case AFF_FLAG_LONG:
+                if (i + 1 >= n) return count;
+                out[count++] = ((uint32_t)(unsigned char)s[i] << 8) | (unsigned char)s[i + 1];
+                i += 2;
+                break;
+            case AFF_FLAG_NUM: {
+                uint32_t v = 0;
+                while (i < n && s[i] >= '0' && s[i] <= '9') v = v * 10 + (uint32_t)(s[i++] - '0');
+                out[count++] = v;
+                while (i < n && (s[i] < '0' || s[i] > '9')) i++;
+                break;
+            }
+            case AFF_FLAG_UTF8: {
+                unsigned char c = (unsigned char)s[i];
+                int extra = (c >= 0xF0) ? 3 : (c >= 0xE0) ? 2 : (c >= 0xC0) ? 1 : 0;
+                uint32_t v = extra ? (c & (0x3F >> extra)) : c;
+                i++;
+                for (int k = 0; k < extra && i < n; k++, i++) v = (v << 6) | ((unsigned char)s[i] & 0x3F);
+                out[count++] = v;
+                break;
+            }
+            default:
+                out[count++] = (unsigned char)s[i++];
+                break;
+        }
+    }
+    return count;
+}
+
+static void parse_aff(const char *aff_path, AffInfo *aff) {
+    memset(aff, 0, sizeof(*aff));
+    FILE *f = fopen(aff_path, "r");
+    if (!f) return;
+    char line[1024], key[64], value[256];
+    int alias_cap = 0;
+    bool alias_header = false;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%63s %255s", key, value) != 2) continue;
+        if (strcmp(key, "SET") == 0) {
+            aff->utf8 = strcasecmp(value, "UTF-8") == 0;
+        } else if (strcmp(key, "FLAG") == 0) {
+            if (strcmp(value, "long") == 0) aff->flag_type = AFF_FLAG_LONG;
+            else if (strcmp(value, "num") == 0) aff->flag_type = AFF_FLAG_NUM;
+            else if (strcasecmp(value, "UTF-8") == 0) aff->flag_type = AFF_FLAG_UTF8;
+        } else if (strcmp(key, "NEEDAFFIX") == 0 || strcmp(key, "PSEUDOROOT") == 0) {
+            snprintf(aff->excluded_raw[EXCL_NEEDAFFIX], sizeof(aff->excluded_raw[0]), "%.63s", value);
+        } else if (strcmp(key, "ONLYINCOMPOUND") == 0) {
+            snprintf(aff->excluded_raw[EXCL_ONLYINCOMPOUND], sizeof(aff->excluded_raw[0]), "%.63s", value);
+        } else if (strcmp(key, "KEEPCASE") == 0) {
+            snprintf(aff->excluded_raw[EXCL_KEEPCASE], sizeof(aff->excluded_raw[0]), "%.63s", value);
+        } else if (strcmp(key, "FORBIDDENWORD") == 0) {
+            snprintf(aff->excluded_raw[EXCL_FORBIDDEN], sizeof(aff->excluded_raw[0]), "%.63s", value);
+        } else if (strcmp(key, "IGNORE") == 0) {
+            aff->has_ignore = true;
+        } else if (strcmp(key, "AF") == 0) {
+            // The first AF line holds the count; the others are flag vectors
+            if (!alias_header) { alias_header = true; continue; }
+            if (aff->num_aliases >= alias_cap) {
+                int new_cap = alias_cap > 0 ? alias_cap * 2 : 64;
+                char **aliases = realloc(aff->aliases, sizeof(char *) * new_cap);
+                if (!aliases) continue;
+                aff->aliases = aliases;
+                alias_cap = new_cap;
+            }
+            aff->aliases[aff->num_aliases++] = strdup(value);
+        }
+    }
+    fclose(f);
+
+    // Flags can only be decoded once FLAG is known
+    for (int i = 0; i < 4; i++) {
+        if (aff->excluded_raw[i][0] == '\0') continue;
+        aff->has_excluded[i] = decode_flags(aff, aff->excluded_raw[i], strlen(aff->excluded_raw[i]), &aff->excluded[i], 1) == 1;
+    }
+}
+
+static void free_aff(AffInfo *aff) {
+    for (int i = 0; i < aff->num_aliases; i++) free(aff->aliases[i]);
+    free(aff->aliases);
+}
+
+// ---------- build ----------
+
+static BuildSlot *build_find(BuildSet *set, const char *word, size_t len, uint32_t hash) {
+    uint32_t mask = set->num_slots - 1;
+    for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+        BuildSlot *slot = &set->slots[i];
+        if (slot->offset == 0) return slot;
+        const char *w = set->pool + slot->offset - 1;
+        if (slot->hash == hash && strncmp(w, word, len) == 0 && w[len] == '\0') return slot;
+    }
+}
+
+static bool build_grow(BuildSet *set) {
+    uint32_t new_slots = set->num_slots ? set->num_slots * 2 : 1u << 16;
+    BuildSlot *slots = calloc(new_slots, sizeof(BuildSlot));
+    if (!slots) return false;
+    BuildSlot *old = set->slots;
+    uint32_t old_slots = set->num_slots;
+    set->slots = slots;
+    set->num_slots = new_slots;
+    for (uint32_t i = 0; i < old_slots; i++) {
+        if (old[i].offset == 0) continue;
+        uint32_t mask = new_slots - 1;
+        uint32_t j = old[i].hash & mask;
+        while (slots[j].offset != 0) j = (j + 1) & mask;
+        slots[j] = old[i];
+    }
+    free(old);
+    return true;
+}
+
+static void build_add(BuildSet *set, const char *word, size_t len, bool forbidden) {
+    if (len == 0 || len >= SPELL_COMPILED_WORD_MAX) return;
+    if ((set->num_words + 1) * 2 > set->num_slots && !build_grow(set)) return;
+    uint32_t hash = word_hash(word, len);
+    BuildSlot *slot = build_find(set, word, len, hash);
+    if (slot->offset != 0) {
+        slot->forbidden = slot->forbidden || forbidden;
+        return;
+    }
+    if (set->pool_size + len + 1 > set->pool_cap) {
+        size_t new_cap = set->pool_cap ? set->pool_cap * 2 : 1 << 20;
+        while (new_cap < set->pool_size + len + 1) new_cap *= 2;
+        char *pool = realloc(set->pool, new_cap);
+        if (!pool) return;
+        set->pool = pool;
+        set->pool_cap = new_cap;
+    }
+    memcpy(set->pool + set->pool_size, word, len);
+    set->pool[set->pool_size + len] = '\0';
+    slot->hash = hash;
+    slot->offset = (uint32_t)set->pool_size + 1;
+    slot->forbidden = forbidden;
+    set->pool_size += len + 1;
+    set->num_words++;
+}
+
+static void add_dic_entry(BuildSet *set, const AffInfo *aff, const char *line) {
+    char word[SPELL_COMPILED_WORD_MAX];
+    size_t len = 0;
+    const char *p = line;
+    bool ascii = true;
+    // The word ends at an unescaped '/' (flags follow) or at whitespace (morphology follows)
+    while (*p && *p != '/' && *p != '\t' && *p != ' ' && *p != '\r' && *p != '\n') {
+        if (*p == '\\' && p[1] == '/') p++;
+        if ((unsigned char)*p >= 0x80) ascii = false;
+        if (len + 1 >= sizeof(word)) return;
+        word[len++] = *p++;
+    }
+    if (len == 0 || (!aff->utf8 && !ascii)) return; // legacy 8-bit encodings: ASCII words only
+
+    bool forbidden = false;
+    if (*p == '/') {
+        p++;
+        const char *flags = p;
+        while (*p && *p != '\t' && *p != ' ' && *p != '\r' && *p != '\n') p++;
+        size_t n = p - flags;
+        if (aff->num_aliases > 0) {
+            int idx = atoi(flags);
+            if (idx < 1 || idx > aff->num_aliases) return;
+            flags = aff->aliases[idx - 1];
+            n = strlen(flags);
+        }
+        uint32_t decoded[64];
+        int count = decode_flags(aff, flags, n, decoded, 64);
+        for (int i = 0; i < count; i++) {
+            for (int k = 0; k < 4; k++) {
+                if (!aff->has_excluded[k] || decoded[i] != aff->excluded[k]) continue;
+                if (k == EXCL_FORBIDDEN) forbidden = true;
+                else return; // not valid on its own: leave it to Hunspell
+            }
+        }
+    }
+    build_add(set, word, len, forbidden);
+}
+
+static bool write_compiled(const char *cache_path, const BuildSet *set, SpellCompiledHeader *header) {
+    uint32_t num_words = 0;
+    for (uint32_t i = 0; i < set->num_slots; i++) {
+        if (set->slots[i].offset && !set->slots[i].forbidden) num_words++;
+    }
+    uint32_t num_slots = 1024;
+    while (num_slots < num_words * 2) num_slots *= 2;
+
+    SpellCompiledSlot *slots = calloc(num_slots, sizeof(SpellCompiledSlot));
+    char *pool = malloc(set->pool_size + 1);
+    if (!slots || !pool) { free(slots); free(pool); return false; }
+
+    size_t pool_size = 0;
+    for (uint32_t i = 0; i < set->num_slots; i++) {
+        const BuildSlot *b = &set->slots[i];
+        if (!b->offset || b->forbidden) continue;
+        const char *w = set->pool + b->offset - 1;
+        size_t len = strlen(w);
+        uint32_t j = b->hash & (num_slots - 1);
+        while (slots[j].offset != 0) j = (j + 1) & (num_slots - 1);
+        slots[j].hash = b->hash;
+        slots[j].offset = (uint32_t)pool_size + 1;
+        memcpy(pool + pool_size, w, len + 1);
+        pool_size += len + 1;
+    }
+
+    memcpy(header->magic, SPELL_COMPILED_MAGIC, 4);
+    header->format = SPELL_COMPILED_FORMAT;
+    header->num_slots = num_slots;
+    header->num_words = num_words;
+    header->pool_size = pool_size;
+
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", cache_path);
+    FILE *f = fopen(tmp_path, "wb");
+    bool ok = f != NULL;
+    if (ok) {
+        ok = fwrite(header, sizeof(*header), 1, f) == 1 &&
+             fwrite(slots, sizeof(SpellCompiledSlot), num_slots, f) == num_slots &&
+             fwrite(pool, 1, pool_size, f) == pool_size;
+        ok = (fclose(f) == 0) && ok;
+    }
+    if (ok) ok = rename(tmp_path, cache_path) == 0;
+    if (!ok) unlink(tmp_path);
+    free(slots);
+    free(pool);
+    return ok;
+}
+
+static bool build_compiled(const char *aff_path, const char *dic_path, const char *personal_path,
+                           const char *cache_path, SpellCompiledHeader *header) {
+    AffInfo aff;
+    parse_aff(aff_path, &aff);
+    if (aff.has_ignore) { free_aff(&aff); return false; } // IGNORE changes matching, not worth emulating
+
+    FILE *f = fopen(dic_path, "r");
+    if (!f) { free_aff(&aff); return false; }
+    BuildSet set = {0};
+    char line[1024];
+    bool first = true;
+    while (fgets(line, sizeof(line), f)) {
+        if (first) { first = false; continue; } // word count
+        add_dic_entry(&set, &aff, line);
+    }
+    fclose(f);
+    free_aff(&aff);
+
+    if (personal_path && (f = fopen(personal_path, "r"))) {
+        while (fgets(line, sizeof(line), f)) {
+            size_t len = strcspn(line, "\r\n");
+            if (len == 0 || len >= SPELL_COMPILED_WORD_MAX) continue;
+            if ((set.num_words + 1) * 2 > set.num_slots && !build_grow(&set)) break;
+            BuildSlot *slot = build_find(&set, line, len, word_hash(line, len));
+            if (slot->offset) slot->forbidden = false; // the user's word wins
+            else build_add(&set, line, len, false);
+        }
+        fclose(f);
+    }
+
+    bool ok = set.num_words > 0 && write_compiled(cache_path, &set, header);
+    free(set.slots);
+    free(set.pool);
+    return ok;
+}
+
+// ---------- mapping and lookup ----------
+
+static SpellCompiled *map_compiled(const char *cache_path, const SpellCompiledHeader *expect) {
+    int fd = open(cache_path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SpellCompiledHeader)) { close(fd); return NULL; }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    const SpellCompiledHeader *h = map;
+    bool valid = memcmp(h->magic, SPELL_COMPILED_MAGIC, 4) == 0 && h->format == SPELL_COMPILED_FORMAT &&
+                 h->num_slots > 0 && (h->num_slots & (h->num_slots - 1)) == 0 && h->num_words * 2 <= h->num_slots &&
+                 (size_t)st.st_size == sizeof(*h) + (size_t)h->num_slots * sizeof(SpellCompiledSlot) + h->pool_size &&
+                 h->dic_mtime == expect->dic_mtime && h->dic_size == expect->dic_size &&
+                 h->aff_mtime == expect->aff_mtime && h->aff_size == expect->aff_size &&
+                 h->personal_mtime == expect->personal_mtime && h->personal_size == expect->personal_size;
+    if (!valid) { munmap(map, st.st_size); return NULL; }
+
+    SpellCompiled *sc = malloc(sizeof(SpellCompiled));
+    if (!sc) { munmap(map, st.st_size); return NULL; }
+    sc->map = map;
+    sc->map_size = st.st_size;
+    sc->header = h;
+    sc->slots = (const SpellCompiledSlot *)(h + 1);
+    sc->pool = (const char *)(sc->slots + h->num_slots);
+    return sc;
+}
+
+SpellCompiled *spell_compiled_open(const char *aff_path, const char *dic_path, const char *personal_path, const char *cache_path) {
+    if (!aff_path || !dic_path || !cache_path) return NULL;
+    SpellCompiledHeader header;
+    memset(&header, 0, sizeof(header));
+    source_stamp(dic_path, &header.dic_mtime, &header.dic_size);
+    source_stamp(aff_path, &header.aff_mtime, &header.aff_size);
+    source_stamp(personal_path, &header.personal_mtime, &header.personal_size);
+
+    SpellCompiled *sc = map_compiled(cache_path, &header);
+    if (sc) return sc;
+    if (!build_compiled(aff_path, dic_path, personal_path, cache_path, &header)) return NULL;
+    return map_compiled(cache_path, &header);
+}
+
+static bool lookup_exact(const SpellCompiled *sc, const char *word, size_t len) {
+    uint32_t hash = word_hash(word, len);
+    uint32_t mask = sc->header->num_slots - 1;
+    for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+        const SpellCompiledSlot *slot = &sc->slots[i];
+        if (slot->offset == 0) return false;
+        if (slot->hash != hash || slot->offset > sc->header->pool_size) continue;
+        const char *w = sc->pool + slot->offset - 1;
+        if (strncmp(w, word, len) == 0 && w[len] == '\0') return true;
+    }
+}
+
+bool spell_compiled_contains(const SpellCompiled *sc, const char *word, size_t len) {
+    if (!sc || len == 0 || len >= SPELL_COMPILED_WORD_MAX) return false;
+    if (lookup_exact(sc, word, len)) return true;
+    if (word[0] < 'A' || word[0] > 'Z') return false;
+
+    // Like Hunspell: "Word" matches "word", "WORD" matches "word" and "Word" (ASCII only)
+    char buf[SPELL_COMPILED_WORD_MAX];
+    bool all_upper = true;
+    for (size_t i = 0; i < len; i++) {
+        char c = word[i];
+        if (c >= 'a' && c <= 'z') all_upper = false;
+        buf[i] = (c >= 'A' && c <= 'Z') ? (char)(c + 32) : c;
+    }
+    if (all_upper) {
+        if (lookup_exact(sc, buf, len)) return true;
+        buf[0] = word[0];
+        return lookup_exact(sc, buf, len);
+    }
+    memcpy(buf + 1, word + 1, len - 1);
+    return lookup_exact(sc, buf, len);
+}
+
+size_t spell_compiled_count(const SpellCompiled *sc) {
+    return sc ? sc->header->num_words : 0;
+}
+
+void spell_compiled_close(SpellCompiled *sc) {
+    if (!sc) return;
+    munmap(sc->map, sc->map_size);
+    free(sc);
+}
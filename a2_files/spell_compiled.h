@@ -0,0 +1,26 @@
+#ifndef SPELL_COMPILED_H
+#define SPELL_COMPILED_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Compiled word set for fast "is this word valid?" checks.
+// Built once from the stems of a .dic file (plus the personal word list) into
+// an open-addressing hash table on disk, then mmapped. It only answers
+// positively: stems that can't stand alone (NEEDAFFIX, ONLYINCOMPOUND,
+// FORBIDDENWORD, KEEPCASE) are left out, and a miss (an inflected form, a
+// compound, a typo) has to be confirmed by Hunspell.
+
+typedef struct SpellCompiled SpellCompiled;
+
+// Maps the compiled set at cache_path, (re)building it first if it is missing or
+// older than the sources. personal_path may be NULL. Returns NULL if unavailable.
+SpellCompiled *spell_compiled_open(const char *aff_path, const char *dic_path, const char *personal_path, const char *cache_path);
+
+// True if the word (len bytes) is a known stem, also accepting Capitalized and ALL CAPS forms
+bool spell_compiled_contains(const SpellCompiled *sc, const char *word, size_t len);
+
+size_t spell_compiled_count(const SpellCompiled *sc);
+void spell_compiled_close(SpellCompiled *sc);
+
+#endif // SPELL_COMPILED_H
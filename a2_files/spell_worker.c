@@ -0,0 +1,403 @@
+#include "spell_worker.h"
+#include "editor_utils.h"
+#include "syntax_cache.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define SPELL_BACKGROUND_BATCH 64   // background lines kept queued at most
+#define SPELL_SCAN_STEP 2048        // lines examined per poll and buffer by the background feed
+#define SPELL_KEY_MUL 0x9E3779B97F4A7C15ULL
+
+typedef enum {
+    SPELL_JOB_LINE,
+    SPELL_JOB_SUGGEST
+} SpellJobType;
+
+typedef struct SpellJob {
+    SpellJobType type;
+    SpellChecker *sc;
+    uint64_t generation;
+    int line_idx;
+    uint64_t version;
+    bool code_only;      // only comments and strings are checked
+    bool in_comment;     // the line starts inside a block comment
+    SyntaxComments comments;
+    char *text;          // copy of the line, or the word for suggestions
+    LineSpan *spans;     // result: misspelled words
+    int count, cap;
+    char *message;       // result: "Did you mean: ..."
+    struct SpellJob *next;
+} SpellJob;
+
+typedef struct {
+    SpellJob *head, *tail;
+    int count;
+} SpellJobList;
+
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;
+    pthread_cond_t idle_cond;
+    bool started;
+    SpellJobList visible;
+    SpellJobList background;
+    SpellJobList done;
+    const SpellChecker *busy;  // checker of the job being processed
+    bool scan_pending;         // main thread only: some buffer is not fully scanned yet
+} worker = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .work_cond = PTHREAD_COND_INITIALIZER,
+    .idle_cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void job_free(SpellJob *job) {
+    free(job->text);
+    free(job->spans);
+    free(job->message);
+    free(job);
+}
+
+static void list_push(SpellJobList *list, SpellJob *job) {
+    job->next = NULL;
+    if (list->tail) list->tail->next = job;
+    else list->head = job;
+    list->tail = job;
+    list->count++;
+}
+
+static SpellJob *list_pop(SpellJobList *list) {
+    SpellJob *job = list->head;
+    if (!job) return NULL;
+    list->head = job->next;
+    if (!list->head) list->tail = NULL;
+    list->count--;
+    return job;
+}
+
+static void list_remove_checker(SpellJobList *list, const SpellChecker *sc) {
+    SpellJob **link = &list->head;
+    list->tail = NULL;
+    while (*link) {
+        SpellJob *job = *link;
+        if (job->sc == sc) {
+            *link = job->next;
+            list->count--;
+            job_free(job);
+        } else {
+            list->tail = job;
+            link = &job->next;
+        }
+    }
+}
+
+static void job_push_span(SpellJob *job, int start, int end) {
+    if (job->count == job->cap) {
+        int new_cap = job->cap > 0 ? job->cap * 2 : 4;
+        LineSpan *spans = realloc(job->spans, sizeof(LineSpan) * new_cap);
+        if (!spans) return;
+        job->spans = spans;
+        job->cap = new_cap;
+    }
+    job->spans[job->count++] = (LineSpan){ start, end, 0 };
+}
+
+// Cache key: the same text is checked differently inside and outside a block comment
+static uint64_t spell_key(uint64_t generation, bool in_comment) {
+    return (generation << 1) | (in_comment ? 1 : 0);
+}
+
+// Same words the renderer tokenizes. In code buffers only the words inside
+// comments and string literals are checked, with the language's comment
+// delimiters and the comment state the syntax lexer found entering the line.
+static void run_line_job(SpellJob *job) {
+    const char *line = job->text;
+    const SyntaxComments *comments = &job->comments;
+    bool code = job->code_only;
+    bool in_comment = code && job->in_comment, in_string = false, line_comment = false;
+    size_t end_len = strlen(comments->block_end);
+    char quote = 0;
+    char word[256];
+
+    int i = 0;
+    while (line[i] != '\0') {
+        char c = line[i];
+        if (code && !line_comment) {
+            if (in_string) {
+                if (c == '\\' && line[i + 1] != '\0') { i += 2; continue; }
+                if (c == quote) { in_string = false; i++; continue; }
+            } else if (in_comment) {
+                if (end_len > 0 && strncmp(&line[i], comments->block_end, end_len) == 0) { in_comment = false; i += end_len; continue; }
+            } else {
+                bool block;
+                int opener = syntax_comment_start(comments, &line[i], &block);
+                if (opener > 0) {
+                    if (block) in_comment = true;
+                    else line_comment = true;
+                    i += opener;
+                    continue;
+                }
+                if (c == '"' || c == '\'') { in_string = true; quote = c; }
+                i++;
+                continue;
+            }
+        }
+        if (strchr(SPELL_DELIMITERS, c)) { i++; continue; }
+
+        int start = i;
+        while (line[i] != '\0' && !strchr(SPELL_DELIMITERS, line[i])) {
+            if (in_string && (line[i] == quote || line[i] == '\\')) break;
+            i++;
+        }
+        int len = i - start;
+        if (isdigit((unsigned char)line[start]) || len >= (int)sizeof(word)) continue;
+        memcpy(word, &line[start], len);
+        word[len] = '\0';
+        if (!spell_checker_check_word(job->sc, word)) job_push_span(job, start, i);
+    }
+}
+
+static void run_suggest_job(SpellJob *job) {
+    int n_sugg = 0;
+    char **suggestions = spell_checker_suggest(job->sc, job->text, &n_sugg);
+    if (n_sugg > 0) {
+        char popup_msg[256] = "Did you mean: ";
+        for (int i = 0; i < n_sugg && i < 3; i++) {
+            size_t used = strlen(popup_msg);
+            snprintf(popup_msg + used, sizeof(popup_msg) - used, "%s%s", suggestions[i], (i < n_sugg - 1 && i < 2) ? ", " : "");
+        }
+        job->message = strdup(popup_msg);
+    }
+    if (suggestions) spell_checker_free_suggestions(job->sc, suggestions, n_sugg);
+}
+
+static void *spell_worker_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&worker.mutex);
+    for (;;) {
+        SpellJob *job = list_pop(&worker.visible);
+        if (!job) job = list_pop(&worker.background);
+        if (!job) {
+            pthread_cond_wait(&worker.work_cond, &worker.mutex);
+            continue;
+        }
+        worker.busy = job->sc;
+        pthread_mutex_unlock(&worker.mutex);
+
+        if (job->type == SPELL_JOB_LINE) run_line_job(job);
+        else run_suggest_job(job);
+
+        pthread_mutex_lock(&worker.mutex);
+        list_push(&worker.done, job);
+        worker.busy = NULL;
+        pthread_cond_broadcast(&worker.idle_cond);
+    }
+    return NULL;
+}
+
+static void enqueue(SpellJob *job, bool visible) {
+    pthread_mutex_lock(&worker.mutex);
+    if (!worker.started) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, spell_worker_main, NULL) == 0) {
+            pthread_detach(thread);
+            worker.started = true;
+        }
+    }
+    list_push(visible ? &worker.visible : &worker.background, job);
+    pthread_cond_signal(&worker.work_cond);
+    pthread_mutex_unlock(&worker.mutex);
+}
+
+// Queues a line unless the same text was already requested. Returns true if queued.
+static bool request_line(EditorState *state, int line_idx, const char *line, uint64_t version, bool in_comment, bool visible) {
+    EditorSpell *spell = &state->spell;
+    if (line_idx >= spell->requested_cap) {
+        int new_cap = spell->requested_cap > 0 ? spell->requested_cap : 256;
+        while (new_cap <= line_idx) new_cap *= 2;
+        uint64_t *requested = realloc(spell->requested, sizeof(uint64_t) * new_cap);
+        if (!requested) return false;
+        memset(requested + spell->requested_cap, 0, sizeof(uint64_t) * (new_cap - spell->requested_cap));
+        spell->requested = requested;
+        spell->requested_cap = new_cap;
+    }
+    uint64_t generation = spell_checker_generation(&spell->checker);
+    uint64_t key = version ^ (spell_key(generation, in_comment) * SPELL_KEY_MUL);
+    if (spell->requested[line_idx] == key) return false;
+
+    SpellJob *job = calloc(1, sizeof(SpellJob));
+    if (!job) return false;
+    job->text = strdup(line);
+    if (!job->text) { free(job); return false; }
+    job->type = SPELL_JOB_LINE;
+    job->sc = &spell->checker;
+    job->generation = generation;
+    job->line_idx = line_idx;
+    job->version = version;
+    job->code_only = state->buffer.num_syntax_rules > 0;
+    job->in_comment = in_comment;
+    job->comments = state->buffer.comments;
+    spell->requested[line_idx] = key;
+    enqueue(job, visible);
+    return true;
+}
+
+const LineSpanSlot *spell_line_spans(EditorState *state, int line_idx, const char *line, bool in_comment) {
+    if (!line || !spell_checker_ready(&state->spell.checker)) return NULL;
+    const LineSpanSlot *slot = line_cache_lookup(&state->spell.line_cache, line_idx, line,
+                                                 spell_key(spell_checker_generation(&state->spell.checker), in_comment));
+    if (slot) return slot;
+    request_line(state, line_idx, line, line_version(line), in_comment, true);
+    return NULL;
+}
+
+void spell_worker_request_suggestions(EditorState *state, const char *word) {
+    if (!spell_checker_ready(&state->spell.checker) || !word || word[0] == '\0') return;
+    if (strcmp(state->spell.hover_request, word) == 0) return; // already asked
+    SpellJob *job = calloc(1, sizeof(SpellJob));
+    if (!job) return;
+    job->text = strdup(word);
+    if (!job->text) { free(job); return; }
+    job->type = SPELL_JOB_SUGGEST;
+    job->sc = &state->spell.checker;
+    job->generation = spell_checker_generation(&state->spell.checker);
+    snprintf(state->spell.hover_request, sizeof(state->spell.hover_request), "%s", word);
+    enqueue(job, true);
+}
+
+static EditorState *state_for_checker(const SpellChecker *sc) {
+    for (int i = 0; i < workspace_manager.num_workspaces; i++) {
+        Workspace *ws = workspace_manager.workspaces[i];
+        for (int j = 0; j < ws->num_windows; j++) {
+            EditorWindow *jw = ws->windows[j];
+            if (jw->type == WINDOW_TYPE_EDITOR && jw->state && &jw->state->spell.checker == sc) return jw->state;
+        }
+    }
+    return NULL;
+}
+
+static void install_result(SpellJob *job) {
+    EditorState *state = state_for_checker(job->sc);
+    if (!state || job->generation != spell_checker_generation(&state->spell.checker)) return;
+
+    if (job->type == SPELL_JOB_SUGGEST) {
+        if (strcmp(state->spell.hover_request, job->text) != 0) return; // cursor moved on
+        state->spell.hover_request[0] = '\0';
+        if (!job->message) return;
+        if (state->spell.hover_message) free(state->spell.hover_message);
+        state->spell.hover_message = job->message;
+        job->message = NULL;
+        snprintf(state->spell.hover_word, sizeof(state->spell.hover_word), "%s", job->text);
+        state->buffer.is_dirty = true;
+        return;
+    }
+
+    LineSpanSlot *slot = line_cache_begin_version(&state->spell.line_cache, job->line_idx, job->version, spell_key(job->generation, job->in_comment));
+    if (!slot) return;
+    for (int i = 0; i < job->count; i++) {
+        line_cache_push(slot, job->spans[i].start, job->spans[i].end, job->spans[i].style);
+    }
+    // Only redraw for lines that are (roughly) on screen and still hold this text
+    if (job->count > 0 && job->line_idx >= state->view.top_line && job->line_idx < state->view.top_line + LINES &&
+        job->line_idx < state->buffer.num_lines && line_version(state->buffer.lines[job->line_idx]) == job->version) {
+        mark_line_as_dirty(state, job->line_idx);
+        state->buffer.is_dirty = true;
+    }
+}
+
+// Queues lines of every buffer that have no spans yet, a bounded amount per call
+static void feed_background(int budget) {
+    worker.scan_pending = false;
+    for (int i = 0; i < workspace_manager.num_workspaces && budget > 0; i++) {
+        Workspace *ws = workspace_manager.workspaces[i];
+        for (int j = 0; j < ws->num_windows && budget > 0; j++) {
+            EditorWindow *jw = ws->windows[j];
+            if (jw->type != WINDOW_TYPE_EDITOR || !jw->state || !spell_checker_ready(&jw->state->spell.checker)) continue;
+            EditorState *state = jw->state;
+            EditorSpell *spell = &state->spell;
+            uint64_t generation = spell_checker_generation(&spell->checker);
+            if (spell->scan_generation != generation) {
+                // Dictionary finished loading or changed: rescan, and redraw what is on screen
+                spell->scan_generation = generation;
+                spell->scan_line = 0;
+                spell->scan_comment = false;
+                state->buffer.is_dirty = true;
+            }
+            int examined = 0;
+            while (spell->scan_line < state->buffer.num_lines && budget > 0 && examined < SPELL_SCAN_STEP) {
+                int idx = spell->scan_line++;
+                const char *line = state->buffer.lines[idx];
+                bool in_comment = spell->scan_comment;
+                examined++;
+                if (!line) continue;
+                // Carried down from the line above through the syntax cache's state of each line
+                spell->scan_comment = syntax_line_ends_in_comment(state, idx, in_comment);
+                if (line_cache_lookup(&spell->line_cache, idx, line, spell_key(generation, in_comment))) continue;
+                if (request_line(state, idx, line, line_version(line), in_comment, false)) budget--;
+            }
+            if (spell->scan_line < state->buffer.num_lines) worker.scan_pending = true;
+        }
+    }
+}
+
+// A dictionary that could not be loaded would otherwise accept every word in silence
+static void report_failed_dicts(void) {
+    for (int i = 0; i < workspace_manager.num_workspaces; i++) {
+        Workspace *ws = workspace_manager.workspaces[i];
+        for (int j = 0; j < ws->num_windows; j++) {
+            EditorWindow *jw = ws->windows[j];
+            if (jw->type != WINDOW_TYPE_EDITOR || !jw->state || !spell_checker_failed(&jw->state->spell.checker)) continue;
+            editor_set_status_msg(jw->state, "Could not load the %s dictionary, spell checking is off",
+                                  jw->state->spell.checker.current_lang);
+            spell_checker_unload_dict(&jw->state->spell.checker);
+        }
+    }
+}
+
+void spell_worker_poll(void) {
+    report_failed_dicts();
+
+    pthread_mutex_lock(&worker.mutex);
+    SpellJob *done = worker.done.head;
+    worker.done.head = worker.done.tail = NULL;
+    worker.done.count = 0;
+    int queued = worker.background.count;
+    pthread_mutex_unlock(&worker.mutex);
+
+    while (done) {
+        SpellJob *next = done->next;
+        install_result(done);
+        job_free(done);
+        done = next;
+    }
+
+    if (queued < SPELL_BACKGROUND_BATCH / 2) feed_background(SPELL_BACKGROUND_BATCH - queued);
+}
+
+bool spell_worker_busy(void) {
+    if (spell_dicts_loading()) return true;
+    if (!worker.started) return worker.scan_pending;
+    pthread_mutex_lock(&worker.mutex);
+    bool busy = worker.busy || worker.visible.count > 0 || worker.background.count > 0 || worker.done.count > 0;
+    pthread_mutex_unlock(&worker.mutex);
+    return busy || worker.scan_pending;
+}
+
+void spell_worker_cancel(const SpellChecker *sc) {
+    if (!worker.started) return;
+    pthread_mutex_lock(&worker.mutex);
+    list_remove_checker(&worker.visible, sc);
+    list_remove_checker(&worker.background, sc);
+    while (worker.busy == sc) pthread_cond_wait(&worker.idle_cond, &worker.mutex);
+    list_remove_checker(&worker.done, sc);
+    pthread_mutex_unlock(&worker.mutex);
+}
+
+void spell_worker_free_state(EditorState *state) {
+    spell_worker_cancel(&state->spell.checker);
+    line_cache_free(&state->spell.line_cache);
+    free(state->spell.requested);
+    state->spell.requested = NULL;
+    state->spell.requested_cap = 0;
+}
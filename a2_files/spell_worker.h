@@ -0,0 +1,31 @@
+#ifndef SPELL_WORKER_H
+#define SPELL_WORKER_H
+
+#include "defs.h"
+
+// Background spell checking.
+// The renderer asks for a line's misspelled spans; on a miss the line text is
+// copied and queued for the worker thread, and the line is drawn without
+// underlines until the result arrives. Visible lines are queued first, the
+// rest of the buffer is fed to the worker in batches while it is idle.
+// Results are installed from the main loop by spell_worker_poll().
+
+// Misspelled spans of a line if they are known for its current text, NULL otherwise.
+// in_comment is the lexer state entering the line (inside a block comment or not).
+const LineSpanSlot *spell_line_spans(EditorState *state, int line_idx, const char *line, bool in_comment);
+
+// Ask for suggestions for the word under the hover; fills spell.hover_message when done
+void spell_worker_request_suggestions(EditorState *state, const char *word);
+
+// Install finished results and queue more background lines. Call from the main loop.
+void spell_worker_poll(void);
+
+// True while jobs are queued or results are waiting to be installed
+bool spell_worker_busy(void);
+
+// Drop all jobs and results for this checker and wait for the one in progress
+void spell_worker_cancel(const SpellChecker *sc);
+
+void spell_worker_free_state(EditorState *state);
+
+#endif // SPELL_WORKER_H
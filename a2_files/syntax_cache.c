@@ -0,0 +1,192 @@
+#include "syntax_cache.h"
+#include "themes.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *syntax_delimiters = " \t\n\r,;()[]{}<>=+-*/%&|!^.";
+
+static inline bool token_at(const char *p, const char *token) {
+    return token[0] && p[0] == token[0] && strncmp(p, token, strlen(token)) == 0;
+}
+
+int syntax_comment_start(const SyntaxComments *comments, const char *p, bool *block) {
+    for (int k = 0; k < 2; k++) {
+        if (token_at(p, comments->line[k])) {
+            *block = false;
+            return strlen(comments->line[k]);
+        }
+    }
+    if (token_at(p, comments->block_start)) {
+        *block = true;
+        return strlen(comments->block_start);
+    }
+    return 0;
+}
+
+int syntax_comment_end(const SyntaxComments *comments, const char *line, int from, int len, bool *closed) {
+    const char *end = from <= len && comments->block_end[0] ? strstr(line + from, comments->block_end) : NULL;
+    *closed = end != NULL;
+    return end ? (int)(end - line) + (int)strlen(comments->block_end) : len;
+}
+
+static inline bool is_comment_start(const SyntaxComments *comments, const char *p) {
+    bool block;
+    return syntax_comment_start(comments, p, &block) > 0;
+}
+
+// The entry state and the rules generation are part of every key
+static inline uint64_t syntax_key(EditorState *state, bool in_comment) {
+    return ((uint64_t)state->buffer.syntax_cache.generation << 1) | (in_comment ? 1 : 0);
+}
+
+static int keyword_color(EditorState *state, const char *token, int len) {
+    for (int j = 0; j < state->buffer.num_syntax_rules; j++) {
+        const char *word = state->buffer.syntax_rules[j].word;
+        if (strncmp(token, word, len) == 0 && word[len] == '\0') {
+            switch (state->buffer.syntax_rules[j].type) {
+                case SYNTAX_KEYWORD: return PAIR_KEYWORD;
+                case SYNTAX_TYPE: return PAIR_TYPE;
+                case SYNTAX_STD_FUNCTION: return PAIR_STD_FUNCTION;
+            }
+        }
+    }
+    return 0;
+}
+
+static bool lex_line(EditorState *state, const char *line, bool in_comment, LineSpanSlot *slot) {
+    int len = strlen(line);
+    int first = 0;
+    while (line[first] && isspace((unsigned char)line[first])) first++;
+    bool directive = line[first] == '#';
+    const int comment = PAIR_COMMENT | SYNTAX_SPAN_REGION;
+    const SyntaxComments *comments = &state->buffer.comments;
+
+    int pos = 0;
+    while (pos < len) {
+        if (in_comment) {
+            bool closed;
+            int stop = syntax_comment_end(comments, line, pos, len, &closed);
+            line_cache_push(slot, pos, stop, comment);
+            in_comment = !closed;
+            pos = stop;
+            continue;
+        }
+        bool block;
+        int opener = syntax_comment_start(comments, line + pos, &block);
+        if (opener > 0 && !block) {
+            line_cache_push(slot, pos, len, comment);
+            break;
+        }
+        if (opener > 0) {
+            // "/*/" doesn't close itself
+            bool closed;
+            int stop = syntax_comment_end(comments, line, pos + opener, len, &closed);
+            line_cache_push(slot, pos, stop, comment);
+            in_comment = !closed;
+            pos = stop;
+            continue;
+        }
+        if (directive) {
+            int stop = pos + 1;
+            while (stop < len && !is_comment_start(comments, line + stop)) stop++;
+            line_cache_push(slot, pos, stop, comment);
+            pos = stop;
+            continue;
+        }
+
+        int end = pos + 1;
+        if (!strchr(syntax_delimiters, line[pos])) {
+            while (end < len && !strchr(syntax_delimiters, line[end]) && !is_comment_start(comments, line + end)) end++;
+        }
+        if (slot) {
+            int color = line[pos] == '#' ? PAIR_COMMENT : keyword_color(state, line + pos, end - pos);
+            line_cache_push(slot, pos, end, color);
+        }
+        pos = end;
+    }
+    return in_comment;
+}
+
+const LineSpanSlot *syntax_line_spans(EditorState *state, int line_idx, bool in_comment) {
+    if (line_idx < 0 || line_idx >= state->buffer.num_lines) return NULL;
+    const char *line = state->buffer.lines[line_idx];
+    if (!line) return NULL;
+
+    LineSpanCache *cache = &state->buffer.syntax_cache.spans;
+    uint64_t key = syntax_key(state, in_comment);
+    LineSpanSlot *slot = line_cache_lookup(cache, line_idx, line, key);
+    if (slot) return slot;
+
+    slot = line_cache_begin(cache, line_idx, line, key);
+    if (!slot) return NULL;
+    slot->end_state = lex_line(state, line, in_comment, slot);
+    return slot;
+}
+
+bool syntax_line_current(EditorState *state, int line_idx, bool in_comment) {
+    if (line_idx < 0 || line_idx >= state->buffer.num_lines || !state->buffer.lines[line_idx]) return false;
+    return line_cache_lookup(&state->buffer.syntax_cache.spans, line_idx, state->buffer.lines[line_idx], syntax_key(state, in_comment)) != NULL;
+}
+
+bool syntax_line_ends_in_comment(EditorState *state, int line_idx, bool in_comment) {
+    if (line_idx < 0 || line_idx >= state->buffer.num_lines) return in_comment;
+    const char *line = state->buffer.lines[line_idx];
+    if (!line) return in_comment;
+
+    LineSpanCache *cache = &state->buffer.syntax_cache.states;
+    uint64_t key = syntax_key(state, in_comment);
+    LineSpanSlot *slot = line_cache_lookup(cache, line_idx, line, key);
+    if (slot) return slot->end_state;
+
+    bool out = lex_line(state, line, in_comment, NULL);
+    slot = line_cache_begin(cache, line_idx, line, key);
+    if (slot) slot->end_state = out;
+    return out;
+}
+
+bool syntax_comment_state_at(EditorState *state, int line_idx) {
+    SyntaxCache *sc = &state->buffer.syntax_cache;
+    if (line_idx > state->buffer.num_lines) line_idx = state->buffer.num_lines;
+    if (line_idx <= 0) return false;
+    if (line_idx >= sc->entry_cap) {
+        int new_cap = sc->entry_cap > 0 ? sc->entry_cap : 256;
+        while (new_cap <= line_idx) new_cap *= 2;
+        bool *grown = realloc(sc->entry_states, sizeof(bool) * new_cap);
+        if (!grown) return false;
+        sc->entry_states = grown;
+        sc->entry_cap = new_cap;
+    }
+    // Extend the known states from the last one; edits cut them back (syntax_cache_note_edit)
+    if (sc->entry_valid == 0) {
+        sc->entry_states[0] = false;
+        sc->entry_valid = 1;
+    }
+    while (sc->entry_valid <= line_idx) {
+        int i = sc->entry_valid - 1;
+        sc->entry_states[i + 1] = syntax_line_ends_in_comment(state, i, sc->entry_states[i]);
+        sc->entry_valid++;
+    }
+    return sc->entry_states[line_idx];
+}
+
+void syntax_cache_note_edit(EditorState *state, int line_idx) {
+    SyntaxCache *sc = &state->buffer.syntax_cache;
+    // The state entering the edited line only depends on the lines above it
+    if (line_idx < 0) sc->entry_valid = 0;
+    else if (sc->entry_valid > line_idx + 1) sc->entry_valid = line_idx + 1;
+}
+
+void syntax_cache_invalidate(EditorState *state) {
+    // Bumping the generation makes every cached line miss without touching the slots
+    state->buffer.syntax_cache.generation++;
+    state->buffer.syntax_cache.entry_valid = 0;
+}
+
+void syntax_cache_free(EditorState *state) {
+    line_cache_free(&state->buffer.syntax_cache.spans);
+    line_cache_free(&state->buffer.syntax_cache.states);
+    free(state->buffer.syntax_cache.entry_states);
+    state->buffer.syntax_cache.entry_states = NULL;
+    state->buffer.syntax_cache.entry_valid = state->buffer.syntax_cache.entry_cap = 0;
+}
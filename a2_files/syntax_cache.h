@@ -0,0 +1,44 @@
+#ifndef SYNTAX_CACHE_H
+#define SYNTAX_CACHE_H
+
+#include "defs.h"
+
+// Styled spans per line, shared by the word-wrap and horizontal-scroll renderers.
+// A line is lexed once into spans covering every byte (tokens, comment runs)
+// with their color pair; the spans are reused until the line's text, the
+// lexer state it starts in (inside a block comment or not) or the syntax rules
+// change. The state at the end of each line is kept in a second, span-less
+// cache so finding the state at the top of the screen doesn't re-lex the file.
+
+// Comment and directive runs: drawn as one piece, without per-token overlays
+#define SYNTAX_SPAN_REGION 0x100
+#define SYNTAX_SPAN_COLOR(style) ((style) & 0xFF)
+
+// Spans of a line lexed from the given entry state; slot->end_state is the state after it
+const LineSpanSlot *syntax_line_spans(EditorState *state, int line_idx, bool in_comment);
+
+// True if the spans cached for the line match its text and entry state (the line can be kept on screen)
+bool syntax_line_current(EditorState *state, int line_idx, bool in_comment);
+
+// Whether a block comment is still open after the line
+bool syntax_line_ends_in_comment(EditorState *state, int line_idx, bool in_comment);
+
+// Lexer state at the start of line_idx. States are kept per line, so this is
+// O(1) once known; only lines past the first edit are lexed again.
+bool syntax_comment_state_at(EditorState *state, int line_idx);
+
+// Forget the entry states below an edited line (-1: the whole buffer changed)
+void syntax_cache_note_edit(EditorState *state, int line_idx);
+
+// Length of the comment opener at p, 0 if there is none; *block tells a block
+// comment from a line comment. Uses only `comments`, so any thread may call it.
+int syntax_comment_start(const SyntaxComments *comments, const char *p, bool *block);
+// Offset just past the delimiter closing a block comment whose body starts at from,
+// or len if it stays open
+int syntax_comment_end(const SyntaxComments *comments, const char *line, int from, int len, bool *closed);
+
+// Call when the syntax rules change
+void syntax_cache_invalidate(EditorState *state);
+void syntax_cache_free(EditorState *state);
+
+#endif // SYNTAX_CACHE_H
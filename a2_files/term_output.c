@@ -0,0 +1,140 @@
+#include "term_output.h"
+#include "defs.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SYNC_BEGIN "\033[?2026h"
+#define SYNC_END "\033[?2026l"
+#define OUTPUT_KEEP_CAP (1 << 20) // a larger buffer (image upload) is released after the flush
+
+static char *out_buf;
+static size_t out_len, out_cap;
+static bool frame_synced;
+
+static bool stats_enabled;
+static bool sample_valid;
+static long sample_writes, sample_bytes;
+static FrameOutputStats stats;
+
+static bool out_reserve(size_t extra) {
+    if (out_len + extra <= out_cap) return true;
+    size_t new_cap = out_cap > 0 ? out_cap : 4096;
+    while (new_cap < out_len + extra) new_cap *= 2;
+    char *buf = realloc(out_buf, new_cap);
+    if (!buf) return false;
+    out_buf = buf;
+    out_cap = new_cap;
+    return true;
+}
+
+void term_output_write(const char *data, size_t len) {
+    if (!data || len == 0 || !out_reserve(len)) return;
+    memcpy(out_buf + out_len, data, len);
+    out_len += len;
+}
+
+void term_output_printf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    char small[256];
+    int n = vsnprintf(small, sizeof(small), format, args);
+    va_end(args);
+    if (n < 0) return;
+    if ((size_t)n < sizeof(small)) {
+        term_output_write(small, n);
+        return;
+    }
+    if (!out_reserve(n + 1)) return;
+    va_start(args, format);
+    vsnprintf(out_buf + out_len, n + 1, format, args);
+    va_end(args);
+    out_len += n;
+}
+
+void term_output_flush(void) {
+    size_t done = 0;
+    while (done < out_len) {
+        ssize_t n = write(STDOUT_FILENO, out_buf + done, out_len - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break; // terminal gone, drop the rest
+        }
+        done += n;
+    }
+    out_len = 0;
+    if (out_cap > OUTPUT_KEEP_CAP) {
+        free(out_buf);
+        out_buf = NULL;
+        out_cap = 0;
+    }
+}
+
+// Terminals without synchronized output ignore the unknown private mode, but the
+// Linux console and dumb terminals are skipped; the setting turns it off entirely.
+static bool sync_supported(void) {
+    if (!global_config.synchronized_output) return false;
+    const char *term = getenv("TERM");
+    return !term || (strcmp(term, "linux") != 0 && strcmp(term, "dumb") != 0);
+}
+
+// Write syscalls and bytes of the calling thread so far. Frames are drawn on
+// the main thread; writes from the other threads (LSP transport, spell
+// worker, their logging) stay out of the count.
+static bool read_proc_io(long *writes, long *bytes) {
+    FILE *f = fopen("/proc/thread-self/io", "r");
+    if (!f) return false;
+    char line[128];
+    int found = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "syscw: %ld", writes) == 1) found++;
+        else if (sscanf(line, "wchar: %ld", bytes) == 1) found++;
+    }
+    fclose(f);
+    return found == 2;
+}
+
+void frame_output_begin(void) {
+    if (stats_enabled) sample_valid = read_proc_io(&sample_writes, &sample_bytes);
+    frame_synced = sync_supported();
+    // putp() would go through stdio and reach the terminal after the frame, so
+    // the marker is written directly, ahead of everything doupdate() sends
+    if (frame_synced) {
+        term_output_write(SYNC_BEGIN, strlen(SYNC_BEGIN));
+        term_output_flush();
+    }
+}
+
+void frame_output_end(void) {
+    if (frame_synced) term_output_write(SYNC_END, strlen(SYNC_END));
+    frame_synced = false;
+    term_output_flush();
+
+    long writes, bytes;
+    if (stats_enabled && sample_valid && read_proc_io(&writes, &bytes)) {
+        stats.last_writes = writes - sample_writes;
+        stats.last_bytes = bytes - sample_bytes;
+        stats.frames++;
+        stats.writes += stats.last_writes;
+        stats.bytes += stats.last_bytes;
+        if (stats.last_writes > stats.max_writes) stats.max_writes = stats.last_writes;
+        if (stats.last_bytes > stats.max_bytes) stats.max_bytes = stats.last_bytes;
+    }
+    sample_valid = false;
+}
+
+void frame_output_stats_enable(bool enable) {
+    if (enable && !stats_enabled) memset(&stats, 0, sizeof(stats));
+    stats_enabled = enable;
+}
+
+bool frame_output_stats_enabled(void) {
+    return stats_enabled;
+}
+
+const FrameOutputStats *frame_output_stats(void) {
+    return &stats;
+}
@@ -0,0 +1,37 @@
+#ifndef TERM_OUTPUT_H
+#define TERM_OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Escape sequences the editor writes itself (kitty graphics, cursor save and
+// restore) are queued here instead of going through stdio, and leave in one
+// write() at the end of the frame. ncurses still flushes its own buffer inside
+// doupdate(); frame_output_begin() sends the DECSET 2026 begin marker before it
+// and frame_output_end() the end marker after, so the terminal shows the whole
+// frame at once.
+
+void term_output_write(const char *data, size_t len);
+void term_output_printf(const char *format, ...);
+
+// Writes whatever is queued. Used outside frames (e.g. clearing images at exit).
+void term_output_flush(void);
+
+void frame_output_begin(void);
+void frame_output_end(void);
+
+// Write syscalls and bytes per frame, sampled from /proc/thread-self/io between
+// frame_output_begin() and frame_output_end() on the main thread, so ncurses'
+// writes are counted too and the other threads' are not.
+typedef struct {
+    long frames;
+    long writes, bytes;
+    long last_writes, last_bytes;
+    long max_writes, max_bytes;
+} FrameOutputStats;
+
+void frame_output_stats_enable(bool enable);
+bool frame_output_stats_enabled(void);
+const FrameOutputStats *frame_output_stats(void);
+
+#endif // TERM_OUTPUT_H
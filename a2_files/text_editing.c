@@ -169,6 +169,7 @@ void _editor_insert_char(EditorState *state, wint_t ch) {
     state->cursor.ideal_col = state->cursor.col;
     new_line[line_len + char_len] = '\0';
     mark_line_as_dirty(state, state->cursor.line);
+    editor_note_edit(state, state->cursor.line, 1, 1);
     if (state->lsp.enabled) {
         lsp_did_change(state);
     }
@@ -234,6 +235,7 @@ void _editor_handle_enter(EditorState *state) {
 
     mark_line_as_dirty(state, state->cursor.line - 1);
     mark_line_as_dirty(state, state->cursor.line);
+    editor_note_edit(state, state->cursor.line - 1, 1, 2);
 
     if (state->lsp.enabled) {
         lsp_did_change(state);
@@ -268,6 +270,7 @@ void _editor_handle_backspace(EditorState *state) {
         state->cursor.col = prev_char_start;
         state->cursor.ideal_col = state->cursor.col;
         mark_line_as_dirty(state, state->cursor.line);
+        editor_note_edit(state, state->cursor.line, 1, 1);
     } else { 
         if (state->cursor.line == 0) return;
         int prev_line_idx = state->cursor.line - 1;
@@ -296,6 +299,7 @@ void _editor_handle_backspace(EditorState *state) {
         state->cursor.ideal_col = state->cursor.col;
         mark_line_as_dirty(state, state->cursor.line);
         mark_line_as_dirty(state, state->cursor.line + 1);
+        editor_note_edit(state, state->cursor.line, 2, 1);
     }
     if (state->lsp.enabled) {
         lsp_did_change(state);
@@ -310,6 +314,7 @@ void editor_delete_specific_line(EditorState *state, int line_num) {
     }
     state->buffer.num_lines--;
     state->buffer.lines[state->buffer.num_lines] = NULL;
+    editor_note_edit(state, line_num, 1, 0);
     if (state->cursor.line >= state->buffer.num_lines) state->cursor.line = state->buffer.num_lines - 1;
 }
 
@@ -328,6 +333,7 @@ void _editor_delete_line(EditorState *state) {
         state->cursor.line = 0;
         state->cursor.col = 0; state->cursor.ideal_col = 0;
         mark_line_as_dirty(state, 0);
+        editor_note_edit(state, 0, 1, 1);
         if (state->lsp.enabled) lsp_did_change(state);
         return;
     }
@@ -337,6 +343,7 @@ void _editor_delete_line(EditorState *state) {
     }
     state->buffer.num_lines--;
     state->buffer.lines[state->buffer.num_lines] = NULL;
+    editor_note_edit(state, state->cursor.line, 1, 0);
     if (state->cursor.line >= state->buffer.num_lines) {
         state->cursor.line = state->buffer.num_lines - 1;
     }
@@ -374,9 +381,11 @@ void editor_delete_selection(EditorState *state) {
             memmove(&state->buffer.lines[start_line], &state->buffer.lines[end_line + 1], (state->buffer.num_lines - end_line - 1) * sizeof(char*));
         }
         state->buffer.num_lines -= num_deleted;
+        editor_note_edit(state, start_line, num_deleted, 0);
         if (state->buffer.num_lines <= 0) {
             state->buffer.lines[0] = calloc(1, 1);
             state->buffer.num_lines = 1;
+            editor_note_edit(state, 0, 0, 1);
         }
     } 
     else if (state->cursor.visual_selection_mode == VISUAL_MODE_BLOCK) {
@@ -391,6 +400,7 @@ void editor_delete_selection(EditorState *state) {
                 memmove(&line[min_col], &line[ec + 1], len - ec);
             }
         }
+        editor_note_edit(state, start_line, end_line - start_line + 1, end_line - start_line + 1);
     }
     else {
         if (start_line == end_line) {
@@ -401,6 +411,7 @@ void editor_delete_selection(EditorState *state) {
                 char *resized_line = realloc(line, strlen(line) + 1);
                 if (resized_line) state->buffer.lines[start_line] = resized_line;
             }
+            editor_note_edit(state, start_line, 1, 1);
         } else {
             char *first_line = state->buffer.lines[start_line];
             char *last_line = state->buffer.lines[end_line];
@@ -417,6 +428,7 @@ void editor_delete_selection(EditorState *state) {
                 memmove(&state->buffer.lines[start_line + 1], &state->buffer.lines[end_line + 1], (state->buffer.num_lines - end_line - 1) * sizeof(char*));
             }
             state->buffer.num_lines -= num_deleted;
+            editor_note_edit(state, start_line, num_deleted + 1, 1);
         }
     }
     for (int i = 0; i < state->buffer.num_lines; i++) mark_line_as_dirty(state, i);
@@ -439,6 +451,7 @@ void editor_ident_line(EditorState *state, int line_num) {
     state->buffer.lines[line_num] = new_line;
     if (line_num == state->cursor.line) state->cursor.col += TAB_SIZE;
     mark_line_as_dirty(state, line_num);
+    editor_note_edit(state, line_num, 1, 1);
 }
 
 void editor_unindent_line(EditorState *state, int line_num) {
@@ -454,6 +467,7 @@ void editor_unindent_line(EditorState *state, int line_num) {
             if (state->cursor.col < 0) state->cursor.col = 0;
         }
         mark_line_as_dirty(state, line_num);
+        editor_note_edit(state, line_num, 1, 1);
     }
 }
 
@@ -485,6 +499,7 @@ void editor_join_line(EditorState *state) {
     for (int i = next_line_idx; i < state->buffer.num_lines - 1; i++) state->buffer.lines[i] = state->buffer.lines[i+1];
     state->buffer.num_lines--;
     mark_all_lines_dirty(state);
+    editor_note_edit(state, state->cursor.line, 2, 1);
     if (state->lsp.enabled) lsp_did_change(state);
 }
 
@@ -526,6 +541,7 @@ void editor_toggle_comment(EditorState *state) {
         }
         mark_line_as_dirty(state, i);
     }
+    editor_note_edit(state, start_line, end_line - start_line + 1, end_line - start_line + 1);
     if (state->lsp.enabled) lsp_did_change(state);
 }
 
@@ -782,6 +798,7 @@ void editor_paste(EditorState *state) {
     state->buffer.lines[last_idx] = realloc(state->buffer.lines[last_idx], old_len + strlen(rest_of_line) + 1);
     strcat(state->buffer.lines[last_idx], rest_of_line);
     mark_line_as_dirty(state, last_idx);
+    editor_note_edit(state, state->cursor.line, 1, num_new + 1);
     state->cursor.line = last_idx; state->cursor.col = old_len; state->cursor.ideal_col = state->cursor.col;
     free(rest_of_line); free(yank_copy);
     for (int i = 0; i < state->buffer.num_lines; i++) mark_line_as_dirty(state, i);
@@ -856,6 +873,7 @@ void editor_change_inside_quotes(EditorState *state, char open_char, bool enter_
         state->cursor.ideal_col = content_start;
         state->buffer.modified = true;
         mark_line_as_dirty(state, state->cursor.line);
+        editor_note_edit(state, state->cursor.line, 1, 1);
         if (enter_insert) state->input.mode = INSERT;
         if (state->lsp.enabled) lsp_did_change(state);
     }
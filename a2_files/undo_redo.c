@@ -31,6 +31,7 @@ void restore_from_snapshot(EditorState *state, EditorSnapshot *snapshot) {
     for (int i = 0; i < state->buffer.num_lines; i++) free(state->buffer.lines[i]);
     state->buffer.num_lines = snapshot->num_lines;
     for (int i = 0; i < state->buffer.num_lines; i++) state->buffer.lines[i] = snapshot->lines[i];
+    editor_note_buffer_replaced(state);
     state->cursor.line = snapshot->current_line;
     state->cursor.col = snapshot->current_col;
     state->cursor.ideal_col = snapshot->ideal_col;
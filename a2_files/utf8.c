@@ -0,0 +1,156 @@
+#define _XOPEN_SOURCE 700 // wcwidth
+#include "utf8.h"
+#include <ctype.h>
+#include <string.h>
+#include <wchar.h>
+#include <wctype.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+int utf8_decode(const char *s, uint32_t *cp) {
+    const unsigned char *p = (const unsigned char *)s;
+    unsigned char c = p[0];
+    if (c < 0x80) { *cp = c; return 1; }
+
+    int len;
+    uint32_t min, value;
+    if ((c & 0xE0) == 0xC0) { len = 2; min = 0x80; value = c & 0x1F; }
+    else if ((c & 0xF0) == 0xE0) { len = 3; min = 0x800; value = c & 0x0F; }
+    else if ((c & 0xF8) == 0xF0) { len = 4; min = 0x10000; value = c & 0x07; }
+    else { *cp = UTF8_INVALID; return 1; }
+
+    for (int i = 1; i < len; i++) {
+        // Also stops at the terminating NUL of a truncated sequence
+        if ((p[i] & 0xC0) != 0x80) { *cp = UTF8_INVALID; return 1; }
+        value = (value << 6) | (p[i] & 0x3F);
+    }
+    // Overlong forms, surrogates and values past Unicode are invalid
+    if (value < min || value > 0x10FFFF || (value >= 0xD800 && value <= 0xDFFF)) {
+        *cp = UTF8_INVALID;
+        return 1;
+    }
+    *cp = value;
+    return len;
+}
+
+// wcwidth() results for the first two planes, filled on first use (stored as width + 2, 0 = unknown)
+#define WIDTH_MEMO_SIZE 0x20000
+static unsigned char width_memo[WIDTH_MEMO_SIZE];
+
+int utf8_char_width(uint32_t cp) {
+    if (cp < 0x7F) return cp >= 0x20 ? 1 : (cp == 0 ? 0 : -1);
+    if (cp < 0xA0) return -1;
+    if (cp < 0x300) return 1;
+    // The common CJK and Hangul blocks
+    if ((cp >= 0x4E00 && cp <= 0x9FFF) || (cp >= 0xAC00 && cp <= 0xD7A3) || (cp >= 0x3041 && cp <= 0x30FF)) return 2;
+    if (cp < WIDTH_MEMO_SIZE) {
+        int w = width_memo[cp];
+        if (w == 0) {
+            w = wcwidth((wchar_t)cp) + 2;
+            width_memo[cp] = (unsigned char)w;
+        }
+        return w - 2;
+    }
+    return wcwidth((wchar_t)cp);
+}
+
+size_t utf8_ascii_run(const char *s, size_t n) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        // High bit set, tab or NUL ends the run
+        __m128i stop = _mm_or_si128(_mm_cmpeq_epi8(v, tab), _mm_cmpeq_epi8(v, zero));
+        int mask = _mm_movemask_epi8(_mm_or_si128(v, stop));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t tab = vdupq_n_u8('\t');
+    const uint8x16_t high = vdupq_n_u8(0x80);
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)(s + i));
+        uint8x16_t stop = vorrq_u8(vorrq_u8(vcgeq_u8(v, high), vceqq_u8(v, tab)), vceqzq_u8(v));
+        if (vmaxvq_u8(stop)) break; // the scalar loop finds the exact byte
+    }
+#else
+    // Eight bytes at a time: a byte is flagged if its high bit is set or it equals tab or NUL
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, s + i, 8);
+        uint64_t t = w ^ 0x0909090909090909ULL;
+        uint64_t has_tab = (t - 0x0101010101010101ULL) & ~t;
+        uint64_t has_nul = (w - 0x0101010101010101ULL) & ~w;
+        if ((w | has_tab | has_nul) & 0x8080808080808080ULL) break;
+    }
+#endif
+    while (i < n) {
+        unsigned char c = (unsigned char)s[i];
+        if (c >= 0x80 || c == '\t' || c == 0) break;
+        i++;
+    }
+    return i;
+}
+
+int utf8_column_step(const char *s, int i, int *col, int tab_size) {
+    if (s[i] == '\t') {
+        *col += tab_size - (*col % tab_size);
+        return 1;
+    }
+    uint32_t cp;
+    int bytes = utf8_decode(&s[i], &cp);
+    int width = utf8_char_width(cp);
+    *col += width > 0 ? width : 1;
+    return bytes;
+}
+
+int utf8_columns_advance(const char *s, int from, int col, int to, int tab_size) {
+    if (!s || to <= from) return col;
+    int end = from + (int)strnlen(s + from, to - from);
+    int i = from;
+    while (i < end) {
+        // Plain ASCII is one column per byte
+        size_t run = utf8_ascii_run(s + i, end - i);
+        i += run;
+        col += run;
+        if (i < end) i += utf8_column_step(s, i, &col, tab_size);
+    }
+    return col;
+}
+
+int utf8_wrap_break(const char *s, int len, int width) {
+    int bytes = 0, cols = 0, last_space = -1;
+    while (bytes < len) {
+        int room = width - cols;
+        size_t run = utf8_ascii_run(s + bytes, (size_t)(room < len - bytes ? (room > 0 ? room : 0) : len - bytes));
+        if (run > 0) {
+            for (int k = bytes + (int)run; k > bytes; k--) {
+                if (isspace((unsigned char)s[k - 1])) { last_space = k; break; }
+            }
+            bytes += run;
+            cols += run;
+            continue;
+        }
+        uint32_t cp;
+        int n = utf8_decode(s + bytes, &cp);
+        int w = utf8_char_width(cp);
+        if (w < 0) w = 1;
+        if (cols + w > width) break;
+        cols += w;
+        if (cp < 0x80 ? isspace((int)cp) : iswspace((wint_t)cp)) last_space = bytes + n;
+        bytes += n;
+    }
+
+    int break_pos = (bytes < len && last_space != -1) ? last_space : bytes;
+    if (break_pos == 0 && len > 0) {
+        // Not even one character fits: take it anyway so the caller moves on
+        uint32_t cp;
+        break_pos = utf8_decode(s, &cp);
+    }
+    return break_pos;
+}
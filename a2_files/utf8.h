@@ -0,0 +1,36 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// UTF-8 decoding and display width, used by all the column math.
+// Independent of the libc locale tables except for rare code points, whose
+// wcwidth() result is memoized, so the editor and ncurses agree on widths.
+
+#define UTF8_INVALID 0xFFFD
+
+// Decodes the character at s into *cp and returns its length (1-4).
+// Invalid or truncated sequences decode as one byte of UTF8_INVALID.
+int utf8_decode(const char *s, uint32_t *cp);
+
+// Display width of a code point, like wcwidth(): -1 for control characters, 0 for combining marks
+int utf8_char_width(uint32_t cp);
+
+// Length of the run at the start of s[0, n) of ASCII bytes other than tab and NUL,
+// i.e. characters that take exactly one column. Vectorized where available.
+size_t utf8_ascii_run(const char *s, size_t n);
+
+// Advances over the character at s[i], adding its width to *col; returns its length.
+// Tabs go to the next multiple of tab_size, other characters take at least one column.
+int utf8_column_step(const char *s, int i, int *col, int tab_size);
+
+// Visual column reached after measuring s[from, to) starting at column col (stops at NUL)
+int utf8_columns_advance(const char *s, int from, int col, int to, int tab_size);
+
+// Bytes to put on one wrapped row of width columns: the row ends after the
+// last whitespace that fits (unless the whole rest of s fits), and always
+// holds at least one character. len is strlen(s).
+int utf8_wrap_break(const char *s, int len, int width);
+
+#endif // UTF8_H
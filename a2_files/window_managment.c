@@ -14,6 +14,12 @@
 #include "themes.h"
 #include "a2_files/settings.h" // Added include
 #include "logger.h"
+#include "frame_scheduler.h"
+#include "search_local.h"
+#include "spell_worker.h"
+#include "syntax_cache.h"
+#include "term_output.h"
+#include "scroll_region.h"
 
 
 #include <unistd.h>
@@ -105,6 +111,7 @@ void create_generic_terminal_window(char *const argv[]) {
 
     vterm_resize(jw->term.vterm, cols - 2 * border_offset, rows - 2 * border_offset);
     atualizar_tamanho_pty(jw);
+    jw->term.dirty = true;
     redraw_all_windows();
 }
 
@@ -133,6 +140,7 @@ void free_editor_state(EditorState* state) {
         save_last_line(state->buffer.filename, state->cursor.line);
     }
     if (state->input.completion_mode != COMPLETION_NONE) editor_end_completion(state);
+    editor_clear_completion_cache(&state->input.completion_cache);
     for(int j=0; j < state->input.history_count; j++) free(state->input.command_history[j]);
     for (int j = 0; j < state->buffer.undo_count; j++) free_snapshot(state->buffer.undo_stack[j]);
     for (int j = 0; j < state->buffer.redo_count; j++) free_snapshot(state->buffer.redo_stack[j]);
@@ -158,19 +166,24 @@ void free_editor_state(EditorState* state) {
         }
         free(state->recent_files);
     }
-    if (state->buffer.unmatched_brackets) free(state->buffer.unmatched_brackets);
+    bracket_index_free(&state->buffer.bracket_index);
+    syntax_cache_free(state);
+    line_columns_free(&state->buffer.columns);
+    free(state->view.gutter.rows);
     if (state->cursor.yank_register) free(state->cursor.yank_register);
     if (state->cursor.move_register) free(state->cursor.move_register);
 
     if (state->search.is_regex) {
         regfree(&state->search.compiled_regex);
     }
+    search_highlight_free(state);
 
     if (state->buffer.dirty_lines) {
         free(state->buffer.dirty_lines);
     }
 
     spell_checker_destroy(&state->spell.checker);
+    spell_worker_free_state(state);
 
     for (int j = 0; j < state->buffer.num_lines; j++) {
         if (state->buffer.lines[j]) free(state->buffer.lines[j]);
@@ -516,6 +529,7 @@ void toggle_floating_terminal() {
         vterm_set_userptr(ws->floating_term->term.vterm, ws->floating_term);
 
         ws->floating_terminal_visible = true;
+        ws->floating_term->term.dirty = true;
         atualizar_tamanho_pty(ws->floating_term);
     } else {
         ws->floating_terminal_visible = !ws->floating_terminal_visible;
@@ -614,7 +628,7 @@ void recalculate_window_layout() {
         // 2. creation of the main window (container)
         jw->win = newwin(jw->height, jw->width, jw->y, jw->x);
         keypad(jw->win, TRUE);
-        scrollok(jw->win, FALSE);
+        scroll_window_setup(jw->win);
         
         // 3. creation of the sub-window of the content (safe area)
         int border_offset = ws->num_windows > 1 ? 1 : 0;
@@ -630,7 +644,7 @@ void recalculate_window_layout() {
         // configure the sub-window too 
         if (jw->content_win != jw->win) {
             keypad(jw->content_win, TRUE);
-            scrollok(jw->content_win, FALSE);
+            scroll_window_setup(jw->content_win);
             touchwin(jw->win); // makes the border to be draw
         }
         
@@ -654,6 +668,7 @@ void recalculate_window_layout() {
             vterm_wnd_set(jw->term.vterm, jw->content_win);
             vterm_resize(jw->term.vterm, content_w > 0 ? content_w : 1, content_h > 0 ? content_h : 1);
             atualizar_tamanho_pty(jw);
+            jw->term.dirty = true;
         }
     }
 
@@ -681,6 +696,7 @@ void recalculate_window_layout() {
             vterm_wnd_set(ws->floating_term->term.vterm, ws->floating_term->content_win);
             vterm_resize(ws->floating_term->term.vterm, ws->floating_term->width - 2, ws->floating_term->height - 2);
             atualizar_tamanho_pty(ws->floating_term);
+            ws->floating_term->term.dirty = true;
         }
     }
 }        
@@ -851,45 +867,20 @@ void redraw_all_windows() {
     if (workspace_manager.num_workspaces == 0) return;
 
     Workspace *ws = ACTIVE_WS;    
-    bool any_dirty = false;
-
-    // First, check if anything at all needs to be redrawn.
-    for (int i = 0; i < ws->num_windows; i++) {
-        EditorWindow *jw = ws->windows[i];
-        if (!jw) continue;
-
-        switch (jw->type) {
-            case WINDOW_TYPE_EDITOR:
-                if (jw->state && jw->state->buffer.is_dirty) any_dirty = true;
-                break;
-            case WINDOW_TYPE_EXPLORER:
-                if (jw->explorer_state && jw->explorer_state->is_dirty) any_dirty = true;
-                break;
-            case WINDOW_TYPE_HELP:
-                if (jw->help_state && jw->help_state->is_dirty) any_dirty = true;
-                break;
-            case WINDOW_TYPE_SETTINGS_PANEL:
-                if (jw->settings_state && jw->settings_state->is_dirty) any_dirty = true;
-                break;
-            case WINDOW_TYPE_TERMINAL:
-                any_dirty = true; // Terminals are always considered dirty
-                break;
-        }
-        if (any_dirty) break;
-    }
-    
-    if (ws->floating_terminal_visible) any_dirty = true;
+    frame_check_layout(ws);
 
-    // If no windows are dirty, we can often just reposition the cursor and do a minimal update.
-    if (!any_dirty) {
+    // If no windows are damaged, we can just reposition the cursor and do a minimal update.
+    if (!frame_has_damage()) {
         position_active_cursor();
         doupdate();
+        term_output_flush();
+        frame_rendered();
         return;
     }
 
-    // Since at least one window is dirty, we perform a more thorough redraw.
-    // erase(); // We avoid a full erase() to reduce flicker. Individual redraw functions will clear their areas.
-    touchwin(stdscr); // Mark the whole screen as needing a check.
+    // Only damaged windows are re-rendered. The others are just touched so their
+    // existing contents are copied back over stdscr and any popup left behind.
+    touchwin(stdscr);
     wnoutrefresh(stdscr);
 
     // 1. Draw all main windows first
@@ -898,20 +889,27 @@ void redraw_all_windows() {
         if (jw) {
             // Prepare the window content to be drawn
             if (jw->type == WINDOW_TYPE_EDITOR && jw->state) {
-                editor_redraw(jw->win, jw->state);
-                jw->state->buffer.is_dirty = false; // Reset the flag after drawing
-                
+                if (jw->state->buffer.is_dirty) {
+                    editor_redraw(jw->win, jw->state);
+                    jw->state->buffer.is_dirty = false; // Reset the flag after drawing
+                } else if (jw->state->view.status_dirty) {
+                    editor_draw_status_bar(jw->win, jw->state);
+                }
+                jw->state->view.status_dirty = false;
             } else if (jw->type == WINDOW_TYPE_EXPLORER && jw->explorer_state) {
-                explorer_redraw(jw); 
+                if (jw->explorer_state->is_dirty) explorer_redraw(jw);
             } else if (jw->type == WINDOW_TYPE_HELP && jw->help_state) {
-                help_viewer_redraw(jw);
+                if (jw->help_state->is_dirty) help_viewer_redraw(jw);
                 jw->help_state->is_dirty = false;
             } else if (jw->type == WINDOW_TYPE_SETTINGS_PANEL && jw->settings_state) {
-                settings_panel_redraw(jw);
+                if (jw->settings_state->is_dirty) settings_panel_redraw(jw);
                 jw->settings_state->is_dirty = false;
             } else if (jw->type == WINDOW_TYPE_TERMINAL && jw->term.vterm) {
-                // Terminal drawing is special, it's always "dirty" from our perspective
-                vterm_wnd_update(jw->term.vterm, -1, 0, VTERM_WND_RENDER_ALL);
+                // Terminals only re-render when the pty produced output or the layout changed
+                if (jw->term.dirty) {
+                    vterm_wnd_update(jw->term.vterm, -1, 0, VTERM_WND_RENDER_ALL);
+                    jw->term.dirty = false;
+                }
                 
                 if (ws->num_windows > 1) {
                     if (i == ws->active_window_idx) {
@@ -926,6 +924,7 @@ void redraw_all_windows() {
                }
             }
             // Add the window to the redraw "queue"
+            touchwin(jw->win);
             wnoutrefresh(jw->win);
             if (jw->content_win != jw->win) wnoutrefresh(jw->content_win);
         }
@@ -982,17 +981,22 @@ void redraw_all_windows() {
         mvwprintw(ws->floating_term->win, 0, 2, " FLOATING TERMINAL ");
         wattroff(ws->floating_term->win, COLOR_PAIR(PAIR_BORDER_ACTIVE) | A_BOLD);
         
-        vterm_wnd_update(ws->floating_term->term.vterm, -1, 0, VTERM_WND_RENDER_ALL);
+        if (ws->floating_term->term.dirty) {
+            vterm_wnd_update(ws->floating_term->term.vterm, -1, 0, VTERM_WND_RENDER_ALL);
+            ws->floating_term->term.dirty = false;
+        }
+        touchwin(ws->floating_term->win);
         wnoutrefresh(ws->floating_term->win);
         wnoutrefresh(ws->floating_term->content_win);
     }
 
     // 3. Position the cursor and update the physical screen
     position_active_cursor();
+    frame_output_begin();
     doupdate();
     
     // 4. Draw Kitty Graphics overlays on top of the ncurses screen
-    printf("\0337"); // Save cursor position
+    term_output_printf("\0337"); // Save cursor position
     static Workspace *last_drawn_ws = NULL;
     if (last_drawn_ws != ws) {
         // Check if last_drawn_ws is still a valid workspace
@@ -1065,8 +1069,9 @@ void redraw_all_windows() {
             }
         }
     }
-    printf("\0338"); // Restore cursor position
-    fflush(stdout);
+    term_output_printf("\0338"); // Restore cursor position
+    frame_output_end(); // one write for the images and the end of the synchronized update
+    frame_rendered();
 }
 
 void position_active_cursor() {
@@ -1114,24 +1119,19 @@ void position_active_cursor() {
                 (void)cols;
                 wmove(win, rows - 1, state->input.command_pos + 2);
             } else {
-                int line_number_width = 0;
-                if (state->view.show_line_numbers) {
-                    int max_lines = state->buffer.num_lines > 0 ? state->buffer.num_lines : 1;
-                    line_number_width = snprintf(NULL, 0, "%d", max_lines) + 1;
-                    if (line_number_width < 4) line_number_width = 4;
-                }
+                int gutter_width = editor_gutter_width(state);
                 
                 int visual_y, visual_x;
                 get_visual_pos(win, state, &visual_y, &visual_x);
                 int border_offset = ws->num_windows > 1 ? 1 : 0;
                 int screen_y = visual_y - state->view.top_line + border_offset;
-                int screen_x = visual_x - state->view.left_col + border_offset + line_number_width;
+                int screen_x = visual_x - state->view.left_col + border_offset + gutter_width;
                 int max_y, max_x;
                 getmaxyx(win, max_y, max_x);
                 if (screen_y >= max_y) screen_y = max_y - 1;
                 if (screen_x >= max_x) screen_x = max_x - 1;
                 if (screen_y < border_offset) screen_y = border_offset;
-                if (screen_x < border_offset + line_number_width) screen_x = border_offset + line_number_width;
+                if (screen_x < border_offset + gutter_width) screen_x = border_offset + gutter_width;
                 wmove(win, screen_y, screen_x);
             }
         }
@@ -0,0 +1,155 @@
+// LSP decode benchmark: parse latency of a large completion response.
+//
+//   make bench
+//   ./bench/lsp_decode_bench [megabytes]
+//
+// Builds a completion response of about 5 MB (clangd-style items with
+// documentation and text edits) and times three ways of reading it:
+//   tree      json_loads and a walk over every item (the old path)
+//   pull all  json_pull over every item, reading label/detail/insertText
+//   pull 200  what the editor does: the envelope scan that routes the message,
+//             then the first LSP_MAX_COMPLETION_ITEMS items and stop
+// Exits with status 1 if the editor's path is not faster than the tree.
+
+#include "json_pull.h"
+#include <jansson.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FIRST_ITEMS 200 // LSP_MAX_COMPLETION_ITEMS in lsp_client.c
+#define RUNS 7
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static char *build_response(size_t target, int *num_items) {
+    size_t cap = target + 4096, len = 0;
+    char *json = malloc(cap);
+    len += sprintf(json, "{\"jsonrpc\":\"2.0\",\"id\":42,\"result\":{\"isIncomplete\":false,\"items\":[");
+    int n = 0;
+    while (len + 1024 < target) {
+        len += sprintf(json + len,
+            "%s{\"label\":\" symbol_%d(int value, const char *name)\",\"kind\":3,"
+            "\"detail\":\"int\",\"documentation\":{\"kind\":\"plaintext\",\"value\":"
+            "\"From \\\"module_%d.h\\\"\\nReturns the value for \\\\name, or -1.\\tSee also symbol_%d.\"},"
+            "\"sortText\":\"%08x\",\"filterText\":\"symbol_%d\",\"insertText\":\"symbol_%d\","
+            "\"insertTextFormat\":1,\"textEdit\":{\"range\":{\"start\":{\"line\":120,\"character\":4},"
+            "\"end\":{\"line\":120,\"character\":7}},\"newText\":\"symbol_%d\"},\"score\":%d.5}",
+            n ? "," : "", n, n % 97, n + 1, n, n, n, n, n % 1000);
+        n++;
+    }
+    len += sprintf(json + len, "]}}");
+    *num_items = n;
+    return json;
+}
+
+// Sum of label lengths, so the work can't be optimized away
+static size_t decode_tree(const char *json) {
+    json_error_t error;
+    json_t *root = json_loads(json, 0, &error);
+    json_t *items = json_object_get(json_object_get(root, "result"), "items");
+    size_t total = 0;
+    for (size_t i = 0; i < json_array_size(items); i++) {
+        json_t *item = json_array_get(items, i);
+        const char *label = json_string_value(json_object_get(item, "label"));
+        const char *detail = json_string_value(json_object_get(item, "detail"));
+        const char *insert = json_string_value(json_object_get(item, "insertText"));
+        if (label) total += strlen(label);
+        if (detail) total += strlen(detail);
+        if (insert) total += strlen(insert);
+    }
+    json_decref(root);
+    return total;
+}
+
+// The envelope scan lsp_handle_message does before dispatching
+static void scan_envelope(const char *json, size_t len) {
+    JsonPull jp;
+    json_pull_init(&jp, json, len);
+    if (!json_pull_enter_object(&jp)) return;
+    char key[32];
+    while (json_pull_next_key(&jp, key, sizeof(key))) json_pull_skip(&jp);
+}
+
+static size_t decode_pull(const char *json, size_t len, int max_items) {
+    JsonPull jp;
+    json_pull_init(&jp, json, len);
+    size_t total = 0;
+    if (!json_pull_enter_object(&jp) || !json_pull_find_key(&jp, "result")) return 0;
+    if (json_pull_enter_object(&jp) && !json_pull_find_key(&jp, "items")) return 0;
+    if (!json_pull_enter_array(&jp)) return 0;
+    for (int n = 0; n < max_items && json_pull_next_item(&jp); n++) {
+        if (!json_pull_enter_object(&jp)) return total;
+        char key[32];
+        while (json_pull_next_key(&jp, key, sizeof(key))) {
+            if (strcmp(key, "label") == 0 || strcmp(key, "detail") == 0 || strcmp(key, "insertText") == 0) {
+                char *value = json_pull_string(&jp);
+                if (value) total += strlen(value);
+                free(value);
+            } else {
+                json_pull_skip(&jp);
+            }
+        }
+    }
+    return total;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+typedef enum { TREE, PULL_ALL, PULL_FIRST } Mode;
+
+// Median of RUNS timings
+static double time_mode(Mode mode, const char *json, size_t len, size_t *check) {
+    double runs[RUNS];
+    for (int r = 0; r < RUNS; r++) {
+        double start = now_ms();
+        if (mode == TREE) {
+            *check = decode_tree(json);
+        } else if (mode == PULL_ALL) {
+            *check = decode_pull(json, len, 1 << 30);
+        } else {
+            scan_envelope(json, len);
+            *check = decode_pull(json, len, FIRST_ITEMS);
+        }
+        runs[r] = now_ms() - start;
+    }
+    qsort(runs, RUNS, sizeof(double), cmp_double);
+    return runs[RUNS / 2];
+}
+
+int main(int argc, char **argv) {
+    double megabytes = argc > 1 ? atof(argv[1]) : 5.0;
+    int num_items;
+    char *json = build_response((size_t)(megabytes * 1024 * 1024), &num_items);
+    size_t len = strlen(json);
+
+    size_t tree_sum, all_sum, first_sum;
+    double tree = time_mode(TREE, json, len, &tree_sum);
+    double all = time_mode(PULL_ALL, json, len, &all_sum);
+    double first = time_mode(PULL_FIRST, json, len, &first_sum);
+
+    printf("completion response: %.1f MB, %d items\n", len / (1024.0 * 1024.0), num_items);
+    printf("  tree (json_loads)    %8.2f ms\n", tree);
+    printf("  pull, all items      %8.2f ms\n", all);
+    printf("  pull, first %-4d     %8.2f ms (envelope scan included)\n", FIRST_ITEMS, first);
+
+    int failed = 0;
+    if (tree_sum != all_sum) {
+        printf("FAIL: pull decoder disagrees with jansson (%zu vs %zu)\n", all_sum, tree_sum);
+        failed = 1;
+    }
+    if (first >= tree) {
+        printf("FAIL: selective decode is not faster than building the tree\n");
+        failed = 1;
+    }
+    free(json);
+    return failed;
+}
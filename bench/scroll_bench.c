@@ -0,0 +1,152 @@
+// Scroll output test: rows rendered and bytes sent to the terminal for a scroll.
+//
+//   make bench
+//   ./bench/scroll_bench [terminal] [rows] [cols]
+//
+// Without a terminal it runs for xterm-256color and ansi.
+//
+// Fills a screen with code-like text, then scrolls it by a few lines down and
+// up the way editor_redraw does, in a window set up like the editor's
+// (scroll_window_setup()) and with its own scroll_plan() and scroll_text_rows()
+// (scroll_region.c): rows that stay on screen are shifted and only the rows
+// the plan reports as exposed are rendered. For comparison the same scroll is
+// also done the old way, in a plain window erased and repainted in full. The
+// terminal output goes to a temporary file and its size is counted.
+// Exits with status 1 if a scroll that keeps rows on screen renders more rows
+// than it exposes or sends more bytes than the old repaint, or if a one-line
+// scroll sends a quarter of the first full paint or more. On ansi that last check
+// fails when the editor's windows are not idlok().
+
+#include "scroll_region.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int rows, cols;
+static int rendered; // text rows drawn since the last reset
+
+static void draw_row(WINDOW *win, int y, int line_idx) {
+    static const char *snippets[] = {
+        "if (state->buffer.num_lines > 0) {", "return editor_redraw(win, state);", "int col = 0;",
+        "// walk the lines below the viewport", "for (int i = 0; i < count; i++) total += values[i];",
+        "}", "", "char *line = state->buffer.lines[line_idx];",
+    };
+    wmove(win, y, 0);
+    wclrtoeol(win);
+    wattron(win, A_DIM);
+    mvwprintw(win, y, 0, "%4d ", line_idx + 1);
+    wattroff(win, A_DIM);
+    // Mixed so that no shift of the screen lines it up with itself
+    waddnstr(win, snippets[((unsigned int)line_idx * 2654435761u >> 16) % 8], cols - 6);
+    rendered++;
+}
+
+static void draw_status(WINDOW *win, int top) {
+    wattron(win, A_REVERSE);
+    mvwprintw(win, rows - 1, 0, " scroll_bench  top %-6d", top);
+    for (int x = getcurx(win); x < cols; x++) waddch(win, ' ');
+    wattroff(win, A_REVERSE);
+}
+
+// Erase the window and render every row again
+static void scroll_repaint(WINDOW *win, int top) {
+    werase(win);
+    for (int y = 0; y < rows - 1; y++) draw_row(win, y, top + y);
+    draw_status(win, top);
+}
+
+// What editor_redraw does for a vertical scroll of the text rows
+static void scroll_editor(WINDOW *win, int top, int delta) {
+    int content = rows - 1;
+    ScrollPlan plan = scroll_plan(delta, content, true);
+    if (plan.shift) {
+        scroll_text_rows(win, 0, content, delta);
+        for (int y = 0; y < content; y++) {
+            if (scroll_row_exposed(&plan, y)) draw_row(win, y, top + y);
+        }
+        draw_status(win, top);
+    } else {
+        scroll_repaint(win, top);
+    }
+}
+
+static long flush_bytes(FILE *out) {
+    doupdate();
+    fflush(out);
+    return ftell(out);
+}
+
+// Bytes written for one scroll by delta from a fully painted screen at top 100;
+// *rows_drawn gets the text rows rendered for the scroll, *full_paint the bytes
+// of the first paint
+static long measure(const char *term, bool editor, int delta, int *rows_drawn, long *full_paint) {
+    FILE *out = tmpfile();
+    FILE *in = fopen("/dev/null", "r");
+    SCREEN *screen = newterm(term, out, in);
+    if (!screen) { fprintf(stderr, "unknown terminal %s\n", term); exit(2); }
+    resizeterm(rows, cols);
+
+    // The old setup is a plain window, without idlok()
+    WINDOW *win = newwin(rows, cols, 0, 0);
+    if (editor) scroll_window_setup(win);
+    int top = 100;
+    scroll_repaint(win, top);
+    wnoutrefresh(win);
+    long before = flush_bytes(out);
+    *full_paint = before;
+
+    top += delta;
+    rendered = 0;
+    if (editor) scroll_editor(win, top, delta);
+    else scroll_repaint(win, top);
+    wnoutrefresh(win);
+    long bytes = flush_bytes(out) - before;
+    *rows_drawn = rendered;
+
+    delwin(win);
+    endwin();
+    delscreen(screen);
+    fclose(in);
+    fclose(out);
+    return bytes;
+}
+
+// Scrolls by a few deltas on one terminal; false if any of them failed
+static bool bench_term(const char *term) {
+    int content = rows - 1;
+    int deltas[] = { 1, -1, 3, -3, content / 2, -(content / 2) };
+    bool passed = true;
+    for (size_t i = 0; i < sizeof(deltas) / sizeof(deltas[0]); i++) {
+        int delta = deltas[i];
+        if (delta == 0) continue;
+        int repaint_rows, editor_rows;
+        long full_paint;
+        long repaint = measure(term, false, delta, &repaint_rows, &full_paint);
+        long shifted = measure(term, true, delta, &editor_rows, &full_paint);
+        int exposed = abs(delta);
+        bool ok = editor_rows == exposed && shifted <= repaint;
+        // A line scrolled in costs about one row, not a screen
+        if (exposed == 1) ok = ok && shifted * 4 < full_paint;
+        printf("%s %dx%d scroll %+4d  full paint %6ld B  repaint %3d rows %6ld B   editor %3d rows %6ld B  %s\n",
+               term, cols, rows, delta, full_paint, repaint_rows, repaint, editor_rows, shifted, ok ? "ok" : "FAIL");
+        if (!ok) passed = false;
+    }
+    return passed;
+}
+
+int main(int argc, char **argv) {
+    rows = argc > 2 ? atoi(argv[2]) : 50;
+    cols = argc > 3 ? atoi(argv[3]) : 120;
+
+    // xterm has a scroll region, which ncurses uses for any window; ansi only
+    // has insert/delete line, which ncurses uses only for idlok() windows
+    bool passed;
+    if (argc > 1) {
+        passed = bench_term(argv[1]);
+    } else {
+        passed = bench_term("xterm-256color");
+        passed = bench_term("ansi") && passed;
+    }
+    if (!passed) printf("FAIL: a scroll re-renders or resends rows that were only shifted\n");
+    return passed ? 0 : 1;
+}
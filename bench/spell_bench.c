@@ -0,0 +1,136 @@
+// Spell check benchmark: plain Hunspell_spell vs the compiled word set.
+//
+//   make bench
+//   ./bench/spell_bench /usr/share/hunspell/en_US.aff /usr/share/hunspell/en_US.dic [words.txt] [rounds]
+//
+// Without a word list, the stems of the .dic plus a few inflected and
+// misspelled variants of each are used. Every mode runs in its own process so
+// the reported RSS growth belongs to that mode alone.
+
+#include "spell_compiled.h"
+#if __has_include(<hunspell/hunspell.h>)
+#include <hunspell/hunspell.h>
+#else
+#include <hunspell.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+typedef struct {
+    char **words;
+    int count, cap;
+} WordList;
+
+static void add_word(WordList *list, const char *word, size_t len) {
+    if (len == 0 || len > 100) return;
+    if (list->count == list->cap) {
+        list->cap = list->cap ? list->cap * 2 : 4096;
+        list->words = realloc(list->words, sizeof(char *) * list->cap);
+    }
+    list->words[list->count++] = strndup(word, len);
+}
+
+static void load_words(WordList *list, const char *path, bool from_dic) {
+    FILE *f = fopen(path, "r");
+    if (!f) { perror(path); exit(1); }
+    char line[1024];
+    bool first = true;
+    while (fgets(line, sizeof(line), f)) {
+        if (from_dic && first) { first = false; continue; }
+        size_t len = strcspn(line, from_dic ? "/ \t\r\n" : "\r\n");
+        add_word(list, line, len);
+        if (!from_dic || len < 3) continue;
+        // Typical editor text also has inflections and typos
+        char variant[128];
+        snprintf(variant, sizeof(variant), "%.*ss", (int)len, line);
+        add_word(list, variant, strlen(variant));
+        snprintf(variant, sizeof(variant), "%.*s", (int)len, line);
+        char t = variant[1]; variant[1] = variant[2]; variant[2] = t;
+        add_word(list, variant, len);
+    }
+    fclose(f);
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long rss_kb(void) {
+    long pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    if (fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+    fclose(f);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void run_mode(const char *mode, const char *aff, const char *dic, const char *cache, const WordList *list, int rounds) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid != 0) { waitpid(pid, NULL, 0); return; }
+
+    long rss_before = rss_kb();
+    double t0 = now_sec();
+    Hunhandle *h = NULL;
+    SpellCompiled *sc = NULL;
+    if (strcmp(mode, "compiled") != 0) h = Hunspell_create(aff, dic);
+    if (strcmp(mode, "hunspell") != 0) sc = spell_compiled_open(aff, dic, NULL, cache);
+    double load = now_sec() - t0;
+
+    long valid = 0, fallbacks = 0;
+    t0 = now_sec();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < list->count; i++) {
+            const char *w = list->words[i];
+            if (sc && spell_compiled_contains(sc, w, strlen(w))) { valid++; continue; }
+            if (h) { fallbacks++; valid += Hunspell_spell(h, w) != 0; }
+        }
+    }
+    double elapsed = now_sec() - t0;
+    long checks = (long)list->count * rounds;
+
+    printf("%-9s load %7.1f ms  rss +%7ld KB  %10.0f words/s  valid %5.1f%%  hunspell calls %5.1f%%\n",
+           mode, load * 1000, rss_kb() - rss_before, checks / elapsed,
+           100.0 * valid / checks, 100.0 * fallbacks / checks);
+    fflush(stdout);
+    _exit(0);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <file.aff> <file.dic> [words.txt] [rounds]\n", argv[0]);
+        return 1;
+    }
+    const char *aff = argv[1], *dic = argv[2];
+    int rounds = argc > 4 ? atoi(argv[4]) : 3;
+    if (rounds < 1) rounds = 1;
+
+    WordList list = {0};
+    load_words(&list, argc > 3 ? argv[3] : dic, argc <= 3);
+
+    char cache[] = "/tmp/a2_spell_bench_XXXXXX";
+    int fd = mkstemp(cache);
+    if (fd < 0) { perror("mkstemp"); return 1; }
+    close(fd);
+    unlink(cache);
+
+    double t0 = now_sec();
+    SpellCompiled *sc = spell_compiled_open(aff, dic, NULL, cache);
+    if (!sc) { fprintf(stderr, "could not compile %s\n", dic); return 1; }
+    printf("compiled %zu stems in %.1f ms; %d words x %d rounds\n",
+           spell_compiled_count(sc), (now_sec() - t0) * 1000, list.count, rounds);
+    spell_compiled_close(sc);
+
+    run_mode("hunspell", aff, dic, cache, &list, rounds);
+    run_mode("compiled", aff, dic, cache, &list, rounds);
+    run_mode("both", aff, dic, cache, &list, rounds);
+
+    unlink(cache);
+    return 0;
+}
@@ -0,0 +1,138 @@
+// Width kernel benchmark: mbtowc/wcwidth loops vs the utf8.c kernel.
+//
+//   make bench
+//   ./bench/utf8_bench [megabytes]
+//
+// Measures the visual width of a long line and lays it out in wrapped rows,
+// for ASCII, CJK, emoji-heavy and mixed text, and checks that both
+// implementations agree.
+
+#define _XOPEN_SOURCE 700
+#include "utf8.h"
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wchar.h>
+#include <wctype.h>
+
+#define TAB 4
+#define WRAP_WIDTH 80
+
+// The measuring loop the editor used before utf8.c
+static int libc_columns(const char *line, int byte_col) {
+    int col = 0, i = 0;
+    while (i < byte_col) {
+        if (line[i] == '\t') { col += TAB - (col % TAB); i++; continue; }
+        wchar_t wc;
+        int bytes = mbtowc(&wc, &line[i], MB_CUR_MAX);
+        if (bytes <= 0) { col++; i++; continue; }
+        int w = wcwidth(wc);
+        col += w > 0 ? w : 1;
+        i += bytes;
+    }
+    return col;
+}
+
+static int libc_wrap_rows(const char *line, int len) {
+    int rows = 0, offset = 0;
+    while (offset < len) {
+        int bytes = 0, width = 0, last_space = -1;
+        while (line[offset + bytes]) {
+            wchar_t wc;
+            int n = mbtowc(&wc, &line[offset + bytes], MB_CUR_MAX);
+            if (n <= 0) { n = 1; wc = ' '; }
+            int w = wcwidth(wc);
+            if (w < 0) w = 1;
+            if (width + w > WRAP_WIDTH) break;
+            width += w;
+            if (iswspace(wc)) last_space = bytes + n;
+            bytes += n;
+        }
+        int brk = (line[offset + bytes] && last_space != -1) ? last_space : bytes;
+        if (brk == 0) brk = 1;
+        offset += brk;
+        rows++;
+    }
+    return rows;
+}
+
+static int kernel_wrap_rows(const char *line, int len) {
+    int rows = 0, offset = 0;
+    while (offset < len) {
+        offset += utf8_wrap_break(line + offset, len - offset, WRAP_WIDTH);
+        rows++;
+    }
+    return rows;
+}
+
+static char *make_text(const char *const *pieces, int count, size_t size) {
+    char *text = malloc(size + 16);
+    size_t n = 0;
+    srand(42);
+    while (n < size) {
+        const char *p = pieces[rand() % count];
+        size_t len = strlen(p);
+        if (n + len > size) break;
+        memcpy(text + n, p, len);
+        n += len;
+    }
+    text[n] = '\0';
+    return text;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const char *name, const char *text) {
+    int len = strlen(text);
+    double mb = len / 1e6;
+
+    double t0 = now_sec();
+    int libc_cols = libc_columns(text, len);
+    double t_libc = now_sec() - t0;
+
+    t0 = now_sec();
+    int kernel_cols = utf8_columns_advance(text, 0, 0, len, TAB);
+    double t_kernel = now_sec() - t0;
+
+    t0 = now_sec();
+    int libc_rows = libc_wrap_rows(text, len);
+    double t_libc_wrap = now_sec() - t0;
+
+    t0 = now_sec();
+    int kernel_rows = kernel_wrap_rows(text, len);
+    double t_kernel_wrap = now_sec() - t0;
+
+    printf("%-7s width: libc %7.1f MB/s  kernel %7.1f MB/s (x%.1f)%s   wrap: libc %7.1f MB/s  kernel %7.1f MB/s (x%.1f)%s\n",
+           name, mb / t_libc, mb / t_kernel, t_libc / t_kernel, libc_cols == kernel_cols ? "" : " MISMATCH",
+           mb / t_libc_wrap, mb / t_kernel_wrap, t_libc_wrap / t_kernel_wrap, libc_rows == kernel_rows ? "" : " MISMATCH");
+}
+
+int main(int argc, char **argv) {
+    if (!setlocale(LC_ALL, "C.UTF-8") && !setlocale(LC_ALL, "en_US.UTF-8")) {
+        fprintf(stderr, "no UTF-8 locale available\n");
+        return 1;
+    }
+    size_t size = (argc > 1 ? atof(argv[1]) : 8) * 1000 * 1000;
+
+    const char *ascii[] = { "int ", "return ", "value", " = ", "foo(bar, baz);", "\t", "// comment ", "x" };
+    const char *cjk[] = { "漢字", "かな", "カタカナ", "한국어", "、", "。", " " };
+    const char *emoji[] = { "😀", "🚀", "👍🏽", "🎉", " ", "✨", "ok " };
+    const char *mixed[] = { "name", "=", "\"héllo wörld\"", " ", "日本", "😀", "\t", "ascii text here " };
+
+    char *texts[] = {
+        make_text(ascii, 8, size), make_text(cjk, 7, size),
+        make_text(emoji, 7, size), make_text(mixed, 8, size),
+    };
+    run("ascii", texts[0]);
+    run("cjk", texts[1]);
+    run("emoji", texts[2]);
+    run("mixed", texts[3]);
+    for (int i = 0; i < 4; i++) free(texts[i]);
+    return 0;
+}